@@ -0,0 +1,271 @@
+/*  Benchmark application
+    Replays a pcap / pcapng capture through ribanENC28J60::Process and reports processing rate.
+    Host only. Build with -DNIC_CLASS=PcapNic -DNIC_HEADER=\"pcapnic.h\"
+    Add -DNIC_SPI_METER to report SPI transactions, bytes and estimated bus time per protocol handler.
+    Usage: benchmark [-o output.pcap] [-r repeats] [-i ip] [-n netmask] [-m mac] [-s spi_clock_hz] [-p idle_polls] [-I] capture.pcap
+    -p calls Process the given quantity of times between frames to measure idle cost. -I enables interrupt driven receive.
+*/
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "ribanENC28J60.h"
+
+static const byte BENCH_ARP         = 0;
+static const byte BENCH_ICMP        = 1;
+static const byte BENCH_UDP         = 2;
+static const byte BENCH_TCP         = 3;
+static const byte BENCH_IPV4        = 4;
+static const byte BENCH_UNHANDLED   = 5;
+static const byte BENCH_TYPES       = 6;
+
+static const char* g_sTypeName[BENCH_TYPES] = {"ARP", "IPv4/ICMP", "IPv4/UDP", "IPv4/TCP", "IPv4/other", "Unhandled"};
+
+/** Accumulated processing cost for one protocol handler category */
+struct BenchResult
+{
+    uint32_t nFrames; //!< Quantity of frames processed
+    uint64_t nTotal; //!< Total processing time in nanoseconds
+    uint64_t nMin; //!< Shortest processing time in nanoseconds
+    uint64_t nMax; //!< Longest processing time in nanoseconds
+    #ifdef NIC_SPI_METER
+    SpiCount countSpi; //!< Accumulated SPI activity
+    uint64_t nBusTime; //!< Accumulated estimated SPI bus time in nanoseconds
+    #endif // NIC_SPI_METER
+};
+
+ribanENC28J60 g_nic; //network interface
+
+/** @brief  Get monotonic time
+*   @return <i>uint64_t</i> Nanoseconds
+*/
+static uint64_t GetNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/** @brief  Get the protocol handler category of a frame
+*   @param  pFrame Pointer to Ethernet frame
+*   @param  nLen Quantity of bytes in frame
+*   @return <i>byte</i> Category BENCH_xxx
+*/
+static byte GetCategory(const byte* pFrame, uint16_t nLen)
+{
+    if(nLen < MAC_HEADER_SIZE)
+        return BENCH_UNHANDLED;
+    switch((pFrame[MAC_OFFSET_TYPE] << 8) | pFrame[MAC_OFFSET_TYPE + 1])
+    {
+        case ETHTYPE_ARP:
+            return BENCH_ARP;
+        case ETHTYPE_IPV4:
+            if(nLen < MAC_HEADER_SIZE + IPV4_HEADER_SIZE)
+                return BENCH_IPV4;
+            switch(pFrame[MAC_HEADER_SIZE + IPV4_OFFSET_PROTOCOL])
+            {
+                case IP_PROTOCOL_ICMP:
+                    return BENCH_ICMP;
+                case IP_PROTOCOL_UDP:
+                    return BENCH_UDP;
+                case IP_PROTOCOL_TCP:
+                    return BENCH_TCP;
+            }
+            return BENCH_IPV4;
+    }
+    return BENCH_UNHANDLED;
+}
+
+int main(int argc, char** argv)
+{
+    const char* sOutput = NULL;
+    unsigned int nRepeats = 1;
+    MacAddress addressMac{0x02,0x00,0x00,0x00,0x00,0x01};
+    Ipv4Address addressIp{192,168,0,88};
+    Ipv4Address addressMask{255,255,255,0};
+    uint32_t lSpiClock = 8000000;
+    unsigned int nIdlePolls = 0;
+    bool bInterrupt = false;
+    int nOption;
+    while((nOption = getopt(argc, argv, "o:r:i:n:m:s:p:I")) != -1)
+    {
+        bool bValid = true;
+        switch(nOption)
+        {
+            case 'o':
+                sOutput = optarg;
+                break;
+            case 'r':
+                nRepeats = atoi(optarg);
+                break;
+            case 'i':
+                bValid = addressIp.Parse(optarg);
+                break;
+            case 'n':
+                bValid = addressMask.Parse(optarg);
+                break;
+            case 'm':
+                bValid = addressMac.Parse(optarg);
+                break;
+            case 's':
+                lSpiClock = strtoul(optarg, NULL, 0);
+                bValid = lSpiClock > 0;
+                break;
+            case 'p':
+                nIdlePolls = atoi(optarg);
+                break;
+            case 'I':
+                bInterrupt = true;
+                break;
+            default:
+                bValid = false;
+        }
+        if(!bValid)
+        {
+            fprintf(stderr, "Usage: %s [-o output.pcap] [-r repeats] [-i ip] [-n netmask] [-m mac] [-s spi_clock_hz] [-p idle_polls] [-I] capture.pcap\n", argv[0]);
+            return 1;
+        }
+    }
+    if(optind >= argc)
+    {
+        fprintf(stderr, "No capture file specified\n");
+        return 1;
+    }
+
+    g_nic.Initialise(addressMac);
+    g_nic.ipv4.ConfigureStaticIp(&addressIp, 0, 0, &addressMask);
+    if(bInterrupt)
+        g_nic.EnableInterrupt(2); //Simulator ignores pin
+
+    NIC* pNic = g_nic.GetNic();
+    if(!pNic->Open(argv[optind]))
+    {
+        fprintf(stderr, "Failed to open capture %s\n", argv[optind]);
+        return 1;
+    }
+    if(sOutput && !pNic->OpenOutput(sOutput))
+    {
+        fprintf(stderr, "Failed to open output %s\n", sOutput);
+        return 1;
+    }
+    pNic->SetAutoFeed(false); //Feed one frame per Process call so each frame may be timed
+    #ifdef NIC_SPI_METER
+    pNic->SetClock(lSpiClock);
+    #endif // NIC_SPI_METER
+
+    BenchResult pResult[BENCH_TYPES];
+    for(byte i = 0; i < BENCH_TYPES; ++i)
+    {
+        pResult[i].nFrames = 0;
+        pResult[i].nTotal = 0;
+        pResult[i].nMin = UINT64_MAX;
+        pResult[i].nMax = 0;
+        #ifdef NIC_SPI_METER
+        memset(&pResult[i].countSpi, 0, sizeof(SpiCount));
+        pResult[i].nBusTime = 0;
+        #endif // NIC_SPI_METER
+    }
+
+    uint64_t nIdle = 0; //Time spent in idle calls to Process
+    uint32_t nIdleCalls = 0;
+    uint64_t nStart = GetNanoseconds();
+    for(unsigned int nRepeat = 0; nRepeat < nRepeats; ++nRepeat)
+    {
+        pNic->Rewind();
+        while(pNic->Feed())
+        {
+            byte nType = GetCategory(pNic->GetFrame(), pNic->GetFrameLength());
+            uint64_t nBegin = GetNanoseconds();
+            g_nic.Process();
+            uint64_t nTime = GetNanoseconds() - nBegin;
+            BenchResult& result = pResult[nType];
+            ++result.nFrames;
+            result.nTotal += nTime;
+            result.nMin = min(result.nMin, nTime);
+            result.nMax = max(result.nMax, nTime);
+            #ifdef NIC_SPI_METER
+            const SpiCount& countFrame = pNic->GetRxFrame();
+            result.countSpi.nTransactions += countFrame.nTransactions;
+            result.countSpi.nOpcodeBytes += countFrame.nOpcodeBytes;
+            result.countSpi.nPayloadBytes += countFrame.nPayloadBytes;
+            result.nBusTime += pNic->GetBusTime(countFrame);
+            #endif // NIC_SPI_METER
+            for(unsigned int nPoll = 0; nPoll < nIdlePolls; ++nPoll)
+            {
+                nBegin = GetNanoseconds();
+                g_nic.Process();
+                nIdle += GetNanoseconds() - nBegin;
+                ++nIdleCalls;
+            }
+        }
+    }
+    uint64_t nElapsed = GetNanoseconds() - nStart;
+
+    uint32_t nFrames = 0;
+    uint64_t nProcessing = 0;
+    for(byte i = 0; i < BENCH_TYPES; ++i)
+    {
+        nFrames += pResult[i].nFrames;
+        nProcessing += pResult[i].nTotal;
+    }
+    if(0 == nFrames)
+    {
+        fprintf(stderr, "No Ethernet frames in capture\n");
+        return 1;
+    }
+    printf("Frames:       %u (%u dropped - receive buffer full, %u rejected by receive filter)\n", nFrames, pNic->GetDroppedCount(),
+           pNic->RxGetFilteredCount());
+    printf("Rx buffer:    %u bytes, high water %u bytes, %u overflows, %u frames lost\n", pNic->RxGetSize(), pNic->RxGetHighWater(),
+           pNic->RxGetOverflowCount(), pNic->RxGetLostCount());
+    printf("Elapsed:      %.3f ms\n", nElapsed / 1e6);
+    printf("Rate:         %.0f frames/s\n", nFrames * 1e9 / nProcessing);
+    printf("Per frame:    %.0f ns\n", double(nProcessing) / nFrames);
+    if(nIdleCalls)
+        printf("Idle call:    %.0f ns (%s)\n", double(nIdle) / nIdleCalls, bInterrupt ? "interrupt" : "polling");
+    printf("\n%-10s %10s %12s %10s %10s\n", "Handler", "Frames", "ns/frame", "min ns", "max ns");
+    for(byte i = 0; i < BENCH_TYPES; ++i)
+    {
+        if(0 == pResult[i].nFrames)
+            continue;
+        printf("%-10s %10u %12.0f %10llu %10llu\n", g_sTypeName[i], pResult[i].nFrames,
+            double(pResult[i].nTotal) / pResult[i].nFrames,
+            (unsigned long long)pResult[i].nMin, (unsigned long long)pResult[i].nMax);
+    }
+    #ifdef NIC_SPI_METER
+    printf("\nSPI bus per frame at %.1f MHz (including frames sent in response)\n", lSpiClock / 1e6);
+    printf("%-10s %12s %12s %12s %12s\n", "Handler", "transactions", "opcode B", "payload B", "bus us");
+    for(byte i = 0; i < BENCH_TYPES; ++i)
+    {
+        const BenchResult& result = pResult[i];
+        if(0 == result.nFrames)
+            continue;
+        printf("%-10s %12.1f %12.1f %12.1f %12.2f\n", g_sTypeName[i],
+            double(result.countSpi.nTransactions) / result.nFrames,
+            double(result.countSpi.nOpcodeBytes) / result.nFrames,
+            double(result.countSpi.nPayloadBytes) / result.nFrames,
+            result.nBusTime / 1e3 / result.nFrames);
+    }
+    const SpiCount& countTotal = pNic->GetTotal();
+    printf("Total:     %u transactions, %u bytes, %.3f ms estimated bus time (including idle polls)\n",
+        countTotal.nTransactions, countTotal.nOpcodeBytes + countTotal.nPayloadBytes, pNic->GetBusTime(countTotal) / 1e6);
+    #endif // NIC_SPI_METER
+    NetStats stats;
+    g_nic.GetStats(stats);
+    static const char* sEthName[STATS_ETH_TYPES] = {"ARP", "IPv4", "IPv6", "other"};
+    static const char* sIpName[STATS_IP_PROTOCOLS] = {"ICMP", "TCP", "UDP", "other"};
+    static const char* sDropName[STATS_DROPS] = {"runt", "filtered", "EtherType", "ARP short", "ARP operation", "IP short", "IP header",
+        "IP length", "IP checksum", "IP protocol", "L4 short", "ICMP checksum", "ICMP type", "UDP length",
+        "UDP checksum", "UDP port", "TCP checksum", "TCP port", "ARP queue", "ARP timeout", "no route"};
+    printf("\n%-10s %10s %12s %10s %12s\n", "Stack", "Rx frames", "Rx bytes", "Tx frames", "Tx bytes");
+    for(byte i = 0; i < STATS_ETH_TYPES; ++i)
+        printf("%-10s %10u %12u %10u %12u\n", sEthName[i], stats.aRxEth[i].lFrames, stats.aRxEth[i].lBytes, stats.aTxEth[i].lFrames, stats.aTxEth[i].lBytes);
+    for(byte i = 0; i < STATS_IP_PROTOCOLS; ++i)
+        printf("IPv4/%-5s %10u %12u %10u %12u\n", sIpName[i], stats.aRxIp[i].lFrames, stats.aRxIp[i].lBytes, stats.aTxIp[i].lFrames, stats.aTxIp[i].lBytes);
+    printf("Dropped:  ");
+    for(byte i = 0; i < STATS_DROPS; ++i)
+        if(stats.aDrop[i])
+            printf(" %s %u", sDropName[i], stats.aDrop[i]);
+    printf("\nARP cache: %u hits, %u misses, %u evictions\n", stats.nArpHits, stats.nArpMisses, stats.nArpEvictions);
+    pNic->Close();
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*  Checksum microbenchmark
+    Compares the Internet checksum library (include/checksum.h) with the NIC DMA checksum at several lengths.
+    Host only. Build with -mavx2 to select the AVX2 implementation (SSE2 is default on x86-64).
+    Usage: checksumbench [-r repeats] [-s spi_clock_hz] [-d dma_ns_per_byte] [-f avr_clock_hz]
+    Columns:
+        generic / selected - measured host time of portable and selected implementation
+        AVR model - estimated time of AVR assembly implementation (27 cycles per 8 bytes, 14 per remaining word, 40 call overhead)
+        NIC DMA - SPI bus time to set up the DMA checksum and read its result (SpiMeter cost model) plus -d ns per byte of DMA engine time
+    Data in MCU RAM should use the library when it beats the NIC DMA column. Data only in NIC memory must use the DMA checksum.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "checksum.h"
+#include "constants.h"
+#include "enc28j60sim.h"
+#include "spimeter.h"
+
+static const uint16_t g_aLength[] = {8, 20, 28, 64, 128, 256, 576, 1024, 1480};
+
+/** @brief  Get monotonic time
+*   @return <i>uint64_t</i> Nanoseconds
+*/
+static uint64_t GetNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/** @brief  Measure mean time of a checksum function
+*   @param  Function Checksum function to measure
+*   @param  pData Pointer to data
+*   @param  nLen Quantity of bytes
+*   @param  nRepeats Quantity of calls
+*   @return <i>double</i> Nanoseconds per call
+*/
+static double Measure(uint16_t (*Function)(const byte*, uint16_t, uint32_t), const byte* pData, uint16_t nLen, unsigned int nRepeats)
+{
+    volatile uint16_t nSink = 0;
+    uint64_t nStart = GetNanoseconds();
+    for(unsigned int nRepeat = 0; nRepeat < nRepeats; ++nRepeat)
+        nSink = nSink + Function(pData, nLen, 0);
+    return double(GetNanoseconds() - nStart) / nRepeats;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int nRepeats = 100000;
+    uint32_t lSpiClock = 8000000;
+    double dDmaPerByte = 0;
+    uint32_t lAvrClock = 16000000;
+    int nOption;
+    while((nOption = getopt(argc, argv, "r:s:d:f:")) != -1)
+    {
+        bool bValid = true;
+        switch(nOption)
+        {
+            case 'r':
+                nRepeats = atoi(optarg);
+                bValid = nRepeats > 0;
+                break;
+            case 's':
+                lSpiClock = strtoul(optarg, NULL, 0);
+                bValid = lSpiClock > 0;
+                break;
+            case 'd':
+                dDmaPerByte = atof(optarg);
+                break;
+            case 'f':
+                lAvrClock = strtoul(optarg, NULL, 0);
+                bValid = lAvrClock > 0;
+                break;
+            default:
+                bValid = false;
+        }
+        if(!bValid)
+        {
+            fprintf(stderr, "Usage: %s [-r repeats] [-s spi_clock_hz] [-d dma_ns_per_byte] [-f avr_clock_hz]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    static byte pData[1500];
+    for(uint16_t nIndex = 0; nIndex < sizeof(pData); ++nIndex)
+        pData[nIndex] = rand();
+    SpiMeter<ENC28J60Sim> nic;
+    byte pMac[6] = {0x02,0x00,0x00,0x00,0x00,0x01};
+    nic.Initialize(pMac, 10);
+    nic.SetClock(lSpiClock);
+
+    printf("Checksum implementation: %s, SPI clock %uHz, AVR clock %uHz\n", Checksum::GetImplementation(), lSpiClock, lAvrClock);
+    printf("%6s %12s %12s %12s %12s %8s\n", "Bytes", "generic ns", "selected ns", "AVR model ns", "NIC DMA ns", "Check");
+    for(uint16_t nLen : g_aLength)
+    {
+        double dGeneric = Measure(Checksum::AddGeneric, pData, nLen, nRepeats);
+        double dSelected = Measure(Checksum::Add, pData, nLen, nRepeats);
+        uint32_t lAvrCycles = 40 + (nLen / 8) * 27 + ((nLen % 8 + 1) / 2) * 14;
+        double dAvr = double(lAvrCycles) * 1e9 / lAvrClock;
+        //Place data in NIC transmit buffer then meter only the checksum
+        nic.TxBegin();
+        nic.TxAppend(pData, nLen);
+        nic.Reset();
+        uint16_t nDma = nic.GetChecksum(MAC_HEADER_SIZE, nLen);
+        double dDma = nic.GetBusTime(nic.GetTotal()) + dDmaPerByte * nLen;
+        nic.TxDiscard(nic.TxHold());
+        bool bMatch = (nDma == Checksum::Get(pData, nLen)) && (Checksum::Add(pData, nLen) == Checksum::AddGeneric(pData, nLen));
+        printf("%6u %12.1f %12.1f %12.0f %12.0f %8s\n", nLen, dGeneric, dSelected, dAvr, dDma, bMatch ? "ok" : "FAIL");
+    }
+    return 0;
+}
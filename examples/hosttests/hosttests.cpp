@@ -0,0 +1,1552 @@
+/**     Host regression tests - inject frames into the ENC28J60 simulator and check the replies
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Build for host with the simulator (default NIC on host builds), e.g. with hosttests.cbp or:
+*           g++ -std=gnu++11 -Ihost -Iinclude examples/hosttests/hosttests.cpp src/[a-z]*.cpp host/Arduino.cpp
+*       Each test builds request frames, injects them, calls Process and checks the frames sent.
+*       Timeouts are tested by advancing the host clock (AdvanceClock) rather than waiting.
+*       Build with -DTRACE_SIZE=16 to include the trace test.
+*       The DHCP lease is stored in a temporary file which is removed on exit.
+*       Prints each failure and exits with the quantity of failed checks (zero when all pass).
+*/
+
+#include "ribanENC28J60.h"
+#include "checksum.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static const byte MAX_TX_FRAMES = 8;
+static const uint16_t MAX_FRAME = 1518;
+
+static const byte LOCAL_MAC[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const byte REMOTE_MAC[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x09};
+static const byte BROADCAST_MAC[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const byte LOCAL_IP[4] = {10, 0, 0, 2};
+static const byte REMOTE_IP[4] = {10, 0, 0, 9};
+static const byte OTHER_IP[4] = {10, 0, 0, 10};
+static const byte OTHER_MAC[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x0A};
+static const byte SILENT_IP[4] = {10, 0, 0, 11};
+static const byte NETMASK[4] = {255, 255, 255, 0};
+static const byte BROADCAST_IP[4] = {255, 255, 255, 255};
+static const byte OFFERED_IP[4] = {10, 0, 0, 5};
+
+/** Interface which records frames offered to DoProcess */
+class TestInterface : public ribanENC28J60
+{
+    public:
+        uint16_t nDoProcessType = 0; //!< EtherType of last frame offered to DoProcess
+    private:
+        uint16_t DoProcess(uint16_t nType, uint16_t nLen) { nDoProcessType = nType; return 0; };
+};
+
+static TestInterface g_nic;
+static byte g_aTx[MAX_TX_FRAMES][MAX_FRAME]; //!< Frames sent since ClearTx
+static uint16_t g_anTxLen[MAX_TX_FRAMES]; //!< Length of each sent frame
+static byte g_nTxCount = 0; //!< Quantity of frames sent since ClearTx
+static uint16_t g_nFailures = 0; //!< Quantity of failed checks
+static const char* g_sTest = ""; //!< Name of current test
+
+#define CHECK(condition) Check(condition, #condition, __LINE__)
+
+static void Check(bool bCondition, const char* sCondition, int nLine)
+{
+    if(bCondition)
+        return;
+    ++g_nFailures;
+    printf("FAIL %s line %d: %s\n", g_sTest, nLine, sCondition);
+}
+
+static void HandleTx(const byte* pFrame, uint16_t nLen)
+{
+    if(g_nTxCount >= MAX_TX_FRAMES)
+        return;
+    memcpy(g_aTx[g_nTxCount], pFrame, min(nLen, MAX_FRAME));
+    g_anTxLen[g_nTxCount++] = nLen;
+}
+
+static void ClearTx()
+{
+    g_nTxCount = 0;
+}
+
+static uint16_t GetWord(const byte* pData)
+{
+    return (pData[0] << 8) | pData[1];
+}
+
+static uint32_t GetLong(const byte* pData)
+{
+    return (uint32_t(GetWord(pData)) << 16) | GetWord(pData + 2);
+}
+
+static void PutWord(byte* pData, uint16_t nValue)
+{
+    pData[0] = nValue >> 8;
+    pData[1] = nValue & 0xFF;
+}
+
+static void PutLong(byte* pData, uint32_t lValue)
+{
+    PutWord(pData, lValue >> 16);
+    PutWord(pData + 2, lValue & 0xFFFF);
+}
+
+static uint32_t Sum(const byte* pData, uint16_t nLen, uint32_t lSum = 0)
+{
+    for(uint16_t nIndex = 0; nIndex + 1 < nLen; nIndex += 2)
+        lSum += GetWord(pData + nIndex);
+    if(nLen & 1)
+        lSum += pData[nLen - 1] << 8;
+    return lSum;
+}
+
+static uint16_t Fold(uint32_t lSum)
+{
+    while(lSum >> 16)
+        lSum = (lSum & 0xFFFF) + (lSum >> 16);
+    return lSum;
+}
+
+/** @brief  Sum transport segment with its IPV4 pseudo-header
+*   @param  pIp Pointer to IPV4 header
+*   @return <i>uint16_t</i> Folded sum. 0xFFFF if checksum is valid
+*/
+static uint16_t SumTransport(const byte* pIp)
+{
+    uint16_t nLen = GetWord(pIp + IPV4_OFFSET_LENGTH) - IPV4_HEADER_SIZE;
+    return Fold(Sum(pIp + IPV4_HEADER_SIZE, nLen, Sum(pIp + IPV4_OFFSET_SOURCE, 8) + pIp[IPV4_OFFSET_PROTOCOL] + nLen));
+}
+
+/** @brief  Build and inject ARP frame
+*   @param  pDestinationMac Destination MAC
+*   @param  nOperation ARP_REQUEST | ARP_REPLY
+*   @param  pSenderMac Sender hardware address
+*   @param  pSenderIp Sender protocol address
+*   @param  pTargetIp Target protocol address
+*   @param  bProcess True to call Process after injecting frame
+*/
+static void InjectArp(const byte* pDestinationMac, uint16_t nOperation, const byte* pSenderMac, const byte* pSenderIp, const byte* pTargetIp,
+    bool bProcess = true)
+{
+    byte pFrame[60] = {0};
+    memcpy(pFrame + MAC_OFFSET_DESTINATION, pDestinationMac, 6);
+    memcpy(pFrame + MAC_OFFSET_SOURCE, pSenderMac, 6);
+    PutWord(pFrame + MAC_OFFSET_TYPE, ETHTYPE_ARP);
+    byte* pArp = pFrame + MAC_HEADER_SIZE;
+    PutWord(pArp + ARP_HTYPE, 1);
+    PutWord(pArp + ARP_PTYPE, ETHTYPE_IPV4);
+    pArp[ARP_HLEN] = 6;
+    pArp[ARP_PLEN] = 4;
+    PutWord(pArp + ARP_OPER, nOperation);
+    memcpy(pArp + ARP_SHA, pSenderMac, 6);
+    memcpy(pArp + ARP_SPA, pSenderIp, 4);
+    memcpy(pArp + ARP_TPA, pTargetIp, 4);
+    g_nic.GetNic()->RxInject(pFrame, sizeof(pFrame));
+    if(bProcess)
+        g_nic.Process();
+}
+
+/** @brief  Inject minimal IPv4 frame with no valid payload
+*   @param  pDestinationMac Destination MAC
+*   @param  nEthertype EtherType. Default is IPv4
+*   @note   Used to check receive filters and drop counters - stack ignores the frame
+*/
+static void InjectIpv4Frame(const byte* pDestinationMac, uint16_t nEthertype = ETHTYPE_IPV4)
+{
+    byte pFrame[60] = {0};
+    memcpy(pFrame + MAC_OFFSET_DESTINATION, pDestinationMac, 6);
+    memcpy(pFrame + MAC_OFFSET_SOURCE, REMOTE_MAC, 6);
+    PutWord(pFrame + MAC_OFFSET_TYPE, nEthertype);
+    g_nic.GetNic()->RxInject(pFrame, sizeof(pFrame));
+}
+
+/** @brief  Get index of multicast hash table bit (CRC-32 bits 28:23 of address) */
+static byte GetHashIndex(const byte* pMac)
+{
+    uint32_t lCrc = 0xFFFFFFFF;
+    for(byte i = 0; i < 6; ++i)
+    {
+        lCrc ^= pMac[i];
+        for(byte nBit = 0; nBit < 8; ++nBit)
+            lCrc = (lCrc >> 1) ^ ((lCrc & 1) ? 0xEDB88320 : 0);
+    }
+    return (~lCrc >> 23) & 0x3F;
+}
+
+/** @brief  Build and inject IPV4 frame
+*   @param  pDestinationMac Destination MAC
+*   @param  pDestinationIp Destination IP
+*   @param  nProtocol IP protocol
+*   @param  pPayload Transport header and data. Transport checksum must be populated
+*   @param  nLen Quantity of bytes in payload
+*   @param  pTrailer Bytes appended to frame after IPV4 datagram (not included in IPV4 length). NULL for none
+*   @param  nTrailer Quantity of bytes in trailer
+*/
+static void InjectIpv4(const byte* pDestinationMac, const byte* pDestinationIp, byte nProtocol, const byte* pPayload, uint16_t nLen,
+    const byte* pTrailer = NULL, uint16_t nTrailer = 0)
+{
+    byte pFrame[MAX_FRAME] = {0};
+    memcpy(pFrame + MAC_OFFSET_DESTINATION, pDestinationMac, 6);
+    memcpy(pFrame + MAC_OFFSET_SOURCE, REMOTE_MAC, 6);
+    PutWord(pFrame + MAC_OFFSET_TYPE, ETHTYPE_IPV4);
+    byte* pIp = pFrame + MAC_HEADER_SIZE;
+    pIp[IPV4_OFFSET_VERSION] = 0x45;
+    PutWord(pIp + IPV4_OFFSET_LENGTH, IPV4_HEADER_SIZE + nLen);
+    pIp[IPV4_OFFSET_TTL] = 64;
+    pIp[IPV4_OFFSET_PROTOCOL] = nProtocol;
+    memcpy(pIp + IPV4_OFFSET_SOURCE, REMOTE_IP, 4);
+    memcpy(pIp + IPV4_OFFSET_DESTINATION, pDestinationIp, 4);
+    PutWord(pIp + IPV4_OFFSET_CHECKSUM, ~Fold(Sum(pIp, IPV4_HEADER_SIZE)));
+    memcpy(pIp + IPV4_HEADER_SIZE, pPayload, nLen);
+    uint16_t nFrame = MAC_HEADER_SIZE + IPV4_HEADER_SIZE + nLen;
+    if(pTrailer)
+        memcpy(pFrame + nFrame, pTrailer, nTrailer);
+    nFrame += nTrailer;
+    g_nic.GetNic()->RxInject(pFrame, max(nFrame, uint16_t(60)));
+    g_nic.Process();
+}
+
+/** @brief  Build and inject UDP datagram from remote host to local address
+*   @param  nPort Destination port
+*   @param  sData Payload
+*   @param  bCorrupt True to corrupt payload after checksum is calculated
+*   @param  bZeroChecksum True to send without checksum
+*   @param  nLengthAdjust Value added to UDP length field after checksum is calculated
+*/
+static void InjectUdp(uint16_t nPort, const char* sData, bool bCorrupt = false, bool bZeroChecksum = false, int nLengthAdjust = 0)
+{
+    byte pUdp[256] = {0};
+    uint16_t nLen = UDP_HEADER_SIZE + strlen(sData);
+    PutWord(pUdp + UDP_OFFSET_SOURCE_PORT, 12345);
+    PutWord(pUdp + UDP_OFFSET_DESTINATION_PORT, nPort);
+    PutWord(pUdp + UDP_OFFSET_LENGTH, nLen);
+    memcpy(pUdp + UDP_HEADER_SIZE, sData, strlen(sData));
+    uint16_t nChecksum = ~Fold(Sum(pUdp, nLen, Sum(REMOTE_IP, 4) + Sum(LOCAL_IP, 4) + IP_PROTOCOL_UDP + nLen));
+    PutWord(pUdp + UDP_OFFSET_CHECKSUM, bZeroChecksum ? 0 : (nChecksum ? nChecksum : 0xFFFF));
+    PutWord(pUdp + UDP_OFFSET_LENGTH, nLen + nLengthAdjust);
+    if(bCorrupt)
+        pUdp[UDP_HEADER_SIZE] ^= 0x01;
+    InjectIpv4(LOCAL_MAC, LOCAL_IP, IP_PROTOCOL_UDP, pUdp, nLen);
+}
+
+/** @brief  Build and inject TCP segment from remote host to local address
+*   @param  nPort Destination port
+*   @param  lSequence Sequence number
+*   @param  lAcknowledge Acknowledgement number
+*   @param  nFlags TCP_FLAG_xxx
+*   @param  sData Payload
+*   @param  nSourcePort Source port
+*/
+static void InjectTcp(uint16_t nPort, uint32_t lSequence, uint32_t lAcknowledge, byte nFlags, const char* sData = "", uint16_t nSourcePort = 40000)
+{
+    byte pTcp[256] = {0};
+    uint16_t nLen = TCP_HEADER_SIZE + strlen(sData);
+    PutWord(pTcp + TCP_OFFSET_SOURCE_PORT, nSourcePort);
+    PutWord(pTcp + TCP_OFFSET_DESTINATION_PORT, nPort);
+    PutLong(pTcp + TCP_OFFSET_SEQUENCE, lSequence);
+    PutLong(pTcp + TCP_OFFSET_ACKNOWLEDGE, lAcknowledge);
+    pTcp[TCP_OFFSET_DATA] = (TCP_HEADER_SIZE / 4) << 4;
+    pTcp[TCP_OFFSET_FLAGS] = nFlags;
+    PutWord(pTcp + TCP_OFFSET_WINDOW, 1024);
+    memcpy(pTcp + TCP_HEADER_SIZE, sData, strlen(sData));
+    PutWord(pTcp + TCP_OFFSET_CHECKSUM, ~Fold(Sum(pTcp, nLen, Sum(REMOTE_IP, 4) + Sum(LOCAL_IP, 4) + IP_PROTOCOL_TCP + nLen)));
+    InjectIpv4(LOCAL_MAC, LOCAL_IP, IP_PROTOCOL_TCP, pTcp, nLen);
+}
+
+/** @brief  Inject DHCP reply offering OFFERED_IP from REMOTE_IP with one hour lease
+*   @param  lXid Transaction ID
+*   @param  nType DHCP_TYPE_xxx
+*   @param  pOptions Options to append after standard options. NULL for none
+*   @param  nOptions Quantity of bytes in pOptions
+*   @param  pTrailer Bytes after end of datagram instead of end option. NULL to end options normally
+*   @param  nTrailer Quantity of bytes in pTrailer
+*   @param  bUnicast True to send to LOCAL_MAC and OFFERED_IP (renewal). Default is broadcast
+*/
+static void InjectDhcp(uint32_t lXid, byte nType, const byte* pOptions = NULL, byte nOptions = 0, const byte* pTrailer = NULL, byte nTrailer = 0,
+    bool bUnicast = false)
+{
+    byte pUdp[UDP_HEADER_SIZE + DHCP_OFFSET_OPTIONS + 64] = {0};
+    byte* pDhcp = pUdp + UDP_HEADER_SIZE;
+    pDhcp[DHCP_OFFSET_OP] = DHCP_OP_REPLY;
+    pDhcp[DHCP_OFFSET_HTYPE] = 1;
+    pDhcp[DHCP_OFFSET_HLEN] = 6;
+    PutLong(pDhcp + DHCP_OFFSET_XID, lXid);
+    memcpy(pDhcp + DHCP_OFFSET_YIADDR, OFFERED_IP, 4);
+    memcpy(pDhcp + DHCP_OFFSET_SIADDR, REMOTE_IP, 4);
+    memcpy(pDhcp + DHCP_OFFSET_CHADDR, LOCAL_MAC, 6);
+    const byte pStandard[] = {99, 130, 83, 99,
+        DHCP_OPTION_TYPE, 1, nType,
+        DHCP_OPTION_SERVER, 4, REMOTE_IP[0], REMOTE_IP[1], REMOTE_IP[2], REMOTE_IP[3],
+        DHCP_OPTION_MASK, 4, 255, 255, 255, 0,
+        DHCP_OPTION_LEASE, 4, 0, 0, 0x0E, 0x10};
+    memcpy(pDhcp + DHCP_OFFSET_MAGIC, pStandard, sizeof(pStandard));
+    uint16_t nLen = UDP_HEADER_SIZE + DHCP_OFFSET_MAGIC + sizeof(pStandard);
+    if(pOptions)
+        memcpy(pUdp + nLen, pOptions, nOptions);
+    nLen += nOptions;
+    if(!pTrailer)
+        pUdp[nLen++] = DHCP_OPTION_END;
+    PutWord(pUdp + UDP_OFFSET_SOURCE_PORT, DHCP_SERVER_PORT);
+    PutWord(pUdp + UDP_OFFSET_DESTINATION_PORT, DHCP_CLIENT_PORT);
+    PutWord(pUdp + UDP_OFFSET_LENGTH, nLen);
+    //UDP checksum zero (not calculated)
+    if(bUnicast)
+        InjectIpv4(LOCAL_MAC, OFFERED_IP, IP_PROTOCOL_UDP, pUdp, nLen, pTrailer, nTrailer);
+    else
+        InjectIpv4(BROADCAST_MAC, BROADCAST_IP, IP_PROTOCOL_UDP, pUdp, nLen, pTrailer, nTrailer);
+}
+
+/** @brief  Get DHCP message type and transaction ID of a sent frame
+*   @param  pFrame Pointer to sent frame
+*   @param  lXid Transaction ID, populated by this function
+*   @return <i>byte</i> DHCP message type or 0 if not a DHCP request
+*/
+static byte GetDhcpType(const byte* pFrame, uint32_t& lXid)
+{
+    const byte* pDhcp = pFrame + MAC_HEADER_SIZE + IPV4_HEADER_SIZE + UDP_HEADER_SIZE;
+    if(IP_PROTOCOL_UDP != pFrame[MAC_HEADER_SIZE + IPV4_OFFSET_PROTOCOL] || DHCP_OP_REQUEST != pDhcp[DHCP_OFFSET_OP])
+        return 0;
+    lXid = GetLong(pDhcp + DHCP_OFFSET_XID);
+    const byte* pOption = pDhcp + DHCP_OFFSET_OPTIONS;
+    return (DHCP_OPTION_TYPE == pOption[0]) ? pOption[2] : 0;
+}
+
+/** @brief  Start DHCP and get transaction ID of discover
+*   @return <i>uint32_t</i> Transaction ID
+*/
+static uint32_t StartDhcp()
+{
+    g_nic.ipv4.GetLeaseStore().Clear(); //Discover rather than confirm lease stored by previous test
+    ClearTx();
+    g_nic.ipv4.ConfigureDhcp();
+    uint32_t lXid = 0;
+    CHECK(1 == g_nTxCount && DHCP_TYPE_DISCOVER == GetDhcpType(g_aTx[0], lXid));
+    return lXid;
+}
+
+/** @brief  Find option in sent DHCP message
+*   @param  pFrame Pointer to sent frame
+*   @param  nOption DHCP_OPTION_xxx
+*   @return <i>const byte*</i> Pointer to option value or NULL if absent
+*/
+static const byte* FindDhcpOption(const byte* pFrame, byte nOption)
+{
+    const byte* pOption = pFrame + MAC_HEADER_SIZE + IPV4_HEADER_SIZE + UDP_HEADER_SIZE + DHCP_OFFSET_OPTIONS;
+    while(DHCP_OPTION_END != pOption[0])
+    {
+        if(nOption == pOption[0])
+            return pOption + 2;
+        pOption += (DHCP_OPTION_PAD == pOption[0]) ? 1 : 2 + pOption[1];
+    }
+    return NULL;
+}
+
+/** @brief  Restore static configuration after tests which use DHCP */
+static void ConfigureStatic()
+{
+    Ipv4Address ip(LOCAL_IP), mask(NETMASK);
+    g_nic.ipv4.ConfigureStaticIp(&ip, NULL, NULL, &mask);
+    g_nic.Process();
+}
+
+/** ARP cache: unknown hosts, expiry, least recently used eviction and pinned entries */
+static void TestArpCache()
+{
+    g_sTest = "ARP cache";
+    ArpCache cache;
+    byte pIp[4] = {10, 0, 1, 0};
+    byte pMac[6] = {0x02, 0, 0, 0, 1, 0};
+    CHECK(ARP_EOF == cache.Update(pIp, pMac, false)); //Only refresh existing entries
+    CHECK(NULL == cache.Lookup(pIp));
+
+    //Fill table, using first entry after each addition so that second is least recently used
+    for(byte nHost = 1; nHost <= ARP_TABLE_SIZE; ++nHost)
+    {
+        pIp[3] = pMac[5] = nHost;
+        CHECK(ARP_EOF != cache.Update(pIp, pMac));
+        AdvanceClock(1);
+        pIp[3] = 1;
+        CHECK(NULL != cache.Lookup(pIp));
+        AdvanceClock(1);
+    }
+    pIp[3] = 2;
+    byte* pFound = cache.Lookup(pIp);
+    CHECK(pFound && 2 == pFound[5]);
+    //Touch all but host 3 then add another host which should evict host 3
+    for(byte nHost = 1; nHost <= ARP_TABLE_SIZE; ++nHost)
+    {
+        pIp[3] = nHost;
+        if(3 != nHost)
+            cache.Lookup(pIp);
+    }
+    AdvanceClock(1);
+    pIp[3] = pMac[5] = 100;
+    cache.Update(pIp, pMac);
+    pIp[3] = 3;
+    CHECK(ARP_EOF == cache.Find(pIp));
+    pIp[3] = 1;
+    CHECK(ARP_EOF != cache.Find(pIp));
+
+    //Pinned gateway survives eviction and expiry only clears its MAC
+    const byte pGateway[4] = {10, 0, 1, 1}; //Already in cache as unpinned host 1
+    cache.Pin(ARP_GATEWAY_INDEX, pGateway);
+    CHECK(ARP_GATEWAY_INDEX == cache.Find(pGateway));
+    CHECK(NULL == cache.Lookup(pGateway)); //MAC cleared when pinned
+    CHECK(ARP_GATEWAY_INDEX == cache.Update(pGateway, pMac, false));
+    for(byte nHost = 101; nHost < 101 + 2 * ARP_TABLE_SIZE; ++nHost)
+    {
+        pIp[3] = nHost;
+        cache.Add(pIp);
+    }
+    CHECK(ARP_GATEWAY_INDEX == cache.Find(pGateway));
+    CHECK(NULL != cache.Lookup(pGateway));
+
+    //Resolved entries expire after ARP_ENTRY_TIMEOUT but keep their slot
+    AdvanceClock(ARP_ENTRY_TIMEOUT + 1);
+    CHECK(NULL == cache.Lookup(pGateway));
+    CHECK(ARP_GATEWAY_INDEX == cache.Find(pGateway));
+    cache.Flush();
+    CHECK(ARP_GATEWAY_INDEX == cache.Find(pGateway));
+    pIp[3] = 101 + 2 * ARP_TABLE_SIZE - 1;
+    CHECK(ARP_EOF == cache.Find(pIp));
+}
+
+/** ARP: request for local address is answered and its sender learnt. Other requests are ignored */
+static void TestArp()
+{
+    g_sTest = "ARP";
+    ClearTx();
+    InjectArp(BROADCAST_MAC, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP);
+    CHECK(1 == g_nTxCount);
+    const byte* pReply = g_aTx[0] + MAC_HEADER_SIZE;
+    CHECK(ETHTYPE_ARP == GetWord(g_aTx[0] + MAC_OFFSET_TYPE));
+    CHECK(ETHTYPE_IPV4 == GetWord(pReply + ARP_PTYPE));
+    CHECK(ARP_REPLY == GetWord(pReply + ARP_OPER));
+    CHECK(0 == memcmp(pReply + ARP_SHA, LOCAL_MAC, 6));
+    CHECK(0 == memcmp(pReply + ARP_SPA, LOCAL_IP, 4));
+    CHECK(0 == memcmp(pReply + ARP_THA, REMOTE_MAC, 6));
+    CHECK(0 == memcmp(pReply + ARP_TPA, REMOTE_IP, 4));
+
+    //Sender of request is learnt so lookup sends nothing
+    ClearTx();
+    Ipv4Address remote(REMOTE_IP);
+    byte* pMac = g_nic.ipv4.ArpLookup(&remote);
+    CHECK(pMac && 0 == memcmp(pMac, REMOTE_MAC, 6));
+    CHECK(0 == g_nTxCount);
+
+    //Request for another host is not answered and its unknown sender is not added
+    InjectArp(BROADCAST_MAC, ARP_REQUEST, OTHER_MAC, OTHER_IP, REMOTE_IP);
+    CHECK(0 == g_nTxCount);
+    Ipv4Address other(OTHER_IP);
+    CHECK(NULL == g_nic.ipv4.ArpLookup(&other));
+}
+
+/** @brief  Send an IPV4 frame with a short payload
+*   @param  pIp Destination IP
+*/
+static void SendIpv4(const byte* pIp)
+{
+    Ipv4Address ip(pIp);
+    g_nic.ipv4.TxBegin(&ip, IP_PROTOCOL_UDP);
+    g_nic.ipv4.TxAppend((byte*)"data", 4);
+    g_nic.ipv4.TxEnd();
+}
+
+/** @brief  Check whether a sent frame is an ARP request
+*   @param  nFrame Index of sent frame
+*   @param  pTargetIp Target protocol address to check with full frame layout. NULL to check only type of frame
+*   @return <i>bool</i> True if frame is a broadcast ARP request
+*/
+static bool IsArpRequest(byte nFrame, const byte* pTargetIp = NULL)
+{
+    static const byte pZero[6] = {0};
+    const byte* pArp = g_aTx[nFrame] + MAC_HEADER_SIZE;
+    if(nFrame >= g_nTxCount || ETHTYPE_ARP != GetWord(g_aTx[nFrame] + MAC_OFFSET_TYPE)
+        || 0 != memcmp(g_aTx[nFrame] + MAC_OFFSET_DESTINATION, BROADCAST_MAC, 6)
+        || ARP_REQUEST != GetWord(pArp + ARP_OPER))
+        return false;
+    if(!pTargetIp)
+        return true;
+    return g_anTxLen[nFrame] >= MAC_HEADER_SIZE + ARP_IPV4_LEN
+        && 1 == GetWord(pArp + ARP_HTYPE) && ETHTYPE_IPV4 == GetWord(pArp + ARP_PTYPE) && 6 == pArp[ARP_HLEN] && 4 == pArp[ARP_PLEN]
+        && 0 == memcmp(pArp + ARP_SHA, LOCAL_MAC, 6) && 0 == memcmp(pArp + ARP_SPA, LOCAL_IP, 4)
+        && 0 == memcmp(pArp + ARP_THA, pZero, 6) && 0 == memcmp(pArp + ARP_TPA, pTargetIp, 4);
+}
+
+/** ARP queue: frame to unresolved host is held until reply, retried with backoff and abandoned */
+static void TestArpQueue()
+{
+    g_sTest = "ARP queue";
+    ClearTx();
+    SendIpv4(OTHER_IP);
+    CHECK(1 == g_nTxCount && IsArpRequest(0, OTHER_IP)); //Only ARP request sent - frame is held
+    ClearTx();
+    g_nic.Process();
+    CHECK(0 == g_nTxCount);
+    InjectArp(LOCAL_MAC, ARP_REPLY, OTHER_MAC, OTHER_IP, LOCAL_IP);
+    CHECK(1 == g_nTxCount);
+    CHECK(0 == memcmp(g_aTx[0] + MAC_OFFSET_DESTINATION, OTHER_MAC, 6));
+    CHECK(ETHTYPE_IPV4 == GetWord(g_aTx[0] + MAC_OFFSET_TYPE));
+    CHECK(0 == memcmp(g_aTx[0] + MAC_HEADER_SIZE + IPV4_OFFSET_DESTINATION, OTHER_IP, 4));
+    CHECK(0 == memcmp(g_aTx[0] + MAC_HEADER_SIZE + IPV4_HEADER_SIZE, "data", 4));
+    ClearTx();
+    SendIpv4(OTHER_IP);
+    CHECK(1 == g_nTxCount && !IsArpRequest(0)); //Resolved so sent immediately
+
+    //Frames beyond ARP_QUEUE_SIZE (and those with no route) are reported as dropped
+    const byte pQueueIp[4] = {10, 0, 0, 20};
+    Ipv4Address ip(pQueueIp);
+    NetStats stats;
+    g_nic.GetStats(stats, true);
+    for(byte nIndex = 0; nIndex <= ARP_QUEUE_SIZE; ++nIndex)
+    {
+        ip.GetAddress()[3] = pQueueIp[3] + nIndex;
+        g_nic.ipv4.TxBegin(&ip, IP_PROTOCOL_UDP);
+        g_nic.ipv4.TxAppend((byte*)"data", 4);
+        CHECK(g_nic.ipv4.TxEnd() == (nIndex < ARP_QUEUE_SIZE));
+    }
+    byte pData[] = {'x'};
+    CHECK(!g_nic.ipv4.udp.Send(pData, sizeof(pData), &ip, 9));
+    Ipv4Address ipOffNet(BROADCAST_IP);
+    ipOffNet.GetAddress()[0] = 192; //Not on local subnet and no gateway
+    CHECK(!g_nic.ipv4.udp.Send(pData, sizeof(pData), &ipOffNet, 9));
+    g_nic.GetStats(stats);
+    CHECK(2 == stats.aDrop[STATS_DROP_ARP_QUEUE]);
+    CHECK(1 == stats.aDrop[STATS_DROP_NO_ROUTE]);
+    for(byte nIndex = 0; nIndex < ARP_QUEUE_SIZE; ++nIndex)
+    {
+        byte pMac[6] = {0x02, 0, 0, 0, 0, byte(0x20 + nIndex)};
+        ip.GetAddress()[3] = pQueueIp[3] + nIndex;
+        InjectArp(LOCAL_MAC, ARP_REPLY, pMac, ip.GetAddress(), LOCAL_IP); //Release held frames
+    }
+
+    //Unanswered request is retried with exponential backoff then frame is discarded
+    ClearTx();
+    SendIpv4(SILENT_IP);
+    CHECK(1 == g_nTxCount && IsArpRequest(0));
+    for(byte nRetry = 0; nRetry < ARP_RETRIES; ++nRetry)
+    {
+        ClearTx();
+        AdvanceClock((ARP_RETRY_INTERVAL << nRetry) - 1);
+        g_nic.Process();
+        CHECK(0 == g_nTxCount);
+        AdvanceClock(1);
+        g_nic.Process();
+        CHECK(1 == g_nTxCount && IsArpRequest(0));
+    }
+    ClearTx();
+    AdvanceClock(ARP_RETRY_INTERVAL << ARP_RETRIES);
+    g_nic.Process();
+    CHECK(0 == g_nTxCount); //Abandoned
+    const byte pSilentMac[6] = {0x02, 0, 0, 0, 0, 0x0B};
+    InjectArp(LOCAL_MAC, ARP_REPLY, pSilentMac, SILENT_IP, LOCAL_IP);
+    CHECK(0 == g_nTxCount); //Discarded frame is not sent
+}
+
+/** Transmit ring: frames are built in free slots without waiting, completion is collected by TxPoll */
+static void TestTxRing()
+{
+    g_sTest = "Tx ring";
+    ENC28J60Sim nic;
+    nic.Initialize((byte*)LOCAL_MAC, 10);
+    nic.SetTxHandler(HandleTx);
+    ClearTx();
+    for(byte nFrame = 0; nFrame < ENC28J60_TX_SLOTS; ++nFrame)
+    {
+        nic.TxBegin((byte*)REMOTE_MAC);
+        nic.TxAppendByte(nFrame);
+        nic.TxEnd();
+    }
+    CHECK(ENC28J60_TX_SLOTS == g_nTxCount);
+    CHECK(ENC28J60_TX_SLOTS == nic.TxPoll());
+    CHECK(0 == nic.TxPoll());
+
+    //Frame held in one slot whilst others are sent. One slot is always kept for sending
+    ClearTx();
+    nic.TxBegin(NULL);
+    nic.TxAppend((byte*)"held", 4);
+    byte nHeld = nic.TxHold();
+    CHECK(ENC28J60_NO_SLOT != nHeld);
+    for(byte nFrame = 1; nFrame < ENC28J60_TX_SLOTS - 1; ++nFrame)
+    {
+        nic.TxBegin(NULL);
+        CHECK(ENC28J60_NO_SLOT != nic.TxHold());
+    }
+    nic.TxBegin(NULL);
+    CHECK(ENC28J60_NO_SLOT == nic.TxHold());
+    nic.TxBegin((byte*)REMOTE_MAC);
+    nic.TxEnd();
+    CHECK(1 == g_nTxCount && 1 == nic.TxPoll());
+    nic.TxRelease(nHeld, (byte*)OTHER_MAC);
+    CHECK(2 == g_nTxCount);
+    CHECK(0 == memcmp(g_aTx[1] + MAC_OFFSET_DESTINATION, OTHER_MAC, 6));
+    CHECK(0 == memcmp(g_aTx[1] + MAC_HEADER_SIZE, "held", 4));
+
+    //Process collects completion of frames sent by stack
+    SendIpv4(REMOTE_IP);
+    g_nic.Process();
+    CHECK(0 == g_nic.GetNic()->TxPoll());
+}
+
+/** Receive buffer telemetry: high water, overflow events and lost frames */
+static void TestRxTelemetry()
+{
+    g_sTest = "Rx telemetry";
+    ENC28J60Sim nic;
+    nic.Initialize((byte*)LOCAL_MAC, 10);
+    CHECK(ENC28J60_RXEND - ENC28J60_RXSTART + 1 == nic.RxGetSize());
+    CHECK(0 == nic.RxGetHighWater() && 0 == nic.RxGetOverflowCount() && 0 == nic.RxGetLostCount());
+    byte pFrame[ENC28J60_MAX_FRAME - 4] = {0};
+    memcpy(pFrame, LOCAL_MAC, 6);
+    uint16_t nFrames = 0;
+    while(nic.RxInject(pFrame, sizeof(pFrame)))
+        ++nFrames;
+    CHECK(nFrames == nic.RxGetSize() / (sizeof(pFrame) + 4 + ENC28J60_RSV_SIZE));
+    CHECK(nic.RxGetHighWater() >= nFrames * (sizeof(pFrame) + 4 + ENC28J60_RSV_SIZE));
+    CHECK(1 == nic.RxGetOverflowCount() && 1 == nic.RxGetLostCount());
+    CHECK(!nic.RxInject(pFrame, sizeof(pFrame)));
+    CHECK(1 == nic.RxGetOverflowCount() && 2 == nic.RxGetLostCount()); //Same overflow event
+    //Drain one frame so next injection succeeds then overflow again
+    CHECK(nic.RxBegin());
+    nic.RxEnd();
+    CHECK(nic.RxInject(pFrame, sizeof(pFrame)));
+    CHECK(!nic.RxInject(pFrame, sizeof(pFrame)));
+    CHECK(2 == nic.RxGetOverflowCount() && 3 == nic.RxGetLostCount());
+    nic.RxClearStats();
+    CHECK(0 == nic.RxGetOverflowCount() && 0 == nic.RxGetLostCount());
+}
+
+/** Interrupt driven receive: Process only reads NIC after INT and drains all frames pending */
+static void TestInterrupt()
+{
+    g_sTest = "Interrupt";
+    g_nic.EnableInterrupt(2);
+    CHECK(g_nic.IsRxPending()); //Frames may have arrived before interrupt was enabled
+    g_nic.Process();
+    CHECK(!g_nic.IsRxPending());
+    CHECK(0 == g_nic.Process());
+    //Two frames raise one edge - both are processed
+    ClearTx();
+    InjectArp(BROADCAST_MAC, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP, false);
+    InjectArp(BROADCAST_MAC, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP, false);
+    CHECK(g_nic.IsRxPending());
+    CHECK(2 == g_nic.Process());
+    CHECK(2 == g_nTxCount);
+    CHECK(!g_nic.IsRxPending());
+    CHECK(0 == g_nic.Process());
+    g_nic.DisableInterrupt();
+    CHECK(g_nic.IsRxPending()); //Polling
+}
+
+/** Budgeted Process: frame limit leaves remaining frames (and interrupt) pending */
+static void TestBudget()
+{
+    g_sTest = "Budget";
+    ClearTx();
+    for(byte nFrame = 0; nFrame < 3; ++nFrame)
+        InjectArp(BROADCAST_MAC, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP, false);
+    CHECK(g_nic.Process(2));
+    CHECK(2 == g_nTxCount);
+    CHECK(!g_nic.Process(2));
+    CHECK(3 == g_nTxCount);
+
+    g_nic.EnableInterrupt(2);
+    g_nic.Process();
+    ClearTx();
+    for(byte nFrame = 0; nFrame < 3; ++nFrame)
+        InjectArp(BROADCAST_MAC, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP, false);
+    CHECK(g_nic.Process(1));
+    CHECK(1 == g_nTxCount);
+    CHECK(g_nic.IsRxPending()); //No further edge while frames wait so flag must remain set
+    CHECK(!g_nic.Process(0, 0));
+    CHECK(3 == g_nTxCount);
+    CHECK(!g_nic.IsRxPending());
+    g_nic.DisableInterrupt();
+}
+
+/** Receive filters: broadcast listeners, DHCP broadcast window, multicast hash and software filtering of hash collisions */
+static void TestRxFilter()
+{
+    g_sTest = "Receive filter";
+    ENC28J60Sim* pNic = g_nic.GetNic();
+    uint32_t lFiltered = pNic->RxGetFilteredCount();
+    InjectIpv4Frame(BROADCAST_MAC);
+    CHECK(++lFiltered == pNic->RxGetFilteredCount()); //Broadcast not wanted with static IP
+    ClearTx();
+    InjectArp(BROADCAST_MAC, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP);
+    CHECK(lFiltered == pNic->RxGetFilteredCount()); //ARP broadcast passes pattern match
+    CHECK(1 == g_nTxCount);
+
+    g_nic.ListenBroadcast(true);
+    g_nic.ListenBroadcast(true);
+    g_nic.ListenBroadcast(false);
+    InjectIpv4Frame(BROADCAST_MAC);
+    CHECK(lFiltered == pNic->RxGetFilteredCount()); //One listener remains
+    g_nic.ListenBroadcast(false);
+    InjectIpv4Frame(BROADCAST_MAC);
+    CHECK(++lFiltered == pNic->RxGetFilteredCount());
+    g_nic.Process();
+
+    //Broadcast accepted as soon as DHCP sends discover, without waiting for Process
+    ClearTx();
+    g_nic.ipv4.ConfigureDhcp();
+    CHECK(1 == g_nTxCount);
+    InjectIpv4Frame(BROADCAST_MAC);
+    CHECK(lFiltered == pNic->RxGetFilteredCount());
+    ConfigureStatic();
+    InjectIpv4Frame(BROADCAST_MAC);
+    CHECK(++lFiltered == pNic->RxGetFilteredCount());
+
+    //Find a group which shares a hash bit with the joined group and one which does not
+    byte pGroup[6] = {0x01, 0x00, 0x5E, 0x00, 0x00, 0x01};
+    byte pCollision[6] = {0x01, 0x00, 0x5E, 0x00, 0x00, 0x02};
+    while(GetHashIndex(pCollision) != GetHashIndex(pGroup))
+        ++pCollision[5];
+    byte pOther[6] = {0x01, 0x00, 0x5E, 0x00, 0x00, 0x02};
+    while(GetHashIndex(pOther) == GetHashIndex(pGroup))
+        ++pOther[5];
+    InjectIpv4Frame(pGroup);
+    CHECK(++lFiltered == pNic->RxGetFilteredCount()); //Not joined
+    CHECK(g_nic.JoinMulticast(MacAddress(pGroup)));
+    CHECK(g_nic.JoinMulticast(MacAddress(pGroup))); //Joining twice uses one entry
+    ClearTx();
+    InjectArp(pGroup, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP);
+    CHECK(lFiltered == pNic->RxGetFilteredCount());
+    CHECK(1 == g_nTxCount);
+    InjectArp(pCollision, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP);
+    CHECK(lFiltered == pNic->RxGetFilteredCount()); //Passes imperfect hash filter in NIC...
+    CHECK(1 == g_nTxCount); //...but is discarded by stack
+    InjectIpv4Frame(pOther);
+    CHECK(++lFiltered == pNic->RxGetFilteredCount());
+    g_nic.LeaveMulticast(MacAddress(pGroup));
+    InjectIpv4Frame(pGroup);
+    CHECK(++lFiltered == pNic->RxGetFilteredCount());
+    g_nic.Process();
+
+    //Limited quantity of groups
+    byte pFill[6] = {0x01, 0x00, 0x5E, 0x00, 0x01, 0x00};
+    for(byte nGroup = 0; nGroup < RX_MULTICAST_GROUPS; ++nGroup)
+    {
+        pFill[5] = nGroup;
+        CHECK(g_nic.JoinMulticast(MacAddress(pFill)));
+    }
+    pFill[5] = RX_MULTICAST_GROUPS;
+    CHECK(!g_nic.JoinMulticast(MacAddress(pFill)));
+    for(byte nGroup = 0; nGroup <= RX_MULTICAST_GROUPS; ++nGroup)
+    {
+        pFill[5] = nGroup;
+        g_nic.LeaveMulticast(MacAddress(pFill));
+    }
+}
+
+static byte g_nTxErrorHandled = 0; //!< Quantity of calls to transmit error handler
+
+static void HandleTxError()
+{
+    ++g_nTxErrorHandled;
+}
+
+/** Statistics: per EtherType and protocol counters, drop reasons, ARP cache counters, transmit errors and reset */
+static void TestStats()
+{
+    g_sTest = "Statistics";
+    NetStats stats;
+    g_nic.GetStats(stats, true);
+    ClearTx();
+    InjectArp(BROADCAST_MAC, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP);
+    InjectIpv4Frame(LOCAL_MAC, 0x88B5); //Local experimental EtherType
+    InjectIpv4Frame(LOCAL_MAC); //Version 0
+    g_nic.Process();
+    SendIpv4(REMOTE_IP); //Resolved by request
+    CHECK(2 == g_nTxCount);
+    g_nic.GetStats(stats);
+    CHECK(1 == stats.aRxEth[STATS_ETH_ARP].lFrames);
+    CHECK(60 == stats.aRxEth[STATS_ETH_ARP].lBytes);
+    CHECK(1 == stats.aTxEth[STATS_ETH_ARP].lFrames);
+    CHECK(MAC_HEADER_SIZE + ARP_IPV4_LEN == stats.aTxEth[STATS_ETH_ARP].lBytes);
+    CHECK(1 == stats.aRxEth[STATS_ETH_OTHER].lFrames);
+    CHECK(1 == stats.aDrop[STATS_DROP_ETHERTYPE]);
+    CHECK(1 == stats.aRxEth[STATS_ETH_IPV4].lFrames);
+    CHECK(1 == stats.aDrop[STATS_DROP_IP_HEADER]);
+    CHECK(1 == stats.aTxEth[STATS_ETH_IPV4].lFrames);
+    CHECK(1 == stats.aTxIp[STATS_IP_UDP].lFrames);
+    CHECK(4 == stats.aTxIp[STATS_IP_UDP].lBytes);
+    CHECK(stats.nArpHits >= 1);
+
+    g_nic.GetStats(stats, true); //Snapshot then reset
+    CHECK(1 == stats.aRxEth[STATS_ETH_ARP].lFrames);
+    g_nic.GetStats(stats);
+    CHECK(0 == stats.aRxEth[STATS_ETH_ARP].lFrames);
+    CHECK(0 == stats.aDrop[STATS_DROP_ETHERTYPE]);
+    CHECK(0 == stats.nArpHits);
+
+    //Transmit errors are counted once each with or without a handler
+    g_nic.GetNic()->SetTxError(ENC28J60_TXERROR_LATE_COLL);
+    SendIpv4(REMOTE_IP);
+    g_nic.Process();
+    g_nic.Process();
+    g_nic.GetStats(stats);
+    CHECK(1 == stats.nTxErrors);
+    CHECK(ENC28J60_TX_FAILED != g_nic.GetNic()->TxGetStatus());
+    g_nTxErrorHandled = 0;
+    g_nic.SetTxErrorHandler(HandleTxError);
+    g_nic.GetNic()->SetTxError(ENC28J60_TXERROR_COLL);
+    SendIpv4(REMOTE_IP);
+    g_nic.Process();
+    SendIpv4(REMOTE_IP); //Succeeds
+    g_nic.Process();
+    g_nic.GetStats(stats, true);
+    CHECK(2 == stats.nTxErrors);
+    CHECK(1 == g_nTxErrorHandled);
+    g_nic.SetTxErrorHandler(NULL);
+}
+
+/** DHCP: discover, offer, request and acknowledge. Options parsed within datagram bounds */
+static void TestDhcp()
+{
+    g_sTest = "DHCP";
+    uint32_t lXid = StartDhcp();
+    //Discover built from templates and fills
+    const byte* pIp = g_aTx[0] + MAC_HEADER_SIZE;
+    const byte* pUdp = pIp + IPV4_HEADER_SIZE;
+    const byte* pDhcp = pUdp + UDP_HEADER_SIZE;
+    const byte pCookie[] = {99, 130, 83, 99};
+    const byte pZero[DHCP_OFFSET_MAGIC] = {0};
+    CHECK(0 == memcmp(g_aTx[0] + MAC_OFFSET_DESTINATION, BROADCAST_MAC, 6));
+    CHECK(0xFFFF == Fold(Sum(pIp, IPV4_HEADER_SIZE)));
+    CHECK(GetWord(pIp + IPV4_OFFSET_LENGTH) == IPV4_HEADER_SIZE + GetWord(pUdp + UDP_OFFSET_LENGTH));
+    CHECK(DHCP_CLIENT_PORT == GetWord(pUdp + UDP_OFFSET_SOURCE_PORT) && DHCP_SERVER_PORT == GetWord(pUdp + UDP_OFFSET_DESTINATION_PORT));
+    CHECK(DHCP_OP_REQUEST == pDhcp[DHCP_OFFSET_OP] && 1 == pDhcp[DHCP_OFFSET_HTYPE] && 6 == pDhcp[DHCP_OFFSET_HLEN]);
+    CHECK(0 == memcmp(pDhcp + DHCP_OFFSET_SECS, pZero, DHCP_OFFSET_CHADDR - DHCP_OFFSET_SECS));
+    CHECK(0 == memcmp(pDhcp + DHCP_OFFSET_CHADDR, LOCAL_MAC, 6));
+    CHECK(0 == memcmp(pDhcp + DHCP_OFFSET_CHADDR + 6, pZero, DHCP_OFFSET_MAGIC - DHCP_OFFSET_CHADDR - 6));
+    CHECK(0 == memcmp(pDhcp + DHCP_OFFSET_MAGIC, pCookie, 4));
+    const byte* pParams = FindDhcpOption(g_aTx[0], DHCP_OPTION_PARAM);
+    CHECK(pParams && 6 == pParams[-1] && DHCP_OPTION_MASK == pParams[0] && DHCP_OPTION_T2 == pParams[5]);
+    CHECK(g_anTxLen[0] >= MAC_HEADER_SIZE + GetWord(pIp + IPV4_OFFSET_LENGTH));
+    CHECK(0xFFFF == SumTransport(pIp));
+    ClearTx();
+    InjectDhcp(lXid, DHCP_TYPE_ACK); //Not expected whilst discovering
+    CHECK(0 == g_nTxCount);
+    InjectDhcp(lXid, DHCP_TYPE_OFFER);
+    CHECK(1 == g_nTxCount && DHCP_TYPE_REQUEST == GetDhcpType(g_aTx[0], lXid));
+    CHECK(g_nic.ipv4.GetIp()->IsNull()); //Not bound until acknowledged
+
+    //Options end with datagram (no end option) and router option follows in frame padding - parser must stop at datagram end
+    const byte pOptions[] = {DHCP_OPTION_PAD, DHCP_OPTION_T1, 4, 0, 0, 0, 30};
+    const byte pTrailer[] = {DHCP_OPTION_ROUTER, 4, 10, 0, 0, 99, DHCP_OPTION_END};
+    InjectDhcp(lXid, DHCP_TYPE_ACK, pOptions, sizeof(pOptions), pTrailer, sizeof(pTrailer));
+    CHECK(*g_nic.ipv4.GetIp() == OFFERED_IP);
+    CHECK(*g_nic.ipv4.GetNetmask() == NETMASK);
+    CHECK(g_nic.ipv4.GetGw()->IsNull());
+    CHECK(g_nic.ipv4.GetDns()->IsNull());
+    ClearTx();
+    InjectDhcp(lXid, DHCP_TYPE_ACK); //Bound so further replies are ignored
+    CHECK(0 == g_nTxCount);
+
+    //Router and DNS within datagram are used
+    lXid = StartDhcp();
+    InjectDhcp(lXid, DHCP_TYPE_OFFER);
+    const byte pServers[] = {DHCP_OPTION_ROUTER, 4, 10, 0, 0, 1, DHCP_OPTION_DNS, 8, 10, 0, 0, 53, 10, 0, 0, 54};
+    const byte pRouter[] = {10, 0, 0, 1};
+    const byte pDns[] = {10, 0, 0, 53};
+    InjectDhcp(lXid, DHCP_TYPE_ACK, pServers, sizeof(pServers));
+    CHECK(*g_nic.ipv4.GetGw() == pRouter);
+    CHECK(*g_nic.ipv4.GetDns() == pDns);
+
+    //DNS option claiming more bytes than the datagram holds is ignored
+    lXid = StartDhcp();
+    InjectDhcp(lXid, DHCP_TYPE_OFFER);
+    const byte pTruncated[] = {DHCP_OPTION_DNS, 40, 10, 0, 0, 77};
+    InjectDhcp(lXid, DHCP_TYPE_ACK, pTruncated, sizeof(pTruncated), pTruncated, 0);
+    CHECK(*g_nic.ipv4.GetIp() == OFFERED_IP);
+    CHECK(*g_nic.ipv4.GetDns() == pDns);
+
+    //Truncated reply is ignored
+    StartDhcp();
+    ClearTx();
+    byte pShort[UDP_HEADER_SIZE + DHCP_OFFSET_MAGIC] = {0};
+    PutWord(pShort + UDP_OFFSET_SOURCE_PORT, DHCP_SERVER_PORT);
+    PutWord(pShort + UDP_OFFSET_DESTINATION_PORT, DHCP_CLIENT_PORT);
+    PutWord(pShort + UDP_OFFSET_LENGTH, sizeof(pShort));
+    pShort[UDP_HEADER_SIZE + DHCP_OFFSET_OP] = DHCP_OP_REPLY;
+    InjectIpv4(BROADCAST_MAC, BROADCAST_IP, IP_PROTOCOL_UDP, pShort, sizeof(pShort));
+    CHECK(0 == g_nTxCount);
+    ConfigureStatic();
+}
+
+/** @brief  Advance clock and process
+*   @param  lMs Milliseconds to advance
+*   @note   Answers an ARP request from the server (REMOTE_IP) so that unicast frames held for resolution are sent
+*/
+static void Wait(uint32_t lMs)
+{
+    ClearTx();
+    AdvanceClock(lMs);
+    g_nic.Process();
+    if(IsArpRequest(0))
+    {
+        ClearTx();
+        InjectArp(LOCAL_MAC, ARP_REPLY, REMOTE_MAC, REMOTE_IP, OFFERED_IP);
+        g_nic.Process(); //Send frame held for resolution
+    }
+}
+
+/** @brief  Check whether a sent frame is a DHCP message of a type
+*   @param  nFrame Index of sent frame
+*   @param  nType DHCP_TYPE_xxx
+*   @param  lXid Transaction ID, populated by this function
+*   @return <i>bool</i> True if frame is a DHCP message of this type
+*/
+static bool IsDhcp(byte nFrame, byte nType, uint32_t& lXid)
+{
+    return nFrame < g_nTxCount && nType == GetDhcpType(g_aTx[nFrame], lXid);
+}
+
+/** DHCP client: transaction ID, retransmission backoff, request retries, NAK, renewing, rebinding and lease expiry */
+static void TestDhcpLease()
+{
+    g_sTest = "DHCP lease";
+    uint32_t lXid = StartDhcp();
+    uint32_t lSent = 0;
+    ClearTx();
+    InjectDhcp(lXid + 1, DHCP_TYPE_OFFER); //Another client's exchange
+    CHECK(0 == g_nTxCount);
+    CHECK(DHCP_DISCOVERY == g_nic.ipv4.GetDhcpStatus());
+
+    //First retry after 3..5s, second after 7..9s, same transaction
+    Wait(DHCP_RETRY_INTERVAL - 1001);
+    CHECK(0 == g_nTxCount);
+    Wait(2001);
+    CHECK(1 == g_nTxCount && IsDhcp(0, DHCP_TYPE_DISCOVER, lSent) && lSent == lXid);
+    Wait(2 * DHCP_RETRY_INTERVAL - 1001);
+    CHECK(0 == g_nTxCount);
+    Wait(2001);
+    CHECK(1 == g_nTxCount && IsDhcp(0, DHCP_TYPE_DISCOVER, lSent) && lSent == lXid);
+
+    //Unanswered requests restart discovery with new transaction
+    ClearTx();
+    InjectDhcp(lXid, DHCP_TYPE_OFFER);
+    CHECK(IsDhcp(0, DHCP_TYPE_REQUEST, lSent));
+    byte nRequests = 1;
+    for(byte nWait = 0; nWait < 2 * DHCP_REQUEST_RETRIES && DHCP_REQUESTED == g_nic.ipv4.GetDhcpStatus(); ++nWait)
+    {
+        Wait(DHCP_RETRY_MAX + 1000);
+        if(IsDhcp(0, DHCP_TYPE_REQUEST, lSent))
+            ++nRequests;
+    }
+    CHECK(DHCP_REQUEST_RETRIES == nRequests);
+    CHECK(DHCP_DISCOVERY == g_nic.ipv4.GetDhcpStatus());
+    CHECK(IsDhcp(0, DHCP_TYPE_DISCOVER, lSent) && lSent != lXid);
+    lXid = lSent;
+
+    //NAK restarts discovery
+    InjectDhcp(lXid, DHCP_TYPE_OFFER);
+    ClearTx();
+    InjectDhcp(lXid, DHCP_TYPE_NAK);
+    CHECK(DHCP_DISCOVERY == g_nic.ipv4.GetDhcpStatus());
+    CHECK(IsDhcp(0, DHCP_TYPE_DISCOVER, lXid));
+
+    //Bind with one hour lease: renew at 1800s (unicast to server), rebind at 3150s (broadcast), expire at 3600s
+    InjectDhcp(lXid, DHCP_TYPE_OFFER);
+    InjectDhcp(lXid, DHCP_TYPE_ACK);
+    CHECK(DHCP_BOUND == g_nic.ipv4.GetDhcpStatus());
+    Wait(1799000);
+    CHECK(0 == g_nTxCount);
+    Wait(1000);
+    CHECK(DHCP_RENEWING == g_nic.ipv4.GetDhcpStatus());
+    CHECK(IsDhcp(0, DHCP_TYPE_REQUEST, lXid));
+    CHECK(0 == memcmp(g_aTx[0] + MAC_OFFSET_DESTINATION, REMOTE_MAC, 6));
+    CHECK(0 == memcmp(g_aTx[0] + MAC_HEADER_SIZE + IPV4_OFFSET_DESTINATION, REMOTE_IP, 4));
+    CHECK(0 == memcmp(g_aTx[0] + MAC_HEADER_SIZE + IPV4_HEADER_SIZE + UDP_HEADER_SIZE + DHCP_OFFSET_CIADDR, OFFERED_IP, 4));
+    InjectDhcp(lXid, DHCP_TYPE_ACK, NULL, 0, NULL, 0, true);
+    CHECK(DHCP_BOUND == g_nic.ipv4.GetDhcpStatus()); //Lease restarted
+    Wait(1799000);
+    CHECK(DHCP_BOUND == g_nic.ipv4.GetDhcpStatus());
+    Wait(1000);
+    CHECK(DHCP_RENEWING == g_nic.ipv4.GetDhcpStatus());
+    Wait(1349000); //Renewal retransmitted at half of time remaining until T2
+    Wait(1000);
+    CHECK(DHCP_REBINDING == g_nic.ipv4.GetDhcpStatus());
+    CHECK(IsDhcp(0, DHCP_TYPE_REQUEST, lSent) && lSent != lXid);
+    CHECK(0 == memcmp(g_aTx[0] + MAC_OFFSET_DESTINATION, BROADCAST_MAC, 6));
+    CHECK(*g_nic.ipv4.GetIp() == OFFERED_IP); //Address used until lease expires
+    Wait(449000);
+    CHECK(DHCP_REBINDING == g_nic.ipv4.GetDhcpStatus());
+    Wait(1000);
+    CHECK(DHCP_DISCOVERY == g_nic.ipv4.GetDhcpStatus());
+    CHECK(g_nic.ipv4.GetIp()->IsNull());
+    ConfigureStatic();
+}
+
+/** DHCP INIT-REBOOT: stored lease confirmed, refused, used when no server answers and ignored when corrupt */
+static void TestDhcpReboot(const char* sLeaseFile)
+{
+    g_sTest = "DHCP reboot";
+    uint32_t lXid = StartDhcp();
+    InjectDhcp(lXid, DHCP_TYPE_OFFER);
+    InjectDhcp(lXid, DHCP_TYPE_ACK);
+    CHECK(DHCP_BOUND == g_nic.ipv4.GetDhcpStatus());
+
+    //Stored lease is confirmed by a broadcast request without server identifier
+    ClearTx();
+    g_nic.ipv4.ConfigureDhcp();
+    CHECK(DHCP_REBOOTING == g_nic.ipv4.GetDhcpStatus());
+    CHECK(g_nic.ipv4.GetIp()->IsNull()); //Not used until acknowledged
+    CHECK(1 == g_nTxCount && IsDhcp(0, DHCP_TYPE_REQUEST, lXid));
+    CHECK(0 == memcmp(g_aTx[0] + MAC_OFFSET_DESTINATION, BROADCAST_MAC, 6));
+    const byte* pRequested = FindDhcpOption(g_aTx[0], DHCP_OPTION_REQ_IP);
+    CHECK(pRequested && 0 == memcmp(pRequested, OFFERED_IP, 4));
+    CHECK(NULL == FindDhcpOption(g_aTx[0], DHCP_OPTION_SERVER));
+    InjectDhcp(lXid, DHCP_TYPE_ACK);
+    CHECK(DHCP_BOUND == g_nic.ipv4.GetDhcpStatus());
+    CHECK(*g_nic.ipv4.GetIp() == OFFERED_IP);
+
+    //No server answers so unexpired lease is used
+    ClearTx();
+    g_nic.ipv4.ConfigureDhcp();
+    for(byte nWait = 0; nWait < 2 * DHCP_REQUEST_RETRIES && DHCP_REBOOTING == g_nic.ipv4.GetDhcpStatus(); ++nWait)
+        Wait(DHCP_RETRY_MAX + 1000);
+    CHECK(DHCP_BOUND == g_nic.ipv4.GetDhcpStatus());
+    CHECK(*g_nic.ipv4.GetIp() == OFFERED_IP);
+
+    //NAK forgets lease and discovers
+    ClearTx();
+    g_nic.ipv4.ConfigureDhcp();
+    CHECK(IsDhcp(0, DHCP_TYPE_REQUEST, lXid));
+    ClearTx();
+    InjectDhcp(lXid, DHCP_TYPE_NAK);
+    CHECK(DHCP_DISCOVERY == g_nic.ipv4.GetDhcpStatus());
+    CHECK(IsDhcp(0, DHCP_TYPE_DISCOVER, lXid));
+    ClearTx();
+    g_nic.ipv4.ConfigureDhcp();
+    CHECK(IsDhcp(0, DHCP_TYPE_DISCOVER, lXid));
+
+    //Corrupt lease is ignored
+    InjectDhcp(lXid, DHCP_TYPE_OFFER);
+    InjectDhcp(lXid, DHCP_TYPE_ACK);
+    CHECK(DHCP_BOUND == g_nic.ipv4.GetDhcpStatus());
+    FILE* pFile = fopen(sLeaseFile, "r+b");
+    CHECK(NULL != pFile);
+    if(pFile)
+    {
+        fseek(pFile, 6, SEEK_SET);
+        fputc(0x55, pFile);
+        fclose(pFile);
+    }
+    ClearTx();
+    g_nic.ipv4.ConfigureDhcp();
+    CHECK(IsDhcp(0, DHCP_TYPE_DISCOVER, lXid));
+    ConfigureStatic();
+}
+
+/** @brief  Check IPV4 header of a sent frame
+*   @param  nFrame Index of sent frame
+*   @param  pDestinationMac Expected destination MAC
+*   @param  pSourceIp Expected source IP
+*   @param  pDestinationIp Expected destination IP
+*   @return <i>bool</i> True if header matches and its checksum is valid
+*/
+static bool IsIpv4Header(byte nFrame, const byte* pDestinationMac, const byte* pSourceIp, const byte* pDestinationIp)
+{
+    const byte* pIp = g_aTx[nFrame] + MAC_HEADER_SIZE;
+    return nFrame < g_nTxCount && ETHTYPE_IPV4 == GetWord(g_aTx[nFrame] + MAC_OFFSET_TYPE)
+        && 0 == memcmp(g_aTx[nFrame] + MAC_OFFSET_DESTINATION, pDestinationMac, 6)
+        && 0 == memcmp(g_aTx[nFrame] + MAC_OFFSET_SOURCE, LOCAL_MAC, 6)
+        && 0x45 == pIp[IPV4_OFFSET_VERSION]
+        && 0 == memcmp(pIp + IPV4_OFFSET_SOURCE, pSourceIp, 4)
+        && 0 == memcmp(pIp + IPV4_OFFSET_DESTINATION, pDestinationIp, 4)
+        && 0xFFFF == Fold(Sum(pIp, IPV4_HEADER_SIZE));
+}
+
+/** Header cache: more destinations than entries, changed MAC and changed local address */
+static void TestHeaderCache()
+{
+    g_sTest = "Header cache";
+    byte pIp[4] = {10, 0, 0, 20};
+    byte pMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x20};
+    //Each host is resolved by its own ARP request then sent two frames, cycling through more hosts than cache entries
+    for(byte nPass = 0; nPass < 2; ++nPass)
+    {
+        for(byte nHost = 0; nHost < IPV4_HEADER_CACHE_SIZE + 2; ++nHost)
+        {
+            pIp[3] = pMac[5] = 20 + nHost;
+            InjectArp(LOCAL_MAC, ARP_REQUEST, pMac, pIp, LOCAL_IP);
+            ClearTx();
+            SendIpv4(pIp);
+            SendIpv4(pIp);
+            CHECK(2 == g_nTxCount);
+            CHECK(IsIpv4Header(0, pMac, LOCAL_IP, pIp) && IsIpv4Header(1, pMac, LOCAL_IP, pIp));
+            CHECK(IP_PROTOCOL_UDP == g_aTx[0][MAC_HEADER_SIZE + IPV4_OFFSET_PROTOCOL]);
+            CHECK(IPV4_HEADER_SIZE + 4 == GetWord(g_aTx[0] + MAC_HEADER_SIZE + IPV4_OFFSET_LENGTH));
+            CHECK(GetWord(g_aTx[0] + MAC_HEADER_SIZE + IPV4_OFFSET_ID) + 1 == GetWord(g_aTx[1] + MAC_HEADER_SIZE + IPV4_OFFSET_ID));
+        }
+    }
+
+    //Host changes MAC - cached header takes MAC from ARP cache
+    pIp[3] = 20;
+    InjectArp(LOCAL_MAC, ARP_REPLY, OTHER_MAC, pIp, LOCAL_IP);
+    ClearTx();
+    SendIpv4(pIp);
+    CHECK(IsIpv4Header(0, OTHER_MAC, LOCAL_IP, pIp));
+
+    //Local address changes - cached header is rebuilt
+    Ipv4Address ip(OFFERED_IP);
+    g_nic.ipv4.ConfigureStaticIp(&ip);
+    ClearTx();
+    SendIpv4(pIp);
+    CHECK(IsIpv4Header(0, OTHER_MAC, OFFERED_IP, pIp));
+    ConfigureStatic();
+    ClearTx();
+    SendIpv4(pIp);
+    CHECK(IsIpv4Header(0, OTHER_MAC, LOCAL_IP, pIp));
+}
+
+/** ICMP: echo request is answered with valid reply. Corrupt request or IPV4 header is dropped */
+static void TestIcmp()
+{
+    g_sTest = "ICMP";
+    byte pIcmp[ICMP_HEADER_SIZE + 5] = {ICMP_TYPE_ECHOREQUEST, 0, 0, 0, 0x12, 0x34, 0x00, 0x01, 'h', 'e', 'l', 'l', 'o'};
+    PutWord(pIcmp + ICMP_OFFSET_CHECKSUM, ~Fold(Sum(pIcmp, sizeof(pIcmp))));
+    ClearTx();
+    InjectIpv4(LOCAL_MAC, LOCAL_IP, IP_PROTOCOL_ICMP, pIcmp, sizeof(pIcmp));
+    CHECK(1 == g_nTxCount);
+    const byte* pIp = g_aTx[0] + MAC_HEADER_SIZE;
+    CHECK(IsIpv4Header(0, REMOTE_MAC, LOCAL_IP, REMOTE_IP));
+    CHECK(ICMP_TYPE_ECHOREPLY == pIp[IPV4_HEADER_SIZE + ICMP_OFFSET_TYPE]);
+    CHECK(0xFFFF == Fold(Sum(pIp + IPV4_HEADER_SIZE, sizeof(pIcmp))));
+    CHECK(0 == memcmp(pIp + IPV4_HEADER_SIZE + ICMP_OFFSET_TYPE + 4, pIcmp + 4, sizeof(pIcmp) - 4));
+
+    NetStats stats;
+    g_nic.GetStats(stats);
+    pIcmp[ICMP_HEADER_SIZE] ^= 0x01;
+    ClearTx();
+    InjectIpv4(LOCAL_MAC, LOCAL_IP, IP_PROTOCOL_ICMP, pIcmp, sizeof(pIcmp));
+    CHECK(0 == g_nTxCount);
+    uint16_t nDrops = stats.aDrop[STATS_DROP_ICMP_CHECKSUM];
+    g_nic.GetStats(stats);
+    CHECK(nDrops + 1 == stats.aDrop[STATS_DROP_ICMP_CHECKSUM]);
+
+    //Request with corrupt IPV4 header checksum
+    pIcmp[ICMP_HEADER_SIZE] ^= 0x01;
+    byte pFrame[60] = {0};
+    memcpy(pFrame + MAC_OFFSET_DESTINATION, LOCAL_MAC, 6);
+    memcpy(pFrame + MAC_OFFSET_SOURCE, REMOTE_MAC, 6);
+    PutWord(pFrame + MAC_OFFSET_TYPE, ETHTYPE_IPV4);
+    byte* pHeader = pFrame + MAC_HEADER_SIZE;
+    pHeader[IPV4_OFFSET_VERSION] = 0x45;
+    PutWord(pHeader + IPV4_OFFSET_LENGTH, IPV4_HEADER_SIZE + sizeof(pIcmp));
+    pHeader[IPV4_OFFSET_TTL] = 64;
+    pHeader[IPV4_OFFSET_PROTOCOL] = IP_PROTOCOL_ICMP;
+    memcpy(pHeader + IPV4_OFFSET_SOURCE, REMOTE_IP, 4);
+    memcpy(pHeader + IPV4_OFFSET_DESTINATION, LOCAL_IP, 4);
+    PutWord(pHeader + IPV4_OFFSET_CHECKSUM, ~Fold(Sum(pHeader, IPV4_HEADER_SIZE)) ^ 0x0100);
+    memcpy(pHeader + IPV4_HEADER_SIZE, pIcmp, sizeof(pIcmp));
+    nDrops = stats.aDrop[STATS_DROP_IP_CHECKSUM];
+    ClearTx();
+    g_nic.GetNic()->RxInject(pFrame, sizeof(pFrame));
+    g_nic.Process();
+    CHECK(0 == g_nTxCount);
+    g_nic.GetStats(stats);
+    CHECK(nDrops + 1 == stats.aDrop[STATS_DROP_IP_CHECKSUM]);
+}
+
+/** Transmit checksums: UDP and ICMP checksums completed from running sum with odd lengths and offsets */
+static void TestTxChecksum()
+{
+    g_sTest = "Transmit checksum";
+    Ipv4Address ip(REMOTE_IP);
+    byte pOdd[] = {'a', 'b', 'c'};
+    ClearTx();
+    g_nic.ipv4.TxBegin(&ip, IP_PROTOCOL_UDP);
+    g_nic.ipv4.TxAppendWord(1234); //Source port
+    g_nic.ipv4.TxAppendWord(5678); //Destination port
+    g_nic.ipv4.TxAppendWord(0); //Length placeholder
+    g_nic.ipv4.TxAppendWord(0); //Checksum
+    g_nic.ipv4.TxAppend(pOdd, sizeof(pOdd));
+    g_nic.ipv4.TxAppendFill(0x5A, 3); //Starts at odd offset
+    g_nic.ipv4.TxAppendByte(0x07);
+    g_nic.ipv4.TxAppendByte(0); //Placeholder at odd offset
+    g_nic.ipv4.TxWriteByte(UDP_HEADER_SIZE + 7, 0xC3);
+    g_nic.ipv4.TxWriteWord(UDP_OFFSET_LENGTH, UDP_HEADER_SIZE + 8);
+    g_nic.ipv4.TxEnd();
+    CHECK(1 == g_nTxCount);
+    const byte* pIp = g_aTx[0] + MAC_HEADER_SIZE;
+    CHECK(IsIpv4Header(0, REMOTE_MAC, LOCAL_IP, REMOTE_IP));
+    CHECK(IPV4_HEADER_SIZE + UDP_HEADER_SIZE + 8 == GetWord(pIp + IPV4_OFFSET_LENGTH));
+    CHECK(UDP_HEADER_SIZE + 8 == GetWord(pIp + IPV4_HEADER_SIZE + UDP_OFFSET_LENGTH));
+    CHECK(0x5A == pIp[IPV4_HEADER_SIZE + UDP_HEADER_SIZE + 5] && 0xC3 == pIp[IPV4_HEADER_SIZE + UDP_HEADER_SIZE + 7]);
+    CHECK(0 != GetWord(pIp + IPV4_HEADER_SIZE + UDP_OFFSET_CHECKSUM));
+    CHECK(0xFFFF == SumTransport(pIp));
+
+    //Writes replace non-zero bytes in running sum and include bytes skipped beyond end of payload
+    for(byte nSlot = 0; nSlot < 2; ++nSlot)
+    {
+        //Leave stale data in transmit memory to be skipped
+        g_nic.ipv4.TxBegin(&ip, IP_PROTOCOL_UDP);
+        g_nic.ipv4.TxAppendFill(0xEE, UDP_HEADER_SIZE + 16);
+        g_nic.ipv4.TxEnd();
+    }
+    ClearTx();
+    g_nic.ipv4.TxBegin(&ip, IP_PROTOCOL_UDP);
+    g_nic.ipv4.TxAppendWord(1234);
+    g_nic.ipv4.TxAppendWord(5678);
+    g_nic.ipv4.TxAppendWord(0xABCD); //Non-zero length placeholder
+    g_nic.ipv4.TxAppendWord(0);
+    g_nic.ipv4.TxAppend(pOdd, sizeof(pOdd));
+    g_nic.ipv4.TxWrite(UDP_HEADER_SIZE + 1, (byte*)"yz", 2); //Odd offset
+    g_nic.ipv4.TxWriteByte(UDP_HEADER_SIZE + 6, 0x81); //Skips 3 bytes
+    g_nic.ipv4.TxWriteWord(UDP_OFFSET_LENGTH, UDP_HEADER_SIZE + 7);
+    g_nic.ipv4.TxEnd();
+    CHECK(1 == g_nTxCount);
+    CHECK(IPV4_HEADER_SIZE + UDP_HEADER_SIZE + 7 == GetWord(pIp + IPV4_OFFSET_LENGTH));
+    CHECK(0 == memcmp(pIp + IPV4_HEADER_SIZE + UDP_HEADER_SIZE, "ayz", 3) && 0x81 == pIp[IPV4_HEADER_SIZE + UDP_HEADER_SIZE + 6]);
+    CHECK(0xEE == pIp[IPV4_HEADER_SIZE + UDP_HEADER_SIZE + 4]);
+    CHECK(0xFFFF == SumTransport(pIp));
+
+    //ICMP checksum excludes pseudo-header
+    ClearTx();
+    g_nic.ipv4.TxBegin(&ip, IP_PROTOCOL_ICMP);
+    g_nic.ipv4.TxAppendByte(ICMP_TYPE_ECHOREQUEST);
+    g_nic.ipv4.TxAppendFill(0, 3); //Code and checksum
+    g_nic.ipv4.TxAppendWord(0x1234); //Identifier
+    g_nic.ipv4.TxAppendWord(1); //Sequence
+    g_nic.ipv4.TxAppend(pOdd, sizeof(pOdd));
+    g_nic.ipv4.TxEnd();
+    CHECK(1 == g_nTxCount);
+    CHECK(0xFFFF == Fold(Sum(pIp + IPV4_HEADER_SIZE, ICMP_HEADER_SIZE + sizeof(pOdd))));
+}
+
+/** Checksum library: selected implementation matches reference sum for all lengths and alignments */
+static void TestChecksumLibrary()
+{
+    g_sTest = "Checksum library";
+    byte pData[1600];
+    for(uint16_t nIndex = 0; nIndex < sizeof(pData); ++nIndex)
+        pData[nIndex] = (nIndex * 151 + 7) ^ (nIndex >> 3);
+    memset(pData + 100, 0xFF, 200); //Forces carries
+    bool bMatch = true;
+    for(uint16_t nLen = 0; nLen < 300; ++nLen)
+        for(uint16_t nAlign = 0; nAlign < 4; ++nAlign)
+            if(Checksum::Add(pData + nAlign, nLen, 0x1FFFF) != Fold(Sum(pData + nAlign, nLen, 0x1FFFF))
+                || Checksum::AddGeneric(pData + nAlign, nLen) != Fold(Sum(pData + nAlign, nLen)))
+                bMatch = false;
+    CHECK(bMatch);
+    CHECK(Checksum::Add(pData + 1, 1500) == Fold(Sum(pData + 1, 1500)));
+    CHECK(Checksum::Add(pData + 64, 1000, Checksum::Add(pData, 64)) == Fold(Sum(pData, 1064)));
+    //Valid checksum sums to zero
+    byte pHeader[] = {0x45, 0, 0, 28, 0, 1, 0, 0, 64, 17, 0, 0, 10, 0, 0, 2, 10, 0, 0, 9};
+    PutWord(pHeader + IPV4_OFFSET_CHECKSUM, Checksum::Get(pHeader, sizeof(pHeader)));
+    CHECK(0 == Checksum::Get(pHeader, sizeof(pHeader)));
+}
+
+static char g_sUdpRx[64]; //!< Payload of last datagram passed to handler
+static uint16_t g_nUdpPort = 0; //!< Local port of last datagram passed to handler
+
+static byte g_pViewRead[6]; //!< Bytes read by RxView test handler
+static uint32_t g_lViewLong = 0; //!< Long read by RxView test handler
+static bool g_bViewOverrun = false; //!< Overrun state of RxView test handler after reading past end
+
+static void HandleUdp(uint16_t nPort, RxView& view)
+{
+    g_nUdpPort = nPort;
+    uint16_t nLen = view.Read((byte*)g_sUdpRx, sizeof(g_sUdpRx) - 1);
+    g_sUdpRx[nLen] = 0;
+    byte pReply[] = {'a', 'c', 'k'};
+    g_nic.ipv4.udp.Send(pReply, sizeof(pReply), NULL, g_nic.ipv4.udp.GetRemotePort(), nPort);
+}
+
+static void HandleUdpView(uint16_t nPort, RxView& view)
+{
+    //Interleave reads by copies of a view - each must read its own position
+    RxView copy = view;
+    view.Read(g_pViewRead, 2);
+    copy.Seek(6);
+    copy.Read(g_pViewRead + 2, 2);
+    view.Read(g_pViewRead + 4, 2);
+    g_lViewLong = view.GetLong(1);
+    g_bViewOverrun = view.IsOverrun();
+    view.GetWord(view.GetLength() - 1); //Straddles end of payload
+    g_bViewOverrun = !g_bViewOverrun && view.IsOverrun() && 0 == view.GetByte(view.GetLength());
+}
+
+/** UDP: valid, corrupt, zero checksum, bad length and unlistened datagrams. Listeners sharing a hash bucket */
+static void TestUdp()
+{
+    g_sTest = "UDP";
+    const uint16_t PORT = 5000;
+    const uint16_t PORT_SAME_BUCKET = PORT + UDP_HASH_SIZE; //Differs only above hash bits
+    CHECK(g_nic.ipv4.udp.Listen(PORT, HandleUdp));
+    CHECK(g_nic.ipv4.udp.Listen(PORT_SAME_BUCKET, HandleUdp));
+    NetStats stats;
+    g_nic.GetStats(stats, true);
+
+    g_sUdpRx[0] = 0;
+    ClearTx();
+    InjectUdp(PORT, "hello world");
+    CHECK(0 == strcmp(g_sUdpRx, "hello world") && PORT == g_nUdpPort);
+    CHECK(1 == g_nTxCount);
+    const byte* pIp = g_aTx[0] + MAC_HEADER_SIZE;
+    CHECK(IP_PROTOCOL_UDP == pIp[IPV4_OFFSET_PROTOCOL]);
+    CHECK(0xFFFF == SumTransport(pIp));
+    CHECK(PORT == GetWord(pIp + IPV4_HEADER_SIZE + UDP_OFFSET_SOURCE_PORT));
+    CHECK(12345 == GetWord(pIp + IPV4_HEADER_SIZE + UDP_OFFSET_DESTINATION_PORT));
+    CHECK(UDP_HEADER_SIZE + 3 == GetWord(pIp + IPV4_HEADER_SIZE + UDP_OFFSET_LENGTH));
+    CHECK(0 == memcmp(pIp + IPV4_HEADER_SIZE + UDP_HEADER_SIZE, "ack", 3));
+
+    InjectUdp(PORT_SAME_BUCKET, "chained");
+    CHECK(0 == strcmp(g_sUdpRx, "chained") && PORT_SAME_BUCKET == g_nUdpPort);
+
+    g_sUdpRx[0] = 0;
+    ClearTx();
+    InjectUdp(PORT, "corrupt", true);
+    CHECK(0 == g_sUdpRx[0] && 0 == g_nTxCount);
+    InjectUdp(PORT, "zero", false, true);
+    CHECK(0 == strcmp(g_sUdpRx, "zero"));
+    g_sUdpRx[0] = 0;
+    InjectUdp(PORT, "long", false, false, 1); //UDP length exceeds IPV4 payload
+    InjectUdp(PORT, "short", false, false, -6); //UDP length less than header
+    CHECK(0 == g_sUdpRx[0]);
+    InjectUdp(PORT + 1, "nobody");
+    CHECK(0 == g_sUdpRx[0]);
+    g_nic.GetStats(stats);
+    CHECK(1 == stats.aDrop[STATS_DROP_UDP_CHECKSUM]);
+    CHECK(2 == stats.aDrop[STATS_DROP_UDP_LENGTH]);
+    CHECK(1 == stats.aDrop[STATS_DROP_UDP_PORT]);
+
+    //Removing one listener of a bucket leaves the other reachable
+    CHECK(g_nic.ipv4.udp.Listen(PORT, NULL));
+    InjectUdp(PORT, "removed");
+    CHECK(0 == g_sUdpRx[0]);
+    InjectUdp(PORT_SAME_BUCKET, "still");
+    CHECK(0 == strcmp(g_sUdpRx, "still"));
+
+    //Table full
+    for(uint16_t nPort = 1; nPort < UDP_LISTENERS; ++nPort)
+        CHECK(g_nic.ipv4.udp.Listen(6000 + nPort, HandleUdp));
+    CHECK(!g_nic.ipv4.udp.Listen(7000, HandleUdp));
+    for(uint16_t nPort = 1; nPort < UDP_LISTENERS; ++nPort)
+        g_nic.ipv4.udp.Listen(6000 + nPort, NULL);
+    g_nic.ipv4.udp.Listen(PORT_SAME_BUCKET, NULL);
+
+    //Zero-copy view: copies track their own position, field reads are bounded
+    CHECK(g_nic.ipv4.udp.Listen(PORT, HandleUdpView));
+    InjectUdp(PORT, "hello world");
+    CHECK(0 == memcmp(g_pViewRead, "hewoll", 6));
+    CHECK(0x656C6C6F == g_lViewLong); //"ello"
+    CHECK(g_bViewOverrun);
+    g_nic.ipv4.udp.Listen(PORT, NULL);
+}
+
+static char g_sTcpRx[64]; //!< Payload of last segment passed to handler
+static char g_sRawRx[8]; //!< Start of payload of last frame passed to RAW socket handler
+
+static void HandleTcp(Socket* pSocket, RxView& view)
+{
+    uint16_t nLen = view.Read((byte*)g_sTcpRx, sizeof(g_sTcpRx) - 1);
+    g_sTcpRx[nLen] = 0;
+}
+
+static void HandleRaw(Socket* pSocket, RxView& view)
+{
+    view.Read((byte*)g_sRawRx, sizeof(g_sRawRx) - 1);
+    g_sRawRx[sizeof(g_sRawRx) - 1] = 0;
+}
+
+/** @brief  Get TCP header of a sent frame, checking its checksum
+*   @param  nFrame Index of sent frame
+*   @return <i>const byte*</i> Pointer to TCP header
+*/
+static const byte* GetTcp(byte nFrame)
+{
+    const byte* pIp = g_aTx[nFrame] + MAC_HEADER_SIZE;
+    CHECK(IP_PROTOCOL_TCP == pIp[IPV4_OFFSET_PROTOCOL]);
+    CHECK(0xFFFF == SumTransport(pIp));
+    return pIp + IPV4_HEADER_SIZE;
+}
+
+/** Sockets: TCP passive open, data, remote close, resets and handshake timeout. RAW socket claims EtherType from DoProcess */
+static void TestSockets()
+{
+    g_sTest = "TCP";
+    Socket server(AF_INET, &g_nic, PROTO_TCP);
+    CHECK(server.Listen(80, HandleTcp));
+    CHECK(SOCK_LISTEN == server.GetStatus());
+
+    ClearTx();
+    InjectTcp(80, 1000, 0, TCP_FLAG_SYN);
+    CHECK(1 == g_nTxCount);
+    const byte* pTcp = GetTcp(0);
+    CHECK((TCP_FLAG_SYN | TCP_FLAG_ACK) == pTcp[TCP_OFFSET_FLAGS]);
+    CHECK(1001 == GetLong(pTcp + TCP_OFFSET_ACKNOWLEDGE));
+    CHECK(80 == GetWord(pTcp + TCP_OFFSET_SOURCE_PORT) && 40000 == GetWord(pTcp + TCP_OFFSET_DESTINATION_PORT));
+    uint32_t lSequence = GetLong(pTcp + TCP_OFFSET_SEQUENCE) + 1;
+
+    ClearTx();
+    InjectTcp(80, 1001, lSequence, TCP_FLAG_ACK);
+    CHECK(server.IsConnected());
+    CHECK(0 == g_nTxCount);
+
+    InjectTcp(80, 1001, lSequence, TCP_FLAG_ACK | TCP_FLAG_PSH, "hello");
+    CHECK(0 == strcmp(g_sTcpRx, "hello"));
+    CHECK(1 == g_nTxCount);
+    pTcp = GetTcp(0);
+    CHECK(TCP_FLAG_ACK == pTcp[TCP_OFFSET_FLAGS]);
+    CHECK(1006 == GetLong(pTcp + TCP_OFFSET_ACKNOWLEDGE));
+
+    //Closed port and busy socket are reset. Reset is not answered
+    NetStats stats;
+    g_nic.GetStats(stats, true);
+    ClearTx();
+    InjectTcp(81, 1006, 5000, TCP_FLAG_ACK, "x");
+    CHECK(1 == g_nTxCount);
+    pTcp = GetTcp(0);
+    CHECK(TCP_FLAG_RST == pTcp[TCP_OFFSET_FLAGS] && 5000 == GetLong(pTcp + TCP_OFFSET_SEQUENCE));
+    CHECK(81 == GetWord(pTcp + TCP_OFFSET_SOURCE_PORT) && 40000 == GetWord(pTcp + TCP_OFFSET_DESTINATION_PORT));
+    ClearTx();
+    InjectTcp(81, 2000, 0, TCP_FLAG_SYN);
+    CHECK(1 == g_nTxCount);
+    pTcp = GetTcp(0);
+    CHECK((TCP_FLAG_RST | TCP_FLAG_ACK) == pTcp[TCP_OFFSET_FLAGS] && 2001 == GetLong(pTcp + TCP_OFFSET_ACKNOWLEDGE));
+    ClearTx();
+    InjectTcp(80, 3000, 0, TCP_FLAG_SYN, "", 40001); //Socket busy with connection from port 40000
+    CHECK(1 == g_nTxCount);
+    pTcp = GetTcp(0);
+    CHECK((TCP_FLAG_RST | TCP_FLAG_ACK) == pTcp[TCP_OFFSET_FLAGS] && 40001 == GetWord(pTcp + TCP_OFFSET_DESTINATION_PORT));
+    CHECK(server.IsConnected());
+    ClearTx();
+    InjectTcp(81, 1006, 0, TCP_FLAG_RST);
+    CHECK(0 == g_nTxCount);
+    g_nic.GetStats(stats);
+    CHECK(4 == stats.aDrop[STATS_DROP_TCP_PORT]);
+
+    ClearTx();
+    InjectTcp(80, 1006, lSequence, TCP_FLAG_ACK | TCP_FLAG_FIN);
+    CHECK(SOCK_LAST_ACK == server.GetStatus());
+    CHECK(1 == g_nTxCount);
+    pTcp = GetTcp(0);
+    CHECK((TCP_FLAG_FIN | TCP_FLAG_ACK) == pTcp[TCP_OFFSET_FLAGS]);
+    CHECK(1007 == GetLong(pTcp + TCP_OFFSET_ACKNOWLEDGE));
+    InjectTcp(80, 1007, lSequence + 1, TCP_FLAG_ACK);
+    CHECK(SOCK_LISTEN == server.GetStatus());
+
+    //Handshake without final acknowledgement is abandoned so listener accepts another connection
+    ClearTx();
+    InjectTcp(80, 4000, 0, TCP_FLAG_SYN);
+    CHECK(SOCK_SYN_RECEIVED == server.GetStatus());
+    lSequence = GetLong(GetTcp(0) + TCP_OFFSET_SEQUENCE) + 1;
+    ClearTx();
+    AdvanceClock(TCP_HANDSHAKE_TIMEOUT - 1);
+    g_nic.Process();
+    CHECK(SOCK_SYN_RECEIVED == server.GetStatus() && 0 == g_nTxCount);
+    AdvanceClock(1);
+    g_nic.Process();
+    CHECK(SOCK_LISTEN == server.GetStatus());
+    CHECK(1 == g_nTxCount && (TCP_FLAG_RST | TCP_FLAG_ACK) == GetTcp(0)[TCP_OFFSET_FLAGS]);
+    ClearTx();
+    InjectTcp(80, 5000, 0, TCP_FLAG_SYN, "", 40002);
+    CHECK(SOCK_SYN_RECEIVED == server.GetStatus() && 1 == g_nTxCount);
+    server.Close();
+
+    g_sTest = "UDP socket";
+    Socket udp(AF_INET, &g_nic, PROTO_UDP);
+    CHECK(g_nic.ipv4.udp.Listen(5000, HandleUdp));
+    CHECK(!udp.Listen(5000)); //Port held by ipv4.udp listener
+    CHECK(udp.Listen(6000));
+    CHECK(!g_nic.ipv4.udp.Listen(6000, HandleUdp)); //Port held by socket
+    g_nic.ipv4.udp.Listen(5000, NULL);
+    CHECK(udp.Listen(5000));
+    udp.Close();
+    CHECK(g_nic.ipv4.udp.Listen(6000, HandleUdp));
+    g_nic.ipv4.udp.Listen(6000, NULL);
+
+    g_sTest = "RAW socket";
+    byte pFrame[60] = {0};
+    memcpy(pFrame + MAC_OFFSET_DESTINATION, LOCAL_MAC, 6);
+    memcpy(pFrame + MAC_OFFSET_SOURCE, REMOTE_MAC, 6);
+    PutWord(pFrame + MAC_OFFSET_TYPE, 0x88B5);
+    memcpy(pFrame + MAC_HEADER_SIZE, "payload", 7);
+    Socket raw(AF_PACKET, &g_nic, PROTO_RAW);
+    CHECK(raw.Listen(0x88B5, HandleRaw));
+    g_nic.nDoProcessType = 0;
+    g_nic.GetNic()->RxInject(pFrame, sizeof(pFrame));
+    g_nic.Process();
+    CHECK(0 == strcmp(g_sRawRx, "payload"));
+    CHECK(0 == g_nic.nDoProcessType);
+    raw.Close();
+    g_nic.GetNic()->RxInject(pFrame, sizeof(pFrame));
+    g_nic.Process();
+    CHECK(0x88B5 == g_nic.nDoProcessType); //No RAW socket so offered to DoProcess
+}
+
+#if TRACE_SIZE
+/** Trace: events recorded in order, oldest overwritten when ring is full */
+static void TestTrace()
+{
+    g_sTest = "Trace";
+    Trace::Clear();
+    InjectArp(BROADCAST_MAC, ARP_REQUEST, REMOTE_MAC, REMOTE_IP, LOCAL_IP);
+    bool bRequest = false, bReply = false;
+    for(byte nIndex = 0; nIndex < Trace::GetCount(); ++nIndex)
+    {
+        const TraceRecord& record = Trace::GetRecord(nIndex);
+        if(TRACE_ARP_REQUEST == record.nEvent)
+            bRequest = (GetWord(REMOTE_IP) == record.nArg1 && GetWord(REMOTE_IP + 2) == record.nArg2);
+        else if(TRACE_ARP_REPLY_TX == record.nEvent)
+            bReply = bRequest; //Reply follows request
+    }
+    CHECK(bRequest && bReply);
+
+    Trace::Clear();
+    for(uint16_t nRecord = 0; nRecord < TRACE_SIZE + 3; ++nRecord)
+        TRACE(TRACE_NONE, nRecord, 0);
+    CHECK(TRACE_SIZE == Trace::GetCount());
+    CHECK(3 == Trace::GetRecord(0).nArg1);
+    CHECK(TRACE_SIZE + 2 == Trace::GetRecord(TRACE_SIZE - 1).nArg1);
+    Trace::Clear();
+    CHECK(0 == Trace::GetCount());
+}
+#endif // TRACE_SIZE
+
+int main()
+{
+    char sLeaseFile[] = "/tmp/hosttests-lease-XXXXXX";
+    int nLeaseFile = mkstemp(sLeaseFile);
+    if(nLeaseFile < 0)
+    {
+        printf("Cannot create lease file\n");
+        return 1;
+    }
+    close(nLeaseFile);
+    g_nic.ipv4.GetLeaseStore().SetPath(sLeaseFile);
+    g_nic.Initialise(MacAddress(LOCAL_MAC));
+    g_nic.GetNic()->SetTxHandler(HandleTx);
+    Ipv4Address ip(LOCAL_IP), mask(NETMASK);
+    g_nic.ipv4.ConfigureStaticIp(&ip, NULL, NULL, &mask);
+    TestArpCache();
+    TestArp();
+    TestArpQueue();
+    TestTxRing();
+    TestRxTelemetry();
+    TestInterrupt();
+    TestBudget();
+    TestRxFilter();
+    TestStats();
+    TestDhcp();
+    TestDhcpLease();
+    TestDhcpReboot(sLeaseFile);
+    TestHeaderCache();
+    TestIcmp();
+    TestTxChecksum();
+    TestChecksumLibrary();
+    TestUdp();
+    TestSockets();
+    #if TRACE_SIZE
+    TestTrace();
+    #endif // TRACE_SIZE
+    remove(sLeaseFile);
+    printf("%u failures\n", g_nFailures);
+    return g_nFailures ? 1 : 0;
+}
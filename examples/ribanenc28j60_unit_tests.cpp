@@ -52,10 +52,14 @@ void loop()
                 Serial.print("Test NIC initialised - ");
                 Serial.println(TestInitialised()?"Pass":"Fail");
                 break;
+            #if TRACE_SIZE
+            case 't':
+                Trace::Dump(); //Decode on PC with tracedecode
+                break;
+            #endif // TRACE_SIZE
             case 'p':
                 {
-                    byte pIp[] = {192,168,0,6};
-                    Address addressIp(ADDR_TYPE_IPV4, pIp);
+                    Ipv4Address addressIp{192,168,0,6};
                     g_nPingSequence = g_nic.ipv4.Ping(&addressIp, HandleEchoResponse);
                     Serial.println(F("Ping sent to 192.168.0.6"));
                     g_nTime = millis();
@@ -67,8 +71,7 @@ void loop()
                 break;
             case 's':
                 {
-                    byte pBroadcast[] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
-                    Address addressMac(ADDR_TYPE_MAC, pBroadcast);
+                    MacAddress addressMac{0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
                     byte pHeader[] = {0x00,0x00,0x03}; //LLC U-frame
                     byte pBuffer[] = {'H','e','l','l','o',' ','A','r','d','u','i','n','o'};
                     g_nic.TxBegin(&addressMac, 3 + sizeof(pBuffer)); //Start Tx, setting broadcast destination and raw Ethernet packet size 13
@@ -79,17 +82,15 @@ void loop()
                 break;
             case 'u':
                 {
-                    byte pBroadcast[] = {255,255,255,255};
-                    Address addressBroadcast(ADDR_TYPE_IPV4, pBroadcast);
+                    Ipv4Address addressBroadcast{255,255,255,255};
                     byte pBuffer[] = {'H','e','l','l','o',' ','A','r','d','u','i','n','o'};
                     g_nic.ipv4.TxBegin(&addressBroadcast, IP_PROTOCOL_UDP);
                     byte pUdpHeader[] = {0x00,0x10,0x00,0x10,0x00,0x00,0x00,0x00};
                     g_nic.ipv4.TxAppend(pUdpHeader, sizeof(pUdpHeader));
                     uint16_t nLen = 8 + sizeof(pBuffer);
-                    g_nic.ipv4.TxWrite(4, nLen);
+                    g_nic.ipv4.TxWriteWord(UDP_OFFSET_LENGTH, nLen);
                     g_nic.ipv4.TxAppend(pBuffer, sizeof(pBuffer));
-                    g_nic.ipv4.TxEnd();
-                    //!@todo Sending UDP sets wrong CRC value
+                    g_nic.ipv4.TxEnd(); //UDP checksum is completed by TxEnd
                 }
 //                Socket socket(&nic, SOCK_UDP);
 //
@@ -113,6 +114,9 @@ void ShowMenu()
     Serial.println(F("r - Toggle display of recieved packets"));
     Serial.println(F("s - Send raw Ethernet broadcast with content 'Hello Arduino'"));
     Serial.println(F("u - Send UDP broadcast with content 'Hello Arduino'"));
+    #if TRACE_SIZE
+    Serial.println(F("t - Dump trace"));
+    #endif // TRACE_SIZE
 }
 
 bool TestAddress()
@@ -298,13 +302,49 @@ bool TestAddress()
     bSuccess = (ADDR_TYPE_IPV6 == addressIPV6.GetType());
     Serial.println(bSuccess?"Pass":"Fail");
     bResult &= bSuccess;
+
+    Serial.print(F("Typed MAC from literal - "));
+    constexpr MacAddress addressMacLiteral{0x12,0x34,0x56,0x78,0x9A,0xBC};
+    bSuccess = (addressMacLiteral == pAddress);
+    Serial.println(bSuccess?"Pass":"Fail");
+    bResult &= bSuccess;
+    Serial.print(F("Typed IPV4 from literal - "));
+    constexpr Ipv4Address addressIPV4Literal{192,168,0,234};
+    bSuccess = (addressIPV4Literal == pIp);
+    Serial.println(bSuccess?"Pass":"Fail");
+    bResult &= bSuccess;
+    Serial.print(F("Typed IPV6 from literal - "));
+    constexpr Ipv6Address addressIPV6Literal{0x1234,0x5678,0x9ABC,0xDEF0,0x0011,0x2233,0x4455,0x6677};
+    bSuccess = (addressIPV6Literal == pAddress);
+    Serial.println(bSuccess?"Pass":"Fail");
+    bResult &= bSuccess;
+    Serial.print(F("Parse MAC string - "));
+    bSuccess = (MacAddress("12:34:56:78:9a:BC") == pAddress);
+    Serial.println(bSuccess?"Pass":"Fail");
+    bResult &= bSuccess;
+    Serial.print(F("Parse IPV4 string - "));
+    bSuccess = (Ipv4Address("192.168.0.234") == pIp);
+    Serial.println(bSuccess?"Pass":"Fail");
+    bResult &= bSuccess;
+    Serial.print(F("Parse IPV6 string - "));
+    bSuccess = (Ipv6Address("1234:5678:9abc:def0:11:2233:4455:6677") == pAddress);
+    Serial.println(bSuccess?"Pass":"Fail");
+    bResult &= bSuccess;
+    Serial.print(F("Parse IPV6 compressed string - "));
+    bSuccess = (Ipv6Address("fe80::1") == Ipv6Address{0xfe80,0,0,0,0,0,0,1}) && (Ipv6Address("::") == Ipv6Address());
+    Serial.println(bSuccess?"Pass":"Fail");
+    bResult &= bSuccess;
+    Serial.print(F("Reject invalid strings - "));
+    Ipv4Address addressInvalid;
+    bSuccess = !addressInvalid.Parse("192.168.0.256") && !addressInvalid.Parse("192.168.0") && !MacAddress().Parse("12:34:56:78:9A") && !Ipv6Address().Parse("1::2::3");
+    Serial.println(bSuccess?"Pass":"Fail");
+    bResult &= bSuccess;
     return bResult;
 }
 
 bool TestInitialised()
 {
-    byte pMac[6] = {0x12,0x34,0x56,0x78,0x9A,0xBC};
-    Address addressMac(ADDR_TYPE_MAC, pMac);
+    MacAddress addressMac{0x12,0x34,0x56,0x78,0x9A,0xBC};
     g_nic.Initialise(addressMac, ETHERNET_CS_PIN);
 
     //Check ENC28J60 has non-zero version (has been initialised) and that it has the same hardware address as we requested
@@ -326,8 +366,7 @@ bool TestTxError()
 
 bool TestSetIp()
 {
-    byte pIp[4] = {192,168,0,88};
-    Address addressIP(ADDR_TYPE_IPV4, pIp);
+    Ipv4Address addressIP{192,168,0,88};
     g_nic.ipv4.ConfigureStaticIp(&addressIP);
     Serial.print("Set IP to ");
     g_nic.ipv4.GetIp()->PrintAddress();
@@ -338,6 +377,19 @@ bool TestSetIp()
 bool TestDhcp()
 {
     g_nic.ipv4.ConfigureDhcp();
+    //DHCP does not block so process until bound or timeout
+    uint32_t lStart = millis();
+    while(millis() - lStart < 30000)
+    {
+        g_nic.Process();
+        if(DHCP_BOUND == g_nic.ipv4.GetDhcpStatus())
+        {
+            Serial.print(F("DHCP assigned "));
+            g_nic.ipv4.GetIp()->PrintAddress();
+            Serial.println();
+            return true;
+        }
+    }
     return false;
 }
 
@@ -366,7 +418,7 @@ void HandleTxError()
 void HandleEchoResponse(uint16_t nSequence)
 {
     Serial.print("Echo response (pong) recieved from ");
-    Address addressRemote(ADDR_TYPE_IPV4);
+    Ipv4Address addressRemote;
     g_nic.ipv4.GetRemoteIp(addressRemote);
     addressRemote.PrintAddress();
     Serial.print("after ");
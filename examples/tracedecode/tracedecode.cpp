@@ -0,0 +1,102 @@
+/*  Trace decoder
+    Converts trace dumps written by Trace::Dump (build with -DTRACE_SIZE=n) into a readable timeline.
+    Host only. Lines not starting with "T:" are ignored so a whole serial console log may be decoded.
+    Usage: tracedecode [log.txt]    (reads stdin if no file given)
+*/
+#include <stdio.h>
+#include "trace.h"
+
+static const byte ARGS_NONE = 0; //!< No arguments
+static const byte ARGS_DEC  = 1; //!< First argument as decimal
+static const byte ARGS_DEC2 = 2; //!< Both arguments as decimal
+static const byte ARGS_ETH  = 3; //!< Length and Ethertype
+static const byte ARGS_IP   = 4; //!< Arguments form an IPv4 address
+
+/** Description of how to show one trace event */
+struct TraceFormat
+{
+    const char* sName; //!< Event name
+    byte nArgs; //!< Argument format (ARGS_xxx)
+    const char* sArg1; //!< Name of first argument
+    const char* sArg2; //!< Name of second argument
+};
+
+static const TraceFormat g_aFormat[] =
+{
+    {"none", ARGS_NONE, "", ""},
+    {"Rx frame", ARGS_ETH, "len", "type"},
+    {"Rx rejected", ARGS_ETH, "len", "type"},
+    {"Rx unhandled", ARGS_ETH, "len", "type"},
+    {"ARP request", ARGS_IP, "from", ""},
+    {"ARP reply sent", ARGS_IP, "to", ""},
+    {"ARP reply", ARGS_IP, "from", ""},
+    {"ARP unhandled", ARGS_DEC, "oper", ""},
+    {"ARP request sent", ARGS_IP, "for", ""},
+    {"ARP abandoned", ARGS_IP, "for", ""},
+    {"IPv4 unhandled", ARGS_DEC, "protocol", ""},
+    {"ICMP echo request", ARGS_DEC2, "id", "seq"},
+    {"ICMP echo reply", ARGS_DEC2, "id", "seq"},
+    {"ICMP unhandled", ARGS_DEC, "type", ""},
+    {"UDP", ARGS_DEC2, "src", "dst"},
+    {"DHCP offer", ARGS_IP, "ip", ""},
+    {"DHCP ack", ARGS_IP, "ip", ""},
+    {"Tx error", ARGS_NONE, "", ""},
+};
+static_assert(sizeof(g_aFormat) / sizeof(g_aFormat[0]) == TRACE_EVENTS, "Trace decoder must describe every TRACE_EVENT");
+
+int main(int argc, char** argv)
+{
+    FILE* pFile = stdin;
+    if(argc > 1 && !(pFile = fopen(argv[1], "r")))
+    {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    char sLine[256];
+    bool bFirst = true;
+    unsigned long lStart = 0, lLast = 0;
+    while(fgets(sLine, sizeof(sLine), pFile))
+    {
+        unsigned long lTime;
+        unsigned int nEvent, nArg1, nArg2;
+        if(0 == strncmp(sLine, "TRACE ", 6))
+        {
+            printf("--- dump of %s", sLine + 6);
+            continue;
+        }
+        if(4 != sscanf(sLine, "T:%8lx %2x %4x %4x", &lTime, &nEvent, &nArg1, &nArg2))
+            continue;
+        if(bFirst)
+            lStart = lLast = lTime;
+        bFirst = false;
+        //Unsigned arithmetic copes with micros wrapping at 32 bits
+        printf("%12.3f ms +%-9lu us  ", uint32_t(lTime - lStart) / 1000.0, (unsigned long)uint32_t(lTime - lLast));
+        lLast = lTime;
+        if(nEvent >= TRACE_EVENTS)
+        {
+            printf("event %u %04x %04x\n", nEvent, nArg1, nArg2);
+            continue;
+        }
+        const TraceFormat& format = g_aFormat[nEvent];
+        printf("%-18s", format.sName);
+        switch(format.nArgs)
+        {
+            case ARGS_DEC:
+                printf(" %s=%u", format.sArg1, nArg1);
+                break;
+            case ARGS_DEC2:
+                printf(" %s=%u %s=%u", format.sArg1, nArg1, format.sArg2, nArg2);
+                break;
+            case ARGS_ETH:
+                printf(" %s=%u %s=0x%04x", format.sArg1, nArg1, format.sArg2, nArg2);
+                break;
+            case ARGS_IP:
+                printf(" %s=%u.%u.%u.%u", format.sArg1, nArg1 >> 8, nArg1 & 0xFF, nArg2 >> 8, nArg2 & 0xFF);
+                break;
+        }
+        printf("\n");
+    }
+    if(pFile != stdin)
+        fclose(pFile);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "Arduino.h"
+#include <stdio.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+HostSerial Serial;
+
+static uint64_t GetNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static const uint64_t g_nStart = GetNanoseconds();
+static uint64_t g_nOffset = 0; //!< Nanoseconds added to clock by AdvanceClock
+
+unsigned long millis()
+{
+    return (unsigned long)((GetNanoseconds() + g_nOffset - g_nStart) / 1000000ULL);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)((GetNanoseconds() + g_nOffset - g_nStart) / 1000ULL);
+}
+
+void AdvanceClock(unsigned long nMs)
+{
+    g_nOffset += uint64_t(nMs) * 1000000ULL;
+}
+
+void delay(unsigned long nMs)
+{
+    usleep(nMs * 1000);
+}
+
+int HostSerial::available()
+{
+    int nCount = 0;
+    ioctl(STDIN_FILENO, FIONREAD, &nCount);
+    return nCount;
+}
+
+int HostSerial::read()
+{
+    return getchar();
+}
+
+void HostSerial::print(const char* pString)
+{
+    if(!m_bEnabled)
+        return;
+    fputs(pString, stdout);
+}
+
+void HostSerial::print(char cValue)
+{
+    if(!m_bEnabled)
+        return;
+    fputc(cValue, stdout);
+}
+
+void HostSerial::print(long nValue, int nBase)
+{
+    if(!m_bEnabled)
+        return;
+    if(nValue < 0)
+    {
+        fputc('-', stdout);
+        nValue = -nValue;
+    }
+    print((unsigned long)nValue, nBase);
+}
+
+void HostSerial::print(unsigned long nValue, int nBase)
+{
+    if(!m_bEnabled)
+        return;
+    char pBuffer[8 * sizeof(long) + 1];
+    char* pChar = pBuffer + sizeof(pBuffer) - 1;
+    *pChar = '\0';
+    if(nBase < 2)
+        nBase = 10;
+    do
+    {
+        byte nDigit = nValue % nBase;
+        *--pChar = nDigit < 10 ? '0' + nDigit : 'A' + nDigit - 10;
+        nValue /= nBase;
+    } while(nValue);
+    fputs(pChar, stdout);
+}
+
+void HostSerial::write(const byte* pData, size_t nLen)
+{
+    if(!m_bEnabled)
+        return;
+    fwrite(pData, 1, nLen, stdout);
+}
@@ -0,0 +1,94 @@
+/**     Minimal Arduino core replacement for Linux host builds
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Provides just enough of the Arduino API for the library to build and run on a PC
+*       so that it may be tested, profiled and benchmarked against the ENC28J60 simulator.
+*       Add the host directory to the include path before any Arduino core directory.
+*/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HEX 16
+#define DEC 10
+#define OCT 8
+#define BIN 2
+
+#ifndef min
+#define min(a,b) ((a)<(b)?(a):(b))
+#endif // min
+#ifndef max
+#define max(a,b) ((a)>(b)?(a):(b))
+#endif // max
+
+//Program memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define memcpy_P memcpy
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+/** @brief  Get quantity of milliseconds since program started
+*   @return <i>unsigned long</i> Milliseconds since start
+*/
+unsigned long millis();
+
+/** @brief  Get quantity of microseconds since program started
+*   @return <i>unsigned long</i> Microseconds since start
+*/
+unsigned long micros();
+
+/** @brief  Advance millis and micros without waiting
+*   @param  nMs Quantity of milliseconds to add to clock
+*   @note   Allows timeouts to be tested without waiting for them
+*/
+void AdvanceClock(unsigned long nMs);
+
+/** @brief  Block for a period of time
+*   @param  nMs Quantity of milliseconds to wait
+*/
+void delay(unsigned long nMs);
+
+//Interrupts are raised synchronously by the simulator on the host so masking is not required
+#define noInterrupts()
+#define interrupts()
+
+/** @brief  Serial port replacement which writes to stdout and reads from stdin
+*   @note   Like Arduino, output is discarded until begin is called
+*/
+class HostSerial
+{
+    public:
+        HostSerial() : m_bEnabled(false) {};
+        void begin(unsigned long nBaud) { m_bEnabled = true; };
+        void end() { m_bEnabled = false; };
+        int available();
+        int read();
+        void print(const char* pString);
+        void print(const __FlashStringHelper* pString) { print(reinterpret_cast<const char*>(pString)); };
+        void print(char cValue);
+        void print(long nValue, int nBase = DEC);
+        void print(unsigned long nValue, int nBase = DEC);
+        void print(int nValue, int nBase = DEC) { print(long(nValue), nBase); };
+        void print(unsigned int nValue, int nBase = DEC) { print((unsigned long)(nValue), nBase); };
+        void print(byte nValue, int nBase = DEC) { print((unsigned long)(nValue), nBase); };
+        void println() { print("\n"); };
+        template <typename T> void println(T value) { print(value); println(); };
+        template <typename T> void println(T value, int nBase) { print(value, nBase); println(); };
+        void write(const byte* pData, size_t nLen);
+
+    private:
+        bool m_bEnabled; //!< True if begin has been called
+};
+
+extern HostSerial Serial;
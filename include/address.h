@@ -1,4 +1,8 @@
 /** Class provides address for Ethernet protocols
+*   Addresses use fixed inline storage (no heap) and are trivially copyable.
+*   Typed addresses MacAddress, Ipv4Address and Ipv6Address hold exactly the bytes they need and may be
+*   constructed at compile time, e.g. constexpr Ipv4Address ipGw{192,168,0,1};
+*   Address holds any type and is used where the type is only known at runtime.
 */
 #pragma once
 #include "Arduino.h"
@@ -8,76 +12,229 @@ static const byte ADDR_TYPE_MAC     = 1;
 static const byte ADDR_TYPE_IPV4    = 2;
 static const byte ADDR_TYPE_IPV6    = 3;
 
+static const byte ADDR_MAX_SIZE     = 16; //!< Size of largest address (IPV6)
+
+/** @brief  Get the size of an address type
+*   @param  nType Address type: ADDR_TYPE_NONE | ADDR_TYPE_MAC | ADDR_TYPE_IPV4 | ADDR_TYPE_IPV6
+*   @return <i>byte</i> Quantity of bytes in address
+*/
+constexpr byte GetAddressSize(byte nType)
+{
+    return (ADDR_TYPE_MAC == nType) ? 6 : (ADDR_TYPE_IPV4 == nType) ? 4 : (ADDR_TYPE_IPV6 == nType) ? 16 : 0;
+}
+
 class Address
 {
     public:
-        /** @brief  Create an instance of an address
+        /** @brief  Create an instance of an empty (null) address
         *   @param  nType Address type: ADDR_TYPE_NONE | ADDR_TYPE_MAC | ADDR_TYPE_IPV4 | ADDR_TYPE_IPV6
-        *   @param  pAddress Pointer to buffer holding new address. Default is empty (null) address
         */
-        Address(byte nType = ADDR_TYPE_NONE, byte* pAddress = 0);
+        constexpr Address(byte nType = ADDR_TYPE_NONE) :
+            m_nType(nType),
+            m_nSize(GetAddressSize(nType)),
+            m_pAddress{}
+        {
+        }
 
-        //!@todo Implement Address constructor which takes {} defined array, e.g. Address(ADDR_TYPE_IPV4, {192,168,0,1});
-        //!@todo Implement Address constructor which takes string address, e.g. Address(ADDR_TYPE_IPV4, "192.168.0.1"});
+        /** @brief  Create an instance of an address
+        *   @param  nType Address type: ADDR_TYPE_NONE | ADDR_TYPE_MAC | ADDR_TYPE_IPV4 | ADDR_TYPE_IPV6
+        *   @param  pAddress Pointer to buffer holding new address. Null for empty address
+        */
+        Address(byte nType, const byte* pAddress);
 
-        virtual ~Address();
+        /** @brief  Create an instance of an address from a string
+        *   @param  nType Address type: ADDR_TYPE_MAC | ADDR_TYPE_IPV4 | ADDR_TYPE_IPV6
+        *   @param  sAddress String representation, e.g. "192.168.0.1", "02:00:00:00:00:01" or "fe80::1"
+        *   @note   Address is empty (null) if string is not valid. Use Parse to check validity
+        */
+        Address(byte nType, const char* sAddress);
 
         /** @brief  Comparison with another Address operator */
-        bool operator==(Address& address);
+        bool operator==(const Address& address) const;
 
         /** @brief  Comparison with a byte array pointer operator */
-        bool operator==(byte* pAddress);
+        bool operator==(const byte* pAddress) const;
 
         /** @brief  Comparison with another Address operator, not equal */
-        bool operator!=(Address& address);
+        bool operator!=(const Address& address) const { return !(*this == address); };
 
         /** @brief  Comparison with a byte array pointer operator, not equal */
-        bool operator!=(byte* pAddress);
-
-        // Overloaded copy operators to allow initialisation of IPAddress objects from other types
-        /** @brief  Copy from another Address operator */
-        Address& operator=(Address& address);
+        bool operator!=(const byte* pAddress) const { return !(*this == pAddress); };
 
         /** @brief  Copy from a byte array pointer operator */
-        Address& operator=(byte* pAddress);
+        Address& operator=(const byte* pAddress);
 
         /** @brief  Gets pointer to byte array conatining address
         *   @return <i>byte*</i> Pointer to address byte array
         */
-        byte* GetAddress();
+        byte* GetAddress() { return m_pAddress; };
 
         /** @brief  Populates byte array with address
         *   @param  pBuffer Pointer to byte array to populate
         */
-        void GetAddress(byte* pBuffer);
+        void GetAddress(byte* pBuffer) const;
 
         /** @brief  Sets address from byte array
         *   @param  pAddress Pointer to byte array containing address
         */
-        void SetAddress(byte* pAddress);
+        void SetAddress(const byte* pAddress);
 
         /** @brief  Gets the address type
         *   @return <i>byte</i> Address type: ADDR_TYPE_MAC | ADDR_TYPE_IPV4 | ADDR_TYPE_IPV6
         */
-        byte GetType();
+        byte GetType() const { return m_nType; };
 
         /** @brief  Gets address size
         *   @return <i>byte</i> Length of address
         */
-        byte GetSize();
+        byte GetSize() const { return m_nSize; };
+
+        /** @brief  Sets address from string
+        *   @param  sAddress String representation of address of this object's type
+        *   @return <i>bool</i> True on success. Address is unchanged on failure
+        */
+        bool Parse(const char* sAddress) { return Parse(m_nType, sAddress, m_pAddress); };
 
         /** @brief  Prints address
         *   @note   Uses common output format for each address type
         *   @note   Assumes Serial is initialised
         */
-        void PrintAddress();
+        void PrintAddress() const { Print(m_nType, m_pAddress); };
+
+        /** @brief  Parse a string into an address buffer
+        *   @param  nType Address type: ADDR_TYPE_MAC | ADDR_TYPE_IPV4 | ADDR_TYPE_IPV6
+        *   @param  sAddress String, e.g. "192.168.0.1" or "AA:BB:CC:DD:EE:FF" (or AA-BB-...) or "0011:2233::EEFF"
+        *   @param  pBuffer Pointer to buffer to populate (must be size of address type)
+        *   @return <i>bool</i> True on success. Buffer is unchanged on failure
+        */
+        static bool Parse(byte nType, const char* sAddress, byte* pBuffer);
 
-        //!@todo Add helper function to build address from string, e.g. Address("192.168.0.1") or Address("AA:BB:CC:DD:EE") or Address("0011:2233:4455:6677:8899:AABB:CCDD:EEFF")
+        /** @brief  Print an address buffer
+        *   @param  nType Address type: ADDR_TYPE_MAC | ADDR_TYPE_IPV4 | ADDR_TYPE_IPV6
+        *   @param  pAddress Pointer to address
+        *   @note   Assumes Serial is initialised
+        */
+        static void Print(byte nType, const byte* pAddress);
 
-    protected:
     private:
         byte m_nType; //!< Address type MAC | IPV4 | IPV6
         byte m_nSize; //!< Size of address
-        byte* m_pAddress; //!< Pointer to address
+        byte m_pAddress[ADDR_MAX_SIZE]; //!< Address
 };
 
+/** Address of fixed type and size
+*   @note   Use the typedefs MacAddress, Ipv4Address and class Ipv6Address rather than this template directly
+*/
+template <byte TYPE, byte SIZE>
+class TypedAddress
+{
+    public:
+        /** @brief  Create an empty (null) address */
+        constexpr TypedAddress() : m_pAddress{} {};
+
+        /** @brief  Create an address from a list of byte values, e.g. Ipv4Address{192,168,0,1}
+        *   @note   Quantity of values must match address size
+        */
+        template <typename... BYTES>
+        constexpr TypedAddress(byte n0, byte n1, BYTES... nValues) :
+            m_pAddress{n0, n1, byte(nValues)...}
+        {
+            static_assert(sizeof...(BYTES) + 2 == SIZE, "Quantity of values must match address size");
+        }
+
+        /** @brief  Create an address from a byte array
+        *   @param  pAddress Pointer to buffer holding address
+        */
+        explicit TypedAddress(const byte* pAddress) { SetAddress(pAddress); };
+
+        /** @brief  Create an address from a string, e.g. Ipv4Address("192.168.0.1")
+        *   @param  sAddress String representation of address
+        *   @note   Address is empty (null) if string is not valid. Use Parse to check validity
+        */
+        explicit TypedAddress(const char* sAddress) : m_pAddress{} { Parse(sAddress); };
+
+        /** @brief  Convert to a runtime typed Address */
+        operator Address() const { return Address(TYPE, m_pAddress); };
+
+        bool operator==(const TypedAddress& address) const { return 0 == memcmp(m_pAddress, address.m_pAddress, SIZE); };
+        bool operator==(const byte* pAddress) const { return 0 == memcmp(m_pAddress, pAddress, SIZE); };
+        bool operator!=(const TypedAddress& address) const { return !(*this == address); };
+        bool operator!=(const byte* pAddress) const { return !(*this == pAddress); };
+
+        /** @brief  Copy from a byte array pointer operator */
+        TypedAddress& operator=(const byte* pAddress) { SetAddress(pAddress); return *this; };
+
+        /** @brief  Gets pointer to byte array conatining address
+        *   @return <i>byte*</i> Pointer to address byte array
+        */
+        byte* GetAddress() { return m_pAddress; };
+        const byte* GetAddress() const { return m_pAddress; };
+
+        /** @brief  Populates byte array with address
+        *   @param  pBuffer Pointer to byte array to populate
+        */
+        void GetAddress(byte* pBuffer) const { memcpy(pBuffer, m_pAddress, SIZE); };
+
+        /** @brief  Sets address from byte array
+        *   @param  pAddress Pointer to byte array containing address
+        */
+        void SetAddress(const byte* pAddress) { memcpy(m_pAddress, pAddress, SIZE); };
+
+        /** @brief  Gets the address type
+        *   @return <i>byte</i> Address type: ADDR_TYPE_MAC | ADDR_TYPE_IPV4 | ADDR_TYPE_IPV6
+        */
+        static constexpr byte GetType() { return TYPE; };
+
+        /** @brief  Gets address size
+        *   @return <i>byte</i> Length of address
+        */
+        static constexpr byte GetSize() { return SIZE; };
+
+        /** @brief  Check whether address is empty (all zero)
+        *   @return <i>bool</i> True if all bytes are zero
+        */
+        bool IsNull() const
+        {
+            for(byte i = 0; i < SIZE; ++i)
+                if(m_pAddress[i])
+                    return false;
+            return true;
+        }
+
+        /** @brief  Sets address from string
+        *   @param  sAddress String representation of address
+        *   @return <i>bool</i> True on success. Address is unchanged on failure
+        */
+        bool Parse(const char* sAddress) { return Address::Parse(TYPE, sAddress, m_pAddress); };
+
+        /** @brief  Prints address
+        *   @note   Assumes Serial is initialised
+        */
+        void PrintAddress() const { Address::Print(TYPE, m_pAddress); };
+
+    protected:
+        byte m_pAddress[SIZE]; //!< Address
+};
+
+typedef TypedAddress<ADDR_TYPE_MAC, 6> MacAddress;
+typedef TypedAddress<ADDR_TYPE_IPV4, 4> Ipv4Address;
+
+class Ipv6Address : public TypedAddress<ADDR_TYPE_IPV6, 16>
+{
+    public:
+        /** @brief  Create an empty (null) address */
+        constexpr Ipv6Address() : TypedAddress() {};
+
+        /** @brief  Create an address from eight 16-bit groups, e.g. Ipv6Address{0xfe80,0,0,0,0,0,0,1} */
+        constexpr Ipv6Address(uint16_t n0, uint16_t n1, uint16_t n2, uint16_t n3, uint16_t n4, uint16_t n5, uint16_t n6, uint16_t n7) :
+            TypedAddress(n0 >> 8, n0 & 0xFF, n1 >> 8, n1 & 0xFF, n2 >> 8, n2 & 0xFF, n3 >> 8, n3 & 0xFF,
+                         n4 >> 8, n4 & 0xFF, n5 >> 8, n5 & 0xFF, n6 >> 8, n6 & 0xFF, n7 >> 8, n7 & 0xFF)
+        {
+        }
+
+        /** @brief  Create an address from a byte array */
+        explicit Ipv6Address(const byte* pAddress) : TypedAddress(pAddress) {};
+
+        /** @brief  Create an address from a string, e.g. Ipv6Address("fe80::1") */
+        explicit Ipv6Address(const char* sAddress) : TypedAddress(sAddress) {};
+};
@@ -0,0 +1,140 @@
+/**     ArpCache - IPV4 neighbour cache
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Maps IPV4 addresses to Ethernet MAC addresses. Entries are found by hashing the IP address into a small
+*       bucket table so lookup does not search the whole table. Each entry records when its MAC was last confirmed
+*       and when it was last used. Resolved entries expire after ARP_ENTRY_TIMEOUT. When the table is full the
+*       least recently used entry is replaced. The first two entries are pinned to the gateway and DNS server
+*       which are never evicted.
+*/
+
+///!@note   Configure ARP table size with #define ARP_TABLE_SIZE. Default size is 8. 2 further entries are used internally for gateway and DNS.
+///!@note   Configure quantity of hash buckets with #define ARP_HASH_SIZE. Must be a power of 2. Default is 16.
+///!@note   Configure entry lifetime with #define ARP_ENTRY_TIMEOUT (milliseconds). Default is 300000 (5 minutes).
+
+#pragma once
+#include "Arduino.h"
+#include "address.h"
+#include "stats.h"
+
+#ifndef ARP_TABLE_SIZE
+    #define ARP_TABLE_SIZE 8 //Default to ARP table of gateway, DNS plus 8 remote host addresses
+#endif // ARP_TABLE_SIZE
+#ifndef ARP_HASH_SIZE
+    #define ARP_HASH_SIZE 16
+#endif // ARP_HASH_SIZE
+#ifndef ARP_ENTRY_TIMEOUT
+    #define ARP_ENTRY_TIMEOUT 300000UL
+#endif // ARP_ENTRY_TIMEOUT
+
+static_assert((ARP_HASH_SIZE & (ARP_HASH_SIZE - 1)) == 0, "ARP_HASH_SIZE must be a power of 2");
+static_assert(ARP_TABLE_SIZE > 0 && ARP_TABLE_SIZE + 2 < 0xFF, "ARP_TABLE_SIZE must be 1..252");
+
+const static byte ARP_GATEWAY_INDEX = 0;
+const static byte ARP_DNS_INDEX     = 1;
+const static byte ARP_EOF           = 0xFF;
+
+//ARP entry flags
+const static byte ARP_FLAG_USED     = 0x01; //!< Entry holds an IP address
+const static byte ARP_FLAG_RESOLVED = 0x02; //!< Entry holds a valid MAC address
+const static byte ARP_FLAG_PINNED   = 0x04; //!< Entry is never evicted (gateway / DNS)
+
+class ArpEntry
+{
+    public:
+        Ipv4Address ip; //!< IP address
+        MacAddress mac; //!< MAC address. Only valid if ARP_FLAG_RESOLVED is set
+        uint32_t lUpdated; //!< Time (millis) MAC was last confirmed
+        uint32_t lUsed; //!< Time (millis) entry was last used to send
+        byte nFlags; //!< Bitwise ARP_FLAG_xxx
+        byte nNext; //!< Index of next entry in same hash bucket or ARP_EOF
+};
+
+class ArpCache
+{
+    public:
+        ArpCache();
+
+        /** @brief  Find entry by IP address
+        *   @param  pIp Pointer to IP address (4 bytes)
+        *   @return <i>byte</i> Index of entry or ARP_EOF if not found
+        */
+        byte Find(const byte* pIp);
+
+        /** @brief  Get MAC address for an IP address
+        *   @param  pIp Pointer to IP address (4 bytes)
+        *   @return <i>byte*</i> Pointer to MAC address or NULL if not resolved or expired
+        *   @note   Marks entry as used for LRU eviction
+        */
+        byte* Lookup(const byte* pIp);
+
+        /** @brief  Update the MAC address of an entry
+        *   @param  pIp Pointer to IP address (4 bytes)
+        *   @param  pMac Pointer to MAC address (6 bytes)
+        *   @param  bCreate True to add an entry if IP address not in cache. False to only refresh existing entries
+        *   @return <i>byte</i> Index of entry updated or ARP_EOF if not updated
+        */
+        byte Update(const byte* pIp, const byte* pMac, bool bCreate = true);
+
+        /** @brief  Add an unresolved entry, e.g. whilst waiting for ARP reply
+        *   @param  pIp Pointer to IP address (4 bytes)
+        *   @return <i>byte</i> Index of entry
+        *   @note   Existing entry is returned unchanged if already in cache
+        */
+        byte Add(const byte* pIp);
+
+        /** @brief  Set the IP address of a pinned entry
+        *   @param  nIndex ARP_GATEWAY_INDEX | ARP_DNS_INDEX
+        *   @param  pIp Pointer to IP address (4 bytes)
+        *   @note   MAC is cleared if IP address changes
+        */
+        void Pin(byte nIndex, const byte* pIp);
+
+        /** @brief  Remove all unpinned entries and clear MAC of pinned entries
+        */
+        void Flush();
+
+        /** @brief  Copy hit, miss and eviction counters to a statistics block
+        *   @param  stats Statistics block to populate
+        */
+        void GetStats(NetStats& stats) { stats.nArpHits = m_nHits; stats.nArpMisses = m_nMisses; stats.nArpEvictions = m_nEvictions; };
+
+        /** @brief  Reset hit, miss and eviction counters
+        */
+        void ClearStats() { m_nHits = m_nMisses = m_nEvictions = 0; };
+
+        /** @brief  Get an entry
+        *   @param  nIndex Index of entry
+        *   @return <i>ArpEntry*</i> Pointer to entry
+        */
+        ArpEntry* GetEntry(byte nIndex) { return &m_aEntry[nIndex]; };
+
+    private:
+        /** @brief  Get hash bucket for IP address
+        *   @param  pIp Pointer to IP address (4 bytes)
+        *   @return <i>byte</i> Bucket index
+        */
+        static byte Hash(const byte* pIp) { return (pIp[3] ^ (pIp[2] << 1) ^ pIp[1] ^ pIp[0]) & (ARP_HASH_SIZE - 1); };
+
+        /** @brief  Add entry to head of its hash bucket
+        *   @param  nIndex Index of entry
+        */
+        void Link(byte nIndex);
+
+        /** @brief  Remove entry from its hash bucket
+        *   @param  nIndex Index of entry
+        */
+        void Unlink(byte nIndex);
+
+        /** @brief  Get an entry to populate, evicting least recently used entry if table is full
+        *   @return <i>byte</i> Index of entry (removed from hash bucket)
+        */
+        byte Allocate();
+
+        ArpEntry m_aEntry[ARP_TABLE_SIZE + 2]; //!< ARP table. First 2 entries are pinned to gateway and DNS
+        byte m_pBucket[ARP_HASH_SIZE]; //!< Index of first entry in each hash bucket or ARP_EOF
+        uint16_t m_nHits; //!< Quantity of lookups that found a valid MAC address
+        uint16_t m_nMisses; //!< Quantity of lookups that did not find a valid MAC address
+        uint16_t m_nEvictions; //!< Quantity of entries replaced to make room
+};
@@ -0,0 +1,68 @@
+/**     Checksum - Internet checksum (RFC 1071) of data in MCU memory
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Use for data already in RAM (headers in the prefetch buffer, header templates, data being appended). Data held only
+*       in NIC memory is checksummed by the NIC DMA engine (NIC::GetChecksum) which avoids reading it over SPI.
+*       Implementation is selected at compile time:
+*           AVR - unrolled add with carry in assembly, 8 bytes per iteration
+*           AVX2 / SSE2 - 32 / 16 bytes per iteration on host builds compiled with -mavx2 / -msse2 (default on x86-64)
+*           Generic - portable C, one 16-bit word per iteration
+*       #define CHECKSUM_GENERIC to force the portable implementation.
+*       See examples/checksumbench for a comparison with the NIC DMA checksum.
+*/
+#pragma once
+
+#include "Arduino.h"
+
+#if defined(CHECKSUM_GENERIC)
+    #define CHECKSUM_IMPL_GENERIC
+#elif defined(__AVR__)
+    #define CHECKSUM_IMPL_AVR
+#elif defined(__AVX2__)
+    #define CHECKSUM_IMPL_AVX2
+#elif defined(__SSE2__)
+    #define CHECKSUM_IMPL_SSE2
+#else
+    #define CHECKSUM_IMPL_GENERIC
+#endif
+
+class Checksum
+{
+    public:
+        /** @brief  Add data to a one's complement sum
+        *   @param  pData Pointer to data
+        *   @param  nLen Quantity of bytes. If odd, last byte is padded with zero so only the final block of a message may be odd
+        *   @param  lSum Sum to add to (may be unfolded). Default is 0
+        *   @return <i>uint16_t</i> Folded sum of 16-bit network order words (not complemented)
+        */
+        static uint16_t Add(const byte* pData, uint16_t nLen, uint32_t lSum = 0);
+
+        /** @brief  Add data to a one's complement sum using portable implementation
+        *   @note   Same as Add. Provided for comparison and for short tails of optimised implementations
+        */
+        static uint16_t AddGeneric(const byte* pData, uint16_t nLen, uint32_t lSum = 0);
+
+        /** @brief  Fold carries of a one's complement sum into 16 bits
+        *   @param  lSum Unfolded sum
+        *   @return <i>uint16_t</i> Folded sum (not complemented)
+        */
+        static uint16_t Fold(uint32_t lSum)
+        {
+            while(lSum >> 16)
+                lSum = (lSum & 0xFFFF) + (lSum >> 16);
+            return lSum;
+        };
+
+        /** @brief  Get Internet checksum of data
+        *   @param  pData Pointer to data
+        *   @param  nLen Quantity of bytes
+        *   @return <i>uint16_t</i> Checksum in host byte order. Zero if data includes a valid checksum
+        */
+        static uint16_t Get(const byte* pData, uint16_t nLen) { return ~Add(pData, nLen); };
+
+        /** @brief  Get name of selected implementation
+        *   @return <i>const char*</i> "AVR", "AVX2", "SSE2" or "generic"
+        */
+        static const char* GetImplementation();
+};
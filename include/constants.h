@@ -27,6 +27,8 @@ const static uint16_t IPV4_OFFSET_PROTOCOL      = 9;
 const static uint16_t IPV4_OFFSET_CHECKSUM      = 10;
 const static uint16_t IPV4_OFFSET_SOURCE        = 12;
 const static uint16_t IPV4_OFFSET_DESTINATION   = 16;
+const static uint16_t IPV4_PSEUDO_HEADER_SIZE   = 12; //!< Source, destination, zero, protocol and length summed into transport checksums
+const static byte IPV4_TTL                      = 64; //!< Time to live of sent datagrams
 
 //IP Protocol types
 const static uint16_t IP_PROTOCOL_ICMP  = 1;
@@ -65,14 +67,35 @@ const static uint16_t UDP_OFFSET_SOURCE_PORT        = 0;
 const static uint16_t UDP_OFFSET_DESTINATION_PORT   = 2;
 const static uint16_t UDP_OFFSET_LENGTH             = 4;
 const static uint16_t UDP_OFFSET_CHECKSUM           = 6;
+const static uint16_t UDP_EPHEMERAL_PORT            = 49152; //!< Default source port of datagrams sent (start of IANA dynamic range)
+
+//TCP
+const static uint16_t TCP_HEADER_SIZE               = 20; //!< Header without options
+const static uint16_t TCP_OFFSET_SOURCE_PORT        = 0;
+const static uint16_t TCP_OFFSET_DESTINATION_PORT   = 2;
+const static uint16_t TCP_OFFSET_SEQUENCE           = 4;
+const static uint16_t TCP_OFFSET_ACKNOWLEDGE        = 8;
+const static uint16_t TCP_OFFSET_DATA               = 12; //!< Upper nibble is header length in 32-bit words
+const static uint16_t TCP_OFFSET_FLAGS              = 13;
+const static uint16_t TCP_OFFSET_WINDOW             = 14;
+const static uint16_t TCP_OFFSET_CHECKSUM           = 16;
+const static uint16_t TCP_OFFSET_URGENT             = 18;
+const static byte TCP_FLAG_FIN                      = 0x01;
+const static byte TCP_FLAG_SYN                      = 0x02;
+const static byte TCP_FLAG_RST                      = 0x04;
+const static byte TCP_FLAG_PSH                      = 0x08;
+const static byte TCP_FLAG_ACK                      = 0x10;
 
 //DHCP
 const static byte DHCP_DISABLED             = 0; //!< DHCP disabled - using static IP configuration
 const static byte DHCP_RESET                = 1; //!< DHCP enabled but not yet requested
-const static byte DHCP_DISCOVERY            = 2; //!< DHCP discovery - asked for a new IP
-const static byte DHCP_REQUESTED            = 3; //!< DHCP requested - requested specifi IP based on offer
+const static byte DHCP_DISCOVERY            = 2; //!< DHCP discovery (RFC 2131 SELECTING) - asked for a new IP
+const static byte DHCP_REQUESTED            = 3; //!< DHCP requested (RFC 2131 REQUESTING) - requested specifi IP based on offer
 const static byte DHCP_BOUND                = 4; //!< DHCP bound to valid address - DHCP complete and ready to roll
-const static byte DHCP_RENEWING             = 5; //!< DHCP bound, renewing lease - requested lease renewal
+const static byte DHCP_RENEWING             = 5; //!< DHCP bound, renewing lease - T1 passed, requested lease renewal from server
+const static byte DHCP_REBINDING            = 6; //!< DHCP bound, rebinding lease - T2 passed, requested lease renewal from any server
+const static byte DHCP_REBOOTING            = 7; //!< DHCP rebooting (RFC 2131 INIT-REBOOT) - requested confirmation of stored lease
+const static byte DHCP_STATES               = 8; //!< Quantity of DHCP states
 const static uint16_t DHCP_PACKET_SIZE      = 249; //!< Quantity of bytes in DHCP messages sent from this host (including consistent set of options)
 const static uint16_t DHCP_SERVER_PORT      = 67; //!< UDP port used by DHCP server
 const static uint16_t DHCP_CLIENT_PORT      = 68; //!< UDP port used by DHCP client
@@ -84,11 +107,14 @@ const static uint16_t DHCP_OFFSET_XID       = 4;
 const static uint16_t DHCP_OFFSET_SECS      = 8;
 const static uint16_t DHCP_OFFSET_FLAGS     = 10;
 const static uint16_t DHCP_OFFSET_CIADDR    = 12; //!<DHCP client IP address
-const static uint16_t DHCP_OFFSET_YIADDR    = 14; //!<DHCP your IP address
-const static uint16_t DHCP_OFFSET_SIADDR    = 16; //!<DHCP server IP address
-const static uint16_t DHCP_OFFSET_GIADDR    = 18; //!<DHCP gateway IP address
-const static uint16_t DHCP_OFFSET_CHADDR    = 20; //!<DHCP client hardware address
+const static uint16_t DHCP_OFFSET_YIADDR    = 16; //!<DHCP your IP address
+const static uint16_t DHCP_OFFSET_SIADDR    = 20; //!<DHCP server IP address
+const static uint16_t DHCP_OFFSET_GIADDR    = 24; //!<DHCP gateway IP address
+const static uint16_t DHCP_OFFSET_CHADDR    = 28; //!<DHCP client hardware address
+const static uint16_t DHCP_OFFSET_MAGIC     = 236; //!< Magic cookie 99.130.83.99
 const static uint16_t DHCP_OFFSET_OPTIONS   = 240; //!< Start of DHCP options
+const static byte DHCP_OP_REQUEST           = 1; //!< BOOTP op: client to server
+const static byte DHCP_OP_REPLY             = 2; //!< BOOTP op: server to client
 const static uint16_t DHCP_OPTION_PAD       = 0; //!< DHCP Option 0: Pads DHCP options, e.g. to meet word boundaries
 const static uint16_t DHCP_OPTION_MASK      = 1; //!< DHCP Option 1: Subnetmask
 const static uint16_t DHCP_OPTION_ROUTER    = 3; //!< DHCP Option 3: Router
@@ -98,9 +124,15 @@ const static uint16_t DHCP_OPTION_LEASE     = 51; //!< DHCP Option 51: Lease tim
 const static uint16_t DHCP_OPTION_TYPE      = 53; //!< DHCP Option 53: Message type
 const static uint16_t DHCP_OPTION_SERVER    = 54; //!< DHCP Option 54: DHCP server
 const static uint16_t DHCP_OPTION_PARAM     = 55; //!< DHCP Option 55: Parameter list
-//!@todo Check DHCP Type constants (Wikipedia does not define these)
+const static uint16_t DHCP_OPTION_T1        = 58; //!< DHCP Option 58: Renewal (T1) time
+const static uint16_t DHCP_OPTION_T2        = 59; //!< DHCP Option 59: Rebinding (T2) time
+const static uint16_t DHCP_OPTION_END       = 255; //!< DHCP Option 255: End of options
+//DHCP message types (RFC 2132 9.6)
 const static uint16_t DHCP_TYPE_DISCOVER    = 1; //!< DHCP Type 1: Discover
 const static uint16_t DHCP_TYPE_OFFER       = 2; //!< DHCP Type 2: Offer
 const static uint16_t DHCP_TYPE_REQUEST     = 3; //!< DHCP Type 3: Request
-const static uint16_t DHCP_TYPE_ACK         = 4; //!< DHCP Type 4: Acknowledge
+const static uint16_t DHCP_TYPE_DECLINE     = 4; //!< DHCP Type 4: Decline
+const static uint16_t DHCP_TYPE_ACK         = 5; //!< DHCP Type 5: Acknowledge
+const static uint16_t DHCP_TYPE_NAK         = 6; //!< DHCP Type 6: Negative acknowledge
+const static uint16_t DHCP_TYPE_RELEASE     = 7; //!< DHCP Type 7: Release
 
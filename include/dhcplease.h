@@ -0,0 +1,56 @@
+/**     DhcpLease - DHCP lease record persisted across restarts
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Fixed size record with no padding so it may be copied byte by byte to and from storage.
+*       Stored by a lease store backend (see leasestore.h) and used by IPV4 for DHCP INIT-REBOOT.
+*/
+
+#pragma once
+#include "address.h"
+
+const static uint16_t DHCP_LEASE_VERSION = 0x4C01; //!< Record format identifier. Change if layout changes to invalidate stored records
+
+class DhcpLease
+{
+    public:
+        /** @brief  Create an empty (invalid) lease record
+        */
+        DhcpLease() : lLease(0), lExpiry(0), nVersion(0), nCheck(0) {};
+
+        /** @brief  Set version and check fields so that record is valid
+        */
+        void Seal() { nVersion = DHCP_LEASE_VERSION; nCheck = GetCheck(); };
+
+        /** @brief  Check whether record is complete and uncorrupted
+        *   @return <i>bool</i> True if valid
+        */
+        bool IsValid() const { return DHCP_LEASE_VERSION == nVersion && GetCheck() == nCheck; };
+
+        uint32_t lLease; //!< Lease duration in seconds (0xFFFFFFFF for infinite)
+        uint32_t lExpiry; //!< Time lease expires in seconds of lease store clock or 0 if store has no clock
+        Ipv4Address addressLocal; //!< Leased IP address
+        Ipv4Address addressServer; //!< DHCP server IP address
+        Ipv4Address addressMask; //!< Subnet mask
+        Ipv4Address addressRouter; //!< Default gateway
+        Ipv4Address addressDns; //!< DNS server
+        uint16_t nVersion; //!< Record format identifier DHCP_LEASE_VERSION
+        uint16_t nCheck; //!< Fletcher-16 checksum of preceding fields
+
+    private:
+        /** @brief  Calculate checksum of record excluding check field
+        *   @return <i>uint16_t</i> Fletcher-16 checksum
+        */
+        uint16_t GetCheck() const
+        {
+            const byte* pData = (const byte*)this;
+            uint16_t nSum1 = 0, nSum2 = 0;
+            for(byte nIndex = 0; nIndex < sizeof(DhcpLease) - sizeof(nCheck); ++nIndex)
+            {
+                nSum1 = (nSum1 + pData[nIndex]) % 255;
+                nSum2 = (nSum2 + nSum1) % 255;
+            }
+            return (nSum2 << 8) | nSum1;
+        };
+};
+static_assert(sizeof(DhcpLease) == 32, "DhcpLease must not contain padding");
@@ -0,0 +1,52 @@
+/**     EepromLeaseStore - Persists DHCP lease in EEPROM
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Lease store on target, used when DHCP_LEASE_EEPROM_ADDRESS is defined. Bytes are only written when they change so renewing an unchanged lease does
+*       not wear the EEPROM. There is no real time clock so the lease expiry is not known after restart.
+*/
+
+///!@note   Enable by defining EEPROM location of lease record (32 bytes) with #define DHCP_LEASE_EEPROM_ADDRESS. Choose an area not used by the application.
+
+#pragma once
+#include <EEPROM.h>
+#include "dhcplease.h"
+
+#ifndef DHCP_LEASE_EEPROM_ADDRESS
+    #error "Define DHCP_LEASE_EEPROM_ADDRESS to store DHCP lease in EEPROM"
+#endif // DHCP_LEASE_EEPROM_ADDRESS
+
+class EepromLeaseStore
+{
+    public:
+        /** @brief  Read lease record
+        *   @param  lease Record to populate
+        *   @return <i>bool</i> True if record was read. Check lease.IsValid() for content
+        */
+        bool Load(DhcpLease& lease)
+        {
+            byte* pData = (byte*)&lease;
+            for(byte nIndex = 0; nIndex < sizeof(DhcpLease); ++nIndex)
+                pData[nIndex] = EEPROM.read(DHCP_LEASE_EEPROM_ADDRESS + nIndex);
+            return true;
+        };
+
+        /** @brief  Write lease record
+        *   @param  lease Record to write
+        */
+        void Save(const DhcpLease& lease)
+        {
+            const byte* pData = (const byte*)&lease;
+            for(byte nIndex = 0; nIndex < sizeof(DhcpLease); ++nIndex)
+                EEPROM.update(DHCP_LEASE_EEPROM_ADDRESS + nIndex, pData[nIndex]);
+        };
+
+        /** @brief  Remove lease record
+        */
+        void Clear() { Save(DhcpLease()); };
+
+        /** @brief  Get time from a clock that continues across restart
+        *   @return <i>uint32_t</i> Always 0 - no clock available
+        */
+        uint32_t GetTime() { return 0; };
+};
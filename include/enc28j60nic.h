@@ -0,0 +1,440 @@
+/**     ENC28J60Nic - Adapts the ENC28J60 driver to the NIC policy
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Provides NIC functions (see nic.h) which the ENC28J60 driver does not implement.
+*       The driver has a single transmit buffer so frames cannot be held in NIC memory and each TxBegin waits for the
+*       previous frame to complete. The adapter copies each frame as it is built to a RAM park buffer so that one frame
+*       awaiting ARP resolution may be held and rewritten to the driver when released. The driver fixes the receive / transmit
+*       partition and does not report receive buffer usage so receive telemetry is ENC28J60_RX_UNAVAILABLE.
+*       The driver does not expose the interrupt enable or receive filter registers so the adapter writes them with its own
+*       control register transactions, using SPI as configured by the driver and restoring the driver's register bank afterwards.
+*/
+
+///!@note   Configure size of RAM buffer holding a frame awaiting ARP resolution with #define ENC28J60_PARK_SIZE. Default is 96. 0 to disable (frames are dropped)
+
+#pragma once
+#include <SPI.h>
+#include "enc28j60.h"
+
+#ifndef ENC28J60_PARK_SIZE
+    #define ENC28J60_PARK_SIZE 96
+#endif // ENC28J60_PARK_SIZE
+
+static const byte ENC28J60_NO_SLOT = 0xFF; //!< Indicates no transmit slot available
+static const byte ENC28J60_TX_HOLD_MAX = 1; //!< Maximum quantity of frames held by TxHold (one park buffer)
+static const uint16_t ENC28J60_PARK_INVALID = 0xFFFF; //!< Indicates frame being built cannot be parked
+static const uint32_t ENC28J60_RX_UNAVAILABLE = 0xFFFFFFFF; //!< Receive buffer telemetry not reported by driver (0xFFFF from 16-bit functions)
+
+//Receive filters (ERXFCON)
+static const byte ENC28J60_FILTER_UNICAST       = 0x80; //!< Accept frames to local MAC (UCEN)
+static const byte ENC28J60_FILTER_CRC           = 0x20; //!< Discard frames with invalid CRC (CRCEN)
+static const byte ENC28J60_FILTER_ARP           = 0x10; //!< Accept broadcast ARP frames by pattern match (PMEN)
+static const byte ENC28J60_FILTER_HASH          = 0x04; //!< Accept multicast frames matching hash table (HTEN)
+static const byte ENC28J60_FILTER_MULTICAST     = 0x02; //!< Accept all multicast frames (MCEN)
+static const byte ENC28J60_FILTER_BROADCAST     = 0x01; //!< Accept all broadcast frames (BCEN)
+
+//SPI opcodes and control registers written by adapter
+static const byte ENC28J60_OP_RCR               = 0x00; //!< Read control register
+static const byte ENC28J60_OP_WCR               = 0x40; //!< Write control register
+static const byte ENC28J60_OP_BFS               = 0x80; //!< Set bits in ETH control register
+static const byte ENC28J60_OP_BFC               = 0xA0; //!< Clear bits in ETH control register
+static const byte ENC28J60_REG_EIE              = 0x1B; //!< Interrupt enable register (all banks)
+static const byte ENC28J60_EIE_INTIE            = 0x80; //!< Global INT pin enable bit of EIE
+static const byte ENC28J60_EIE_PKTIE            = 0x40; //!< Receive packet pending interrupt enable bit of EIE
+static const byte ENC28J60_REG_ECON1            = 0x1F; //!< Control register 1 (all banks)
+static const byte ENC28J60_ECON1_BSEL           = 0x03; //!< Register bank select bits of ECON1
+static const byte ENC28J60_REG_EHT0             = 0x00; //!< Hash table bytes 0..7 (bank 1)
+static const byte ENC28J60_REG_EPMM0            = 0x08; //!< Pattern match mask bytes 0..7 (bank 1)
+static const byte ENC28J60_REG_EPMCSL           = 0x10; //!< Pattern match checksum low byte (bank 1)
+static const byte ENC28J60_REG_EPMCSH           = 0x11; //!< Pattern match checksum high byte (bank 1)
+static const byte ENC28J60_REG_EPMOL            = 0x14; //!< Pattern match offset low byte (bank 1)
+static const byte ENC28J60_REG_EPMOH            = 0x15; //!< Pattern match offset high byte (bank 1)
+static const byte ENC28J60_REG_ERXFCON          = 0x18; //!< Receive filter control (bank 1)
+
+static const byte ENC28J60_FILL_CHUNK = 16; //!< Size of stack buffer used to stream fills and program memory blocks to driver
+
+class ENC28J60Nic : public ENC28J60
+{
+    public:
+        /** @brief  Initialise NIC
+        *   @param  pMac Pointer to MAC address
+        *   @param  nChipSelectPin Arduino pin connected to ENC28J60 chip select
+        *   @return <i>byte</i> Silicon revision or 0 on failure
+        *   @note   Records chip select so that adapter can write registers the driver does not expose
+        */
+        byte Initialize(byte* pMac, byte nChipSelectPin)
+        {
+            m_nChipSelect = nChipSelectPin;
+            m_nParkLen = ENC28J60_PARK_INVALID;
+            m_bParked = false;
+            return ENC28J60::Initialize(pMac, nChipSelectPin);
+        }
+
+        /** @brief  Finish the transmit frame without sending it
+        *   @return <i>byte</i> Slot 0 if frame is held in park buffer. ENC28J60_NO_SLOT if frame is discarded
+        *   @note   Only one frame may be parked. Frame is discarded if longer than ENC28J60_PARK_SIZE or built with DMACopy
+        */
+        byte TxHold()
+        {
+            if(m_bParked || ENC28J60_PARK_INVALID == m_nParkLen)
+                return ENC28J60_NO_SLOT;
+            m_bParked = true;
+            return 0;
+        }
+
+        /** @brief  Send a held frame
+        *   @param  nSlot Handle returned by TxHold
+        *   @param  pMac Pointer to destination MAC address. NULL to use destination set when frame was built
+        *   @note   Waits for any frame being sent then rewrites parked frame to the driver's transmit buffer
+        */
+        void TxRelease(byte nSlot, byte* pMac)
+        {
+            if(0 != nSlot || !m_bParked)
+                return;
+            ENC28J60::TxBegin(pMac ? pMac : m_aPark, (m_aPark[12] << 8) | m_aPark[13]);
+            ENC28J60::TxAppend(m_aPark + 14, m_nParkLen - 14);
+            ENC28J60::TxEnd();
+            TxDiscard(nSlot);
+        }
+
+        /** @brief  Free a held frame
+        *   @param  nSlot Handle returned by TxHold
+        */
+        void TxDiscard(byte nSlot)
+        {
+            if(0 != nSlot)
+                return;
+            m_bParked = false;
+            m_nParkLen = ENC28J60_PARK_INVALID;
+        }
+
+        /** @brief  Collect completion of sent frames
+        *   @return <i>byte</i> Always 0 - driver waits for completion within TxBegin
+        *   @note   There is no transmit ring on hardware (see enc28j60sim.h) so frames are not pipelined
+        */
+        byte TxPoll() { return 0; };
+
+        /** @brief  Start a transmit transaction
+        *   @param  pMac Pointer to destination MAC address. NULL for broadcast
+        *   @param  nEthertype EtherType of frame
+        */
+        void TxBegin(byte* pMac = NULL, uint16_t nEthertype = 0x0800)
+        {
+            ENC28J60::TxBegin(pMac, nEthertype);
+            if(m_bParked)
+                return; //Park buffer holds another frame so this one cannot be parked
+            byte pHeader[14] = {0}; //Driver writes source MAC so it is not needed in park buffer
+            if(pMac)
+                memcpy(pHeader, pMac, 6);
+            else
+                memset(pHeader, 0xFF, 6);
+            pHeader[12] = nEthertype >> 8;
+            pHeader[13] = nEthertype & 0xFF;
+            m_nParkLen = 0;
+            Park(ENC28J60_CURSOR, pHeader, sizeof(pHeader));
+        }
+
+        /** @brief  Start a transmit transaction, writing a prebuilt header
+        *   @param  pHeader Pointer to header starting with Ethernet header (destination, source, EtherType)
+        *   @param  nLen Quantity of bytes in header
+        *   @note   Driver writes its own Ethernet header so only destination and EtherType are taken from header
+        */
+        void TxBeginFrame(const byte* pHeader, uint16_t nLen)
+        {
+            TxBegin((byte*)pHeader, (pHeader[12] << 8) | pHeader[13]);
+            TxAppend((byte*)pHeader + 14, nLen - 14);
+        }
+
+        /** @brief  Append data to transmit frame
+        *   @param  pData Pointer to data
+        *   @param  nLen Quantity of bytes
+        *   @return <i>bool</i> True on success. False if insufficient space
+        */
+        bool TxAppend(byte* pData, uint16_t nLen)
+        {
+            if(!ENC28J60::TxAppend(pData, nLen))
+                return false;
+            Park(ENC28J60_CURSOR, pData, nLen);
+            return true;
+        }
+
+        /** @brief  Append byte to transmit frame
+        *   @param  nData Byte to append
+        *   @return <i>bool</i> True on success. False if insufficient space
+        */
+        bool TxAppendByte(byte nData)
+        {
+            return TxAppend(&nData, 1);
+        }
+
+        /** @brief  Append 16-bit word to transmit frame in network byte order
+        *   @param  nData Word to append
+        *   @return <i>bool</i> True on success. False if insufficient space
+        */
+        bool TxAppendWord(uint16_t nData)
+        {
+            byte pData[2] = {byte(nData >> 8), byte(nData & 0xFF)};
+            return TxAppend(pData, 2);
+        }
+
+        /** @brief  Write data to transmit frame
+        *   @param  nOffset Offset from start of frame
+        *   @param  pData Pointer to data
+        *   @param  nLen Quantity of bytes
+        */
+        void TxWrite(uint16_t nOffset, byte* pData, uint16_t nLen)
+        {
+            ENC28J60::TxWrite(nOffset, pData, nLen);
+            Park(nOffset, pData, nLen);
+        }
+
+        /** @brief  Write byte to transmit frame
+        *   @param  nOffset Offset from start of frame
+        *   @param  nData Byte to write
+        */
+        void TxWriteByte(uint16_t nOffset, byte nData)
+        {
+            TxWrite(nOffset, &nData, 1);
+        }
+
+        /** @brief  Write 16-bit word to transmit frame in network byte order
+        *   @param  nOffset Offset from start of frame
+        *   @param  nData Word to write
+        */
+        void TxWriteWord(uint16_t nOffset, uint16_t nData)
+        {
+            byte pData[2] = {byte(nData >> 8), byte(nData & 0xFF)};
+            TxWrite(nOffset, pData, 2);
+        }
+
+        /** @brief  Swap blocks of data within transmit frame
+        *   @param  nOffset1 Offset of first block
+        *   @param  nOffset2 Offset of second block
+        *   @param  nLen Quantity of bytes in each block
+        */
+        void TxSwap(uint16_t nOffset1, uint16_t nOffset2, uint16_t nLen)
+        {
+            ENC28J60::TxSwap(nOffset1, nOffset2, nLen);
+            if(m_bParked || ENC28J60_PARK_INVALID == m_nParkLen)
+                return;
+            if(uint32_t(nOffset1) + nLen > m_nParkLen || uint32_t(nOffset2) + nLen > m_nParkLen)
+            {
+                m_nParkLen = ENC28J60_PARK_INVALID;
+                return;
+            }
+            for(uint16_t i = 0; i < nLen; ++i)
+            {
+                byte nTmp = m_aPark[nOffset1 + i];
+                m_aPark[nOffset1 + i] = m_aPark[nOffset2 + i];
+                m_aPark[nOffset2 + i] = nTmp;
+            }
+        }
+
+        /** @brief  Copy data from received frame to transmit frame
+        *   @param  nDestination Offset within transmit frame
+        *   @param  nSource Offset within received frame
+        *   @param  nLen Quantity of bytes
+        *   @note   Data is not read back so frame cannot be parked
+        */
+        void DMACopy(uint16_t nDestination, uint16_t nSource, uint16_t nLen)
+        {
+            ENC28J60::DMACopy(nDestination, nSource, nLen);
+            if(!m_bParked)
+                m_nParkLen = ENC28J60_PARK_INVALID;
+        }
+
+        /** @brief  Calculate Internet checksum of data in transmit frame
+        *   @param  nOffset Offset of start of data
+        *   @param  nLen Quantity of bytes
+        *   @return <i>uint16_t</i> Checksum in host byte order
+        *   @note   Driver returns DMA checksum registers with bytes swapped
+        */
+        uint16_t GetChecksum(uint16_t nOffset, uint16_t nLen)
+        {
+            return SwapBytes(ENC28J60::GetChecksum(nOffset, nLen));
+        }
+
+        /** @brief  Append repeated byte to transmit frame
+        *   @param  nData Byte to append
+        *   @param  nLen Quantity of copies
+        *   @return <i>bool</i> True on success. False if insufficient space
+        *   @note   Driver has no fill operation so data is written in blocks of ENC28J60_FILL_CHUNK bytes
+        */
+        bool TxAppendFill(byte nData, uint16_t nLen)
+        {
+            byte pBuffer[ENC28J60_FILL_CHUNK];
+            memset(pBuffer, nData, min(nLen, uint16_t(ENC28J60_FILL_CHUNK)));
+            for(uint16_t nChunk; nLen; nLen -= nChunk)
+            {
+                nChunk = min(nLen, uint16_t(ENC28J60_FILL_CHUNK));
+                if(!TxAppend(pBuffer, nChunk))
+                    return false;
+            }
+            return true;
+        }
+
+        /** @brief  Append data from program memory to transmit frame
+        *   @param  pData Pointer to data in program memory (PROGMEM)
+        *   @param  nLen Quantity of bytes
+        *   @return <i>bool</i> True on success. False if insufficient space
+        *   @note   Data is copied to RAM and written in blocks of ENC28J60_FILL_CHUNK bytes
+        */
+        bool TxAppend_P(const byte* pData, uint16_t nLen)
+        {
+            byte pBuffer[ENC28J60_FILL_CHUNK];
+            for(uint16_t nChunk; nLen; nLen -= nChunk, pData += nChunk)
+            {
+                nChunk = min(nLen, uint16_t(ENC28J60_FILL_CHUNK));
+                memcpy_P(pBuffer, pData, nChunk);
+                if(!TxAppend(pBuffer, nChunk))
+                    return false;
+            }
+            return true;
+        }
+
+        /** @brief  Configure receive filters
+        *   @param  nFilter Bitwise ENC28J60_FILTER_xxx (written to ERXFCON)
+        *   @param  pMulticast Pointer to list of multicast MAC addresses (6 bytes each) to accept by hash table
+        *   @param  nGroups Quantity of addresses in list
+        *   @note   Hash table is imperfect so the stack filters multicast frames in software too
+        */
+        void SetRxFilter(byte nFilter, const byte* pMulticast, byte nGroups)
+        {
+            byte nBank = ReadControl(ENC28J60_REG_ECON1) & ENC28J60_ECON1_BSEL; //Driver's selected bank
+            SelectBank(1);
+            if(nFilter & ENC28J60_FILTER_HASH)
+            {
+                byte pHash[8] = {0};
+                for(byte nGroup = 0; nGroup < nGroups; ++nGroup)
+                {
+                    byte nIndex = GetHashIndex(pMulticast + nGroup * 6);
+                    pHash[nIndex >> 3] |= 1 << (nIndex & 7);
+                }
+                for(byte nIndex = 0; nIndex < 8; ++nIndex)
+                    WriteControl(ENC28J60_REG_EHT0 + nIndex, pHash[nIndex]);
+            }
+            if(nFilter & ENC28J60_FILTER_ARP)
+            {
+                //Pattern match broadcast destination (bytes 0..5) and ARP EtherType (bytes 12..13)
+                for(byte nIndex = 0; nIndex < 8; ++nIndex)
+                    WriteControl(ENC28J60_REG_EPMM0 + nIndex, (0 == nIndex) ? 0x3F : (1 == nIndex) ? 0x30 : 0x00);
+                WriteControl(ENC28J60_REG_EPMCSL, 0xF9); //Checksum of FF FF FF FF FF FF 08 06 is 0xF7F9
+                WriteControl(ENC28J60_REG_EPMCSH, 0xF7);
+                WriteControl(ENC28J60_REG_EPMOL, 0);
+                WriteControl(ENC28J60_REG_EPMOH, 0);
+            }
+            WriteControl(ENC28J60_REG_ERXFCON, nFilter);
+            SelectBank(nBank);
+        }
+
+        /** @brief  Enable interrupt on frame reception
+        *   @param  nPin Arduino pin connected to ENC28J60 INT output (must support external interrupts)
+        *   @param  HandleInterrupt Pointer to function called on falling edge of INT. NULL to disable
+        *   @note   Sets EIE.INTIE and EIE.PKTIE so that INT is asserted whilst frames are pending. Clears them when disabled
+        */
+        void EnableInterrupt(byte nPin, void (*HandleInterrupt)())
+        {
+            if(HandleInterrupt)
+            {
+                pinMode(nPin, INPUT);
+                attachInterrupt(digitalPinToInterrupt(nPin), HandleInterrupt, FALLING);
+                WriteControl(ENC28J60_REG_EIE, ENC28J60_EIE_INTIE | ENC28J60_EIE_PKTIE, ENC28J60_OP_BFS);
+            }
+            else
+            {
+                WriteControl(ENC28J60_REG_EIE, ENC28J60_EIE_INTIE | ENC28J60_EIE_PKTIE, ENC28J60_OP_BFC);
+                detachInterrupt(digitalPinToInterrupt(nPin));
+            }
+        }
+
+        /** @brief  Receive buffer telemetry - partition is fixed inside driver which does not report buffer usage
+        *   @return Always ENC28J60_RX_UNAVAILABLE so that missing telemetry is not mistaken for zero overflows
+        */
+        uint16_t RxGetSize() { return uint16_t(ENC28J60_RX_UNAVAILABLE); };
+        uint16_t RxGetHighWater() { return uint16_t(ENC28J60_RX_UNAVAILABLE); };
+        uint32_t RxGetOverflowCount() { return ENC28J60_RX_UNAVAILABLE; };
+        uint32_t RxGetLostCount() { return ENC28J60_RX_UNAVAILABLE; };
+        void RxClearStats() {};
+
+    private:
+        /** @brief  Copy data written to transmit frame to park buffer
+        *   @param  nOffset Offset from start of frame or ENC28J60_CURSOR to append
+        *   @param  pData Pointer to data
+        *   @param  nLen Quantity of bytes
+        *   @note   Frame cannot be parked if data does not fit in park buffer or is written beyond end of frame
+        */
+        void Park(uint16_t nOffset, const byte* pData, uint16_t nLen)
+        {
+            if(m_bParked || ENC28J60_PARK_INVALID == m_nParkLen)
+                return;
+            bool bAppend = (ENC28J60_CURSOR == nOffset);
+            uint16_t nStart = bAppend ? m_nParkLen : nOffset;
+            uint16_t nLimit = bAppend ? ENC28J60_PARK_SIZE : m_nParkLen;
+            if(uint32_t(nStart) + nLen > nLimit)
+            {
+                m_nParkLen = ENC28J60_PARK_INVALID;
+                return;
+            }
+            memcpy(m_aPark + nStart, pData, nLen);
+            if(bAppend)
+                m_nParkLen += nLen;
+        }
+
+        /** @brief  Read an ETH control register in current bank
+        *   @param  nRegister Register address (0x00..0x1F)
+        *   @return <i>byte</i> Value
+        */
+        byte ReadControl(byte nRegister)
+        {
+            digitalWrite(m_nChipSelect, LOW);
+            SPI.transfer(ENC28J60_OP_RCR | nRegister);
+            byte nValue = SPI.transfer(0);
+            digitalWrite(m_nChipSelect, HIGH);
+            return nValue;
+        }
+
+        /** @brief  Write an ETH control register or set / clear its bits
+        *   @param  nRegister Register address (0x00..0x1F) in current bank
+        *   @param  nValue Value to write or bits to set / clear
+        *   @param  nOpcode ENC28J60_OP_WCR | ENC28J60_OP_BFS | ENC28J60_OP_BFC. Default is write
+        */
+        void WriteControl(byte nRegister, byte nValue, byte nOpcode = ENC28J60_OP_WCR)
+        {
+            digitalWrite(m_nChipSelect, LOW);
+            SPI.transfer(nOpcode | nRegister);
+            SPI.transfer(nValue);
+            digitalWrite(m_nChipSelect, HIGH);
+        }
+
+        /** @brief  Select control register bank
+        *   @param  nBank Bank (0..3)
+        */
+        void SelectBank(byte nBank)
+        {
+            WriteControl(ENC28J60_REG_ECON1, ENC28J60_ECON1_BSEL, ENC28J60_OP_BFC);
+            if(nBank)
+                WriteControl(ENC28J60_REG_ECON1, nBank, ENC28J60_OP_BFS);
+        }
+
+        /** @brief  Get index of multicast hash table bit for a destination address
+        *   @param  pMac Pointer to MAC address
+        *   @return <i>byte</i> Bit index (0..63) - bits 28:23 of Ethernet CRC-32 of address
+        */
+        static byte GetHashIndex(const byte* pMac)
+        {
+            uint32_t lCrc = 0xFFFFFFFF;
+            for(byte i = 0; i < 6; ++i)
+            {
+                lCrc ^= pMac[i];
+                for(byte nBit = 0; nBit < 8; ++nBit)
+                    lCrc = (lCrc >> 1) ^ ((lCrc & 1) ? 0xEDB88320 : 0);
+            }
+            return (~lCrc >> 23) & 0x3F;
+        }
+
+        byte m_nChipSelect; //!< Arduino pin connected to ENC28J60 chip select
+        byte m_aPark[ENC28J60_PARK_SIZE ? ENC28J60_PARK_SIZE : 1]; //!< Copy of frame being built or parked
+        uint16_t m_nParkLen; //!< Length of frame in park buffer or ENC28J60_PARK_INVALID if frame being built cannot be parked
+        bool m_bParked; //!< True if park buffer holds a frame awaiting TxRelease
+};
@@ -0,0 +1,410 @@
+/**     ENC28J60Sim - In-memory simulation of the ENC28J60 Ethernet controller
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Provides the same public functions as the ENC28J60 driver so that the stack may be built,
+*       tested, profiled and benchmarked on a Linux host without hardware.
+*       Models the 8KB buffer SRAM with a circular receive buffer and a ring of transmit slots. The next frame is built
+*       in a free slot whilst previous frames are still being sent. A completed frame may be held in its slot (e.g. whilst
+*       its destination MAC is resolved) and sent later. Frames are passed to the handler as soon as they are sent but
+*       their slots are not reused until completion is collected by TxPoll (as the silicon's transmit status vector).
+*       The transmit ring is simulator-only. The ENC28J60 driver (see enc28j60nic.h) has a single transmit buffer.
+*       Received frames are written to the receive buffer with the same 6 byte receive status vector as the silicon.
+*       Frames may be injected into the receive buffer with RxInject. Transmitted frames are passed to a handler function.
+*       Receive filters (unicast, broadcast, multicast, hash table and ARP pattern match) are applied by RxInject.
+*       The INT pin is modelled as asserted whilst frames are waiting. Its falling edge (first frame into an empty
+*       receive buffer) calls the interrupt handler.
+*/
+
+///!@note   Partition SRAM between receive buffer and transmit slots with #define ENC28J60_TX_SLOTS and ENC28J60_TX_SLOT_SIZE.
+///!@note   Default is 2 slots of 1536 bytes (full size frames) leaving 5KB receive buffer. Receive buffer is the remaining SRAM.
+///!@note   Use fewer slots for a deeper receive buffer, more (or smaller) slots to pipeline simulated sends. Frames larger than a slot cannot be sent.
+///!@note   Use RxGetHighWater, RxGetOverflowCount and RxGetLostCount to size the receive buffer from measured traffic.
+
+#pragma once
+#include "Arduino.h"
+
+#ifndef ENC28J60_TX_SLOTS
+    #define ENC28J60_TX_SLOTS 2
+#endif // ENC28J60_TX_SLOTS
+#ifndef ENC28J60_TX_SLOT_SIZE
+    #define ENC28J60_TX_SLOT_SIZE 0x0600
+#endif // ENC28J60_TX_SLOT_SIZE
+
+static const uint16_t ENC28J60_SRAM_SIZE        = 8192; //!< Size of ENC28J60 buffer memory
+static const uint16_t ENC28J60_RXSTART          = 0x0000; //!< Start of receive buffer
+static const uint16_t ENC28J60_TXSTART          = ENC28J60_SRAM_SIZE - ENC28J60_TX_SLOTS * ENC28J60_TX_SLOT_SIZE; //!< Start of transmit slots
+static const uint16_t ENC28J60_RXEND            = ENC28J60_TXSTART - 1; //!< End of receive buffer (last byte)
+static const byte ENC28J60_NO_SLOT              = 0xFF; //!< Indicates no transmit slot available
+static const byte ENC28J60_TX_HOLD_MAX          = ENC28J60_TX_SLOTS - 1; //!< Maximum quantity of frames held by TxHold (one slot is kept for sending)
+static const uint16_t ENC28J60_MAX_FRAME        = 1518; //!< Maximum Ethernet frame size including CRC
+static const uint16_t ENC28J60_TX_MAX_FRAME     = (ENC28J60_TX_SLOT_SIZE - 8 < ENC28J60_MAX_FRAME - 4) ? ENC28J60_TX_SLOT_SIZE - 8 : ENC28J60_MAX_FRAME - 4; //!< Largest frame (excluding CRC) that fits in a slot with control byte and status vector
+
+static_assert(ENC28J60_TX_SLOTS >= 1 && ENC28J60_TX_SLOTS <= 8, "ENC28J60_TX_SLOTS must be 1..8");
+static_assert(ENC28J60_TX_SLOT_SIZE >= 0x0100 && !(ENC28J60_TX_SLOT_SIZE & 1), "ENC28J60_TX_SLOT_SIZE must be even and at least 256");
+static_assert(uint32_t(ENC28J60_TX_SLOTS) * ENC28J60_TX_SLOT_SIZE + ENC28J60_MAX_FRAME + 8 <= ENC28J60_SRAM_SIZE, "Receive buffer must hold at least one full size frame");
+
+//Transmit slot states
+static const byte ENC28J60_SLOT_FREE            = 0; //!< Slot may be used for next frame
+static const byte ENC28J60_SLOT_BUILDING        = 1; //!< Frame is being built in slot
+static const byte ENC28J60_SLOT_HELD            = 2; //!< Completed frame is held in slot awaiting TxRelease
+static const byte ENC28J60_SLOT_SENDING         = 3; //!< Frame sent, awaiting completion (TxPoll)
+static const uint16_t ENC28J60_RSV_SIZE         = 6; //!< Size of receive status vector
+static const uint16_t ENC28J60_CURSOR           = 0xFFFF; //!< Offset value which indicates use of current read cursor
+
+//Transmit status
+static const byte ENC28J60_TX_IDLE              = 0;
+static const byte ENC28J60_TX_IN_PROGRESS       = 1;
+static const byte ENC28J60_TX_SUCCESS           = 2;
+static const byte ENC28J60_TX_FAILED            = 3;
+
+//Receive filters (ERXFCON). Frame is accepted if it passes any enabled filter. All clear accepts every frame.
+static const byte ENC28J60_FILTER_UNICAST       = 0x80; //!< Accept frames to local MAC (UCEN)
+static const byte ENC28J60_FILTER_CRC           = 0x20; //!< Discard frames with invalid CRC (CRCEN)
+static const byte ENC28J60_FILTER_ARP           = 0x10; //!< Accept broadcast ARP frames by pattern match (PMEN)
+static const byte ENC28J60_FILTER_HASH          = 0x04; //!< Accept multicast frames matching hash table (HTEN)
+static const byte ENC28J60_FILTER_MULTICAST     = 0x02; //!< Accept all multicast frames (MCEN)
+static const byte ENC28J60_FILTER_BROADCAST     = 0x01; //!< Accept all broadcast frames (BCEN)
+
+//Transmit errors
+static const byte ENC28J60_TXERROR_CRC          = 0x01;
+static const byte ENC28J60_TXERROR_LEN          = 0x02;
+static const byte ENC28J60_TXERROR_SIZE         = 0x04;
+static const byte ENC28J60_TXERROR_DEFER        = 0x08;
+static const byte ENC28J60_TXERROR_EXCESS_DEFER = 0x10;
+static const byte ENC28J60_TXERROR_COLL         = 0x20;
+static const byte ENC28J60_TXERROR_LATE_COLL    = 0x40;
+static const byte ENC28J60_TXERROR_GIANT        = 0x80;
+
+class ENC28J60Sim
+{
+    public:
+        ENC28J60Sim();
+
+        /** @brief  Initialise the simulated controller
+        *   @param  pMac Pointer to 6 byte MAC address
+        *   @param  nChipSelectPin Ignored - present for compatibility with ENC28J60
+        *   @return <i>byte</i> Silicon revision (always non-zero)
+        */
+        byte Initialize(byte* pMac, byte nChipSelectPin = 10);
+
+        /** @brief  Populate buffer with local MAC address
+        *   @param  pBuffer Pointer to 6 byte buffer
+        */
+        void GetMac(byte* pBuffer);
+
+        /** @brief  Start processing the next received frame
+        *   @return <i>uint16_t</i> Quantity of bytes in frame (excluding CRC). Zero if no frame waiting
+        *   @note   Calling again before RxEnd returns the same frame
+        */
+        uint16_t RxBegin();
+
+        /** @brief  Get a byte from the current received frame
+        *   @param  nOffset Offset from start of frame. Default is read cursor
+        *   @return <i>byte</i> Value at offset. Zero if beyond end of frame
+        *   @note   Read cursor is advanced to the byte after the one read
+        */
+        byte RxGetByte(uint16_t nOffset = ENC28J60_CURSOR);
+
+        /** @brief  Get a 16-bit word from the current received frame
+        *   @param  nOffset Offset from start of frame. Default is read cursor
+        *   @return <i>uint16_t</i> Word in host byte order
+        */
+        uint16_t RxGetWord(uint16_t nOffset = ENC28J60_CURSOR);
+
+        /** @brief  Get data from the current received frame
+        *   @param  pBuffer Pointer to buffer to populate
+        *   @param  nLen Maximum quantity of bytes to read
+        *   @param  nOffset Offset from start of frame. Default is read cursor
+        *   @return <i>uint16_t</i> Quantity of bytes read which may be less than requested if end of frame is reached
+        */
+        uint16_t RxGetData(byte* pBuffer, uint16_t nLen, uint16_t nOffset = ENC28J60_CURSOR);
+
+        /** @brief  Finish processing current frame and release its receive buffer space
+        */
+        void RxEnd();
+
+        /** @brief  Start a transmit transaction, writing Ethernet header
+        *   @param  pMac Pointer to destination MAC address. NULL for broadcast
+        *   @param  nEthertype EtherType or length
+        */
+        void TxBegin(byte* pMac = NULL, uint16_t nEthertype = 0x0800);
+
+        /** @brief  Start a transmit transaction, writing a prebuilt header
+        *   @param  pHeader Pointer to header starting with Ethernet header (destination, source, EtherType)
+        *   @param  nLen Quantity of bytes in header
+        *   @note   Source MAC is taken from header. Cursor is left after header
+        */
+        void TxBeginFrame(const byte* pHeader, uint16_t nLen);
+
+        /** @brief  Append data to transmit frame
+        *   @param  pData Pointer to data
+        *   @param  nLen Quantity of bytes
+        *   @return <i>bool</i> True on success. False if insufficient space
+        */
+        bool TxAppend(byte* pData, uint16_t nLen);
+
+        /** @brief  Append a byte to transmit frame
+        *   @param  nData Byte to append
+        *   @return <i>bool</i> True on success. False if insufficient space
+        */
+        bool TxAppendByte(byte nData);
+
+        /** @brief  Append a 16-bit word to transmit frame
+        *   @param  nData Word in host byte order (written in network byte order)
+        *   @return <i>bool</i> True on success. False if insufficient space
+        */
+        bool TxAppendWord(uint16_t nData);
+
+        /** @brief  Append repeated byte to transmit frame
+        *   @param  nData Byte to append
+        *   @param  nLen Quantity of copies
+        *   @return <i>bool</i> True on success. False if insufficient space
+        */
+        bool TxAppendFill(byte nData, uint16_t nLen);
+
+        /** @brief  Append data from program memory to transmit frame
+        *   @param  pData Pointer to data in program memory (PROGMEM)
+        *   @param  nLen Quantity of bytes
+        *   @return <i>bool</i> True on success. False if insufficient space
+        */
+        bool TxAppend_P(const byte* pData, uint16_t nLen);
+
+        /** @brief  Write a byte to a specific position in transmit frame
+        *   @param  nOffset Offset from start of frame
+        *   @param  nData Byte to write
+        */
+        void TxWriteByte(uint16_t nOffset, byte nData);
+
+        /** @brief  Write a 16-bit word to a specific position in transmit frame
+        *   @param  nOffset Offset from start of frame
+        *   @param  nData Word in host byte order (written in network byte order)
+        */
+        void TxWriteWord(uint16_t nOffset, uint16_t nData);
+
+        /** @brief  Write data to a specific position in transmit frame
+        *   @param  nOffset Offset from start of frame
+        *   @param  pData Pointer to data
+        *   @param  nLen Quantity of bytes
+        */
+        void TxWrite(uint16_t nOffset, byte* pData, uint16_t nLen);
+
+        /** @brief  Send the transmit frame
+        */
+        void TxEnd();
+
+        /** @brief  Finish the transmit frame without sending it, keeping it in NIC memory
+        *   @return <i>byte</i> Handle of held frame or ENC28J60_NO_SLOT if frame cannot be held (frame is discarded)
+        *   @note   Next TxBegin uses another slot. Send held frame with TxRelease or free it with TxDiscard
+        *   @note   One slot is always kept available for sending so at most ENC28J60_TX_SLOTS - 1 frames may be held
+        */
+        byte TxHold();
+
+        /** @brief  Send a held frame
+        *   @param  nSlot Handle returned by TxHold
+        *   @param  pMac Pointer to destination MAC address to write into frame. NULL to leave unchanged
+        */
+        void TxRelease(byte nSlot, byte* pMac);
+
+        /** @brief  Free a held frame without sending
+        *   @param  nSlot Handle returned by TxHold
+        */
+        void TxDiscard(byte nSlot);
+
+        /** @brief  Collect completion status of sent frames, freeing their slots
+        *   @return <i>byte</i> Quantity of frames completed since last call
+        *   @note   Updates TxGetStatus / TxGetError. Call regularly - ribanENC28J60::Process does this.
+        *   @note   TxBegin calls this if no slot is free
+        */
+        byte TxPoll();
+
+        /** @brief  Configure receive filters
+        *   @param  nFilter Bitwise ENC28J60_FILTER_xxx. 0 to accept all frames (promiscuous)
+        *   @param  pMulticast Pointer to list of multicast MAC addresses (6 bytes each) used to populate hash table
+        *   @param  nGroups Quantity of multicast addresses in list
+        *   @note   Hash table is only used if ENC28J60_FILTER_HASH is set. Hash matches are imperfect so stack must still check destination address.
+        */
+        void SetRxFilter(byte nFilter, const byte* pMulticast, byte nGroups);
+
+        /** @brief  Enable interrupt on frame reception
+        *   @param  nPin Ignored - present for compatibility with ENC28J60Nic
+        *   @param  HandleInterrupt Pointer to function called on falling edge of INT. NULL to disable
+        */
+        void EnableInterrupt(byte nPin, void (*HandleInterrupt)()) { m_pHandleInterrupt = HandleInterrupt; };
+
+        /** @brief  Copy data from current received frame to transmit frame
+        *   @param  nDestination Offset within transmit frame
+        *   @param  nSource Offset within received frame
+        *   @param  nLen Quantity of bytes to copy
+        */
+        void DMACopy(uint16_t nDestination, uint16_t nSource, uint16_t nLen);
+
+        /** @brief  Swap two blocks of data within transmit frame
+        *   @param  nOffset1 Offset of first block
+        *   @param  nOffset2 Offset of second block
+        *   @param  nLen Quantity of bytes in each block
+        */
+        void TxSwap(uint16_t nOffset1, uint16_t nOffset2, uint16_t nLen);
+
+        /** @brief  Calculate Internet checksum of data in transmit frame
+        *   @param  nOffset Offset of start of data
+        *   @param  nLen Quantity of bytes
+        *   @return <i>uint16_t</i> Checksum in host byte order
+        */
+        uint16_t GetChecksum(uint16_t nOffset, uint16_t nLen);
+
+        /** @brief  Get status of last transmission
+        *   @return <i>byte</i> ENC28J60_TX_IDLE | ENC28J60_TX_IN_PROGRESS | ENC28J60_TX_SUCCESS | ENC28J60_TX_FAILED
+        */
+        byte TxGetStatus() { return m_nTxStatus; };
+
+        /** @brief  Get transmission errors
+        *   @return <i>byte</i> Bitwise flag of ENC28J60_TXERROR_xxx
+        */
+        byte TxGetError() { return m_nTxError; };
+
+        /** @brief  Clear transmission error
+        */
+        void TxClearError();
+
+        /** @brief  Swap the bytes of a 16-bit word
+        *   @param  nValue Word to swap
+        *   @return <i>uint16_t</i> Byte swapped word
+        */
+        static uint16_t SwapBytes(uint16_t nValue) { return (nValue << 8) | (nValue >> 8); };
+
+        //Simulation control
+
+        /** @brief  Inject a frame into the receive buffer as if received from the network
+        *   @param  pFrame Pointer to Ethernet frame (destination MAC onwards, excluding CRC)
+        *   @param  nLen Quantity of bytes in frame
+        *   @return <i>bool</i> True on success or if frame is rejected by receive filter. False if receive buffer has insufficient space (frame dropped)
+        */
+        bool RxInject(const byte* pFrame, uint16_t nLen);
+
+        /** @brief  Get quantity of frames waiting in receive buffer
+        *   @return <i>byte</i> Quantity of frames (EPKTCNT)
+        */
+        byte RxGetPacketCount() { return m_nRxPacketCount; };
+
+        //Receive buffer telemetry
+
+        /** @brief  Get size of receive buffer
+        *   @return <i>uint16_t</i> Quantity of bytes in receive buffer
+        */
+        uint16_t RxGetSize() { return ENC28J60_RXEND - ENC28J60_RXSTART + 1; };
+
+        /** @brief  Get most receive buffer used since last RxClearStats
+        *   @return <i>uint16_t</i> Quantity of bytes (including receive status vectors)
+        */
+        uint16_t RxGetHighWater() { return m_nRxHighWater; };
+
+        /** @brief  Get quantity of receive buffer overflow events since last RxClearStats
+        *   @return <i>uint32_t</i> Quantity of times receive buffer filled (EIR.RXERIF set)
+        *   @note   One event may lose several frames
+        */
+        uint32_t RxGetOverflowCount() { return m_lRxOverflows; };
+
+        /** @brief  Get quantity of frames lost due to full receive buffer since last RxClearStats
+        *   @return <i>uint32_t</i> Quantity of frames
+        */
+        uint32_t RxGetLostCount() { return m_lRxLost; };
+
+        /** @brief  Get quantity of frames rejected by receive filters since last RxClearStats
+        *   @return <i>uint32_t</i> Quantity of frames
+        */
+        uint32_t RxGetFilteredCount() { return m_lRxFiltered; };
+
+        /** @brief  Reset receive buffer telemetry
+        */
+        void RxClearStats();
+
+        /** @brief  Set the handler called when a frame is transmitted
+        *   @param  HandleTx Pointer to handler function or NULL to disable
+        *   @note   Handler function should be declared: void HandleTx(const byte* pFrame, uint16_t nLen);
+        */
+        void SetTxHandler(void (*HandleTx)(const byte* pFrame, uint16_t nLen)) { m_pHandleTx = HandleTx; };
+
+        /** @brief  Simulate failure of the next transmission to complete
+        *   @param  nError Bitwise flag of ENC28J60_TXERROR_xxx reported by TxGetError. 0 to cancel
+        *   @note   TxGetStatus reports ENC28J60_TX_FAILED from completion until TxClearError, like the hardware error flags
+        */
+        void SetTxError(byte nError) { m_nTxErrorNext = nError; };
+
+        /** @brief  Get pointer to simulated buffer memory
+        *   @return <i>byte*</i> Pointer to ENC28J60_SRAM_SIZE bytes
+        */
+        byte* GetSram() { return m_pSram; };
+
+    protected:
+        /** @brief  Get receive buffer address wrapped around end of receive buffer
+        *   @param  nAddress Unwrapped address
+        *   @return <i>uint16_t</i> Address within receive buffer
+        */
+        uint16_t RxWrap(uint32_t nAddress);
+
+        /** @brief  Get free space in receive buffer
+        *   @return <i>uint16_t</i> Quantity of free bytes
+        */
+        uint16_t RxGetFree();
+
+        /** @brief  Get pointer to transmit frame data at offset
+        *   @param  nOffset Offset from start of frame
+        *   @return <i>byte*</i> Pointer to SRAM
+        */
+        byte* TxGetPointer(uint16_t nOffset) { return m_pSram + ENC28J60_TXSTART + m_nTxSlot * ENC28J60_TX_SLOT_SIZE + 1 + nOffset; };
+
+        /** @brief  Check whether a frame passes the receive filters
+        *   @param  pFrame Pointer to Ethernet frame
+        *   @param  nLen Quantity of bytes in frame
+        *   @return <i>bool</i> True if frame is accepted
+        */
+        bool RxIsAccepted(const byte* pFrame, uint16_t nLen);
+
+        /** @brief  Get position of a MAC address in the receive hash table
+        *   @param  pMac Pointer to destination MAC address
+        *   @return <i>byte</i> Bit index 0..63 (CRC-32 bits 28:23)
+        */
+        static byte GetHashIndex(const byte* pMac);
+
+        /** @brief  Get a slot in which to build the next frame
+        *   @return <i>byte</i> Slot index
+        *   @note   Slots are used in turn so that the most recently sent frame is not overwritten. Waits for completion if all slots are busy.
+        */
+        byte TxAcquireSlot();
+
+        /** @brief  Pad and send frame in a transmit slot
+        *   @param  nSlot Slot index
+        *   @param  nLen Quantity of bytes in frame
+        */
+        void TxSend(byte nSlot, uint16_t nLen);
+
+        byte m_pSram[ENC28J60_SRAM_SIZE]; //!< Simulated buffer memory
+        byte m_pMac[6]; //!< Local MAC address
+        uint16_t m_nRxWrite; //!< Receive buffer write pointer (ERXWRPT)
+        uint16_t m_nRxRead; //!< Receive buffer read pointer (ERXRDPT) - hardware will not write beyond this
+        uint16_t m_nRxNext; //!< Address of next frame to process
+        uint16_t m_nRxFrame; //!< Address of current frame data (after receive status vector)
+        uint16_t m_nRxLen; //!< Quantity of bytes in current frame excluding CRC. Zero if no current frame
+        uint16_t m_nRxCursor; //!< Read cursor offset within current frame
+        byte m_nRxPacketCount; //!< Quantity of frames in receive buffer (EPKTCNT)
+        uint16_t m_nRxHighWater; //!< Most bytes used in receive buffer
+        uint32_t m_lRxOverflows; //!< Quantity of overflow events
+        uint32_t m_lRxLost; //!< Quantity of frames lost to overflow
+        bool m_bRxOverflow; //!< True whilst receive buffer is overflowing (EIR.RXERIF)
+        uint32_t m_lRxFiltered; //!< Quantity of frames rejected by receive filters
+        byte m_nRxFilter; //!< Receive filter flags (ERXFCON)
+        byte m_pRxHash[8]; //!< Receive hash table (EHT0..EHT7)
+        uint16_t m_nTxLen; //!< Quantity of bytes in transmit frame
+        uint16_t m_nTxCursor; //!< Append cursor offset within transmit frame
+        byte m_nTxSlot; //!< Slot used to build transmit frame
+        byte m_pTxSlotState[ENC28J60_TX_SLOTS]; //!< State of each slot ENC28J60_SLOT_xxx
+        uint16_t m_pTxSlotLen[ENC28J60_TX_SLOTS]; //!< Length of frame held in each slot
+        const byte* m_pTxFrame; //!< Pointer to last sent frame
+        uint16_t m_nTxFrameLen; //!< Quantity of bytes in last sent frame
+        byte m_nTxStatus; //!< Transmit status
+        byte m_nTxError; //!< Transmit error flags
+        byte m_nTxErrorNext; //!< Error flags of next transmission to complete or 0 for success
+        void (*m_pHandleTx)(const byte* pFrame, uint16_t nLen); //!< Pointer to function to handle transmitted frames
+        void (*m_pHandleInterrupt)(); //!< Pointer to function to handle INT falling edge
+};
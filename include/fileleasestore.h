@@ -0,0 +1,67 @@
+/**     FileLeaseStore - Persists DHCP lease in a file
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Default lease store on host builds. Uses the system clock so the lease expiry is known after restart.
+*/
+
+///!@note   Configure default path of lease file with #define DHCP_LEASE_FILE. Default is "dhcplease.bin" in working directory.
+///!@note   Change path at run time with SetPath, e.g. ipv4.GetLeaseStore().SetPath(sPath).
+
+#pragma once
+#include <stdio.h>
+#include <time.h>
+#include "dhcplease.h"
+
+#ifndef DHCP_LEASE_FILE
+    #define DHCP_LEASE_FILE "dhcplease.bin"
+#endif // DHCP_LEASE_FILE
+
+class FileLeaseStore
+{
+    public:
+        FileLeaseStore() : m_sPath(DHCP_LEASE_FILE) {};
+
+        /** @brief  Set path of lease file
+        *   @param  sPath Path of file. Must remain valid whilst store is used
+        */
+        void SetPath(const char* sPath) { m_sPath = sPath; };
+
+        /** @brief  Read lease record
+        *   @param  lease Record to populate
+        *   @return <i>bool</i> True if record was read. Check lease.IsValid() for content
+        */
+        bool Load(DhcpLease& lease)
+        {
+            FILE* pFile = fopen(m_sPath, "rb");
+            if(!pFile)
+                return false;
+            bool bResult = (1 == fread(&lease, sizeof(DhcpLease), 1, pFile));
+            fclose(pFile);
+            return bResult;
+        };
+
+        /** @brief  Write lease record
+        *   @param  lease Record to write
+        */
+        void Save(const DhcpLease& lease)
+        {
+            FILE* pFile = fopen(m_sPath, "wb");
+            if(!pFile)
+                return;
+            fwrite(&lease, sizeof(DhcpLease), 1, pFile);
+            fclose(pFile);
+        };
+
+        /** @brief  Remove lease record
+        */
+        void Clear() { remove(m_sPath); };
+
+        /** @brief  Get time from a clock that continues across restart
+        *   @return <i>uint32_t</i> Seconds since Unix epoch
+        */
+        uint32_t GetTime() { return time(NULL); };
+
+    private:
+        const char* m_sPath; //!< Path of lease file
+};
@@ -5,35 +5,104 @@
 *       Allows different protocols to be added
 */
 
-///!@note   Configure ARP table size with #define ARP_TABLE_SIZE. Default size is 8. 2 entries are used internally for gateway and DNS.
+///!@note   Configure ARP cache with #define ARP_TABLE_SIZE, ARP_HASH_SIZE and ARP_ENTRY_TIMEOUT. See arpcache.h
+///!@note   Configure quantity of frames awaiting ARP resolution with #define ARP_QUEUE_SIZE. Default and maximum is the quantity the NIC
+///!@note   can hold (ENC28J60_TX_HOLD_MAX, at least 1).
+///!@note   Configure quantity of cached Ethernet + IPv4 transmit headers (one per destination and protocol) with #define IPV4_HEADER_CACHE_SIZE. Default is 4.
+///!@note   Configure ARP retransmission with #define ARP_RETRY_INTERVAL (milliseconds, doubled after each retry) and ARP_RETRIES.
+///!@note   Configure quantity of DNS servers extracted from DHCP messages with #define DHCP_DNS_SERVERS. Default is 2.
+///!@note   Configure DHCP retransmission with #define DHCP_RETRY_INTERVAL and DHCP_RETRY_MAX (milliseconds, doubled after each retry, randomised by +/-1s)
+///!@note   and DHCP_REQUEST_RETRIES (quantity of requests without reply before restarting discovery).
+///!@note   Select DHCP lease persistence with LEASE_STORE_CLASS or DHCP_NO_LEASE_STORE. See leasestore.h
+///!@note   Configure UDP listeners with #define UDP_LISTENERS and UDP_HASH_SIZE. See udp.h
 
 //!@todo Wrap optional features in #define directives to allow user to minimise resource usage
 
 #pragma once
 
-const static unsigned int ARP_GATEWAY_INDEX = 0;
-const static unsigned int ARP_DNS_INDEX     = 1;
-const static unsigned int ARP_EOF           = 0xFF;
-
 #include "address.h"
+#include "arpcache.h"
+#include "checksum.h"
 #include "constants.h"
-#include "ribanTimer.h"
+#include "leasestore.h"
+#include "nic.h"
+#include "rxpacket.h"
+#include "socket.h"
+#include "stats.h"
+#include "trace.h"
+#include "udp.h"
+
+#ifndef ARP_QUEUE_SIZE
+    #define ARP_QUEUE_SIZE (ENC28J60_TX_HOLD_MAX > 0 ? ENC28J60_TX_HOLD_MAX : 1)
+#endif // ARP_QUEUE_SIZE
+#ifndef IPV4_HEADER_CACHE_SIZE
+    #define IPV4_HEADER_CACHE_SIZE 4
+#endif // IPV4_HEADER_CACHE_SIZE
+#ifndef ARP_RETRY_INTERVAL
+    #define ARP_RETRY_INTERVAL 500UL
+#endif // ARP_RETRY_INTERVAL
+#ifndef ARP_RETRIES
+    #define ARP_RETRIES 3
+#endif // ARP_RETRIES
+#ifndef DHCP_DNS_SERVERS
+    #define DHCP_DNS_SERVERS 2
+#endif // DHCP_DNS_SERVERS
+#ifndef DHCP_RETRY_INTERVAL
+    #define DHCP_RETRY_INTERVAL 4000UL
+#endif // DHCP_RETRY_INTERVAL
+#ifndef DHCP_RETRY_MAX
+    #define DHCP_RETRY_MAX 64000UL
+#endif // DHCP_RETRY_MAX
+#ifndef DHCP_REQUEST_RETRIES
+    #define DHCP_REQUEST_RETRIES 4
+#endif // DHCP_REQUEST_RETRIES
+static_assert(ARP_QUEUE_SIZE > 0 && (ARP_QUEUE_SIZE <= ENC28J60_TX_HOLD_MAX || 1 == ARP_QUEUE_SIZE), "ARP_QUEUE_SIZE must not exceed quantity of frames the NIC can hold (ENC28J60_TX_HOLD_MAX)");
+static_assert(DHCP_RETRY_INTERVAL > 1000 && DHCP_RETRY_MAX >= DHCP_RETRY_INTERVAL, "DHCP_RETRY_INTERVAL must exceed 1s randomisation and not exceed DHCP_RETRY_MAX");
+
+const static byte DHCP_PARSE_CHUNK = 32; //!< Quantity of option bytes read from NIC in each burst
+const static byte DHCP_OPTION_MAX_USED = (DHCP_DNS_SERVERS * 4 > 4) ? DHCP_DNS_SERVERS * 4 : 4; //!< Longest option value that is used
+static_assert(DHCP_DNS_SERVERS > 0 && DHCP_OPTION_MAX_USED + 2 <= DHCP_PARSE_CHUNK, "DHCP_DNS_SERVERS must be 1..7");
+
+/** DHCP reply fields and options extracted in a single pass */
+class DhcpMessage
+{
+    public:
+        byte nType; //!< Message type (option 53) DHCP_TYPE_xxx or 0 if absent
+        uint32_t lXid; //!< Transaction ID
+        Ipv4Address addressYour; //!< Address assigned to client (yiaddr)
+        Ipv4Address addressServer; //!< Server identifier (option 54) or siaddr if absent
+        Ipv4Address addressMask; //!< Subnet mask (option 1). Null if absent
+        Ipv4Address addressRouter; //!< First router (option 3). Null if absent
+        Ipv4Address aDns[DHCP_DNS_SERVERS]; //!< DNS servers (option 6)
+        byte nDnsCount; //!< Quantity of DNS servers in aDns
+        uint32_t lLease; //!< Lease time in seconds (option 51). 0 if absent
+        uint32_t lT1; //!< Renewal time in seconds (option 58). 0 if absent
+        uint32_t lT2; //!< Rebinding time in seconds (option 59). 0 if absent
+};
 
-class ENC28J60;
+/** Frame held in NIC memory whilst the MAC address of its next hop is resolved */
+class ArpPending
+{
+    public:
+        Ipv4Address ip; //!< IP address of next hop (target host or gateway)
+        byte nSlot; //!< NIC transmit slot holding frame or ENC28J60_NO_SLOT if descriptor is free
+        byte nRetries; //!< Quantity of ARP requests retransmitted
+        uint32_t lNext; //!< Time (millis) of next ARP retransmission
+};
 
-class ArpEntry
+/** Prebuilt Ethernet + IPv4 header for a destination, written to NIC in one burst by TxBegin */
+class TxHeader
 {
     public:
-        ArpEntry()
-        {
-            //Reset IP and MAC addresses to all zeros
-            memset(ip, 0, 4);
-            memset(mac, 0, 6);
-        };
-        byte ip[4];
-        byte mac[6];
+        Ipv4Address ip; //!< Destination IP address
+        byte nProtocol; //!< IPv4 protocol. 0 if entry is unused
+        uint16_t nSum; //!< One's complement sum of header excluding length, identification and checksum
+        uint16_t nAddressSum; //!< One's complement sum of source and destination addresses (transport pseudo-header)
+        byte aHeader[MAC_HEADER_SIZE + IPV4_HEADER_SIZE]; //!< Header with length, identification and checksum cleared
 };
 
+class ribanENC28J60;
+
 class IPV4
 {
     public:
@@ -44,8 +113,12 @@ class IPV4
 
         /** @brief  Initialise IPV4 class
         *   @param  pInterface Pointer to the network interface object
+        *   @param  pRxPacket Pointer to the descriptor of the current received frame
+        *   @param  pStats Pointer to the statistics block shared with the network interface
+        *   @param  pSockets Pointer to the socket index of the network interface
+        *   @param  pOwner Pointer to the Ethernet interface which programs receive filters from GetRxFilter. NULL if none
         */
-        void Initialise(ENC28J60* pInterface);
+        void Initialise(NIC* pInterface, RxPacket* pRxPacket, NetStats* pStats, SocketIndex* pSockets, ribanENC28J60* pOwner = NULL);
 
         /** @brief  Configure network interface with static IP
         *   @param  pIp Pointer to IP address (4 bytes). 0 for no change.
@@ -54,22 +127,35 @@ class IPV4
         *   @param  pNetmask Pointer to subnet mask (4 bytes). 0 for no change. Default = 0
         *   @return <i>bool</i> Returns true on success - actually always true
         */
-        void ConfigureStaticIp(Address *pIp,
-                            Address *pGw = 0,
-                            Address *pDns = 0,
-                            Address *pNetmask = 0);
+        void ConfigureStaticIp(Ipv4Address* pIp,
+                            Ipv4Address* pGw = 0,
+                            Ipv4Address* pDns = 0,
+                            Ipv4Address* pNetmask = 0);
 
         /** @brief  Configure network interface with DHCP
+        *   @note   If a lease was stored by a previous run, asks server to confirm it (INIT-REBOOT) and only discovers if server refuses
         *   @note   Accepts first DHCP offer and broadcasts response to ensure all DHCP servers are aware of chosen one
+        *   @note   Does not block. Messages are retransmitted and the lease renewed by Poll (called by ribanENC28J60::Process)
         */
         void ConfigureDhcp();
 
+        /** @brief  Get DHCP client state
+        *   @return <i>byte</i> DHCP_xxx state, e.g. DHCP_BOUND once an address is assigned
+        */
+        byte GetDhcpStatus() { return m_nDhcpStatus; };
+
+        /** @brief  Get DHCP lease store, e.g. to change its location or forget the stored lease
+        *   @return <i>LeaseStore&</i> Lease store selected at compile time (see leasestore.h)
+        */
+        LeaseStore& GetLeaseStore() { return m_leaseStore; };
+
         /** @brief  Starts a transmission transaction
         *   @param  pTarget Pointer to the target host IP address. Set to null to use source address in last recieved packet
         *   @param  nProtocol IPV4 protocol number
         *   @note   Creates Ethernet and IP header. Clears checksum and length fields
+        *   @note   If MAC address of next hop is not known the frame is held by TxEnd until ARP resolves it. Does not block.
         */
-        void TxBegin(Address* pTarget, uint16_t nProtocol);
+        void TxBegin(Ipv4Address* pTarget, uint16_t nProtocol);
 
         /** @brief  Append byte to transmission transaction
         *   @param  nData Single byte of data to append
@@ -91,11 +177,26 @@ class IPV4
         */
         bool TxAppend(byte* pData, uint16_t nLen);
 
+        /** @brief  Appends repeated byte to transmission transaction
+        *   @param  nData Byte to append
+        *   @param  nLen Quantity of copies
+        *   @return <i>bool</i> True on success. Fails if insufficient space in Tx buffer
+        *   @note   Written to NIC in one bus transaction rather than one per byte
+        */
+        bool TxAppendFill(byte nData, uint16_t nLen);
+
+        /** @brief  Appends constant data from program memory to transmission transaction
+        *   @param  pData Pointer to data in program memory (PROGMEM)
+        *   @param  nLen Quantity of bytes to append
+        *   @return <i>bool</i> True on success. Fails if insufficient space in Tx buffer
+        */
+        bool TxAppend_P(const byte* pData, uint16_t nLen);
+
         /** @brief  Write a single byte to specific position in write buffer
         *   @param  nOffset Position offset from start of IPV4 payload
         *   @param  nData Data to write
         *   @note   Leaves append buffer cursor unchanged. Tx packet size is only changed if nOffset is greater than current size
-        *   @todo   Add unit test for TxWriteByte
+        *   @note   Running checksum replaces overwritten byte using one NIC DMA checksum. Appending costs no DMA
         */
         void TxWriteByte(uint16_t nOffset, byte nData);
 
@@ -103,8 +204,8 @@ class IPV4
         *   @param  nOffset Position offset from start of IPV4 payload
         *   @param  nData Data to write
         *   @note   nData is host byte order, word is written network byte order, i.e. bytes are swapped before writing to buffer
-        *   @note   Leaves append buffer cursor unchanged. Tx packet size is only changed if nOffset is greater than current size
-        *   @todo   Add unit test for TxWriteWord
+        *   @note   Leaves append buffer cursor unchanged. Tx packet size is only changed if nOffset + 2 is greater than current size
+        *   @note   Running checksum replaces overwritten bytes using one NIC DMA checksum. Appending costs no DMA
         */
         void TxWriteWord(uint16_t nOffset, uint16_t nData);
 
@@ -112,30 +213,49 @@ class IPV4
         *   @param  nOffset Position offset from start of IPV4 payload
         *   @param  pData Pointer to data to be written
         *   @param  nLen Quantity of bytes to write to buffer
-        *   @note   Leaves append buffer cursor and Tx packet size counter unchanged.
+        *   @note   Leaves append buffer cursor unchanged. Tx packet size is only changed if nOffset + nLen is greater than current size
+        *   @note   Running checksum replaces overwritten bytes using one NIC DMA checksum. Appending costs no DMA
         */
         void TxWrite(uint16_t nOffset, byte* pData, uint16_t nLen);
 
         /** @brief  Ends a transmission transaction
+        *   @return <i>bool</i> True if frame was sent or is held awaiting ARP resolution. False if it was dropped (no route or ARP queue full)
         *   @note   Finishes populating header and requests packet be sent
+        *   @note   UDP, TCP and ICMP checksums are completed from the running sum of payload so must be left zero by the caller
+        */
+        bool TxEnd();
+
+        /** @brief  Process IPV4 packet
+        *   @note   Expects received frame descriptor to be populated
+        */
+        void Process();
+
+        /** @brief  Perform periodic tasks, e.g. DHCP lease renewal and retransmit ARP requests for frames awaiting resolution
+        *   @note   Call frequently - ribanENC28J60::Process calls this
         */
-        void TxEnd();
+        void Poll();
 
-        /** @brief  Process packet / data
-        *   @param  nLen Quantity of data bytes in recieve buffer
-        *   @note   Expects Rx read pointer to point to start of IP header
+        /** @brief  Get a snapshot of network statistics including ARP cache counters
+        *   @param  stats Statistics block to populate
+        *   @param  bReset True to reset counters after copying. Statistics block is shared so all layers are reset
         */
-        void Process(uint16_t nLen);
+        void GetStats(NetStats& stats, bool bReset = false);
+
+        /** @brief  Get receive filters required by IPV4
+        *   @return <i>byte</i> Bitwise ENC28J60_FILTER_xxx
+        *   @note   Unicast and broadcast ARP always. All broadcasts whilst DHCP is obtaining an address.
+        */
+        byte GetRxFilter();
 
         /** @brief  Process ARP packet
-        *   @param  nLen Quantity of bytes in ARP packet
         *   @return <i>byte</i> Index of ARP table entry updated. Otherwise ARP_EOF.
-        *   @note   Recieve pointer should point to start of ARP header
+        *   @note   Expects received frame descriptor to be populated
         *   @note   Assumes valid IPV4 ARP header
-        *   @note   Library maintins an ARP table. If this message is an ARP reply, the table is updated if there is an entry with the same IP address.
+        *   @note   Library maintins an ARP cache. Any ARP message refreshes the sender's entry if it is in the cache. A request for our address adds the sender to the cache.
+        *   @note   Frames waiting for the sender's MAC address are sent
         *   @note   See ArpLookup
         */
-        byte ProcessArp(uint16_t nLen);
+        byte ProcessArp();
 
         /** @brief  Send an echo request (ping)
         *   @param  pIp Pointer to remote host IP
@@ -146,7 +266,7 @@ class IPV4
         *   @note   Handler function should be declared: void HandleEchoResponse(uint16_t nSequence); where nSequence is the echo response sequence number
         *   @todo   Add ping parameters, e.g. quantity of pings, response handler, etc.
         */
-        uint16_t Ping(Address* pIp, void (*HandleEchoResponse)(uint16_t nSequence));
+        uint16_t Ping(Ipv4Address* pIp, void (*HandleEchoResponse)(uint16_t nSequence));
 
         /** @brief  Enable / disable ICMP (ping) responses
         *   @param  bEnable True to enable, false to disable
@@ -157,82 +277,108 @@ class IPV4
         *   @param  pIp Pointer to IP address
         *   @param  nTimeout Quantity of milliseconds to wait for ARP response before abandoning ARP request as failed. Default is 0 which results in immediate return but no result if host not already known.
         *   @return <i>byte*</i> Pointer to resulting MAC address or NULL on failure (timeout)
-        *   @note   If host is in ARP table, returns pointer to MAC immediately. Otherwise add host IP to ARP table, clear MAC and make ARP request.
+        *   @note   If host is in ARP cache and not expired, returns pointer to MAC immediately. Otherwise add host IP to ARP cache, clear MAC and make ARP request.
         *   @note   If nTimeout > 0, wait for ARP response, dropping all other network traffic. This should only be done when it is acceptable to miss messages, e.g. populate ARP table at startup.
-        *   @note   If nTimeout = 0 and host not in ARP table, return NULL. This may be used to begin a Tx transaction with broadcast address (default).
+        *   @note   If nTimeout = 0 and host not in ARP table, return NULL without blocking
+        *   @note   TxBegin does not use this function. Frames to unresolved hosts are held until the ARP reply arrives.
         */
-        byte* ArpLookup(Address* pIp, uint16_t nTimeout = 0);
+        byte* ArpLookup(Ipv4Address* pIp, uint16_t nTimeout = 0);
 
         /** @brief  Gets the local IP address
-        *   @return <i>Address*</i> Pointer to an Address object representing local IP address
+        *   @return <i>Ipv4Address*</i> Pointer to an Ipv4Address object representing local IP address
         */
-        Address* GetIp() { return &m_addressLocal; };
+        Ipv4Address* GetIp() { return &m_addressLocal; };
 
         /** @brief  Gets the gateway IP address
-        *   @return <i>Address*</i> Pointer to an Address object representing gatewayIP address
-        *   @todo   Change to return Address pointer
+        *   @return <i>Ipv4Address*</i> Pointer to an Ipv4Address object representing gatewayIP address
         */
-        byte* GetGw() { return m_aArpTable[ARP_GATEWAY_INDEX].ip; };
+        Ipv4Address* GetGw() { return &m_arpCache.GetEntry(ARP_GATEWAY_INDEX)->ip; };
 
         /** @brief  Gets the DNS IP address
-        *   @return <i>Address*</i> Pointer to an Address object representing DNS server IP address
-        *   @todo   Change to return Address pointer
+        *   @return <i>Ipv4Address*</i> Pointer to an Ipv4Address object representing DNS server IP address
         */
-        byte* GetDns() { return m_aArpTable[ARP_DNS_INDEX].ip; };
+        Ipv4Address* GetDns() { return &m_arpCache.GetEntry(ARP_DNS_INDEX)->ip; };
 
         /** @brief  Gets the local subnet mask
-        *   @return <i>Address*</i> Pointer to an Address object representing local subnet mask
+        *   @return <i>Ipv4Address*</i> Pointer to an Ipv4Address object representing local subnet mask
         */
-        Address* GetNetmask() { return &m_addressMask; };
+        Ipv4Address* GetNetmask() { return &m_addressMask; };
 
         /** @brief  Gets the subnet broadcast address
-        *   @return <i>Address*</i> Pointer to an Address object representing broadcast address
+        *   @return <i>Ipv4Address*</i> Pointer to an Ipv4Address object representing broadcast address
         */
-        Address* GetBroadcastIp() { return &m_addressBroadcast; };
+        Ipv4Address* GetBroadcastIp() { return &m_addressBroadcast; };
 
         /** @brief  Get the IP address of the remote host from the last recieved packet
-        *   @param  address Address object to populate
+        *   @param  address Ipv4Address object to populate
         *   @brief  Implement GetRemoteIp
         */
-        void GetRemoteIp(Address& address);
+        void GetRemoteIp(Ipv4Address& address);
 
         /** @brief  Check whether using DHCP or static IP
         *   @return <i>bool</i> True if using DHCP
         */
         bool IsUsingDhcp() { return m_nDhcpStatus != DHCP_DISABLED; };
 
+        UDP udp; //!< UDP layer. Use to listen on ports and send datagrams
+
     protected:
 
     private:
         /** @brief  Check for ICMP and process
-        *   @param  nLen Quantity of bytes in payload
         *   @return <i>bool</i> True if ICMP packet processed
         */
-        bool ProcessIcmp(uint16_t nLen);
+        bool ProcessIcmp();
 
         /** @brief  Process UDP messages
-        *   @param  nLen Quantity of bytes in payload
-        *   @note   Expects Rx read pointer to point to start of UDP header (immediately after IPV4 header)
+        *   @note   Validates length, finds listener (or socket) then validates checksum so datagrams without a listener are dropped first
+        */
+        void ProcessUdp();
+
+        /** @brief  Process TCP segment
+        *   @note   Finds socket by destination port then validates checksum so segments not sent to this host are dropped first
+        *   @note   Segments to a closed port or not accepted by their socket are answered with a reset
+        */
+        void ProcessTcp();
+
+        /** @brief  Send TCP reset in reply to current received segment
+        *   @param  nLen Quantity of bytes in segment including TCP header
+        *   @note   Nothing is sent in reply to a reset
         */
-        void ProcessUdp(uint16_t nLen);
+        void SendTcpReset(uint16_t nLen);
+
+        /** @brief  Check transport checksum of current received frame
+        *   @param  nLen Quantity of bytes in transport header and payload
+        *   @param  nProtocol IP_PROTOCOL_UDP | IP_PROTOCOL_TCP
+        *   @return <i>bool</i> True if checksum is valid or absent (zero UDP checksum)
+        *   @note   Segment is copied to a transmit slot by DMA and pseudo-header written before it so that the NIC checksums both
+        *   @note   Cost: a DMA copy and a DMA checksum of nLen bytes, each polled to completion, plus a 12 byte SPI write. The copy
+        *           is built in the free transmit slot that the next TxBegin uses so must not be called while a frame is being built.
+        *           Only called for datagrams and segments that have a listener or socket.
+        */
+        bool IsChecksumValid(uint16_t nLen, byte nProtocol);
+
+        /** @brief  Process DHCP reply to current exchange
+        */
+        void ProcessDhcp();
 
         /** @brief  Checks whether IP address is same as local host IP address
         *   @param  pIp IP address to check
         *   @return <i>bool</i> True if same
         */
-        bool IsLocalIp(byte* pIp);
+        bool IsLocalIp(const byte* pIp);
 
         /** @brief  Checks whether IP address is on local subnet or whether a gatway is required to reach host
         *   @param  pIp IP address to check
         *   @return <i>bool</i> True if on local subnet
         */
-        bool IsOnLocalSubnet(Address* pIp);
+        bool IsOnLocalSubnet(const byte* pIp);
 
         /** @brief  Check whether IP address is a broadcast address (subnet or global)
         *   @param  pIp Pointer to IP address
         *   @return <i>bool</i> True if a broadcast address
         */
-        bool IsBroadcast(Address* pIp);
+        bool IsBroadcast(Ipv4Address* pIp);
 
         /** @brief  Check whether IP address is a multicast address
         *   @param  pIp Pointer to IP address
@@ -240,46 +386,123 @@ class IPV4
         */
         bool IsMulticast(byte* pIp);
 
-        /** @brief  Send a DHCP message
-        *   @param  nType DHCP message type
+        /** @brief  Send an ARP request
+        *   @param  pIp Pointer to IP address to resolve
+        *   @note   Adds unresolved entry to ARP cache so that reply is accepted
+        */
+        void SendArpRequest(const byte* pIp);
+
+        /** @brief  Hold current transmit frame until its next hop is resolved
+        *   @return <i>bool</i> True if frame is held. False if it is dropped (no route, ARP_QUEUE_SIZE frames held or NIC cannot hold it)
+        *   @note   Sends ARP request unless one is already outstanding for the next hop
+        */
+        bool ParkFrame();
+
+        /** @brief  Send held frames whose next hop is now resolved
+        */
+        void ReleaseFrames();
+
+        /** @brief  Add data to running checksum of transmit payload
+        *   @param  nOffset Offset of data from start of IPV4 payload
+        *   @param  pData Pointer to data
+        *   @param  nLen Quantity of bytes
+        */
+        void AddTxSum(uint16_t nOffset, const byte* pData, uint16_t nLen);
+
+        /** @brief  Prepare running checksum of transmit payload for a write
+        *   @param  nOffset Offset of write from start of IPV4 payload
+        *   @param  nLen Quantity of bytes to be written
+        *   @note   Call before writing. Removes bytes to be overwritten or adds bytes skipped beyond end of payload
+        *   @note   Bytes written are added to running checksum by caller after writing
+        */
+        void ReplaceTxSum(uint16_t nOffset, uint16_t nLen);
+
+        /** @brief  Get cached transmit header for destination, building it if not cached or local address has changed
+        *   @param  ip Destination IP address
+        *   @param  nProtocol IPv4 protocol
+        *   @return <i>TxHeader*</i> Pointer to header. Replaces least recently built entry if not cached
+        */
+        TxHeader* GetTxHeader(const Ipv4Address& ip, byte nProtocol);
+
+        /** @brief  Update subnet and broadcast addresses from local address and netmask
         */
-        void SendDhcpPacket(byte nType);
+        void UpdateSubnet();
 
-        /** @brief  Find a DHCP option
-        *   @param  nOption DHCP option number to find
-        *   @param  nLen Quantity of bytes in UDP payload
-        *   @return <i>bool</i> True if option found
-        *   @note   This method may be processor intensive but minimises memory resources
-        *   @note   An alternative would be to parse all options before using any
+        /** @brief  Change DHCP client state and send any message required by new state
+        *   @param  nState DHCP_xxx state
         */
-        bool FindDhcpOption(byte nOption, uint16_t nLen);
+        void SetDhcpState(byte nState);
+
+        /** @brief  Send the DHCP message for current state (discover or request) and schedule its retransmission
+        */
+        void SendDhcpPacket();
+
+        /** @brief  Retransmit DHCP messages and advance lease timers
+        */
+        void PollDhcp();
+
+        /** @brief  Get a pseudo-random number
+        *   @return <i>uint32_t</i> Pseudo-random number (xorshift seeded from MAC and time)
+        */
+        uint32_t Random();
+
+        /** @brief  Parse received DHCP reply
+        *   @param  message DHCP message to populate
+        *   @return <i>bool</i> True if valid DHCP reply
+        *   @note   Options are walked once, reading from NIC in bursts of DHCP_PARSE_CHUNK bytes, bounded by UDP payload length
+        */
+        bool ParseDhcp(DhcpMessage& message);
+
+        /** @brief  Write current lease to lease store
+        */
+        void SaveLease();
+
+        /** @brief  Bind to stored lease without server confirmation
+        *   @return <i>bool</i> True if stored lease is valid and known to be unexpired
+        *   @note   Used when no server answers INIT-REBOOT (RFC 2131 3.2)
+        */
+        bool RestoreLease();
 
         bool m_bIcmpEnabled; //!< True to enable ICMP responses
-        Address m_addressLocal; //!< IP address of local host
-        Address m_addressRemote; //!< IP address of remote host
-        Address m_addressGw; //!< IP address of default gateway / router
-        Address m_addressDns; //!< IP address of DNS server - only supports one DNS server
-        Address m_addressMask; //!< Subnet mask
-        Address m_addressSubnet; //!< Subnet IP address
-        Address m_addressBroadcast; //!< Subnet broadcast IP address
-        Address m_addressDhcp; //!< IP address of DHCP server
-        byte m_nDhcpStatus; //!< Status of DHCP configuration DHCP_DISABLED | DHCP_REQUESTED | DHCP_BOUND | DHCP_RENEWING
-
-        byte m_nArpCursor; //!< Cursor holds index of next ARP table entry to update
+        Ipv4Address m_addressLocal; //!< IP address of local host
+        Ipv4Address m_addressRemote; //!< IP address of remote host
+        Ipv4Address m_addressMask; //!< Subnet mask
+        Ipv4Address m_addressSubnet; //!< Subnet IP address
+        Ipv4Address m_addressBroadcast; //!< Subnet broadcast IP address
+        Ipv4Address m_addressDhcp; //!< IP address of DHCP server
+        Ipv4Address m_addressOffered; //!< IP address offered by DHCP server
+        byte m_nDhcpStatus; //!< Status of DHCP configuration DHCP_xxx
+        byte m_nDhcpRetries; //!< Quantity of DHCP messages sent in current state
+        uint32_t m_lDhcpXid; //!< DHCP transaction ID of current exchange
+        uint32_t m_lDhcpNext; //!< Time (millis) of next DHCP retransmission
+        uint32_t m_lDhcpTick; //!< Time (millis) lease clock last advanced
+        uint32_t m_lDhcpElapsed; //!< Seconds since lease was granted
+        uint32_t m_lDhcpT1; //!< Lease renewal time in seconds
+        uint32_t m_lDhcpT2; //!< Lease rebinding time in seconds
+        uint32_t m_lDhcpLease; //!< Lease duration in seconds
+        uint32_t m_lRandom; //!< Pseudo-random number generator state
+        LeaseStore m_leaseStore; //!< Persistent storage of DHCP lease
+
         byte m_nIpv4Protocol; //!< IPv4 protocol of current message
         uint16_t m_nTxPayload; //!< Quantity of bytes in IPV4 Tx payload
-        uint16_t m_nHeaderLength; //!< Quantity of bytes in recieved IPV4 header. Note: All transmitted packets have IPV4_HEADER_SIZE sized header
         uint16_t m_nPingSequence; //!< ICMP echo response sequence number
         uint16_t m_nIdentification; //!< IPv4 packet identification
         uint16_t m_nIpv4Port; //!< IPv4 port number
-
-        ENC28J60* m_pInterface; //!< Pointer to network interface object
-        Timer m_timerDhcp; //!< DHCP lease renewal timer
-
-        #ifndef ARP_TABLE_SIZE
-            #define ARP_TABLE_SIZE 8 //Default to ARP table of gateway, DNS plus 6 remote host addresses
-        #endif // ARP_TABLE_SIZE
-        ArpEntry m_aArpTable[ARP_TABLE_SIZE + 2]; //!< ARP table. Minimum size is 2 to hold gateway and DNS host IP/MAC
+        Ipv4Address m_addressNextHop; //!< IP address of next hop of current transmit frame
+        bool m_bTxResolved; //!< True if MAC address of next hop of current transmit frame is known
+        uint16_t m_nTxSum; //!< Header sum of current transmit frame excluding length, identification and checksum
+        uint16_t m_nTxAddressSum; //!< Sum of source and destination addresses of current transmit frame
+        uint32_t m_lTxPayloadSum; //!< Running one's complement sum (unfolded) of IPV4 payload appended and written
+        TxHeader m_aTxHeader[IPV4_HEADER_CACHE_SIZE]; //!< Cached transmit headers
+        byte m_nTxHeaderNext; //!< Index of next cached transmit header to replace
+        ArpPending m_aArpQueue[ARP_QUEUE_SIZE]; //!< Frames awaiting ARP resolution
+
+        NIC* m_pInterface; //!< Pointer to network interface object
+        RxPacket* m_pRxPacket; //!< Pointer to descriptor of current received frame
+        NetStats* m_pStats; //!< Pointer to statistics block
+        SocketIndex* m_pSockets; //!< Pointer to socket index
+        ribanENC28J60* m_pOwner; //!< Pointer to Ethernet interface which owns this protocol handler
+        ArpCache m_arpCache; //!< ARP cache. Gateway and DNS are pinned (only supports one DNS server)
         void (*m_pHandleEchoResponse)(uint16_t nSequence); //!< Pointer to function to handle echo response (pong)
 
 };
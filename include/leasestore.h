@@ -0,0 +1,45 @@
+/**     LeaseStore - DHCP lease storage policy
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       IPV4 saves each DHCP lease and on restart asks the server to confirm it (INIT-REBOOT) rather than discovering again.
+*       The storage backend is selected at compile time (static dispatch, no virtual functions) and must provide:
+*           bool Load(DhcpLease& lease) - false if no record
+*           void Save(const DhcpLease& lease)
+*           void Clear()
+*           uint32_t GetTime() - seconds from a clock that continues across restart or 0 if none
+*
+*       Backend is selected by:
+*           #define LEASE_STORE_CLASS and LEASE_STORE_HEADER to use a custom store, e.g. -DLEASE_STORE_CLASS=MyStore -DLEASE_STORE_HEADER=\"mystore.h\"
+*           #define DHCP_NO_LEASE_STORE to disable persistence (every start performs discovery)
+*           #define DHCP_LEASE_EEPROM_ADDRESS on target to store lease in EEPROM at that address (see eepromleasestore.h)
+*           Otherwise nothing is stored on target (EEPROM may hold application data) or a file is used on host builds (see fileleasestore.h)
+*/
+
+#pragma once
+#include "dhcplease.h"
+
+/** Lease store which stores nothing */
+class NullLeaseStore
+{
+    public:
+        bool Load(DhcpLease& lease) { return false; };
+        void Save(const DhcpLease& lease) {};
+        void Clear() {};
+        uint32_t GetTime() { return 0; };
+};
+
+#if defined(LEASE_STORE_CLASS)
+    #include LEASE_STORE_HEADER
+    typedef LEASE_STORE_CLASS LeaseStore;
+#elif defined(DHCP_NO_LEASE_STORE)
+    typedef NullLeaseStore LeaseStore;
+#elif defined(ARDUINO) && defined(DHCP_LEASE_EEPROM_ADDRESS)
+    #include "eepromleasestore.h"
+    typedef EepromLeaseStore LeaseStore;
+#elif defined(ARDUINO)
+    typedef NullLeaseStore LeaseStore;
+#else
+    #include "fileleasestore.h"
+    typedef FileLeaseStore LeaseStore;
+#endif
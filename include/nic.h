@@ -0,0 +1,72 @@
+/**     Network interface controller (NIC) backend selection
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       The NIC driver is a compile-time policy. The stack calls the class named NIC directly so there are no
+*       virtual functions and no vtable cost. Each NIC class must implement public functions:
+*           byte Initialize(byte* pMac, byte nChipSelectPin)
+*           void GetMac(byte* pBuffer)
+*           uint16_t RxBegin()
+*           byte RxGetByte(uint16_t nOffset = cursor)
+*           uint16_t RxGetWord(uint16_t nOffset = cursor)
+*           uint16_t RxGetData(byte* pBuffer, uint16_t nLen, uint16_t nOffset = cursor)
+*           void RxEnd()
+*           void TxBegin(byte* pMac = NULL, uint16_t nEthertype = 0x0800)
+*           void TxBeginFrame(const byte* pHeader, uint16_t nLen) - start frame with prebuilt header including Ethernet header
+*           bool TxAppend(byte* pData, uint16_t nLen)
+*           bool TxAppendByte(byte nData)
+*           bool TxAppendWord(uint16_t nData)
+*           bool TxAppendFill(byte nData, uint16_t nLen) - append nLen copies of nData
+*           bool TxAppend_P(const byte* pData, uint16_t nLen) - append data from program memory (PROGMEM)
+*           void TxWriteByte(uint16_t nOffset, byte nData)
+*           void TxWriteWord(uint16_t nOffset, uint16_t nData)
+*           void TxWrite(uint16_t nOffset, byte* pData, uint16_t nLen)
+*           void TxEnd()
+*           byte TxHold() - returns ENC28J60_NO_SLOT if frame cannot be held
+*           void TxRelease(byte nSlot, byte* pMac)
+*           void TxDiscard(byte nSlot)
+*           byte TxPoll() - returns quantity of sent frames completed since last call (0 if NIC waits within TxBegin)
+*           void DMACopy(uint16_t nDestination, uint16_t nSource, uint16_t nLen)
+*           void TxSwap(uint16_t nOffset1, uint16_t nOffset2, uint16_t nLen)
+*           uint16_t GetChecksum(uint16_t nOffset, uint16_t nLen) - returns checksum in host byte order
+*           byte TxGetStatus()
+*           byte TxGetError()
+*           void TxClearError()
+*           static uint16_t SwapBytes(uint16_t nValue)
+*           uint16_t RxGetSize()
+*           uint16_t RxGetHighWater()
+*           uint32_t RxGetOverflowCount()
+*           uint32_t RxGetLostCount() - receive telemetry functions return all bits set (0xFFFF / 0xFFFFFFFF) if not reported
+*           void RxClearStats()
+*           void SetRxFilter(byte nFilter, const byte* pMulticast, byte nGroups) - nFilter is bitwise ENC28J60_FILTER_xxx
+*           void EnableInterrupt(byte nPin, void (*HandleInterrupt)()) - NULL handler disables
+*       and define constants:
+*           ENC28J60_NO_SLOT - handle returned by TxHold when frame cannot be held
+*           ENC28J60_TX_HOLD_MAX - maximum quantity of frames TxHold can hold at once
+*
+*       Backend is selected by:
+*           #define NIC_CLASS and NIC_HEADER to use a custom NIC class, e.g. -DNIC_CLASS=MyNic -DNIC_HEADER=\"mynic.h\"
+*           #define NIC_SIM to use the ENC28J60 simulator (default when ARDUINO is not defined, i.e. host builds)
+*           Otherwise the ENC28J60 driver is used (wrapped by ENC28J60Nic to provide any functions it lacks)
+*       #define NIC_SPI_METER to wrap the selected backend with SPI bus accounting (see spimeter.h)
+*/
+
+#pragma once
+
+#if defined(NIC_CLASS)
+    #include NIC_HEADER
+    typedef NIC_CLASS NicDriver;
+#elif defined(NIC_SIM) || !defined(ARDUINO)
+    #include "enc28j60sim.h"
+    typedef ENC28J60Sim NicDriver;
+#else
+    #include "enc28j60nic.h"
+    typedef ENC28J60Nic NicDriver;
+#endif
+
+#ifdef NIC_SPI_METER
+    #include "spimeter.h"
+    typedef SpiMeter<NicDriver> NIC;
+#else
+    typedef NicDriver NIC;
+#endif
@@ -0,0 +1,133 @@
+/**     PcapNic - ENC28J60 simulator fed from a packet capture file
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Host only NIC backend which memory maps a pcap or pcapng capture file and injects each Ethernet frame
+*       into the simulated receive buffer. Transmitted frames may be written to an output pcap file.
+*       Select with -DNIC_CLASS=PcapNic -DNIC_HEADER=\"pcapnic.h\"
+*/
+
+#pragma once
+#include "enc28j60sim.h"
+#include <stdio.h>
+
+static const byte PCAPNG_MAX_INTERFACES = 16; //!< Maximum quantity of pcapng interfaces per section
+
+class PcapNic : public ENC28J60Sim
+{
+    public:
+        PcapNic();
+        ~PcapNic();
+
+        /** @brief  Open a capture file to replay
+        *   @param  sFilename Path to pcap or pcapng file
+        *   @return <i>bool</i> True on success. False if file cannot be mapped or is not an Ethernet capture
+        */
+        bool Open(const char* sFilename);
+
+        /** @brief  Open a pcap file to which transmitted frames are written
+        *   @param  sFilename Path to output file
+        *   @return <i>bool</i> True on success
+        */
+        bool OpenOutput(const char* sFilename);
+
+        /** @brief  Close input and output files
+        */
+        void Close();
+
+        /** @brief  Restart replay from first frame of capture
+        */
+        void Rewind();
+
+        /** @brief  Inject next frame from capture into receive buffer
+        *   @return <i>bool</i> True if a frame was injected. False at end of capture
+        *   @note   Frames which do not fit in receive buffer are counted as dropped and skipped
+        */
+        bool Feed();
+
+        /** @brief  Enable / disable automatic feeding of frames from RxBegin
+        *   @param  bEnable True to feed next frame from capture whenever receive buffer is empty (default)
+        *   @note   Disable to control feeding with Feed, e.g. to time processing of individual frames
+        */
+        void SetAutoFeed(bool bEnable) { m_bAutoFeed = bEnable; };
+
+        /** @brief  Get the EtherType of the last frame fed from capture
+        *   @return <i>uint16_t</i> EtherType or length field
+        */
+        uint16_t GetEthertype() { return m_nEthertype; };
+
+        /** @brief  Get the last frame fed from capture
+        *   @return <i>const byte*</i> Pointer to frame within capture. NULL if no frame fed
+        */
+        const byte* GetFrame() { return m_pFrame; };
+
+        /** @brief  Get length of the last frame fed from capture
+        *   @return <i>uint16_t</i> Quantity of bytes in frame
+        */
+        uint16_t GetFrameLength() { return m_nFrameLen; };
+
+        /** @brief  Get quantity of frames fed from capture
+        *   @return <i>uint32_t</i> Quantity of frames
+        */
+        uint32_t GetFedCount() { return m_nFed; };
+
+        /** @brief  Get quantity of frames which did not fit in receive buffer
+        *   @return <i>uint32_t</i> Quantity of frames
+        */
+        uint32_t GetDroppedCount() { return m_nDropped; };
+
+        /** @brief  Start processing the next received frame, feeding from capture if enabled
+        *   @return <i>uint16_t</i> Quantity of bytes in frame. Zero if no frame waiting
+        */
+        uint16_t RxBegin();
+
+        /** @brief  Send the transmit frame, writing it to output file if open
+        */
+        void TxEnd();
+
+        /** @brief  Send a held frame, writing it to output file if open
+        *   @param  nSlot Handle returned by TxHold
+        *   @param  pMac Pointer to destination MAC address. NULL to leave unchanged
+        */
+        void TxRelease(byte nSlot, byte* pMac);
+
+    private:
+        /** @brief  Write last transmitted frame to output file if open
+        */
+        void WriteOutput();
+
+        /** @brief  Get next Ethernet frame from capture
+        *   @param  ppFrame Pointer to pointer which is set to start of frame
+        *   @param  pnLen Pointer to length which is set to captured length
+        *   @return <i>bool</i> True if frame found. False at end of capture
+        */
+        bool NextFrame(const byte** ppFrame, uint32_t* pnLen);
+
+        /** @brief  Read 32-bit value from capture in capture's byte order
+        *   @param  nOffset Offset within capture
+        *   @return <i>uint32_t</i> Value
+        */
+        uint32_t Read32(size_t nOffset);
+
+        /** @brief  Read 16-bit value from capture in capture's byte order
+        *   @param  nOffset Offset within capture
+        *   @return <i>uint16_t</i> Value
+        */
+        uint16_t Read16(size_t nOffset);
+
+        const byte* m_pCapture; //!< Pointer to memory mapped capture
+        size_t m_nSize; //!< Size of capture in bytes
+        size_t m_nPos; //!< Offset of next record / block in capture
+        size_t m_nFirst; //!< Offset of first record / block in capture
+        bool m_bSwapped; //!< True if capture byte order differs from host
+        bool m_bPcapng; //!< True if capture is pcapng format
+        bool m_bAutoFeed; //!< True to feed frames from RxBegin
+        const byte* m_pFrame; //!< Pointer to last fed frame
+        uint16_t m_nFrameLen; //!< Quantity of bytes in last fed frame
+        uint16_t m_nEthertype; //!< EtherType of last fed frame
+        uint32_t m_nFed; //!< Quantity of frames fed
+        uint32_t m_nDropped; //!< Quantity of frames dropped due to full receive buffer
+        uint16_t m_pLinkType[PCAPNG_MAX_INTERFACES]; //!< Link type of each pcapng interface in current section
+        byte m_nInterfaces; //!< Quantity of pcapng interfaces in current section
+        FILE* m_pOutput; //!< Output pcap file
+};
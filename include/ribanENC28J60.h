@@ -1,7 +1,7 @@
 /**     ribanENC28J60 - Extensible Ethernet interface
 *       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
 *       Source availble at https://github.com/riban-bw/ribanENC28J60.git
-*       Allows use of different network interface controllers (not yet!)
+*       Allows use of different network interface controllers (selected at compile time - see nic.h)
 *       Allows different protocols to be added
 *
 *       Proposed protocols:
@@ -9,55 +9,68 @@
 *           IPV4 (done) (and IPV6)
 *               ARP (done)
 *               ICMP (echo request and response done)
-*               DHCP
+*               DHCP (done)
 *               DNS
-*               UDP
+*               UDP (done)
 *                  (S)NTP
 *                   SNMP
-*               TCP
+*               TCP (minimal - see socket.h)
 *                   HTTP
 *                   TELNET
 *                   SMTP
 *                   FTP
 *
-*       Uses instance of a network interface chip driver (m_nic). Each NIC driver must implemnent public functions:
-*           Initialize
-*           packetReceive
-*           TxGetStatus
-*           TxClearError
-*           TxBegin
-*           TxAppend
-*           TxWrite
-*           TxEnd
+*       Uses instance of a network interface chip driver (m_nic). The driver class is a compile-time policy
+*       selected in nic.h which lists the public functions each NIC driver must implement.
+*       Sockets (socket.h) are held in an index so received frames reach their socket by hashing protocol and port.
+*       Frames of EtherTypes not handled by the stack or a RAW socket are passed to DoProcess.
+*
 *       Currently implemented NICs:
 *           ENC28J60
+*           ENC28J60Sim (in-memory simulator for host builds)
 */
 
 #pragma once
 #include <Arduino.h>
-#include "enc28j60.h"
+#include "nic.h"
+#include "rxpacket.h"
 #include "ipv4.h"
 #include "socket.h"
 #include "address.h"
 #include "constants.h"
+#include "stats.h"
+#include "trace.h"
 
 #define IP4
 
+///!@note   Configure how often protocol timers run during a receive burst with #define PROCESS_TIMER_FRAMES. Default is every 8 frames.
+#ifndef PROCESS_TIMER_FRAMES
+    #define PROCESS_TIMER_FRAMES 8
+#endif // PROCESS_TIMER_FRAMES
+///!@note   Configure quantity of multicast groups that may be joined with #define RX_MULTICAST_GROUPS. Default is 4.
+#ifndef RX_MULTICAST_GROUPS
+    #define RX_MULTICAST_GROUPS 4
+#endif // RX_MULTICAST_GROUPS
+
 /** @brief  This class provides an Ethernet interface with minimal IP protocol
 *   @note   Use #define IP6 to enable IPV6. Use #undefine IP4 to disable IPV4
 *   @note   Check initialisation is successful by calling GetNicVersion() which should be non-zero.
 *   @note   Call Process() regularly (e.g. within main program loop)
+*   @note   Call EnableInterrupt to only read the NIC when it signals that frames have arrived
+*   @note   NIC receive filters are programmed from what the stack and application listen for so unwanted frames are
+*           discarded by the NIC. Use ListenBroadcast and JoinMulticast to receive more.
 */
 class ribanENC28J60
 {
     friend class Socket;
+    friend class IPV4;
     public:
         /** @brief  Initialise the interface
         *   @param  addressMAC The MAC address for the network interface
         *   @param  nChipSelectPin Arduino pin number used as chip select. Default = 10.
         *   @return <i>bool</i> True on success
         */
-        bool Initialise(Address &addressMAC, byte nChipSelectPin = 10);
+        bool Initialise(const MacAddress& addressMAC, byte nChipSelectPin = 10);
 
         /** @brief  Get the ENC28J60 silicon version
         *   @return <i>byte</i> Version. Zero if not correctly initialised
@@ -70,6 +83,55 @@ class ribanENC28J60
         */
         byte Process();
 
+        /** @brief  Process recieved data and send any pending data, limiting the work done
+        *   @param  nMaxFrames Maximum quantity of received frames to process. 0 for no limit
+        *   @param  lMaxTime Maximum time to spend processing received frames in microseconds. 0 for no limit
+        *   @return <i>bool</i> True if work remains (budget exhausted before receive buffer emptied)
+        *   @note   Protocol timers (ARP retries, DHCP renewal, transmit completion) run on entry and every PROCESS_TIMER_FRAMES frames
+        *   @note   Time limit is checked between frames so a call may exceed it by the time to process one frame
+        */
+        bool Process(byte nMaxFrames, uint32_t lMaxTime = 0);
+
+        /** @brief  Enable interrupt driven receive
+        *   @param  nPin Arduino pin connected to NIC INT output
+        *   @note   Process then only reads received frames after an interrupt so idle calls cost no SPI transactions
+        *   @note   Process must still be called regularly to run protocol timers
+        *   @note   Only one interface may use interrupt mode
+        */
+        void EnableInterrupt(byte nPin);
+
+        /** @brief  Disable interrupt driven receive, returning to polling the NIC on each call to Process
+        */
+        void DisableInterrupt();
+
+        /** @brief  Check whether received frames are waiting to be processed
+        *   @return <i>bool</i> True if an interrupt is pending. Always true in polling mode.
+        */
+        bool IsRxPending() { return !m_bInterrupt || s_nRxPending; };
+
+        /** @brief  Request reception of all broadcast frames
+        *   @param  bEnable True to add a broadcast listener, false to remove one
+        *   @note   Listeners are counted. Broadcasts are received whilst any listener remains. ARP broadcasts are always received.
+        */
+        void ListenBroadcast(bool bEnable);
+
+        /** @brief  Receive frames sent to a multicast MAC address
+        *   @param  addressMac Multicast MAC address
+        *   @return <i>bool</i> True on success. False if RX_MULTICAST_GROUPS already joined
+        */
+        bool JoinMulticast(const MacAddress& addressMac);
+
+        /** @brief  Stop receiving frames sent to a multicast MAC address
+        *   @param  addressMac Multicast MAC address
+        */
+        void LeaveMulticast(const MacAddress& addressMac);
+
+        /** @brief  Get a snapshot of network statistics
+        *   @param  stats Statistics block to populate
+        *   @param  bReset True to reset all counters (including NIC receive buffer telemetry) after copying
+        */
+        void GetStats(NetStats& stats, bool bReset = false);
+
         /** @brief  Set the handler function for transmission errors
         *   @param  TxErrorHandler Pointer to error handler function
         *   @note   Error handler function should be declared: void HandleTxError();
@@ -77,9 +139,9 @@ class ribanENC28J60
         void SetTxErrorHandler(void (*HandleTxError)());
 
         /** @brief  Get the local hardware (MAC) address
-        *   @return <i>Address*</i> Pointer to the MAC address
+        *   @return <i>MacAddress*</i> Pointer to the MAC address
         */
-        Address* GetMac() { return &m_addressLocalMac; };
+        MacAddress* GetMac() { return &m_addressLocalMac; };
 
         /** @brief  Starts a raw transmission transaction
         *   @param  pMac Optional pointer to remote host MAC address. Default is broadcast address FF:FF:FF:FF:FF:FF
@@ -87,7 +149,7 @@ class ribanENC28J60
         *   @note   Call TxAppend to append data to the transmission transaction
         *   @note   Call TxEnd to close transaction and send packet
         */
-        void TxBegin(Address* pMac = NULL, uint16_t nEthertype = 0x0800);
+        void TxBegin(MacAddress* pMac = NULL, uint16_t nEthertype = 0x0800);
 
         /** @brief  Appends data to a raw transmission transaction
         *   @param  pData Pointer to data to append
@@ -107,6 +169,12 @@ class ribanENC28J60
         */
         byte TxGetError() { return m_nic.TxGetError(); }
 
+        /** @brief  Get the network interface controller driver
+        *   @return <i>NIC*</i> Pointer to the driver object
+        *   @note   Allows host builds to inject frames into and capture frames from the simulator
+        */
+        NIC* GetNic() { return &m_nic; };
+
         #ifdef IP4
         IPV4 ipv4;
         #endif // IP4
@@ -119,16 +187,17 @@ class ribanENC28J60
 
         /** @brief  Adds a socket to the event handler
         *   @param  pSocket Pointer to the socket
+        *   @return <i>bool</i> True on success. False if another socket uses same protocol and port
         */
-        void AddSocket(Socket* pSocket);
+        bool AddSocket(Socket* pSocket) { return m_sockets.Add(pSocket); };
 
         /** @brief  Removes socket from event handler
         *   @param  pSocket Pointer to the socket
         */
-        void RemoveSocket(Socket* pSocket);
+        void RemoveSocket(Socket* pSocket) { m_sockets.Remove(pSocket); };
 
-        Address m_addressLocalMac; //!< Pointer to local host hardware MAC address
-        Address m_addressRemoteMac; //!< Pointer to remote host hardware MAC address
+        MacAddress m_addressLocalMac; //!< Local host hardware MAC address
+        MacAddress m_addressRemoteMac; //!< Remote host hardware MAC address
 
     private:
 
@@ -141,10 +210,49 @@ class ribanENC28J60
         */
         virtual uint16_t DoProcess(uint16_t nType, uint16_t nLen) { return 0; };
 
+        /** @brief  Run protocol timers and collect transmit completion
+        */
+        void ServiceTimers();
+
+        /** @brief  Program NIC receive filters if listeners have changed
+        */
+        void UpdateRxFilter();
+
+        /** @brief  Check whether a received frame is wanted
+        *   @return <i>bool</i> True if wanted. False for multicast frames to groups not joined (NIC hash filter is imperfect)
+        */
+        bool IsRxWanted();
+
+        /** @brief  Process received frames within a budget
+        *   @param  nMaxFrames Maximum quantity of frames. 0 for no limit
+        *   @param  lMaxTime Maximum time in microseconds. 0 for no limit
+        *   @param  nRxCnt Quantity of frames processed, updated by this function
+        *   @return <i>bool</i> True if budget exhausted
+        */
+        bool Service(byte nMaxFrames, uint32_t lMaxTime, byte& nRxCnt);
+
+        /** @brief  Interrupt service routine for NIC INT pin
+        */
+        static void HandleInterrupt();
+
+        static volatile byte s_nRxPending; //!< Quantity of interrupts not yet serviced by Process
+
         byte m_nChipSelectPin; //!< Index of pin used to select NIC
+        byte m_nInterruptPin; //!< Index of pin connected to NIC INT
+        bool m_bInterrupt; //!< True if using interrupt driven receive
+        byte m_nRxFilter; //!< Receive filters programmed in NIC
+        bool m_bRxFilterChanged; //!< True if multicast groups have changed since NIC was programmed
+        byte m_nBroadcastListeners; //!< Quantity of broadcast listeners
+        byte m_nMulticastGroups; //!< Quantity of multicast groups joined
+        MacAddress m_aMulticast[RX_MULTICAST_GROUPS]; //!< Joined multicast groups (contiguous so NIC can read as a list)
         //!@todo Do we need to handle Tx errors and if so, does this actually work?
         void (*m_pHandleTxError)(); //!< Pointer to function to handle Tx error
 
-        ENC28J60 m_nic; //!< ENC28J60 network interface object
+        NIC m_nic; //!< Network interface controller driver object
+        RxPacket m_rxPacket; //!< Prefetched and parsed headers of current received frame
+        SocketIndex m_sockets; //!< Index of listening and connected sockets
+        NetStats m_stats; //!< Statistics block shared with protocol layers
+        uint16_t m_nTxEthertype; //!< EtherType of frame being sent with TxBegin
+        uint16_t m_nTxLen; //!< Quantity of bytes in frame being sent with TxBegin
         byte m_nNicVersion; //!< ENC28J60 silicon version - zero if ENC28J60 not initialised succesfully
 };
@@ -0,0 +1,65 @@
+/**     RxPacket - Descriptor of the current received frame
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       The Ethernet, IPV4 and transport (UDP / ICMP / TCP) headers are fetched from the NIC in a single burst
+*       when a frame is received then parsed once so that protocol handlers need not read header fields one at a time.
+*/
+
+///!@note   Configure prefetch size with #define RX_PREFETCH_SIZE. Default (and minimum) is 42 which holds Ethernet + ARP or Ethernet + IPV4 + 8 byte transport header.
+
+#pragma once
+#include "Arduino.h"
+#include "constants.h"
+#include "nic.h"
+
+#ifndef RX_PREFETCH_SIZE
+    #define RX_PREFETCH_SIZE 42 //Ethernet (14) + IPV4 without options (20) + UDP / ICMP header (8). Also Ethernet + ARP (28)
+#endif // RX_PREFETCH_SIZE
+
+const static uint16_t RX_L4_OFFSET = MAC_HEADER_SIZE + IPV4_HEADER_SIZE; //!< Offset of transport header within prefetch buffer (regardless of IPV4 options)
+
+class RxPacket
+{
+    public:
+        /** @brief  Fetch and parse headers of the current received frame
+        *   @param  pInterface Pointer to the network interface which has a current frame (after RxBegin)
+        *   @param  nLen Quantity of bytes in frame
+        *   @note   Reads up to RX_PREFETCH_SIZE bytes in one burst. If IPV4 header has options the transport header
+        *           is fetched with a second burst and placed at RX_L4_OFFSET within the buffer
+        */
+        void Fetch(NIC* pInterface, uint16_t nLen);
+
+        /** @brief  Get a byte from the prefetch buffer
+        *   @param  nOffset Offset within buffer
+        *   @return <i>byte</i> Value
+        */
+        byte GetByte(uint16_t nOffset) { return pData[nOffset]; };
+
+        /** @brief  Get a 16-bit word from the prefetch buffer
+        *   @param  nOffset Offset within buffer
+        *   @return <i>uint16_t</i> Value in host byte order
+        */
+        uint16_t GetWord(uint16_t nOffset) { return (pData[nOffset] << 8) | pData[nOffset + 1]; };
+
+        /** @brief  Get pointer to IPV4 header (or ARP header) within prefetch buffer
+        *   @return <i>byte*</i> Pointer to first byte after Ethernet header
+        */
+        byte* GetNetworkHeader() { return pData + MAC_HEADER_SIZE; };
+
+        /** @brief  Get pointer to transport header within prefetch buffer
+        *   @return <i>byte*</i> Pointer to transport header. Only valid if bL4 is true
+        */
+        byte* GetTransportHeader() { return pData + RX_L4_OFFSET; };
+
+        byte pData[RX_PREFETCH_SIZE]; //!< Prefetched header bytes
+        uint16_t nLen; //!< Quantity of bytes in frame
+        uint16_t nEthertype; //!< EtherType (or length) of frame. Zero if frame too short
+        bool bIpv4; //!< True if frame contains a valid IPV4 header
+        bool bL4; //!< True if transport header was fetched (frame is long enough)
+        byte nProtocol; //!< IPV4 protocol
+        byte nIpHeaderLen; //!< Quantity of bytes in IPV4 header including options
+        uint16_t nPayloadOffset; //!< Offset of IPV4 payload (transport header) within frame
+        uint16_t nPayloadLen; //!< Quantity of bytes in IPV4 payload
+        uint16_t nCursor; //!< Frame offset of NIC read pointer after last read by an RxView or ENC28J60_CURSOR if unknown. Shared by all views of frame
+};
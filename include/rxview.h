@@ -0,0 +1,138 @@
+/**     RxView - Read-only view of part of the current received frame
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       A view is a window (offset and length) onto the frame held in NIC memory. Data is read from the NIC only when
+*       requested so a handler that needs a few fields of a large payload reads only those bytes and no RAM buffer
+*       holds the payload. All reads are bounded by the view. Reading past the end returns zero and sets an overrun
+*       flag which may be checked once after parsing rather than after each field.
+*       Sequential reads continue from the NIC read pointer so cost one SPI transaction without rewriting the pointer.
+*       The NIC has one read pointer per frame so its position is recorded in the frame descriptor (RxPacket) and shared
+*       by all views (and copies of views) of the frame.
+*       A view is only valid until its handler returns. Do not read the received frame by other means whilst using a view.
+*/
+
+#pragma once
+#include "Arduino.h"
+#include "nic.h"
+#include "rxpacket.h"
+
+class RxView
+{
+    public:
+        /** @brief  Create a view of the current received frame
+        *   @param  pInterface Pointer to the network interface which has a current frame
+        *   @param  pRxPacket Pointer to the descriptor of the current frame
+        *   @param  nOffset Offset of start of view within frame
+        *   @param  nLen Quantity of bytes in view
+        */
+        RxView(NIC* pInterface, RxPacket* pRxPacket, uint16_t nOffset, uint16_t nLen) :
+            m_pInterface(pInterface),
+            m_pRxPacket(pRxPacket),
+            m_nOffset(nOffset),
+            m_nLen(nLen),
+            m_nPosition(0),
+            m_bOverrun(false)
+        {};
+
+        /** @brief  Get offset of view within frame
+        *   @return <i>uint16_t</i> Offset of first byte of view from start of frame
+        */
+        uint16_t GetOffset() const { return m_nOffset; };
+
+        /** @brief  Get size of view
+        *   @return <i>uint16_t</i> Quantity of bytes in view
+        */
+        uint16_t GetLength() const { return m_nLen; };
+
+        /** @brief  Get read position
+        *   @return <i>uint16_t</i> Offset of next byte to read from start of view
+        */
+        uint16_t GetPosition() const { return m_nPosition; };
+
+        /** @brief  Get quantity of bytes remaining after read position
+        *   @return <i>uint16_t</i> Quantity of bytes
+        */
+        uint16_t Available() const { return m_nLen - m_nPosition; };
+
+        /** @brief  Check whether a read or skip passed the end of the view
+        *   @return <i>bool</i> True if any access was out of bounds
+        */
+        bool IsOverrun() const { return m_bOverrun; };
+
+        /** @brief  Read data and advance read position
+        *   @param  pBuffer Pointer to buffer to populate
+        *   @param  nLen Maximum quantity of bytes to read
+        *   @return <i>uint16_t</i> Quantity of bytes read (limited to end of view)
+        */
+        uint16_t Read(byte* pBuffer, uint16_t nLen);
+
+        /** @brief  Read data without changing read position
+        *   @param  pBuffer Pointer to buffer to populate
+        *   @param  nLen Maximum quantity of bytes to read
+        *   @param  nPosition Offset from start of view
+        *   @return <i>uint16_t</i> Quantity of bytes read (limited to end of view)
+        */
+        uint16_t Peek(byte* pBuffer, uint16_t nLen, uint16_t nPosition);
+
+        /** @brief  Advance read position without reading
+        *   @param  nLen Quantity of bytes to skip
+        *   @return <i>bool</i> True on success. False if beyond end of view (position is moved to end)
+        */
+        bool Skip(uint16_t nLen);
+
+        /** @brief  Move read position
+        *   @param  nPosition Offset from start of view
+        *   @return <i>bool</i> True on success. False if beyond end of view (position is moved to end)
+        */
+        bool Seek(uint16_t nPosition);
+
+        /** @brief  Read a byte and advance read position
+        *   @return <i>byte</i> Value. Zero if beyond end of view
+        */
+        byte ReadByte();
+
+        /** @brief  Read a big-endian (network order) 16-bit word and advance read position
+        *   @return <i>uint16_t</i> Value in host byte order. Zero if beyond end of view
+        */
+        uint16_t ReadWord();
+
+        /** @brief  Read a big-endian (network order) 32-bit word and advance read position
+        *   @return <i>uint32_t</i> Value in host byte order. Zero if beyond end of view
+        */
+        uint32_t ReadLong();
+
+        /** @brief  Get a byte without changing read position
+        *   @param  nPosition Offset from start of view
+        *   @return <i>byte</i> Value. Zero if beyond end of view
+        */
+        byte GetByte(uint16_t nPosition);
+
+        /** @brief  Get a big-endian (network order) 16-bit word without changing read position
+        *   @param  nPosition Offset from start of view
+        *   @return <i>uint16_t</i> Value in host byte order. Zero if beyond end of view
+        */
+        uint16_t GetWord(uint16_t nPosition);
+
+        /** @brief  Get a big-endian (network order) 32-bit word without changing read position
+        *   @param  nPosition Offset from start of view
+        *   @return <i>uint32_t</i> Value in host byte order. Zero if beyond end of view
+        */
+        uint32_t GetLong(uint16_t nPosition);
+
+    private:
+        /** @brief  Read a field from NIC
+        *   @param  pBuffer Pointer to buffer to populate
+        *   @param  nLen Quantity of bytes in field
+        *   @param  nPosition Offset from start of view
+        *   @return <i>bool</i> True on success. False (buffer cleared, overrun set) if field is not wholly within view
+        */
+        bool Fetch(byte* pBuffer, uint16_t nLen, uint16_t nPosition);
+
+        NIC* m_pInterface; //!< Pointer to network interface holding frame
+        RxPacket* m_pRxPacket; //!< Pointer to descriptor of frame which records NIC read pointer
+        uint16_t m_nOffset; //!< Offset of view within frame
+        uint16_t m_nLen; //!< Quantity of bytes in view
+        uint16_t m_nPosition; //!< Read position within view
+        bool m_bOverrun; //!< True if an access was out of bounds
+};
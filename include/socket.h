@@ -1,9 +1,37 @@
 /*  Create one socket per network connection.
     Each socket describes a single connection. This may be UDP listening, UDP send, TCP listening, TCP connect, RAW listening, RAW sending.
     Only one packet may be populated for transmission. Recieve data handlers may send data so all transmission calls should be complete before calling nic.process.
+
+    Sockets that are listening or connected are held in an index (SocketIndex) keyed by protocol and local port (EtherType
+    for RAW sockets). Received frames are passed to their socket by hashing the key so dispatch does not search all sockets.
+    RAW sockets (AF_PACKET) receive frames of EtherTypes not handled by the stack. Frames not claimed by a socket are passed
+    to ribanENC28J60::DoProcess.
+    TCP is minimal: one connection per socket, in order segments only, no retransmission and no urgent data. A listening
+    socket accepts one connection at a time and returns to listening when it is closed. Segments to a closed port, or from
+    another peer to a socket which is busy with a connection, are answered with a reset. A handshake which does not complete
+    within TCP_HANDSHAKE_TIMEOUT is abandoned. AF_INET6 and raw IP (AF_INET with PROTO_RAW) sockets are not implemented.
 */
+
+///!@note   Configure quantity of socket index hash buckets with #define SOCKET_HASH_SIZE. Must be a power of 2. Default is 8.
+///!@note   Configure TCP receive window advertised to peers with #define TCP_WINDOW. Default is 1024.
+///!@note   Configure time allowed for TCP handshake (milliseconds) with #define TCP_HANDSHAKE_TIMEOUT. Default is 3000.
+
 #pragma once
 #include "Arduino.h"
+#include "address.h"
+#include "rxview.h"
+
+#ifndef SOCKET_HASH_SIZE
+    #define SOCKET_HASH_SIZE 8
+#endif // SOCKET_HASH_SIZE
+#ifndef TCP_WINDOW
+    #define TCP_WINDOW 1024
+#endif // TCP_WINDOW
+#ifndef TCP_HANDSHAKE_TIMEOUT
+    #define TCP_HANDSHAKE_TIMEOUT 3000UL
+#endif // TCP_HANDSHAKE_TIMEOUT
+
+static_assert((SOCKET_HASH_SIZE & (SOCKET_HASH_SIZE - 1)) == 0, "SOCKET_HASH_SIZE must be a power of 2");
 
 //Define Domain names
 static const byte AF_INET   = 0;
@@ -14,84 +42,226 @@ static const byte PROTO_RAW = 0;
 static const byte PROTO_UDP = 1;
 static const byte PROTO_TCP = 2;
 
-static const byte SOCK_IDLE         = 0;
-static const byte SOCK_WAIT         = 1;
-static const byte SOCK_TBA          = 2; //!@todo Define connection states
-static const byte SOCK_CONNECTED    = 3;
+//Connection states
+static const byte SOCK_CLOSED       = 0; //!< Not listening or connected
+static const byte SOCK_LISTEN       = 1; //!< Bound to local port, waiting for data (UDP, RAW) or connection (TCP)
+static const byte SOCK_SYN_SENT     = 2; //!< TCP connection requested
+static const byte SOCK_SYN_RECEIVED = 3; //!< TCP connection request received and acknowledged
+static const byte SOCK_CONNECTED    = 4; //!< Connected (TCP established or UDP with default remote host)
+static const byte SOCK_FIN_WAIT     = 5; //!< TCP close requested by this host
+static const byte SOCK_LAST_ACK     = 6; //!< TCP closed by remote host, waiting for acknowledgement of our close
+
+class ribanENC28J60;
+class Socket;
+
+/** Index of listening and connected sockets keyed by protocol and local port */
+class SocketIndex
+{
+    public:
+        SocketIndex();
+
+        /** @brief  Add socket to index using its protocol and local port
+        *   @param  pSocket Pointer to socket
+        *   @return <i>bool</i> True on success. False if another socket uses same protocol and port
+        */
+        bool Add(Socket* pSocket);
+
+        /** @brief  Remove socket from index
+        *   @param  pSocket Pointer to socket
+        */
+        void Remove(Socket* pSocket);
+
+        /** @brief  Find socket by protocol and local port
+        *   @param  nProtocol PROTO_RAW | PROTO_UDP | PROTO_TCP
+        *   @param  nPort Local port (EtherType for PROTO_RAW)
+        *   @return <i>Socket*</i> Pointer to socket or NULL if none
+        */
+        Socket* Find(byte nProtocol, uint16_t nPort);
 
-class Address;
-class ribanEthernet;
+        /** @brief  Get an unused local port for an outgoing connection
+        *   @param  nProtocol PROTO_UDP | PROTO_TCP
+        *   @return <i>uint16_t</i> Port in dynamic range (49152..65535)
+        */
+        uint16_t GetEphemeralPort(byte nProtocol);
+
+        /** @brief  Run socket timers (idle disconnection)
+        *   @note   Called by ribanENC28J60::Process
+        */
+        void Poll();
+
+    private:
+        /** @brief  Get hash bucket for key
+        *   @param  nProtocol Protocol
+        *   @param  nPort Port
+        *   @return <i>byte</i> Bucket index
+        */
+        static byte Hash(byte nProtocol, uint16_t nPort) { return (nPort ^ (nPort >> 8) ^ nProtocol) & (SOCKET_HASH_SIZE - 1); };
+
+        Socket* m_pBucket[SOCKET_HASH_SIZE]; //!< First socket in each hash bucket or NULL
+        uint16_t m_nNextPort; //!< Next ephemeral port to try
+};
 
 class Socket
 {
+    friend class SocketIndex;
+    friend class IPV4;
+    friend class ribanENC28J60;
     public:
         /** @brief  Create a socket
         *   @param  nDomain The network domain: AF_INET | AF_INET6 | AF_PACKET
         *   @param  pInterface Pointer to the network interface to use
         *   @param  nProtocol Protocol to implement within socket communication: PROTO_RAW | PROTO_UDP | PROTO_TCP
+        *   @note   AF_PACKET sockets are always PROTO_RAW. AF_INET sockets are PROTO_UDP or PROTO_TCP. AF_INET6 is not yet implemented.
         *   @todo   Consider order of arguments
         */
-        Socket(byte nDomain, ribanEthernet* pInterface, byte nProtocol);
+        Socket(byte nDomain, ribanENC28J60* pInterface, byte nProtocol);
 
         virtual ~Socket();
 
         /** @brief  Starts a transmission transaction
-        *   @param  pAddress Pointer to the target address. Null to use socket connection. Default is NULL
-        *   @param  nPort Target port number. Zero to use socket connection. Default is zero.
+        *   @param  pAddress Pointer to the target address. Null to use socket connection (or sender of last received data). Default is NULL
+        *   @param  nPort Target port number (EtherType for RAW). Zero to use socket connection. Default is zero.
+        *   @return <i>bool</i> True on success. Fails if TCP socket is not connected or no target is known
+        *   @note   TCP sockets only send to their connection so ignore pAddress and nPort
         */
-        void TxBegin(Address* pAddress = NULL, uint16_t nPort = 0);
+        bool TxBegin(Address* pAddress = NULL, uint16_t nPort = 0);
 
         /** @brief  Appends data to a transmission transaction
         *   @param  pData Pointer to data to append
         *   @param  nSize Quantity of bytes to append
+        *   @return <i>bool</i> True on success. Fails if insufficient space in Tx buffer
         */
-        void TxAppend(byte* pData, uint16_t nSize);
+        bool TxAppend(byte* pData, uint16_t nSize);
 
         /** @brief  Completes transmit transaction and sends data
+        *   @return <i>bool</i> True if frame was sent or is held awaiting ARP resolution. False if it was dropped
+        *   @note   TCP sequence only advances if the segment is sent or held
         */
-        void TxEnd();
+        bool TxEnd();
 
         /** @brief  Sends a packet of data
         *   @param  pData Pointer to data
         *   @param  nSize Quantity of bytes to send
         *   @param  pAddress Pointer to an address to send to (optional - only for connectionless protocols, e.g. UDP)
         *   @param  nPort Port to send to (optional - only for connectionless protocols, e.g. UDP)
+        *   @return <i>bool</i> True on success
         */
-        void Send(byte* pData, uint16_t nSize, Address* pAddress = NULL, uint16_t nPort = 0);
+        bool Send(byte* pData, uint16_t nSize, Address* pAddress = NULL, uint16_t nPort = 0);
 
         /** @brief  Binds a socket to a port and triggers an event when packets are recieved on that port. Automatically accepts connections.
-        *   @param  nPort Port number to listen on
-        *   @todo   Add event handler pointer to param list
+        *   @param  nPort Port number to listen on (EtherType for RAW sockets)
+        *   @param  pHandler Pointer to function called with each received payload. Default is NULL (data is discarded)
+        *   @return <i>bool</i> True on success. False if port is used by another socket or UDP listener or domain is not implemented
+        *   @note   Handler function should be declared: void HandleData(Socket* pSocket, RxView& view); where view covers the payload (RAW: Ethernet payload)
         */
-        void Listen(uint16_t nPort);
+        bool Listen(uint16_t nPort, void (*pHandler)(Socket* pSocket, RxView& view) = NULL);
 
         /** @brief  Sets a time (in seconds) to disconnect connection
         *   @brief  nTimeout Quantity of seconds of idle (no data flow) before connection cleared. Set to zero to disable disconnection on idle
         */
-        void SetIdleDisconnectTimeout(uint16_t nTimeout);
+        void SetIdleDisconnectTimeout(uint16_t nTimeout) { m_nIdleTimeout = nTimeout; };
 
-        /** @brief  Attempts to make a connection to a remote host. If the socket is configured for connectionless protocol.
-        *   @brief  address Address of remote host
-        *   @brief  nPort Port number to connect to
-        *   @note   Only valid for session type protocols, e.g. TCP
-        *   @todo   Should Connect block until connected / failed and return success?
+        /** @brief  Attempts to make a connection to a remote host. If the socket is configured for connectionless protocol the remote host becomes default target.
+        *   @param  address Address of remote host
+        *   @param  nPort Port number to connect to
+        *   @param  pHandler Pointer to function called with each received payload. Default is NULL (data is discarded)
+        *   @return <i>bool</i> True if connection started (UDP: remote host set)
+        *   @note   Does not block. TCP connection is complete when IsConnected returns true
         */
-        void Connect(const Address& address, uint16_t nPort);
+        bool Connect(const Address& address, uint16_t nPort, void (*pHandler)(Socket* pSocket, RxView& view) = NULL);
+
+        /** @brief  Close connection or stop listening
+        *   @note   Connected TCP socket sends FIN. A listening TCP socket returns to listening once the connection is closed
+        *   @note   Otherwise the socket stops listening and releases its local port, e.g. call again to stop a TCP server
+        */
+        void Close();
 
         /** @brief  Check if socket connected
         *   @return <i>bool</i> True if socket connected
         */
-        bool IsConnected();
+        bool IsConnected() { return SOCK_CONNECTED == m_nStatus; };
 
+        /** @brief  Get connection status
+        *   @return <i>byte</i> SOCK_xxx state
+        */
+        byte GetStatus() { return m_nStatus; };
+
+        /** @brief  Get local port
+        *   @return <i>uint16_t</i> Local port (EtherType for RAW) or zero if not bound
+        */
+        uint16_t GetLocalPort() { return m_nPortLocal; };
+
+        /** @brief  Get remote port
+        *   @return <i>uint16_t</i> Port of connection or sender of last received data
+        */
+        uint16_t GetRemotePort() { return m_nPortRemote; };
+
+        /** @brief  Get remote address
+        *   @return <i>Address*</i> IPV4 address (MAC for RAW) of connection or sender of last received data
+        */
+        Address* GetRemoteAddress() { return &m_addressRemote; };
 
     protected:
 
     private:
+        /** @brief  Pass received UDP datagram to handler
+        *   @param  nLen Quantity of bytes in datagram including header
+        */
+        void ProcessUdp(uint16_t nLen);
+
+        /** @brief  Process received TCP segment
+        *   @param  nLen Quantity of bytes in segment including header
+        *   @return <i>bool</i> True if segment was accepted. False if from another host or not valid in current state
+        */
+        bool ProcessTcp(uint16_t nLen);
+
+        /** @brief  Pass received frame to handler
+        *   @param  nLen Quantity of bytes in frame
+        */
+        void ProcessRaw(uint16_t nLen);
+
+        /** @brief  Run idle disconnection timer
+        */
+        void Poll();
+
+        /** @brief  Start TCP segment to connected host
+        *   @param  nFlags Bitwise TCP_FLAG_xxx
+        *   @return <i>bool</i> True on success
+        */
+        bool TcpBegin(byte nFlags);
+
+        /** @brief  Send TCP segment without data
+        *   @param  nFlags Bitwise TCP_FLAG_xxx. SYN and FIN consume a sequence number
+        */
+        void SendTcp(byte nFlags);
+
+        /** @brief  Drop connection, returning to listening if socket was listening
+        */
+        void Disconnect();
+
+        /** @brief  Add socket to interface socket index using its protocol and local port
+        *   @return <i>bool</i> True on success. False if port is used by another socket or (UDP) by an ipv4.udp listener
+        */
+        bool Bind();
+
+        /** @brief  Remove socket from interface socket index
+        */
+        void Unbind();
+
+        byte m_nDomain; //!< Socket domain AF_INET | AF_INET6 | AF_PACKET
         byte m_nProtocol; //!< Socket type PROTO_RAW | PROTO_UDP | PROTO_TCP
-        byte m_nStatus; //!< Connection status SOCK_CLOSED | SOCK_INIT | SOCK_LISTEN | SOCK_ESTABLISHED | SOCK_CLOSE_WAIT
-        uint16_t nPortLocal; //!< Local host port number
-        uint16_t nPortRemote; //!< Remote host port number
-        Address* m_pIpRemote; //!< Pointer to remote host IP address
-        ribanEthernet* m_pInterface; //!< Pointer to the network interface
+        byte m_nStatus; //!< Connection status SOCK_xxx
+        bool m_bListening; //!< True if bound by Listen (TCP returns to SOCK_LISTEN on disconnection)
+        bool m_bIndexed; //!< True if in interface socket index
+        uint16_t m_nPortLocal; //!< Local host port number
+        uint16_t m_nPortRemote; //!< Remote host port number
+        Address m_addressRemote; //!< Remote host address (IPV4 or MAC)
+        uint16_t m_nTxLen; //!< Quantity of payload bytes in current transmission
+        uint32_t m_lSequence; //!< TCP sequence number of next byte to send
+        uint32_t m_lAcknowledge; //!< TCP sequence number of next byte expected from remote host
+        uint16_t m_nIdleTimeout; //!< Seconds of inactivity before disconnection. Zero to disable
+        uint32_t m_lActivity; //!< Time (millis) of last data flow
+        void (*m_pHandler)(Socket* pSocket, RxView& view); //!< Pointer to function to handle received data
+        Socket* m_pNext; //!< Next socket in same index hash bucket
+        ribanENC28J60* m_pInterface; //!< Pointer to the network interface
 };
-
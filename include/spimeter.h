@@ -0,0 +1,314 @@
+/**     SpiMeter - SPI bus accounting for NIC drivers
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Wraps a NIC class and counts the SPI transactions, opcode bytes and payload bytes that the ENC28J60 driver
+*       performs for each call the stack makes. Counts are accumulated per received frame (RxBegin to RxEnd),
+*       per transmitted frame (TxBegin to TxEnd) and in total. Estimated bus time is derived from the SPI clock
+*       and a per transaction overhead (chip select toggle, function call, etc.)
+*       Enable with #define NIC_SPI_METER which wraps the selected NIC (see nic.h).
+*       The wrapped NIC must use ENC28J60_CURSOR as its default read offset, e.g. ENC28J60Sim and derived classes.
+*
+*       The model assumes the driver moves the buffer pointers (2 x WCR) whenever an explicit offset is given,
+*       switches register bank once for bank 1+ register access and polls DMA completion once.
+*/
+
+#pragma once
+#include "Arduino.h"
+
+//ENC28J60 SPI transaction sizes used by cost model
+static const byte SPI_POINTER_TRANSACTIONS  = 2; //!< Set 16-bit buffer pointer = 2 x WCR (opcode + data)
+static const byte SPI_DMA_TRANSACTIONS      = 8; //!< DMA setup = 3 x 16-bit pointers (6 x WCR) + start (BFS) + poll (RCR)
+static const byte SPI_CHECKSUM_TRANSACTIONS = 8; //!< DMA checksum = 2 x 16-bit pointers (4 x WCR) + start (BFS) + poll (RCR) + read result (2 x RCR)
+
+/** Counts of SPI bus activity */
+struct SpiCount
+{
+    uint32_t nTransactions; //!< Quantity of chip select framed transactions
+    uint32_t nOpcodeBytes; //!< Quantity of opcode bytes (one per transaction)
+    uint32_t nPayloadBytes; //!< Quantity of data bytes (register values and buffer memory)
+};
+
+template <class BASE>
+class SpiMeter : public BASE
+{
+    public:
+        SpiMeter() :
+            m_lClock(8000000),
+            m_nOverhead(1000),
+            m_bRxFrame(false)
+        {
+            Reset();
+        }
+
+        /** @brief  Set the SPI clock used to estimate bus time
+        *   @param  lClock SPI clock frequency in Hz. Default is 8MHz (16MHz AVR with SPI_CLOCK_DIV2)
+        */
+        void SetClock(uint32_t lClock) { m_lClock = lClock; };
+
+        /** @brief  Set the fixed time cost of each transaction
+        *   @param  nOverhead Nanoseconds per transaction (chip select, opcode setup, call overhead). Default is 1000
+        */
+        void SetTransactionOverhead(uint16_t nOverhead) { m_nOverhead = nOverhead; };
+
+        /** @brief  Clear all counters
+        */
+        void Reset()
+        {
+            Clear(m_countTotal);
+            Clear(m_countRxFrame);
+            Clear(m_countTxFrame);
+            Clear(m_countRx);
+            Clear(m_countTx);
+        }
+
+        /** @brief  Get total counts since last Reset
+        *   @return <i>const SpiCount&</i> Counts
+        */
+        const SpiCount& GetTotal() { return m_countTotal; };
+
+        /** @brief  Get counts for last received frame (RxBegin to RxEnd including any frames sent whilst processing)
+        *   @return <i>const SpiCount&</i> Counts
+        */
+        const SpiCount& GetRxFrame() { return m_countRxFrame; };
+
+        /** @brief  Get counts for last transmitted frame (TxBegin to TxEnd)
+        *   @return <i>const SpiCount&</i> Counts
+        */
+        const SpiCount& GetTxFrame() { return m_countTxFrame; };
+
+        /** @brief  Estimate bus time for a set of counts
+        *   @param  count Counts to estimate
+        *   @return <i>uint32_t</i> Estimated time in nanoseconds
+        */
+        uint32_t GetBusTime(const SpiCount& count)
+        {
+            uint64_t nBits = uint64_t(count.nOpcodeBytes + count.nPayloadBytes) * 8;
+            return nBits * 1000000000ULL / m_lClock + uint64_t(count.nTransactions) * m_nOverhead;
+        }
+
+        //Metered NIC functions
+
+        uint16_t RxBegin()
+        {
+            uint16_t nLen = BASE::RxBegin();
+            if(nLen && !m_bRxFrame)
+            {
+                Clear(m_countRx);
+                m_bRxFrame = true;
+            }
+            Count(2, 2); //Bank select (BFS/BFC) + read EPKTCNT (RCR)
+            if(nLen)
+                Count(1, 6, SPI_POINTER_TRANSACTIONS); //Read receive status vector
+            return nLen;
+        }
+
+        byte RxGetByte(uint16_t nOffset = ENC28J60_CURSOR)
+        {
+            Count(1, 1, (nOffset == ENC28J60_CURSOR) ? 0 : SPI_POINTER_TRANSACTIONS);
+            return BASE::RxGetByte(nOffset);
+        }
+
+        uint16_t RxGetWord(uint16_t nOffset = ENC28J60_CURSOR)
+        {
+            Count(1, 2, (nOffset == ENC28J60_CURSOR) ? 0 : SPI_POINTER_TRANSACTIONS);
+            return BASE::RxGetWord(nOffset);
+        }
+
+        uint16_t RxGetData(byte* pBuffer, uint16_t nLen, uint16_t nOffset = ENC28J60_CURSOR)
+        {
+            uint16_t nRead = BASE::RxGetData(pBuffer, nLen, nOffset);
+            Count(1, nRead, (nOffset == ENC28J60_CURSOR) ? 0 : SPI_POINTER_TRANSACTIONS);
+            return nRead;
+        }
+
+        void RxEnd()
+        {
+            Count(2, 1, SPI_POINTER_TRANSACTIONS); //Write ERXRDPT, bank select + PKTDEC
+            BASE::RxEnd();
+            if(m_bRxFrame)
+            {
+                m_countRxFrame = m_countRx;
+                m_bRxFrame = false;
+            }
+        }
+
+        void TxBegin(byte* pMac = NULL, uint16_t nEthertype = 0x0800)
+        {
+            Clear(m_countTx);
+            Count(1, 15, SPI_POINTER_TRANSACTIONS); //Write control byte and Ethernet header (WBM) to free slot - no wait for ECON1.TXRTS
+            BASE::TxBegin(pMac, nEthertype);
+        }
+
+        void TxBeginFrame(const byte* pHeader, uint16_t nLen)
+        {
+            Clear(m_countTx);
+            Count(1, 1 + nLen, SPI_POINTER_TRANSACTIONS); //Write control byte and prebuilt header (WBM) to free slot
+            BASE::TxBeginFrame(pHeader, nLen);
+        }
+
+        bool TxAppend(byte* pData, uint16_t nLen)
+        {
+            Count(1, nLen);
+            return BASE::TxAppend(pData, nLen);
+        }
+
+        bool TxAppendByte(byte nData)
+        {
+            Count(1, 1);
+            return BASE::TxAppendByte(nData);
+        }
+
+        bool TxAppendWord(uint16_t nData)
+        {
+            Count(1, 2);
+            return BASE::TxAppendWord(nData);
+        }
+
+        bool TxAppendFill(byte nData, uint16_t nLen)
+        {
+            Count(1, nLen); //Single WBM with chip select held whilst value is clocked out
+            return BASE::TxAppendFill(nData, nLen);
+        }
+
+        bool TxAppend_P(const byte* pData, uint16_t nLen)
+        {
+            Count(1, nLen); //Single WBM streamed from program memory
+            return BASE::TxAppend_P(pData, nLen);
+        }
+
+        void TxWriteByte(uint16_t nOffset, byte nData)
+        {
+            Count(1, 1, 2 * SPI_POINTER_TRANSACTIONS); //Move write pointer, write, restore write pointer
+            BASE::TxWriteByte(nOffset, nData);
+        }
+
+        void TxWriteWord(uint16_t nOffset, uint16_t nData)
+        {
+            Count(1, 2, 2 * SPI_POINTER_TRANSACTIONS);
+            BASE::TxWriteWord(nOffset, nData);
+        }
+
+        void TxWrite(uint16_t nOffset, byte* pData, uint16_t nLen)
+        {
+            Count(1, nLen, 2 * SPI_POINTER_TRANSACTIONS);
+            BASE::TxWrite(nOffset, pData, nLen);
+        }
+
+        void TxEnd()
+        {
+            Count(1, 1, 2 * SPI_POINTER_TRANSACTIONS); //Write ETXST, ETXND, set ECON1.TXRTS (BFS)
+            BASE::TxEnd();
+            m_countTxFrame = m_countTx;
+        }
+
+        byte TxHold()
+        {
+            return BASE::TxHold(); //Frame stays in its slot - no bus activity until released
+        }
+
+        void TxRelease(byte nSlot, byte* pMac)
+        {
+            if(pMac)
+                Count(1, 6, 2 * SPI_POINTER_TRANSACTIONS); //Write destination MAC into held frame
+            Count(1, 1, 2 * SPI_POINTER_TRANSACTIONS); //Write ETXST, ETXND, set ECON1.TXRTS (BFS)
+            BASE::TxRelease(nSlot, pMac);
+        }
+
+        byte TxPoll()
+        {
+            byte nCompleted = BASE::TxPoll();
+            if(nCompleted)
+            {
+                Count(1, 1); //Read ECON1.TXRTS (RCR)
+                Count(nCompleted, 7 * nCompleted, nCompleted * SPI_POINTER_TRANSACTIONS); //Read transmit status vector of each frame
+            }
+            return nCompleted; //Driver tracks slots so there is no bus activity whilst no frames are in flight
+        }
+
+        void SetRxFilter(byte nFilter, const byte* pMulticast, byte nGroups)
+        {
+            Count(6, 6); //Read ECON1 (RCR) + select bank 1 (BFC, BFS) + write ERXFCON (WCR) + restore bank (BFC, BFS)
+            if(nFilter & ENC28J60_FILTER_HASH)
+                Count(8, 8); //Write EHT0..EHT7
+            if(nFilter & ENC28J60_FILTER_ARP)
+                Count(12, 12); //Write EPMM0..EPMM7, EPMCSL, EPMCSH, EPMOL, EPMOH
+            BASE::SetRxFilter(nFilter, pMulticast, nGroups);
+        }
+
+        void EnableInterrupt(byte nPin, void (*HandleInterrupt)())
+        {
+            Count(1, 1); //Set or clear EIE.INTIE and EIE.PKTIE (BFS / BFC)
+            BASE::EnableInterrupt(nPin, HandleInterrupt);
+        }
+
+        void DMACopy(uint16_t nDestination, uint16_t nSource, uint16_t nLen)
+        {
+            Count(0, 0, SPI_DMA_TRANSACTIONS);
+            BASE::DMACopy(nDestination, nSource, nLen);
+        }
+
+        void TxSwap(uint16_t nOffset1, uint16_t nOffset2, uint16_t nLen)
+        {
+            Count(2, nLen, 2 * SPI_POINTER_TRANSACTIONS); //Read both blocks
+            Count(2, nLen, 2 * SPI_POINTER_TRANSACTIONS); //Write both blocks
+            BASE::TxSwap(nOffset1, nOffset2, nLen);
+        }
+
+        uint16_t GetChecksum(uint16_t nOffset, uint16_t nLen)
+        {
+            Count(0, 0, SPI_CHECKSUM_TRANSACTIONS);
+            return BASE::GetChecksum(nOffset, nLen);
+        }
+
+        byte TxGetStatus()
+        {
+            Count(1, 1); //Read ESTAT (RCR)
+            return BASE::TxGetStatus();
+        }
+
+    private:
+        /** @brief  Clear a set of counts
+        *   @param  count Counts to clear
+        */
+        static void Clear(SpiCount& count)
+        {
+            count.nTransactions = 0;
+            count.nOpcodeBytes = 0;
+            count.nPayloadBytes = 0;
+        }
+
+        /** @brief  Account for SPI activity
+        *   @param  nTransactions Quantity of buffer memory / register transactions (one opcode byte each)
+        *   @param  nPayload Quantity of data bytes moved by those transactions
+        *   @param  nRegisterWrites Quantity of additional 2 byte register write transactions (WCR) e.g. pointer moves
+        */
+        void Count(uint16_t nTransactions, uint16_t nPayload, uint16_t nRegisterWrites = 0)
+        {
+            Add(m_countTotal, nTransactions, nPayload, nRegisterWrites);
+            Add(m_countRx, nTransactions, nPayload, nRegisterWrites);
+            Add(m_countTx, nTransactions, nPayload, nRegisterWrites);
+        }
+
+        /** @brief  Add SPI activity to a set of counts
+        *   @param  count Counts to update
+        *   @param  nTransactions Quantity of buffer memory / register transactions
+        *   @param  nPayload Quantity of data bytes
+        *   @param  nRegisterWrites Quantity of 2 byte register write transactions
+        */
+        static void Add(SpiCount& count, uint16_t nTransactions, uint16_t nPayload, uint16_t nRegisterWrites)
+        {
+            count.nTransactions += nTransactions + nRegisterWrites;
+            count.nOpcodeBytes += nTransactions + nRegisterWrites;
+            count.nPayloadBytes += nPayload + nRegisterWrites;
+        }
+
+        uint32_t m_lClock; //!< SPI clock frequency in Hz
+        uint16_t m_nOverhead; //!< Nanoseconds overhead per transaction
+        bool m_bRxFrame; //!< True whilst processing a received frame
+        SpiCount m_countTotal; //!< Counts since reset
+        SpiCount m_countRx; //!< Counts since start of current received frame
+        SpiCount m_countTx; //!< Counts since start of current transmitted frame
+        SpiCount m_countRxFrame; //!< Counts for last completed received frame
+        SpiCount m_countTxFrame; //!< Counts for last completed transmitted frame
+};
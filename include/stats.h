@@ -0,0 +1,120 @@
+/**     Network statistics for ribanENC28J60
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Counters are plain increments in the processing path so may be left enabled in production.
+*       Frame and byte counters are 32-bit. Event and drop counters are 16-bit and wrap.
+*/
+#pragma once
+
+#include "Arduino.h"
+#include "constants.h"
+
+//EtherType categories (index of NetStats::aRxEth, aTxEth)
+const static byte STATS_ETH_ARP         = 0;
+const static byte STATS_ETH_IPV4        = 1;
+const static byte STATS_ETH_IPV6        = 2;
+const static byte STATS_ETH_OTHER       = 3;
+const static byte STATS_ETH_TYPES       = 4;
+
+//IP protocol categories (index of NetStats::aRxIp, aTxIp)
+const static byte STATS_IP_ICMP         = 0;
+const static byte STATS_IP_TCP          = 1;
+const static byte STATS_IP_UDP          = 2;
+const static byte STATS_IP_OTHER        = 3;
+const static byte STATS_IP_PROTOCOLS    = 4;
+
+//Drop reasons (index of NetStats::aDrop)
+const static byte STATS_DROP_RUNT           = 0; //!< Frame shorter than Ethernet header
+const static byte STATS_DROP_FILTERED       = 1; //!< Multicast frame to group not joined
+const static byte STATS_DROP_ETHERTYPE      = 2; //!< Unhandled EtherType
+const static byte STATS_DROP_ARP_SHORT      = 3; //!< Frame too short for ARP
+const static byte STATS_DROP_ARP_OPERATION  = 4; //!< Unhandled ARP operation
+const static byte STATS_DROP_IP_SHORT       = 5; //!< Frame too short for IPV4 header
+const static byte STATS_DROP_IP_HEADER      = 6; //!< Invalid IPV4 version or header length
+const static byte STATS_DROP_IP_LENGTH      = 7; //!< IPV4 total length exceeds frame
+const static byte STATS_DROP_IP_CHECKSUM    = 8; //!< IPV4 header checksum failed
+const static byte STATS_DROP_IP_PROTOCOL    = 9; //!< Unhandled IP protocol
+const static byte STATS_DROP_L4_SHORT       = 10; //!< IPV4 payload too short for transport header
+const static byte STATS_DROP_ICMP_CHECKSUM  = 11; //!< ICMP checksum failed
+const static byte STATS_DROP_ICMP_TYPE      = 12; //!< Unhandled ICMP message type
+const static byte STATS_DROP_UDP_LENGTH     = 13; //!< UDP length field inconsistent with IPV4 payload
+const static byte STATS_DROP_UDP_CHECKSUM   = 14; //!< UDP checksum failed
+const static byte STATS_DROP_UDP_PORT       = 15; //!< No listener or socket on UDP destination port
+const static byte STATS_DROP_TCP_CHECKSUM   = 16; //!< TCP checksum failed
+const static byte STATS_DROP_TCP_PORT       = 17; //!< No socket on TCP destination port or segment not valid for connection
+const static byte STATS_DROP_ARP_QUEUE      = 18; //!< Transmit frame dropped - no space to hold it whilst resolving next hop
+const static byte STATS_DROP_ARP_TIMEOUT    = 19; //!< Transmit frame dropped - next hop did not respond to ARP
+const static byte STATS_DROP_NO_ROUTE       = 20; //!< Transmit frame dropped - destination off subnet and no gateway configured
+const static byte STATS_DROPS               = 21;
+
+/** Frame and byte counter */
+class StatsCounter
+{
+    public:
+        /** @brief  Count a frame
+        *   @param  nBytes Quantity of bytes in frame
+        */
+        void Add(uint16_t nBytes) { ++lFrames; lBytes += nBytes; };
+
+        uint32_t lFrames; //!< Quantity of frames
+        uint32_t lBytes; //!< Quantity of bytes
+};
+
+/** Statistics block shared by the protocol layers. Take a snapshot with ribanENC28J60::GetStats or IPV4::GetStats. */
+class NetStats
+{
+    public:
+        /** @brief  Get EtherType category
+        *   @param  nEthertype EtherType
+        *   @return <i>byte</i> STATS_ETH_xxx
+        */
+        static byte GetEthIndex(uint16_t nEthertype)
+        {
+            switch(nEthertype)
+            {
+                case ETHTYPE_ARP:
+                    return STATS_ETH_ARP;
+                case ETHTYPE_IPV4:
+                    return STATS_ETH_IPV4;
+                case ETHTYPE_IPV6:
+                    return STATS_ETH_IPV6;
+            }
+            return STATS_ETH_OTHER;
+        };
+
+        /** @brief  Get IP protocol category
+        *   @param  nProtocol IP protocol
+        *   @return <i>byte</i> STATS_IP_xxx
+        */
+        static byte GetIpIndex(byte nProtocol)
+        {
+            switch(nProtocol)
+            {
+                case IP_PROTOCOL_ICMP:
+                    return STATS_IP_ICMP;
+                case IP_PROTOCOL_TCP:
+                    return STATS_IP_TCP;
+                case IP_PROTOCOL_UDP:
+                    return STATS_IP_UDP;
+            }
+            return STATS_IP_OTHER;
+        };
+
+        /** @brief  Clear all counters
+        */
+        void Clear() { memset(this, 0, sizeof(NetStats)); };
+
+        StatsCounter aRxEth[STATS_ETH_TYPES]; //!< Received frames and bytes (whole frame) per EtherType
+        StatsCounter aTxEth[STATS_ETH_TYPES]; //!< Sent frames and bytes (whole frame) per EtherType
+        StatsCounter aRxIp[STATS_IP_PROTOCOLS]; //!< Received IPV4 datagrams and payload bytes per protocol
+        StatsCounter aTxIp[STATS_IP_PROTOCOLS]; //!< Sent IPV4 datagrams and payload bytes per protocol
+        uint16_t aDrop[STATS_DROPS]; //!< Dropped frames per reason STATS_DROP_xxx
+        uint16_t nArpHits; //!< ARP cache lookups that found a MAC address
+        uint16_t nArpMisses; //!< ARP cache lookups that required resolution
+        uint16_t nArpEvictions; //!< ARP cache entries replaced to make room
+        uint16_t aDhcp[DHCP_STATES]; //!< Transitions into each DHCP state DHCP_xxx
+        uint16_t nTxErrors; //!< Transmit errors reported by NIC
+        uint32_t lRxOverflows; //!< NIC receive buffer overflow events (filled by snapshot). 0xFFFFFFFF if NIC does not report overflows
+        uint32_t lRxLost; //!< Frames lost by NIC due to receive buffer overflow (filled by snapshot). 0xFFFFFFFF if NIC does not report losses
+};
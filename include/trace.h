@@ -0,0 +1,114 @@
+/**     Trace ring buffer for ribanENC28J60
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Records compact binary events in RAM for later dump and decode on a PC (see examples/tracedecode).
+*       Tracing compiles to nothing unless enabled so may be left in the hot path.
+*/
+#pragma once
+
+#include "Arduino.h"
+
+///!@note   Enable trace with #define TRACE_SIZE as the quantity of records to hold (power of 2, max 128). Default is 0 which disables trace.
+///!@note   TRACE_SIZE must be the same for all translation units so define it as a build option.
+#ifndef TRACE_SIZE
+    #define TRACE_SIZE 0
+#endif // TRACE_SIZE
+
+/** Trace event identifiers. Append new events before TRACE_EVENTS to keep existing dumps decodable. */
+enum TRACE_EVENT
+{
+    TRACE_NONE              = 0, //!< Unused record
+    TRACE_RX_FRAME          = 1, //!< Frame received. Args: length, Ethertype
+    TRACE_RX_REJECTED       = 2, //!< Frame rejected in software. Args: length, Ethertype
+    TRACE_RX_UNHANDLED      = 3, //!< Frame with unhandled Ethertype. Args: length, Ethertype
+    TRACE_ARP_REQUEST       = 4, //!< ARP request received. Args: sender IP
+    TRACE_ARP_REPLY_TX      = 5, //!< ARP reply sent. Args: target IP
+    TRACE_ARP_REPLY         = 6, //!< ARP reply received. Args: sender IP
+    TRACE_ARP_UNHANDLED     = 7, //!< ARP with unhandled operation. Args: operation
+    TRACE_ARP_REQUEST_TX    = 8, //!< ARP request sent. Args: target IP
+    TRACE_ARP_ABANDON       = 9, //!< ARP resolution abandoned and parked frame discarded. Args: target IP
+    TRACE_IPV4_UNHANDLED    = 10, //!< IPv4 with unhandled protocol. Args: protocol
+    TRACE_ICMP_ECHO_REQUEST = 11, //!< ICMP echo request received. Args: identifier, sequence
+    TRACE_ICMP_ECHO_REPLY   = 12, //!< ICMP echo reply received. Args: identifier, sequence
+    TRACE_ICMP_UNHANDLED    = 13, //!< ICMP with unhandled type. Args: type
+    TRACE_UDP               = 14, //!< UDP datagram received. Args: source port, destination port
+    TRACE_DHCP_OFFER        = 15, //!< DHCP offer received. Args: offered IP
+    TRACE_DHCP_ACK          = 16, //!< DHCP acknowledgement received. Args: assigned IP
+    TRACE_TX_ERROR          = 17, //!< Transmit error reported. Args: none
+    TRACE_EVENTS                 //!< Quantity of event identifiers
+};
+
+#if TRACE_SIZE
+static_assert(TRACE_SIZE <= 128 && 0 == (TRACE_SIZE & (TRACE_SIZE - 1)), "TRACE_SIZE must be a power of 2 no greater than 128");
+
+/** Trace record. Dumped field by field so layout is independent of padding. */
+struct TraceRecord
+{
+    uint32_t lTime; //!< Timestamp in microseconds
+    uint16_t nArg1; //!< First argument
+    uint16_t nArg2; //!< Second argument
+    byte nEvent; //!< Event identifier (TRACE_EVENT)
+};
+
+/** Trace ring buffer. Oldest records are overwritten when full. */
+class Trace
+{
+    public:
+        /** @brief  Add record to trace buffer
+        *   @param  nEvent Event identifier (TRACE_EVENT)
+        *   @param  nArg1 First argument
+        *   @param  nArg2 Second argument
+        */
+        static void Log(byte nEvent, uint16_t nArg1, uint16_t nArg2)
+        {
+            TraceRecord& record = s_aRecord[s_nHead++ & (TRACE_SIZE - 1)];
+            record.lTime = micros();
+            record.nArg1 = nArg1;
+            record.nArg2 = nArg2;
+            record.nEvent = nEvent;
+            if(TRACE_SIZE == s_nHead)
+                s_bWrapped = true;
+        };
+
+        /** @brief  Add record with an IPv4 address argument to trace buffer
+        *   @param  nEvent Event identifier (TRACE_EVENT)
+        *   @param  pAddress Pointer to 4 byte IPv4 address in network byte order
+        */
+        static void LogIp(byte nEvent, const byte* pAddress)
+        {
+            Log(nEvent, (pAddress[0] << 8) | pAddress[1], (pAddress[2] << 8) | pAddress[3]);
+        };
+
+        /** @brief  Get quantity of records held
+        *   @return <i>byte</i> Quantity of records (up to TRACE_SIZE)
+        */
+        static byte GetCount() { return s_bWrapped ? TRACE_SIZE : s_nHead; };
+
+        /** @brief  Get a record
+        *   @param  nIndex Index of record, 0 for oldest. Must be less than GetCount()
+        *   @return <i>const TraceRecord&</i> Record
+        */
+        static const TraceRecord& GetRecord(byte nIndex) { return s_aRecord[(s_nHead - GetCount() + nIndex) & (TRACE_SIZE - 1)]; };
+
+        /** @brief  Write trace records to serial port as text, oldest first, then clear trace
+        *   @note   Each record is a line "T:tttttttt ee aaaa bbbb" of hex time, event and arguments, preceded by a line "TRACE n" with the quantity of records
+        */
+        static void Dump();
+
+        /** @brief  Clear trace buffer
+        */
+        static void Clear() { s_nHead = 0; s_bWrapped = false; };
+
+    private:
+        static TraceRecord s_aRecord[TRACE_SIZE]; //!< Ring buffer of records
+        static byte s_nHead; //!< Total records written (wraps at 256, index is masked)
+        static bool s_bWrapped; //!< True if records have been overwritten since last clear
+};
+
+    #define TRACE(nEvent, nArg1, nArg2) Trace::Log(nEvent, nArg1, nArg2)
+    #define TRACE_IP(nEvent, pAddress) Trace::LogIp(nEvent, pAddress)
+#else
+    #define TRACE(nEvent, nArg1, nArg2) ((void)0)
+    #define TRACE_IP(nEvent, pAddress) ((void)0)
+#endif // TRACE_SIZE
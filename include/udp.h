@@ -1,61 +1,138 @@
+/**     UDP - User Datagram Protocol (RFC 768) over IPV4
+*       Copyright (c) 2014, Brian Walton. All rights reserved. GLPL.
+*       Source availble at https://github.com/riban-bw/ribanENC28J60.git
+*
+*       Listeners are held in a small table indexed by hashing the local port into buckets so a received datagram
+*       reaches its handler without searching all listeners. Datagrams to ports without a listener are dropped by
+*       IPV4 before their checksum is validated so unwanted traffic costs only the prefetched header.
+*       Datagram payload remains in NIC memory. Handlers are passed an RxView of the payload and read only the fields
+*       they need, directly from the NIC, without copying the datagram to RAM.
+*/
+
+///!@note   Configure quantity of UDP listeners with #define UDP_LISTENERS. Default is 4.
+///!@note   Configure quantity of hash buckets with #define UDP_HASH_SIZE. Must be a power of 2. Default is 8.
+
 #pragma once
-#include "ribanethernetprotocol.h"
+#include "Arduino.h"
+#include "address.h"
+#include "constants.h"
+#include "nic.h"
+#include "rxpacket.h"
+#include "rxview.h"
+
+#ifndef UDP_LISTENERS
+    #define UDP_LISTENERS 4
+#endif // UDP_LISTENERS
+#ifndef UDP_HASH_SIZE
+    #define UDP_HASH_SIZE 8
+#endif // UDP_HASH_SIZE
+
+static_assert((UDP_HASH_SIZE & (UDP_HASH_SIZE - 1)) == 0, "UDP_HASH_SIZE must be a power of 2");
+static_assert(UDP_LISTENERS > 0 && UDP_LISTENERS < 0xFF, "UDP_LISTENERS must be 1..254");
+
+const static byte UDP_EOF = 0xFF;
+
+class IPV4;
+class SocketIndex;
+
+/** UDP port listener */
+class UdpListener
+{
+    public:
+        uint16_t nPort; //!< Local port
+        void (*pHandler)(uint16_t nPort, RxView& view); //!< Pointer to datagram handler. NULL if entry is unused
+        byte nNext; //!< Index of next listener in same hash bucket or UDP_EOF
+};
 
 class UDP
 {
     public:
         UDP();
-        virtual ~UDP();
+
+        /** @brief  Initialise UDP class
+        *   @param  pIpv4 Pointer to the IPV4 layer used to send datagrams
+        *   @param  pInterface Pointer to the network interface object
+        *   @param  pRxPacket Pointer to the descriptor of the current received frame
+        *   @param  pSockets Pointer to the socket index which shares the UDP port space. NULL if none
+        */
+        void Initialise(IPV4* pIpv4, NIC* pInterface, RxPacket* pRxPacket, SocketIndex* pSockets = NULL);
 
         /** @brief  Adds or removes a UDP server
         *   @param  nPort Port to listen on
         *   @param  pHandleUdpPacket Pointer to packet handler function. NULL to stop listening
+        *   @return <i>bool</i> True on success. False if UDP_LISTENERS ports are already in use or port is bound by a UDP Socket
+        *   @note   Handler function should be declared: void HandleUdpPacket(uint16_t nPort, RxView& view); where nPort is the local port and view covers the payload
+        *   @note   Listening on a port that already has a listener replaces its handler
+        *   @note   Call ribanENC28J60::ListenBroadcast to also receive datagrams sent to the broadcast address
         */
-        void Listen(uint16_t nPort, void (*pHandleUdpPacket)(uint16_t nPort, uint16_t nLen));
+        bool Listen(uint16_t nPort, void (*pHandleUdpPacket)(uint16_t nPort, RxView& view));
 
-        /** @brief  Send a UDP dstagramp
+        /** @brief  Send a UDP datagram
         *   @param  pData Pointer to buffer holding UDP payload data
         *   @param  nLen Quantity of bytes in payload
-        *   @param  pIp Pointer to 4-byte IP address of target
-        *   @param  nPort UDP port of target
-        *   @todo   Do we want to implement this?
-        */
-        void Send(byte* pData, uint16_t nLen, byte* pIp, uint16_t nPort);
-
-        /** @brief  Start UDP send transaction
-        *   @param  pIp Pointer to IP address of target
+        *   @param  pIp Pointer to IP address of target. NULL to reply to source of last received datagram
         *   @param  nPort UDP port of target
+        *   @param  nLocalPort Local (source) UDP port. Default is UDP_EPHEMERAL_PORT
+        *   @return <i>bool</i> True on success. Fails if insufficient space in Tx buffer or datagram cannot be held awaiting ARP resolution
         */
-        void BeginPacket(byte* pIp, uint16_t nPort);
+        bool Send(byte* pData, uint16_t nLen, Ipv4Address* pIp, uint16_t nPort, uint16_t nLocalPort = UDP_EPHEMERAL_PORT);
 
         /** @brief  Start UDP send transaction
-        *   @param  pHost Pointer to host name of target
+        *   @param  pIp Pointer to IP address of target. NULL to reply to source of last received datagram
         *   @param  nPort UDP port of target
+        *   @param  nLocalPort Local (source) UDP port. Default is UDP_EPHEMERAL_PORT
+        *   @note   Writes UDP header with zero length and checksum. EndPacket writes length. IPV4::TxEnd completes checksum.
         */
-        void BeginPacket(const char* pHost, uint16_t nPort);
+        void BeginPacket(Ipv4Address* pIp, uint16_t nPort, uint16_t nLocalPort = UDP_EPHEMERAL_PORT);
 
         /** @brief  Append data to UDP payload
         *   @param  pData Pointer to data
         *   @param  nLen Quantity of bytes to append
+        *   @return <i>bool</i> True on success. Fails if insufficient space in Tx buffer
         */
-        void Append(byte* pData, uint16_t nLen);
+        bool Append(byte* pData, uint16_t nLen);
 
-        /** @brief  Finsih UDP send transaction and send packet
+        /** @brief  Finish UDP send transaction and send packet
+        *   @return <i>bool</i> True if datagram was sent or is held awaiting ARP resolution. False if it was dropped
         */
-        void EndPacket();
+        bool EndPacket();
 
         /** @brief  Gets the source IP address of the last datagram sent to server
-        *   @return <i>byte*</i> Pointer to IP address
+        *   @return <i>Ipv4Address*</i> Pointer to IP address
         */
-        byte* GetRemoteIp() { return m_pRemoteIp; };
+        Ipv4Address* GetRemoteIp() { return &m_addressRemote; };
 
         /** @brief  Gets the UDP port number of the last datagram sent to server
         *   @return <i>uint16_t</i> Port number
         */
         uint16_t GetRemotePort() { return m_nRemotePort; };
 
-    protected:
+        /** @brief  Find listener for a local port
+        *   @param  nPort Local port
+        *   @return <i>byte</i> Index of listener or UDP_EOF if none
+        */
+        byte Find(uint16_t nPort);
+
+        /** @brief  Pass current received datagram to a listener
+        *   @param  nIndex Index of listener (from Find)
+        *   @param  nLen Quantity of bytes in datagram including UDP header (validated by caller)
+        */
+        void Dispatch(byte nIndex, uint16_t nLen);
+
     private:
-        byte* m_pRemoteIp; //!< Pointer to 4-byte IP address of remote host (UDP server)
-        uint16_t m_nRemotePort; //!< UDP port number of remote host (UDP server)
+        /** @brief  Get hash bucket for port
+        *   @param  nPort Port number
+        *   @return <i>byte</i> Bucket index
+        */
+        static byte Hash(uint16_t nPort) { return (nPort ^ (nPort >> 8)) & (UDP_HASH_SIZE - 1); };
+
+        UdpListener m_aListener[UDP_LISTENERS]; //!< Listener table
+        byte m_pBucket[UDP_HASH_SIZE]; //!< Index of first listener in each hash bucket or UDP_EOF
+        Ipv4Address m_addressRemote; //!< IP address of remote host of last received datagram
+        uint16_t m_nRemotePort; //!< UDP port number of remote host of last received datagram
+        uint16_t m_nTxLen; //!< Quantity of bytes (including header) in datagram being sent
+        IPV4* m_pIpv4; //!< Pointer to IPV4 layer
+        NIC* m_pInterface; //!< Pointer to network interface object
+        RxPacket* m_pRxPacket; //!< Pointer to descriptor of current received frame
+        SocketIndex* m_pSockets; //!< Pointer to socket index sharing UDP ports
 };
@@ -1,110 +1,187 @@
 #include "address.h"
-#include "new.h"
 
-Address::Address(byte nType, byte* pAddress)
+Address::Address(byte nType, const byte* pAddress) :
+    m_nType(nType),
+    m_nSize(GetAddressSize(nType))
 {
-    m_nType = nType;
-    switch(nType)
-    {
-        case ADDR_TYPE_MAC:
-            m_nSize = 6;
-            break;
-        case ADDR_TYPE_IPV4:
-            m_nSize = 4;
-            break;
-        case ADDR_TYPE_IPV6:
-            m_nSize = 16;
-            break;
-        default:
-            m_nSize = 0;
-    }
-    m_pAddress = new byte[m_nSize];
     if(pAddress)
         memcpy(m_pAddress, pAddress, m_nSize);
     else
         memset(m_pAddress, 0, m_nSize);
 }
 
-Address::~Address()
+Address::Address(byte nType, const char* sAddress) :
+    m_nType(nType),
+    m_nSize(GetAddressSize(nType)),
+    m_pAddress{}
 {
-    delete m_pAddress;
+    Parse(sAddress);
 }
 
-bool Address::operator==(Address& address)
+bool Address::operator==(const Address& address) const
 {
-    return (address == m_pAddress);
+    return (m_nType == address.m_nType) && (address == m_pAddress);
 }
 
-bool Address::operator==(byte* pAddress)
+bool Address::operator==(const byte* pAddress) const
 {
     return (0 == memcmp(pAddress, m_pAddress, m_nSize));
 }
 
-bool Address::operator!=(Address& address)
-{
-    return (address != m_pAddress);
-}
-
-bool Address::operator!=(byte* pAddress)
-{
-    return (0 != memcmp(pAddress, m_pAddress, m_nSize));
-}
-
-Address& Address::operator=(Address& address)
-{
-    delete m_pAddress;
-    m_nSize = address.m_nSize;
-    m_nType = address.m_nType;
-    m_pAddress = new byte[m_nSize];
-    memcpy(m_pAddress, address.m_pAddress, m_nSize);
-    return *this;
-}
-
-Address& Address::operator=(byte* pAddress)
+Address& Address::operator=(const byte* pAddress)
 {
     memcpy(m_pAddress, pAddress, m_nSize);
     return *this;
 }
 
-byte* Address::GetAddress()
-{
-    return m_pAddress;
-}
-
-void Address::GetAddress(byte* pBuffer)
+void Address::GetAddress(byte* pBuffer) const
 {
     memcpy(pBuffer, m_pAddress, m_nSize);
 }
 
-void Address::SetAddress(byte* pAddress)
+void Address::SetAddress(const byte* pAddress)
 {
     memcpy(m_pAddress, pAddress, m_nSize);
 }
 
-byte Address::GetType()
+/** @brief  Get value of a hexadecimal digit
+*   @param  c Character
+*   @return <i>int</i> Value 0..15 or -1 if not a hexadecimal digit
+*/
+static int GetHexDigit(char c)
 {
-    return m_nType;
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
 }
 
-byte Address::GetSize()
+bool Address::Parse(byte nType, const char* sAddress, byte* pBuffer)
 {
-    return m_nSize;
+    if(!sAddress)
+        return false;
+    byte pValue[ADDR_MAX_SIZE];
+    byte nSize = GetAddressSize(nType);
+    const char* pChar = sAddress;
+    switch(nType)
+    {
+        case ADDR_TYPE_IPV4:
+            //Dotted decimal: d.d.d.d
+            for(byte i = 0; i < 4; ++i)
+            {
+                uint16_t nValue = 0;
+                byte nDigits = 0;
+                while(*pChar >= '0' && *pChar <= '9' && nDigits < 4)
+                {
+                    nValue = nValue * 10 + *pChar++ - '0';
+                    ++nDigits;
+                }
+                if(0 == nDigits || nValue > 255)
+                    return false;
+                pValue[i] = nValue;
+                if(i < 3 && *pChar++ != '.')
+                    return false;
+            }
+            break;
+        case ADDR_TYPE_MAC:
+            //Six pairs of hexadecimal digits separated by ':' or '-'
+            for(byte i = 0; i < 6; ++i)
+            {
+                int nHigh = GetHexDigit(*pChar++);
+                int nLow = (nHigh < 0) ? -1 : GetHexDigit(*pChar++);
+                if(nLow < 0)
+                    return false;
+                pValue[i] = (nHigh << 4) | nLow;
+                if(i < 5 && *pChar != ':' && *pChar != '-')
+                    return false;
+                if(i < 5)
+                    ++pChar;
+            }
+            break;
+        case ADDR_TYPE_IPV6:
+        {
+            //Up to eight groups of up to four hexadecimal digits separated by ':' with optional single '::' compression
+            byte nGroups = 0; //Quantity of groups parsed
+            int8_t nGap = -1; //Group index of '::' or -1 if not present
+            if(':' == *pChar)
+            {
+                if(':' != *++pChar)
+                    return false; //Single leading colon
+                nGap = 0;
+                ++pChar;
+            }
+            while(*pChar)
+            {
+                if(nGroups >= 8)
+                    return false;
+                uint16_t nValue = 0;
+                byte nDigits = 0;
+                int nDigit;
+                while((nDigit = GetHexDigit(*pChar)) >= 0 && nDigits < 4)
+                {
+                    nValue = (nValue << 4) | nDigit;
+                    ++nDigits;
+                    ++pChar;
+                }
+                if(0 == nDigits)
+                    return false;
+                pValue[nGroups * 2] = nValue >> 8;
+                pValue[nGroups * 2 + 1] = nValue & 0xFF;
+                ++nGroups;
+                if(0 == *pChar)
+                    break;
+                if(':' != *pChar++)
+                    return false;
+                if(':' == *pChar)
+                {
+                    if(nGap >= 0)
+                        return false; //Only one '::' allowed
+                    nGap = nGroups;
+                    ++pChar;
+                }
+                else if(0 == *pChar)
+                    return false; //Trailing single colon
+            }
+            if(nGap < 0 && nGroups != 8)
+                return false;
+            if(nGap >= 0)
+            {
+                if(nGroups > 7)
+                    return false; //'::' must replace at least one group
+                //Move groups after gap to end and zero fill gap
+                byte nTail = (nGroups - nGap) * 2;
+                memmove(pValue + 16 - nTail, pValue + nGap * 2, nTail);
+                memset(pValue + nGap * 2, 0, 16 - nTail - nGap * 2);
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+    if(*pChar)
+        return false; //Trailing characters
+    memcpy(pBuffer, pValue, nSize);
+    return true;
 }
 
-void Address::PrintAddress()
+void Address::Print(byte nType, const byte* pAddress)
 {
-    for(byte i = 0; i < m_nSize; ++i)
+    byte nSize = GetAddressSize(nType);
+    for(byte i = 0; i < nSize; ++i)
     {
-        switch(m_nType)
+        switch(nType)
         {
             case ADDR_TYPE_IPV4:
-                Serial.print(m_pAddress[i], DEC);
-                if(i < m_nSize - 1)
+                Serial.print(pAddress[i], DEC);
+                if(i < nSize - 1)
                     Serial.print(".");
                 break;
             case ADDR_TYPE_IPV6:
             {
-                uint16_t nValue = (m_pAddress[i] << 8) + m_pAddress[i+1];
+                uint16_t nValue = (pAddress[i] << 8) + pAddress[i+1];
                 if(nValue < 0x1000)
                     Serial.print("0");
                 if(nValue < 0x100)
@@ -112,16 +189,16 @@ void Address::PrintAddress()
                 if(nValue < 0x10)
                     Serial.print("0");
                 Serial.print(nValue, HEX);
-                if(i < m_nSize - 1)
+                if(i < nSize - 2)
                     Serial.print(":");
                 ++i;
                 break;
             }
             case ADDR_TYPE_MAC:
-                if(m_pAddress[i] < 0x10)
+                if(pAddress[i] < 0x10)
                     Serial.print("0");
-                Serial.print(m_pAddress[i], HEX);
-                if(i < m_nSize - 1)
+                Serial.print(pAddress[i], HEX);
+                if(i < nSize - 1)
                     Serial.print(":");
                 break;
         }
@@ -0,0 +1,168 @@
+#include "arpcache.h"
+
+ArpCache::ArpCache()
+{
+    memset(m_pBucket, ARP_EOF, sizeof(m_pBucket));
+    ClearStats();
+    for(byte nIndex = 0; nIndex < ARP_TABLE_SIZE + 2; ++nIndex)
+    {
+        m_aEntry[nIndex].nFlags = 0;
+        m_aEntry[nIndex].nNext = ARP_EOF;
+    }
+    m_aEntry[ARP_GATEWAY_INDEX].nFlags = ARP_FLAG_PINNED;
+    m_aEntry[ARP_DNS_INDEX].nFlags = ARP_FLAG_PINNED;
+}
+
+byte ArpCache::Find(const byte* pIp)
+{
+    for(byte nIndex = m_pBucket[Hash(pIp)]; nIndex != ARP_EOF; nIndex = m_aEntry[nIndex].nNext)
+    {
+        if(m_aEntry[nIndex].ip == pIp)
+            return nIndex;
+    }
+    return ARP_EOF;
+}
+
+byte* ArpCache::Lookup(const byte* pIp)
+{
+    byte nIndex = Find(pIp);
+    if(ARP_EOF == nIndex)
+    {
+        ++m_nMisses;
+        return NULL;
+    }
+    ArpEntry& entry = m_aEntry[nIndex];
+    if(!(entry.nFlags & ARP_FLAG_RESOLVED))
+    {
+        ++m_nMisses;
+        return NULL;
+    }
+    uint32_t lNow = millis();
+    if(lNow - entry.lUpdated > ARP_ENTRY_TIMEOUT)
+    {
+        entry.nFlags &= ~ARP_FLAG_RESOLVED; //Expired - keep entry so that its slot is reused for the new resolution
+        ++m_nMisses;
+        return NULL;
+    }
+    ++m_nHits;
+    entry.lUsed = lNow;
+    return entry.mac.GetAddress();
+}
+
+byte ArpCache::Update(const byte* pIp, const byte* pMac, bool bCreate)
+{
+    byte nIndex = Find(pIp);
+    if(ARP_EOF == nIndex)
+    {
+        if(!bCreate)
+            return ARP_EOF;
+        nIndex = Add(pIp);
+    }
+    ArpEntry& entry = m_aEntry[nIndex];
+    entry.mac.SetAddress(pMac);
+    entry.lUpdated = millis();
+    entry.nFlags |= ARP_FLAG_RESOLVED;
+    return nIndex;
+}
+
+byte ArpCache::Add(const byte* pIp)
+{
+    byte nIndex = Find(pIp);
+    if(ARP_EOF != nIndex)
+        return nIndex;
+    nIndex = Allocate();
+    ArpEntry& entry = m_aEntry[nIndex];
+    entry.ip.SetAddress(pIp);
+    entry.mac = MacAddress();
+    entry.lUsed = millis();
+    entry.nFlags = ARP_FLAG_USED;
+    Link(nIndex);
+    return nIndex;
+}
+
+void ArpCache::Pin(byte nIndex, const byte* pIp)
+{
+    ArpEntry& entry = m_aEntry[nIndex];
+    if((entry.nFlags & ARP_FLAG_USED) && entry.ip == pIp)
+        return;
+    if(entry.nFlags & ARP_FLAG_USED)
+        Unlink(nIndex);
+    //Remove any unpinned entry for same host so there is only one entry per IP address
+    byte nDuplicate = Find(pIp);
+    if(ARP_EOF != nDuplicate && !(m_aEntry[nDuplicate].nFlags & ARP_FLAG_PINNED))
+    {
+        Unlink(nDuplicate);
+        m_aEntry[nDuplicate].nFlags = 0;
+    }
+    entry.ip.SetAddress(pIp);
+    entry.mac = MacAddress();
+    entry.nFlags = ARP_FLAG_PINNED;
+    if(entry.ip.IsNull())
+        return; //Pinned entry cleared
+    entry.nFlags |= ARP_FLAG_USED;
+    if(ARP_EOF == Find(pIp))
+        Link(nIndex); //Gateway and DNS may be the same host, in which case only the first is found by hash
+}
+
+void ArpCache::Flush()
+{
+    memset(m_pBucket, ARP_EOF, sizeof(m_pBucket));
+    for(byte nIndex = 0; nIndex < ARP_TABLE_SIZE + 2; ++nIndex)
+    {
+        ArpEntry& entry = m_aEntry[nIndex];
+        entry.nNext = ARP_EOF;
+        entry.nFlags &= ~ARP_FLAG_RESOLVED;
+        if(!(entry.nFlags & ARP_FLAG_PINNED))
+            entry.nFlags = 0;
+        else if((entry.nFlags & ARP_FLAG_USED) && ARP_EOF == Find(entry.ip.GetAddress()))
+            Link(nIndex);
+    }
+}
+
+void ArpCache::Link(byte nIndex)
+{
+    byte nBucket = Hash(m_aEntry[nIndex].ip.GetAddress());
+    m_aEntry[nIndex].nNext = m_pBucket[nBucket];
+    m_pBucket[nBucket] = nIndex;
+}
+
+void ArpCache::Unlink(byte nIndex)
+{
+    byte* pNext = &m_pBucket[Hash(m_aEntry[nIndex].ip.GetAddress())];
+    while(*pNext != ARP_EOF)
+    {
+        if(*pNext == nIndex)
+        {
+            *pNext = m_aEntry[nIndex].nNext;
+            break;
+        }
+        pNext = &m_aEntry[*pNext].nNext;
+    }
+    m_aEntry[nIndex].nNext = ARP_EOF;
+}
+
+byte ArpCache::Allocate()
+{
+    //Use a free entry or the least recently used (preferring expired entries)
+    uint32_t lNow = millis();
+    byte nVictim = ARP_EOF;
+    uint32_t lOldest = 0;
+    for(byte nIndex = ARP_DNS_INDEX + 1; nIndex < ARP_TABLE_SIZE + 2; ++nIndex)
+    {
+        ArpEntry& entry = m_aEntry[nIndex];
+        if(!(entry.nFlags & ARP_FLAG_USED))
+            return nIndex;
+        uint32_t lAge = lNow - entry.lUsed;
+        if((entry.nFlags & ARP_FLAG_RESOLVED) && lNow - entry.lUpdated > ARP_ENTRY_TIMEOUT)
+            lAge = 0xFFFFFFFF;
+        if(ARP_EOF == nVictim || lAge > lOldest)
+        {
+            nVictim = nIndex;
+            lOldest = lAge;
+        }
+    }
+    Unlink(nVictim);
+    m_aEntry[nVictim].nFlags = 0;
+    ++m_nEvictions;
+    return nVictim;
+}
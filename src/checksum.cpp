@@ -0,0 +1,127 @@
+#include "checksum.h"
+
+#if defined(CHECKSUM_IMPL_AVX2) || defined(CHECKSUM_IMPL_SSE2)
+    #include <immintrin.h>
+#endif
+
+uint16_t Checksum::AddGeneric(const byte* pData, uint16_t nLen, uint32_t lSum)
+{
+    for(; nLen > 1; nLen -= 2, pData += 2)
+        lSum += uint16_t((pData[0] << 8) | pData[1]); //Cast avoids sign extension where int is 16-bit
+    if(nLen)
+        lSum += uint16_t(pData[0] << 8);
+    return Fold(lSum);
+}
+
+#if defined(CHECKSUM_IMPL_AVR)
+
+const char* Checksum::GetImplementation() { return "AVR"; }
+
+uint16_t Checksum::Add(const byte* pData, uint16_t nLen, uint32_t lSum)
+{
+    //Blocks of 8 bytes. Carry out of each word is added into the next (end-around carry) so the chain is never broken.
+    //dec and brne do not change the carry flag. Counter is 8-bit so at most 255 blocks are summed per pass.
+    while(nLen >= 8)
+    {
+        byte nBlocks = (nLen / 8 > 255) ? 255 : nLen / 8;
+        nLen -= uint16_t(nBlocks) * 8;
+        uint16_t nSum = 0;
+        byte nHigh;
+        asm volatile(
+            "clc"                           "\n\t"
+            "1:"                            "\n\t"
+            "ld %[h], %a[p]+"               "\n\t"
+            "ld __tmp_reg__, %a[p]+"        "\n\t"
+            "adc %A[s], __tmp_reg__"        "\n\t"
+            "adc %B[s], %[h]"               "\n\t"
+            "ld %[h], %a[p]+"               "\n\t"
+            "ld __tmp_reg__, %a[p]+"        "\n\t"
+            "adc %A[s], __tmp_reg__"        "\n\t"
+            "adc %B[s], %[h]"               "\n\t"
+            "ld %[h], %a[p]+"               "\n\t"
+            "ld __tmp_reg__, %a[p]+"        "\n\t"
+            "adc %A[s], __tmp_reg__"        "\n\t"
+            "adc %B[s], %[h]"               "\n\t"
+            "ld %[h], %a[p]+"               "\n\t"
+            "ld __tmp_reg__, %a[p]+"        "\n\t"
+            "adc %A[s], __tmp_reg__"        "\n\t"
+            "adc %B[s], %[h]"               "\n\t"
+            "dec %[n]"                      "\n\t"
+            "brne 1b"                       "\n\t"
+            "adc %A[s], __zero_reg__"       "\n\t" //Fold final carry. Three additions cover carry out of 0xFFFF + 1
+            "adc %B[s], __zero_reg__"       "\n\t"
+            "adc %A[s], __zero_reg__"       "\n\t"
+            : [s] "+r" (nSum), [p] "+e" (pData), [n] "+r" (nBlocks), [h] "=&r" (nHigh)
+            :
+            : "memory"
+        );
+        lSum += nSum;
+    }
+    return AddGeneric(pData, nLen, lSum);
+}
+
+#elif defined(CHECKSUM_IMPL_AVX2) || defined(CHECKSUM_IMPL_SSE2)
+
+const char* Checksum::GetImplementation()
+{
+    #if defined(CHECKSUM_IMPL_AVX2)
+    return "AVX2";
+    #else
+    return "SSE2";
+    #endif
+}
+
+uint16_t Checksum::Add(const byte* pData, uint16_t nLen, uint32_t lSum)
+{
+    //One's complement sum is independent of byte order (RFC 1071 2.B) so words are summed as loaded (little endian)
+    //into 32-bit lanes and the folded result is byte swapped. Lanes cannot overflow for nLen < 64K.
+    uint32_t lLanes = 0;
+    #if defined(CHECKSUM_IMPL_AVX2)
+    if(nLen >= 32)
+    {
+        __m256i vZero = _mm256_setzero_si256();
+        __m256i vSum = vZero;
+        for(; nLen >= 32; nLen -= 32, pData += 32)
+        {
+            __m256i vData = _mm256_loadu_si256((const __m256i*)pData);
+            vSum = _mm256_add_epi32(vSum, _mm256_unpacklo_epi16(vData, vZero));
+            vSum = _mm256_add_epi32(vSum, _mm256_unpackhi_epi16(vData, vZero));
+        }
+        uint32_t aLane[8];
+        _mm256_storeu_si256((__m256i*)aLane, vSum);
+        for(byte nLane = 0; nLane < 8; ++nLane)
+            lLanes += aLane[nLane] & 0xFFFF; //Add halves separately so that total of 8 lanes cannot overflow
+        for(byte nLane = 0; nLane < 8; ++nLane)
+            lLanes += aLane[nLane] >> 16;
+    }
+    #endif // CHECKSUM_IMPL_AVX2
+    if(nLen >= 16)
+    {
+        __m128i vZero = _mm_setzero_si128();
+        __m128i vSum = vZero;
+        for(; nLen >= 16; nLen -= 16, pData += 16)
+        {
+            __m128i vData = _mm_loadu_si128((const __m128i*)pData);
+            vSum = _mm_add_epi32(vSum, _mm_unpacklo_epi16(vData, vZero));
+            vSum = _mm_add_epi32(vSum, _mm_unpackhi_epi16(vData, vZero));
+        }
+        uint32_t aLane[4];
+        _mm_storeu_si128((__m128i*)aLane, vSum);
+        for(byte nLane = 0; nLane < 4; ++nLane)
+            lLanes += (aLane[nLane] & 0xFFFF) + (aLane[nLane] >> 16);
+    }
+    uint16_t nLanes = Fold(lLanes);
+    lSum += uint16_t((nLanes << 8) | (nLanes >> 8));
+    return AddGeneric(pData, nLen, lSum);
+}
+
+#else
+
+const char* Checksum::GetImplementation() { return "generic"; }
+
+uint16_t Checksum::Add(const byte* pData, uint16_t nLen, uint32_t lSum)
+{
+    return AddGeneric(pData, nLen, lSum);
+}
+
+#endif
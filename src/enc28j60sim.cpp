@@ -0,0 +1,460 @@
+#include "enc28j60sim.h"
+
+static const uint16_t RX_BUFFER_SIZE = ENC28J60_RXEND - ENC28J60_RXSTART + 1;
+
+ENC28J60Sim::ENC28J60Sim() :
+    m_nRxWrite(ENC28J60_RXSTART),
+    m_nRxRead(ENC28J60_RXSTART),
+    m_nRxNext(ENC28J60_RXSTART),
+    m_nRxFrame(ENC28J60_RXSTART),
+    m_nRxLen(0),
+    m_nRxCursor(0),
+    m_nRxPacketCount(0),
+    m_nRxHighWater(0),
+    m_lRxOverflows(0),
+    m_lRxLost(0),
+    m_bRxOverflow(false),
+    m_lRxFiltered(0),
+    m_nRxFilter(0),
+    m_nTxLen(0),
+    m_nTxCursor(0),
+    m_nTxSlot(0),
+    m_pTxFrame(NULL),
+    m_nTxFrameLen(0),
+    m_nTxStatus(ENC28J60_TX_IDLE),
+    m_nTxError(0),
+    m_nTxErrorNext(0),
+    m_pHandleTx(NULL),
+    m_pHandleInterrupt(NULL)
+{
+    memset(m_pSram, 0, sizeof(m_pSram));
+    memset(m_pMac, 0, sizeof(m_pMac));
+    memset(m_pRxHash, 0, sizeof(m_pRxHash));
+    memset(m_pTxSlotState, ENC28J60_SLOT_FREE, sizeof(m_pTxSlotState));
+    memset(m_pTxSlotLen, 0, sizeof(m_pTxSlotLen));
+}
+
+byte ENC28J60Sim::Initialize(byte* pMac, byte nChipSelectPin)
+{
+    memcpy(m_pMac, pMac, 6);
+    m_nRxWrite = m_nRxRead = m_nRxNext = ENC28J60_RXSTART;
+    m_nRxLen = 0;
+    m_nRxPacketCount = 0;
+    RxClearStats();
+    m_nTxSlot = 0;
+    memset(m_pTxSlotState, ENC28J60_SLOT_FREE, sizeof(m_pTxSlotState));
+    m_nTxStatus = ENC28J60_TX_IDLE;
+    m_nTxError = 0;
+    m_nTxErrorNext = 0;
+    return 6; //Silicon revision B7
+}
+
+void ENC28J60Sim::GetMac(byte* pBuffer)
+{
+    memcpy(pBuffer, m_pMac, 6);
+}
+
+uint16_t ENC28J60Sim::RxWrap(uint32_t nAddress)
+{
+    while(nAddress > ENC28J60_RXEND)
+        nAddress -= RX_BUFFER_SIZE;
+    return nAddress;
+}
+
+uint16_t ENC28J60Sim::RxGetFree()
+{
+    uint16_t nUsed = (m_nRxWrite + RX_BUFFER_SIZE - m_nRxRead) % RX_BUFFER_SIZE;
+    return RX_BUFFER_SIZE - nUsed - 1;
+}
+
+bool ENC28J60Sim::RxInject(const byte* pFrame, uint16_t nLen)
+{
+    if(0 == nLen || nLen > ENC28J60_MAX_FRAME - 4)
+        return false;
+    if(!RxIsAccepted(pFrame, nLen))
+    {
+        ++m_lRxFiltered;
+        return true; //Discarded by MAC - never uses receive buffer or SPI bandwidth
+    }
+    uint16_t nSize = ENC28J60_RSV_SIZE + nLen + 4; //Receive status vector + frame + CRC
+    nSize += nSize & 1; //Next packet pointer is always even
+    if(nSize > RxGetFree() || m_nRxPacketCount == 0xFF)
+    {
+        //Overflow - hardware drops frame and sets EIR.RXERIF
+        if(!m_bRxOverflow)
+            ++m_lRxOverflows;
+        m_bRxOverflow = true;
+        ++m_lRxLost;
+        return false;
+    }
+    m_bRxOverflow = false;
+    uint16_t nNext = RxWrap(uint32_t(m_nRxWrite) + nSize);
+    uint16_t nCount = nLen + 4;
+    byte pRsv[ENC28J60_RSV_SIZE] = {byte(nNext & 0xFF), byte(nNext >> 8), byte(nCount & 0xFF), byte(nCount >> 8), 0x80, 0x00}; //Received OK
+    if(pFrame[0] & 0x01)
+        pRsv[4] |= (pFrame[0] == 0xFF) ? 0x40 : 0x20; //Broadcast or multicast
+    uint16_t nAddress = m_nRxWrite;
+    for(uint16_t i = 0; i < ENC28J60_RSV_SIZE; ++i)
+    {
+        m_pSram[nAddress] = pRsv[i];
+        nAddress = RxWrap(uint32_t(nAddress) + 1);
+    }
+    for(uint16_t i = 0; i < nLen; ++i)
+    {
+        m_pSram[nAddress] = pFrame[i];
+        nAddress = RxWrap(uint32_t(nAddress) + 1);
+    }
+    for(uint16_t i = 0; i < 4; ++i)
+    {
+        m_pSram[nAddress] = 0; //CRC is not checked by the stack so leave blank
+        nAddress = RxWrap(uint32_t(nAddress) + 1);
+    }
+    m_nRxWrite = nNext;
+    if(0 == m_nRxPacketCount++ && m_pHandleInterrupt)
+        m_pHandleInterrupt(); //EIR.PKTIF set asserts INT
+    uint16_t nUsed = RX_BUFFER_SIZE - 1 - RxGetFree();
+    if(nUsed > m_nRxHighWater)
+        m_nRxHighWater = nUsed;
+    return true;
+}
+
+void ENC28J60Sim::RxClearStats()
+{
+    m_nRxHighWater = RX_BUFFER_SIZE - 1 - RxGetFree(); //Start from current fill
+    m_lRxOverflows = 0;
+    m_lRxLost = 0;
+    m_bRxOverflow = false;
+    m_lRxFiltered = 0;
+}
+
+void ENC28J60Sim::SetRxFilter(byte nFilter, const byte* pMulticast, byte nGroups)
+{
+    m_nRxFilter = nFilter;
+    memset(m_pRxHash, 0, sizeof(m_pRxHash));
+    for(byte nGroup = 0; nGroup < nGroups; ++nGroup)
+    {
+        byte nIndex = GetHashIndex(pMulticast + nGroup * 6);
+        m_pRxHash[nIndex >> 3] |= 1 << (nIndex & 7);
+    }
+}
+
+byte ENC28J60Sim::GetHashIndex(const byte* pMac)
+{
+    //Ethernet CRC-32 of destination address, least significant bit first
+    uint32_t lCrc = 0xFFFFFFFF;
+    for(byte i = 0; i < 6; ++i)
+    {
+        lCrc ^= pMac[i];
+        for(byte nBit = 0; nBit < 8; ++nBit)
+            lCrc = (lCrc >> 1) ^ ((lCrc & 1) ? 0xEDB88320 : 0);
+    }
+    lCrc = ~lCrc;
+    return (lCrc >> 23) & 0x3F;
+}
+
+bool ENC28J60Sim::RxIsAccepted(const byte* pFrame, uint16_t nLen)
+{
+    if(0 == (m_nRxFilter & ~ENC28J60_FILTER_CRC))
+        return true; //Promiscuous
+    if(nLen < 14)
+        return false;
+    static const byte pBroadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    bool bBroadcast = (0 == memcmp(pFrame, pBroadcast, 6));
+    bool bMulticast = !bBroadcast && (pFrame[0] & 0x01);
+    if((m_nRxFilter & ENC28J60_FILTER_UNICAST) && 0 == memcmp(pFrame, m_pMac, 6))
+        return true;
+    if((m_nRxFilter & ENC28J60_FILTER_BROADCAST) && bBroadcast)
+        return true;
+    if((m_nRxFilter & ENC28J60_FILTER_MULTICAST) && bMulticast)
+        return true;
+    if((m_nRxFilter & ENC28J60_FILTER_ARP) && bBroadcast && 0x08 == pFrame[12] && 0x06 == pFrame[13])
+        return true;
+    if(m_nRxFilter & ENC28J60_FILTER_HASH)
+    {
+        byte nIndex = GetHashIndex(pFrame);
+        if(m_pRxHash[nIndex >> 3] & (1 << (nIndex & 7)))
+            return true;
+    }
+    return false;
+}
+
+uint16_t ENC28J60Sim::RxBegin()
+{
+    if(m_nRxLen)
+        return m_nRxLen; //Still processing current frame
+    if(0 == m_nRxPacketCount)
+        return 0;
+    uint16_t nCount = m_pSram[RxWrap(uint32_t(m_nRxNext) + 2)] | (m_pSram[RxWrap(uint32_t(m_nRxNext) + 3)] << 8);
+    m_nRxFrame = RxWrap(uint32_t(m_nRxNext) + ENC28J60_RSV_SIZE);
+    m_nRxLen = nCount - 4;
+    m_nRxCursor = 0;
+    return m_nRxLen;
+}
+
+byte ENC28J60Sim::RxGetByte(uint16_t nOffset)
+{
+    if(nOffset == ENC28J60_CURSOR)
+        nOffset = m_nRxCursor;
+    m_nRxCursor = nOffset + 1;
+    if(nOffset >= m_nRxLen)
+        return 0;
+    return m_pSram[RxWrap(uint32_t(m_nRxFrame) + nOffset)];
+}
+
+uint16_t ENC28J60Sim::RxGetWord(uint16_t nOffset)
+{
+    uint16_t nValue = RxGetByte(nOffset) << 8;
+    return nValue | RxGetByte();
+}
+
+uint16_t ENC28J60Sim::RxGetData(byte* pBuffer, uint16_t nLen, uint16_t nOffset)
+{
+    if(nOffset == ENC28J60_CURSOR)
+        nOffset = m_nRxCursor;
+    if(nOffset >= m_nRxLen)
+        nLen = 0;
+    else if(nOffset + nLen > m_nRxLen)
+        nLen = m_nRxLen - nOffset;
+    uint16_t nAddress = RxWrap(uint32_t(m_nRxFrame) + nOffset);
+    for(uint16_t i = 0; i < nLen; ++i)
+    {
+        pBuffer[i] = m_pSram[nAddress];
+        nAddress = RxWrap(uint32_t(nAddress) + 1);
+    }
+    m_nRxCursor = nOffset + nLen;
+    return nLen;
+}
+
+void ENC28J60Sim::RxEnd()
+{
+    if(0 == m_nRxLen)
+        return;
+    //Free buffer space up to next frame (ERXRDPT) and decrement packet count (PKTDEC)
+    m_nRxNext = m_pSram[m_nRxNext] | (m_pSram[RxWrap(uint32_t(m_nRxNext) + 1)] << 8);
+    m_nRxRead = m_nRxNext;
+    m_nRxLen = 0;
+    --m_nRxPacketCount;
+}
+
+void ENC28J60Sim::TxBegin(byte* pMac, uint16_t nEthertype)
+{
+    byte pHeader[14]; //Destination, source, EtherType
+    if(pMac)
+        memcpy(pHeader, pMac, 6);
+    else
+        memset(pHeader, 0xFF, 6);
+    memcpy(pHeader + 6, m_pMac, 6);
+    pHeader[12] = nEthertype >> 8;
+    pHeader[13] = nEthertype & 0xFF;
+    TxBeginFrame(pHeader, sizeof(pHeader));
+}
+
+void ENC28J60Sim::TxBeginFrame(const byte* pHeader, uint16_t nLen)
+{
+    m_nTxSlot = TxAcquireSlot();
+    m_pTxSlotState[m_nTxSlot] = ENC28J60_SLOT_BUILDING;
+    m_pSram[ENC28J60_TXSTART + m_nTxSlot * ENC28J60_TX_SLOT_SIZE] = 0; //Per packet control byte - use MACON3 defaults
+    m_nTxLen = 0;
+    m_nTxCursor = 0;
+    TxAppend((byte*)pHeader, nLen);
+}
+
+bool ENC28J60Sim::TxAppend(byte* pData, uint16_t nLen)
+{
+    if(m_nTxCursor + nLen > ENC28J60_TX_MAX_FRAME)
+        return false;
+    memcpy(TxGetPointer(m_nTxCursor), pData, nLen);
+    m_nTxCursor += nLen;
+    m_nTxLen = max(m_nTxLen, m_nTxCursor);
+    return true;
+}
+
+bool ENC28J60Sim::TxAppendByte(byte nData)
+{
+    return TxAppend(&nData, 1);
+}
+
+bool ENC28J60Sim::TxAppendWord(uint16_t nData)
+{
+    byte pData[2] = {byte(nData >> 8), byte(nData & 0xFF)};
+    return TxAppend(pData, 2);
+}
+
+bool ENC28J60Sim::TxAppendFill(byte nData, uint16_t nLen)
+{
+    if(m_nTxCursor + nLen > ENC28J60_TX_MAX_FRAME)
+        return false;
+    memset(TxGetPointer(m_nTxCursor), nData, nLen);
+    m_nTxCursor += nLen;
+    m_nTxLen = max(m_nTxLen, m_nTxCursor);
+    return true;
+}
+
+bool ENC28J60Sim::TxAppend_P(const byte* pData, uint16_t nLen)
+{
+    if(m_nTxCursor + nLen > ENC28J60_TX_MAX_FRAME)
+        return false;
+    memcpy_P(TxGetPointer(m_nTxCursor), pData, nLen);
+    m_nTxCursor += nLen;
+    m_nTxLen = max(m_nTxLen, m_nTxCursor);
+    return true;
+}
+
+void ENC28J60Sim::TxWriteByte(uint16_t nOffset, byte nData)
+{
+    TxWrite(nOffset, &nData, 1);
+}
+
+void ENC28J60Sim::TxWriteWord(uint16_t nOffset, uint16_t nData)
+{
+    byte pData[2] = {byte(nData >> 8), byte(nData & 0xFF)};
+    TxWrite(nOffset, pData, 2);
+}
+
+void ENC28J60Sim::TxWrite(uint16_t nOffset, byte* pData, uint16_t nLen)
+{
+    if(uint32_t(nOffset) + nLen > ENC28J60_TX_MAX_FRAME)
+        return;
+    memcpy(TxGetPointer(nOffset), pData, nLen);
+    m_nTxLen = max(m_nTxLen, uint16_t(nOffset + nLen));
+}
+
+void ENC28J60Sim::TxEnd()
+{
+    if(ENC28J60_SLOT_BUILDING == m_pTxSlotState[m_nTxSlot])
+        TxSend(m_nTxSlot, m_nTxLen);
+}
+
+byte ENC28J60Sim::TxHold()
+{
+    if(ENC28J60_SLOT_BUILDING != m_pTxSlotState[m_nTxSlot])
+        return ENC28J60_NO_SLOT;
+    byte nHeld = 0;
+    for(byte nSlot = 0; nSlot < ENC28J60_TX_SLOTS; ++nSlot)
+        if(ENC28J60_SLOT_HELD == m_pTxSlotState[nSlot])
+            ++nHeld;
+    if(nHeld >= ENC28J60_TX_SLOTS - 1)
+    {
+        m_pTxSlotState[m_nTxSlot] = ENC28J60_SLOT_FREE; //Must keep a slot to send frames so discard this one
+        return ENC28J60_NO_SLOT;
+    }
+    m_pTxSlotState[m_nTxSlot] = ENC28J60_SLOT_HELD;
+    m_pTxSlotLen[m_nTxSlot] = m_nTxLen;
+    return m_nTxSlot;
+}
+
+void ENC28J60Sim::TxRelease(byte nSlot, byte* pMac)
+{
+    if(nSlot >= ENC28J60_TX_SLOTS || ENC28J60_SLOT_HELD != m_pTxSlotState[nSlot])
+        return;
+    if(pMac)
+        memcpy(m_pSram + ENC28J60_TXSTART + nSlot * ENC28J60_TX_SLOT_SIZE + 1, pMac, 6);
+    TxSend(nSlot, m_pTxSlotLen[nSlot]);
+}
+
+void ENC28J60Sim::TxDiscard(byte nSlot)
+{
+    if(nSlot < ENC28J60_TX_SLOTS && ENC28J60_SLOT_HELD == m_pTxSlotState[nSlot])
+        m_pTxSlotState[nSlot] = ENC28J60_SLOT_FREE;
+}
+
+byte ENC28J60Sim::TxPoll()
+{
+    //Simulated wire is instantaneous so every sent frame has completed
+    byte nCompleted = 0;
+    for(byte nSlot = 0; nSlot < ENC28J60_TX_SLOTS; ++nSlot)
+    {
+        if(ENC28J60_SLOT_SENDING != m_pTxSlotState[nSlot])
+            continue;
+        m_pTxSlotState[nSlot] = ENC28J60_SLOT_FREE;
+        ++nCompleted;
+    }
+    if(nCompleted && m_nTxErrorNext)
+    {
+        m_nTxError = m_nTxErrorNext;
+        m_nTxErrorNext = 0;
+        m_nTxStatus = ENC28J60_TX_FAILED;
+    }
+    else if(nCompleted && ENC28J60_TX_FAILED != m_nTxStatus)
+        m_nTxStatus = ENC28J60_TX_SUCCESS; //Failure remains until TxClearError
+    return nCompleted;
+}
+
+byte ENC28J60Sim::TxAcquireSlot()
+{
+    if(ENC28J60_SLOT_BUILDING == m_pTxSlotState[m_nTxSlot])
+        return m_nTxSlot; //Previous frame abandoned before TxEnd so reuse its slot
+    while(true)
+    {
+        for(byte nNext = 1; nNext <= ENC28J60_TX_SLOTS; ++nNext)
+        {
+            byte nSlot = (m_nTxSlot + nNext) % ENC28J60_TX_SLOTS;
+            if(ENC28J60_SLOT_FREE == m_pTxSlotState[nSlot])
+                return nSlot;
+        }
+        TxPoll(); //All slots busy so wait for a transmission to complete
+    }
+}
+
+void ENC28J60Sim::TxSend(byte nSlot, uint16_t nLen)
+{
+    byte* pFrame = m_pSram + ENC28J60_TXSTART + nSlot * ENC28J60_TX_SLOT_SIZE + 1;
+    //Hardware pads short frames to minimum size (PADCFG)
+    if(nLen < 60)
+    {
+        memset(pFrame + nLen, 0, 60 - nLen);
+        nLen = 60;
+    }
+    m_pTxFrame = pFrame;
+    m_nTxFrameLen = nLen;
+    m_pTxSlotState[nSlot] = ENC28J60_SLOT_SENDING;
+    if(ENC28J60_TX_FAILED != m_nTxStatus)
+        m_nTxStatus = ENC28J60_TX_IN_PROGRESS;
+    if(m_pHandleTx)
+        m_pHandleTx(pFrame, nLen);
+}
+
+void ENC28J60Sim::DMACopy(uint16_t nDestination, uint16_t nSource, uint16_t nLen)
+{
+    if(uint32_t(nDestination) + nLen > ENC28J60_TX_MAX_FRAME)
+        return;
+    uint16_t nAddress = RxWrap(uint32_t(m_nRxFrame) + nSource);
+    byte* pDestination = TxGetPointer(nDestination);
+    for(uint16_t i = 0; i < nLen; ++i)
+    {
+        pDestination[i] = m_pSram[nAddress];
+        nAddress = RxWrap(uint32_t(nAddress) + 1);
+    }
+    m_nTxLen = max(m_nTxLen, uint16_t(nDestination + nLen));
+}
+
+void ENC28J60Sim::TxSwap(uint16_t nOffset1, uint16_t nOffset2, uint16_t nLen)
+{
+    byte* p1 = TxGetPointer(nOffset1);
+    byte* p2 = TxGetPointer(nOffset2);
+    for(uint16_t i = 0; i < nLen; ++i)
+    {
+        byte nTmp = p1[i];
+        p1[i] = p2[i];
+        p2[i] = nTmp;
+    }
+}
+
+uint16_t ENC28J60Sim::GetChecksum(uint16_t nOffset, uint16_t nLen)
+{
+    byte* pData = TxGetPointer(nOffset);
+    uint32_t nSum = 0;
+    for(uint16_t i = 0; i + 1 < nLen; i += 2)
+        nSum += (pData[i] << 8) | pData[i + 1];
+    if(nLen & 1)
+        nSum += pData[nLen - 1] << 8;
+    while(nSum >> 16)
+        nSum = (nSum & 0xFFFF) + (nSum >> 16);
+    return ~nSum & 0xFFFF;
+}
+
+void ENC28J60Sim::TxClearError()
+{
+    m_nTxError = 0;
+    m_nTxStatus = ENC28J60_TX_IDLE;
+}
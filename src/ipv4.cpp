@@ -1,92 +1,145 @@
 #include "ipv4.h"
-#include "enc28j60.h"
+#include "ribanENC28J60.h"
 
+//Constant parts of DHCP messages sent by client, streamed to NIC from program memory
+static const byte DHCP_TEMPLATE_HEADER[] PROGMEM = {
+    DHCP_CLIENT_PORT >> 8, DHCP_CLIENT_PORT & 0xFF, //UDP source port
+    DHCP_SERVER_PORT >> 8, DHCP_SERVER_PORT & 0xFF, //UDP destination port
+    0, 0, //UDP length written when complete
+    0, 0, //Clear checksum
+    DHCP_OP_REQUEST, //Boot request
+    0x01, //Ethernet
+    0x06, //Hardware address length
+    0x00 //Hops
+};
+static const byte DHCP_TEMPLATE_COOKIE[] PROGMEM = {
+    99, 130, 83, 99, //Magic cookie
+    DHCP_OPTION_TYPE, 1 //Message type option - value appended by sender
+};
+static const byte DHCP_TEMPLATE_PARAM[] PROGMEM = {
+    DHCP_OPTION_PARAM, 6, //Parameter Request List
+    DHCP_OPTION_MASK,
+    DHCP_OPTION_ROUTER,
+    DHCP_OPTION_DNS,
+    DHCP_OPTION_LEASE,
+    DHCP_OPTION_T1,
+    DHCP_OPTION_T2,
+    DHCP_OPTION_END
+};
 
 IPV4::IPV4() :
     m_bIcmpEnabled(true), //Respond to ICMP echo requests (pings) by default
-    m_addressLocal(ADDR_TYPE_IPV4), //!@todo Is this right? Initialse object in constructor with parenthesis?
-    m_addressRemote(ADDR_TYPE_IPV4), //!@todo Is this right? Initialse object in constructor with parenthesis?
-    m_addressGw(ADDR_TYPE_IPV4), //!@todo Is this right? Initialse object in constructor with parenthesis?
-    m_addressDns(ADDR_TYPE_IPV4), //!@todo Is this right? Initialse object in constructor with parenthesis?
-    m_addressMask(ADDR_TYPE_IPV4), //!@todo Is this right? Initialse object in constructor with parenthesis?
-    m_addressSubnet(ADDR_TYPE_IPV4), //!@todo Is this right? Initialse object in constructor with parenthesis?
-    m_addressBroadcast(ADDR_TYPE_IPV4), //!@todo Is this right? Initialse object in constructor with parenthesis?
-    m_addressDhcp(ADDR_TYPE_IPV4), //!@todo Is this right? Initialse object in constructor with parenthesis?
     m_nDhcpStatus(DHCP_RESET), //Assume DHCP required until explicit request for static IP
-    m_nArpCursor(2), //First two ARP entries are for gateway (router) and DNS
-    m_nIdentification(0)
+    m_lDhcpTick(0),
+    m_lDhcpElapsed(0),
+    m_lRandom(1),
+    m_nIdentification(0),
+    m_bTxResolved(true),
+    m_nTxHeaderNext(0),
+    m_pOwner(NULL)
 {
+    for(byte nIndex = 0; nIndex < ARP_QUEUE_SIZE; ++nIndex)
+        m_aArpQueue[nIndex].nSlot = ENC28J60_NO_SLOT;
+    for(byte nIndex = 0; nIndex < IPV4_HEADER_CACHE_SIZE; ++nIndex)
+        m_aTxHeader[nIndex].nProtocol = 0;
 }
 
-void IPV4::Initialise(ENC28J60* pInterface)
+void IPV4::Initialise(NIC* pInterface, RxPacket* pRxPacket, NetStats* pStats, SocketIndex* pSockets, ribanENC28J60* pOwner)
 {
+    m_pOwner = pOwner;
     m_pInterface = pInterface;
+    m_pRxPacket = pRxPacket;
+    m_pStats = pStats;
+    m_pSockets = pSockets;
+    udp.Initialise(this, pInterface, pRxPacket, pSockets);
 }
 
-void IPV4::Process(uint16_t nLen)
+void IPV4::GetStats(NetStats& stats, bool bReset)
 {
-    if(m_timerDhcp.IsTriggered())
-        SendDhcpPacket(DHCP_RENEWING);
+    stats = *m_pStats;
+    m_arpCache.GetStats(stats);
+    if(!bReset)
+        return;
+    m_pStats->Clear();
+    m_arpCache.ClearStats();
+}
 
-    if(nLen < IPV4_HEADER_SIZE)
+void IPV4::Process()
+{
+    if(!m_pRxPacket->bIpv4)
+    {
+        //Classify why header was rejected
+        byte nVersion = m_pRxPacket->GetByte(MAC_HEADER_SIZE + IPV4_OFFSET_VERSION);
+        if(m_pRxPacket->nLen < MAC_HEADER_SIZE + IPV4_HEADER_SIZE)
+            ++m_pStats->aDrop[STATS_DROP_IP_SHORT];
+        else if((nVersion >> 4) != 4 || (nVersion & 0x0F) < IPV4_HEADER_SIZE / 4)
+            ++m_pStats->aDrop[STATS_DROP_IP_HEADER];
+        else
+            ++m_pStats->aDrop[STATS_DROP_IP_LENGTH]; //Total length inconsistent with header or frame
+        return;
+    }
+    //Validate header checksum in prefetch buffer. Options (rare) are read from NIC
+    byte* pHeader = m_pRxPacket->GetNetworkHeader();
+    uint16_t nSum = Checksum::Add(pHeader, IPV4_HEADER_SIZE, 0);
+    if(m_pRxPacket->nIpHeaderLen > IPV4_HEADER_SIZE)
+    {
+        byte pOptions[60 - IPV4_HEADER_SIZE];
+        byte nOptions = m_pRxPacket->nIpHeaderLen - IPV4_HEADER_SIZE;
+        m_pInterface->RxGetData(pOptions, nOptions, MAC_HEADER_SIZE + IPV4_HEADER_SIZE);
+        nSum = Checksum::Add(pOptions, nOptions, nSum);
+    }
+    if(0xFFFF != nSum)
+    {
+        ++m_pStats->aDrop[STATS_DROP_IP_CHECKSUM];
         return;
+    }
+    m_pStats->aRxIp[NetStats::GetIpIndex(m_pRxPacket->nProtocol)].Add(m_pRxPacket->nPayloadLen);
 
-    byte nProtocol = m_pInterface->RxGetByte(MAC_HEADER_SIZE + IPV4_OFFSET_PROTOCOL);
-    m_nHeaderLength = (m_pInterface->RxGetByte(MAC_HEADER_SIZE + IPV4_OFFSET_VERSION) & 0x0F) * 4;
-    uint16_t nPayload = m_pInterface->RxGetWord(MAC_HEADER_SIZE + IPV4_OFFSET_LENGTH);
-    if(nLen < nPayload)
-        return; //!@todo Should we indicate failure to process packet?
-    nPayload -= m_nHeaderLength;
-    byte nTmp;
-    m_pInterface->RxGetData(&nTmp, 1, MAC_HEADER_SIZE + m_nHeaderLength); //Position read cursor at payload
-    switch(nProtocol)
+    //Learn sender MAC from frames addressed to us so that replies do not need an ARP round trip
+    if(IsLocalIp(pHeader + IPV4_OFFSET_DESTINATION) && IsOnLocalSubnet(pHeader + IPV4_OFFSET_SOURCE))
+        m_arpCache.Update(pHeader + IPV4_OFFSET_SOURCE, m_pRxPacket->pData + MAC_OFFSET_SOURCE);
+    //Frames held for this host are sent by next Poll
+
+    switch(m_pRxPacket->nProtocol)
     {
         case IP_PROTOCOL_ICMP:
             if(m_bIcmpEnabled)
-                ProcessIcmp(nPayload);
+                ProcessIcmp();
             break;
-        case IP_PROTOCOL_IGMP:
-            #ifdef _DEBUG_
-            Serial.println("IPV4 IGMP not handled");
-            #endif // _DEBUG_
+        case IP_PROTOCOL_UDP:
+            ProcessUdp();
             break;
         case IP_PROTOCOL_TCP:
-            #ifdef _DEBUG_
-            Serial.println("IPV4 TCP not handled");
-            #endif // _DEBUG_
-            ProcessUdp(nPayload);
-            break;
-        case IP_PROTOCOL_UDP:
-            #ifdef _DEBUG_
-            Serial.println("IPV4 UDP not handled");
-            #endif // _DEBUG_
+            ProcessTcp();
             break;
         default:
-            #ifdef _DEBUG_
-            Serial.print("IPV4 unhandled IP protocol ");
-            Serial.println(nProtocol);
-            #endif // _DEBUG_
+            TRACE(TRACE_IPV4_UNHANDLED, m_pRxPacket->nProtocol, 0);
+            ++m_pStats->aDrop[STATS_DROP_IP_PROTOCOL];
             break;
     }
 }
 
-byte IPV4::ProcessArp(uint16_t nLen)
+byte IPV4::ProcessArp()
 {
-    #ifdef _DEBUG_
-    Serial.println("IPV4::ProcessArp");
-    #endif // _DEBUG_
-    if(nLen < ARP_IPV4_LEN)
+    if(m_pRxPacket->nLen < MAC_HEADER_SIZE + ARP_IPV4_LEN)
+    {
+        ++m_pStats->aDrop[STATS_DROP_ARP_SHORT];
         return ARP_EOF;
+    }
     byte pBuffer[ARP_IPV4_LEN];
-    m_pInterface->RxGetData(pBuffer, sizeof pBuffer, MAC_HEADER_SIZE);
+    memcpy(pBuffer, m_pRxPacket->GetNetworkHeader(), ARP_IPV4_LEN);
+    uint16_t nOperation = m_pRxPacket->GetWord(MAC_HEADER_SIZE + ARP_OPER);
     //Assume ARP header is valid IPV4 ARP
-    if(m_pInterface->RxGetWord(MAC_HEADER_SIZE + ARP_OPER) == ARP_REQUEST)
+    if(nOperation == ARP_REQUEST)
     {
-        #ifdef _DEBUG_
-        Serial.println("IPV4::ProcessArp ARP Request");
-        #endif // _DEBUG_
-        if(m_addressLocal != pBuffer + ARP_TPA)
-            return ARP_EOF; //Not for me
+        TRACE_IP(TRACE_ARP_REQUEST, pBuffer + ARP_SPA);
+        //Merge sender into cache (RFC 826) - add if request is for us, otherwise only refresh an existing entry
+        bool bForMe = (m_addressLocal == pBuffer + ARP_TPA);
+        byte nIndex = m_arpCache.Update(pBuffer + ARP_SPA, pBuffer + ARP_SHA, bForMe);
+        if(ARP_EOF != nIndex)
+            ReleaseFrames();
+        if(!bForMe)
+            return nIndex; //Not for me
 
         //!@todo Consider whether using DMA would be advantagous within IPV4::ProcessArp
 
@@ -100,262 +153,496 @@ byte IPV4::ProcessArp(uint16_t nLen)
         memcpy(pTmp, pBuffer + ARP_SPA, 4);
         memcpy(pBuffer + ARP_SPA, pBuffer + ARP_TPA, 4);
         memcpy(pBuffer + ARP_TPA, pTmp, 4);
-        m_pInterface->TxBegin(NULL, 0x0806);
+        m_pInterface->TxBegin(pBuffer + ARP_THA, ETHTYPE_ARP); //Reply directly to requester
         m_pInterface->TxAppend(pBuffer, ARP_IPV4_LEN);
         m_pInterface->TxEnd();
-        #ifdef _DEBUG_
-        Serial.print("Sent ARP reply to ");
-        Address pIp(ADDR_TYPE_IPV4, pTmp);
-        pIp.PrintAddress();
-        Serial.println();
-        #endif // _DEBUG_
-    }
-    else if(m_pInterface->RxGetWord(MAC_HEADER_SIZE + ARP_OPER) == ARP_REPLY)
-    {
-        #ifdef _DEBUG_
-        Serial.println("IPV4::ProcessArp ARP Reply");
-        #endif // _DEBUG_
-        //Search ARP table for IP address
-        for(byte i = 0; i < ARP_TABLE_SIZE + 2; ++i)
-        {
-            if(0 == memcmp(pBuffer + ARP_SPA, m_aArpTable[i].ip, 4))
-            {
-                //Found entry in ARP table so update table with MAC address
-                memcpy(m_aArpTable[i].mac, pBuffer + ARP_SHA, 6);
-                return i;
-            }
-        }
+        m_pStats->aTxEth[STATS_ETH_ARP].Add(MAC_HEADER_SIZE + ARP_IPV4_LEN);
+        TRACE_IP(TRACE_ARP_REPLY_TX, pTmp);
+        return nIndex;
     }
-    else
+    else if(nOperation == ARP_REPLY)
     {
-        #ifdef _DEBUG_
-        Serial.print("IPV4::ProcessArp Unhandled ARP message with OPER=");
-        Serial.println(m_pInterface->RxGetWord(MAC_HEADER_SIZE + ARP_OPER));
-        #endif // _DEBUG_
+        TRACE_IP(TRACE_ARP_REPLY, pBuffer + ARP_SPA);
+        //Only accept replies for hosts we have asked for (or already know)
+        byte nIndex = m_arpCache.Update(pBuffer + ARP_SPA, pBuffer + ARP_SHA, false);
+        if(ARP_EOF != nIndex)
+            ReleaseFrames();
+        return nIndex;
     }
+    TRACE(TRACE_ARP_UNHANDLED, nOperation, 0);
+    ++m_pStats->aDrop[STATS_DROP_ARP_OPERATION];
     return ARP_EOF;
 }
 
-void IPV4::GetRemoteIp(Address& address)
+void IPV4::GetRemoteIp(Ipv4Address& address)
 {
-    byte pBuffer[4];
-    m_pInterface->RxGetData(pBuffer, 4);
-    address.SetAddress(pBuffer);
+    address.SetAddress(m_pRxPacket->GetNetworkHeader() + IPV4_OFFSET_SOURCE);
 }
 
-bool IPV4::ProcessIcmp(uint16_t nLen)
+bool IPV4::ProcessIcmp()
 {
-    #ifdef _DEBUG_
-    Serial.println("IPV4::ProcessIcmp");
-    #endif // _DEBUG_
-    if(nLen < ICMP_HEADER_SIZE)
+    uint16_t nLen = m_pRxPacket->nPayloadLen;
+    if(nLen < ICMP_HEADER_SIZE || !m_pRxPacket->bL4)
+    {
+        ++m_pStats->aDrop[STATS_DROP_L4_SHORT];
         return false;
-    m_pInterface->DMACopy(0, MAC_HEADER_SIZE + m_nHeaderLength, nLen); //Populate TxBuffer with ICMP header and payload (not Ethernet or IPV4 header)
-    m_pInterface->TxWriteWord(ICMP_OFFSET_CHECKSUM, 0); //Clear checksum field
-    uint16_t nRxChecksum = m_pInterface->RxGetWord(MAC_HEADER_SIZE + m_nHeaderLength + ICMP_OFFSET_CHECKSUM);
-    uint16_t nCalcChecksum = ENC28J60::SwapBytes(m_pInterface->GetChecksum(0, nLen)); //Calculate checksum of ICMP header and payload in TxBuffer
-    if(nRxChecksum != nCalcChecksum)
-       return false; //Fails checksum
-    #ifdef _DEBUG_
-    #endif // _DEBUG_
-    switch(m_pInterface->RxGetByte(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + ICMP_OFFSET_TYPE))
+    }
+    byte* pIcmp = m_pRxPacket->GetTransportHeader();
+    uint16_t nIcmp = m_pRxPacket->nPayloadOffset; //Offset of ICMP header within frame
+    //Copy whole frame to a transmit slot once - used to validate checksum and, for echo request, as the reply
+    m_pInterface->TxBegin();
+    m_pInterface->DMACopy(0, 0, nIcmp + nLen);
+    if(m_pInterface->GetChecksum(nIcmp, nLen)) //Checksum over message including its checksum field is zero if valid
+    {
+        ++m_pStats->aDrop[STATS_DROP_ICMP_CHECKSUM];
+        return false; //Fails checksum - frame is abandoned and its slot reused by next TxBegin
+    }
+    switch(pIcmp[ICMP_OFFSET_TYPE])
     {
         case ICMP_TYPE_ECHOREPLY:
             //This is a response to an echo request (ping) so call our hanlder if defined
-            #ifdef _DEBUG_
-            Serial.println("Echo reply");
-            #endif // _DEBUG_
+            TRACE(TRACE_ICMP_ECHO_REPLY, (pIcmp[4] << 8) | pIcmp[5], (pIcmp[6] << 8) | pIcmp[7]);
             if(m_pHandleEchoResponse)
-                m_pHandleEchoResponse(m_pInterface->RxGetWord(MAC_HEADER_SIZE + m_nHeaderLength + 6)); //!@todo Pass parameters to handler?
+                m_pHandleEchoResponse((pIcmp[6] << 8) | pIcmp[7]); //!@todo Pass parameters to handler?
             //!@todo This may be prone to DoS attack by targetting unsolicited echo responses at this host - may be less significant than limited recieve handling - Just check we are expecting it in handler?
             break;
         case ICMP_TYPE_ECHOREQUEST:
             //This is an echo request (ping) from a remote host so send an echo reply (pong)
-            #ifdef _DEBUG_
-            Serial.println("Echo request");
-            #endif // _DEBUG_
-            //Reuse recieve buffer and send reply
-            m_pInterface->TxBegin();
-            m_pInterface->DMACopy(0, 0, MAC_HEADER_SIZE + IPV4_HEADER_SIZE + nLen);
+            TRACE(TRACE_ICMP_ECHO_REQUEST, (pIcmp[4] << 8) | pIcmp[5], (pIcmp[6] << 8) | pIcmp[7]);
+            //Turn copied request into reply and send
             m_pInterface->TxSwap(MAC_OFFSET_DESTINATION, MAC_OFFSET_SOURCE, 6);
             m_pInterface->TxSwap(MAC_HEADER_SIZE + IPV4_OFFSET_DESTINATION, MAC_HEADER_SIZE + IPV4_OFFSET_SOURCE, 4);
-            m_pInterface->TxWriteByte(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + ICMP_OFFSET_TYPE, ICMP_TYPE_ECHOREPLY);
-            m_pInterface->TxWriteWord(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + ICMP_OFFSET_CHECKSUM, 0);
-            m_pInterface->TxWriteWord(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + ICMP_OFFSET_CHECKSUM, m_pInterface->GetChecksum(MAC_HEADER_SIZE + IPV4_HEADER_SIZE, nLen));
+            {
+                //Only the type changes so update checksum incrementally (RFC 1624 eqn 3: HC' = ~(~HC + ~m + m'))
+                byte nCode = pIcmp[ICMP_OFFSET_CODE];
+                uint16_t nChecksum = (pIcmp[ICMP_OFFSET_CHECKSUM] << 8) | pIcmp[ICMP_OFFSET_CHECKSUM + 1];
+                uint32_t lSum = uint16_t(~nChecksum) + uint16_t(~((ICMP_TYPE_ECHOREQUEST << 8) | nCode)) + ((ICMP_TYPE_ECHOREPLY << 8) | nCode);
+                lSum = (lSum & 0xFFFF) + (lSum >> 16);
+                lSum = (lSum & 0xFFFF) + (lSum >> 16);
+                nChecksum = ~lSum;
+                byte pPatch[] = {ICMP_TYPE_ECHOREPLY, nCode, byte(nChecksum >> 8), byte(nChecksum & 0xFF)};
+                m_pInterface->TxWrite(nIcmp + ICMP_OFFSET_TYPE, pPatch, sizeof(pPatch));
+            }
             m_pInterface->TxEnd();
+            m_pStats->aTxEth[STATS_ETH_IPV4].Add(nIcmp + nLen);
+            m_pStats->aTxIp[STATS_IP_ICMP].Add(nLen);
             break;
         default:
             //Unhandled message types
-            #ifdef _DEBUG_
-            Serial.println("Unhandled ICMP message");
-            #endif // _DEBUG_
-            ;
+            TRACE(TRACE_ICMP_UNHANDLED, pIcmp[ICMP_OFFSET_TYPE], 0);
+            ++m_pStats->aDrop[STATS_DROP_ICMP_TYPE];
+            break;
     }
     return true; //Valid ICMP message
 }
 
-void IPV4::ProcessUdp(uint16_t nLen)
-{
-    #define _DEBUG_
-    #ifdef _DEBUG_
-    Serial.println("IPV4::ProcessUdp");
-    #endif // _DEBUG_
-    byte pBuffer[UDP_HEADER_SIZE];
-    m_pInterface->RxGetData(pBuffer, UDP_HEADER_SIZE);
-    //Check for DHCP
-    if((DHCP_CLIENT_PORT == pBuffer[UDP_OFFSET_DESTINATION_PORT]) && DHCP_DISCOVERY == m_nDhcpStatus)
-    {
-        //Expecting DHCP OFFER and recieved a DHCP message
-        #ifdef _DEBUG_
-        Serial.println("Recieved DHCP offer");
-        #endif // _DEBUG_
-        if(m_pInterface->RxGetByte() != 2)
-            return; //!@todo Should we bother to check for OP code when all messages targetted at port 68 should be from server to client?
-        if(!FindDhcpOption(53, nLen))
-            return; //Not a DHCP offer
-        //Store IP/MAC in ARP table
-        m_pInterface->RxGetData(m_aArpTable[m_nArpCursor].ip, MAC_HEADER_SIZE + IPV4_HEADER_SIZE + DHCP_OFFSET_SIADDR, 4);
-        if(m_nArpCursor++ >= ARP_TABLE_SIZE + 2)
-            m_nArpCursor = 2;
-        //Store local IP and DHCP server IP addresses
-        m_pInterface->RxGetData(m_addressLocal.GetAddress(), 4, MAC_HEADER_SIZE + m_nHeaderLength + UDP_HEADER_SIZE + DHCP_OFFSET_YIADDR); //!@todo Should we store this during offer? Used by request but maybe we should clear during request and set during acknowledge
-        m_pInterface->RxGetData(m_addressDhcp.GetAddress(), 4, MAC_HEADER_SIZE + m_nHeaderLength + UDP_HEADER_SIZE + DHCP_OFFSET_SIADDR);
-        SendDhcpPacket(DHCP_REQUESTED);
-    }
-    else if((DHCP_CLIENT_PORT == pBuffer[UDP_OFFSET_DESTINATION_PORT]) && DHCP_REQUESTED == m_nDhcpStatus)
-    {
-        //Expecting DHCP ACK and recieved a DHCP message
-        #ifdef _DEBUG_
-        Serial.println("Recieved DHCP acknowledgement");
-        #endif // _DEBUG_
-        //Check this is an acknowledgement
-        if(!FindDhcpOption(DHCP_OPTION_TYPE, nLen))
-            return;
-        m_pInterface->RxGetByte();
-        if(DHCP_TYPE_ACK != m_pInterface->RxGetByte())
+void IPV4::ProcessUdp()
+{
+    uint16_t nLen = m_pRxPacket->nPayloadLen;
+    if(nLen < UDP_HEADER_SIZE || !m_pRxPacket->bL4)
+    {
+        ++m_pStats->aDrop[STATS_DROP_L4_SHORT];
+        return;
+    }
+    uint16_t nUdpLen = m_pRxPacket->GetWord(RX_L4_OFFSET + UDP_OFFSET_LENGTH);
+    if(nUdpLen < UDP_HEADER_SIZE || nUdpLen > nLen)
+    {
+        ++m_pStats->aDrop[STATS_DROP_UDP_LENGTH];
+        return;
+    }
+    uint16_t nPort = m_pRxPacket->GetWord(RX_L4_OFFSET + UDP_OFFSET_DESTINATION_PORT);
+    TRACE(TRACE_UDP, m_pRxPacket->GetWord(RX_L4_OFFSET + UDP_OFFSET_SOURCE_PORT), nPort);
+    bool bDhcp = (DHCP_CLIENT_PORT == nPort && m_nDhcpStatus >= DHCP_DISCOVERY && DHCP_BOUND != m_nDhcpStatus);
+    byte nListener = bDhcp ? UDP_EOF : udp.Find(nPort);
+    Socket* pSocket = (bDhcp || UDP_EOF != nListener) ? NULL : m_pSockets->Find(PROTO_UDP, nPort);
+    if(!bDhcp && UDP_EOF == nListener && !pSocket)
+    {
+        ++m_pStats->aDrop[STATS_DROP_UDP_PORT];
+        return;
+    }
+    if(!IsChecksumValid(nUdpLen, IP_PROTOCOL_UDP))
+    {
+        ++m_pStats->aDrop[STATS_DROP_UDP_CHECKSUM];
+        return;
+    }
+    if(bDhcp)
+        ProcessDhcp();
+    else if(pSocket)
+        pSocket->ProcessUdp(nUdpLen);
+    else
+        udp.Dispatch(nListener, nUdpLen);
+}
+
+void IPV4::ProcessTcp()
+{
+    uint16_t nLen = m_pRxPacket->nPayloadLen;
+    if(nLen < TCP_HEADER_SIZE || !m_pRxPacket->bL4)
+    {
+        ++m_pStats->aDrop[STATS_DROP_L4_SHORT];
+        return;
+    }
+    Socket* pSocket = m_pSockets->Find(PROTO_TCP, m_pRxPacket->GetWord(RX_L4_OFFSET + TCP_OFFSET_DESTINATION_PORT));
+    if(!pSocket && m_addressLocal != m_pRxPacket->GetNetworkHeader() + IPV4_OFFSET_DESTINATION)
+    {
+        ++m_pStats->aDrop[STATS_DROP_TCP_PORT]; //Not sent to this host's address so drop without reset
+        return;
+    }
+    if(!IsChecksumValid(nLen, IP_PROTOCOL_TCP))
+    {
+        ++m_pStats->aDrop[STATS_DROP_TCP_CHECKSUM];
+        return;
+    }
+    if(pSocket && pSocket->ProcessTcp(nLen))
+        return;
+    //Closed port, socket busy with another connection or segment not acceptable in socket's state
+    ++m_pStats->aDrop[STATS_DROP_TCP_PORT];
+    SendTcpReset(nLen);
+}
+
+void IPV4::SendTcpReset(uint16_t nLen)
+{
+    byte pHeader[TCP_HEADER_SIZE];
+    RxView segment(m_pInterface, m_pRxPacket, m_pRxPacket->nPayloadOffset, nLen);
+    if(segment.Read(pHeader, TCP_HEADER_SIZE) != TCP_HEADER_SIZE || (pHeader[TCP_OFFSET_FLAGS] & TCP_FLAG_RST))
+        return; //Never reset a reset
+    byte nFlags = pHeader[TCP_OFFSET_FLAGS];
+    byte pReset[TCP_HEADER_SIZE] = {0};
+    memcpy(pReset + TCP_OFFSET_SOURCE_PORT, pHeader + TCP_OFFSET_DESTINATION_PORT, 2);
+    memcpy(pReset + TCP_OFFSET_DESTINATION_PORT, pHeader + TCP_OFFSET_SOURCE_PORT, 2);
+    pReset[TCP_OFFSET_DATA] = (TCP_HEADER_SIZE / 4) << 4;
+    if(nFlags & TCP_FLAG_ACK)
+    {
+        //Reset takes its sequence number from the acknowledgement (RFC 793 3.4)
+        memcpy(pReset + TCP_OFFSET_SEQUENCE, pHeader + TCP_OFFSET_ACKNOWLEDGE, 4);
+        pReset[TCP_OFFSET_FLAGS] = TCP_FLAG_RST;
+    }
+    else
+    {
+        //Acknowledge everything in the segment so that the sender accepts the reset
+        uint32_t lAcknowledge = (uint32_t(pHeader[TCP_OFFSET_SEQUENCE]) << 24) | (uint32_t(pHeader[TCP_OFFSET_SEQUENCE + 1]) << 16) | (uint16_t(pHeader[TCP_OFFSET_SEQUENCE + 2] << 8)) | pHeader[TCP_OFFSET_SEQUENCE + 3];
+        lAcknowledge += nLen - (pHeader[TCP_OFFSET_DATA] >> 4) * 4;
+        if(nFlags & TCP_FLAG_SYN)
+            ++lAcknowledge;
+        if(nFlags & TCP_FLAG_FIN)
+            ++lAcknowledge;
+        pReset[TCP_OFFSET_ACKNOWLEDGE] = lAcknowledge >> 24;
+        pReset[TCP_OFFSET_ACKNOWLEDGE + 1] = lAcknowledge >> 16;
+        pReset[TCP_OFFSET_ACKNOWLEDGE + 2] = lAcknowledge >> 8;
+        pReset[TCP_OFFSET_ACKNOWLEDGE + 3] = lAcknowledge;
+        pReset[TCP_OFFSET_FLAGS] = TCP_FLAG_RST | TCP_FLAG_ACK;
+    }
+    Ipv4Address addressSource(m_pRxPacket->GetNetworkHeader() + IPV4_OFFSET_SOURCE);
+    TxBegin(&addressSource, IP_PROTOCOL_TCP);
+    TxAppend(pReset, sizeof(pReset)); //Checksum completed by TxEnd
+    TxEnd();
+}
+
+bool IPV4::IsChecksumValid(uint16_t nLen, byte nProtocol)
+{
+    if(IP_PROTOCOL_UDP == nProtocol && 0 == m_pRxPacket->GetWord(RX_L4_OFFSET + UDP_OFFSET_CHECKSUM))
+        return true; //Sender did not calculate checksum (RFC 768)
+    uint16_t nOffset = m_pRxPacket->nPayloadOffset; //Offset of transport header within frame
+    //Pseudo-header is written immediately before copied segment so that the NIC checksums both
+    byte pPseudo[IPV4_PSEUDO_HEADER_SIZE];
+    memcpy(pPseudo, m_pRxPacket->GetNetworkHeader() + IPV4_OFFSET_SOURCE, 8); //Source and destination addresses
+    pPseudo[8] = 0;
+    pPseudo[9] = nProtocol;
+    pPseudo[10] = nLen >> 8;
+    pPseudo[11] = nLen & 0xFF;
+    m_pInterface->TxBegin();
+    m_pInterface->DMACopy(nOffset, nOffset, nLen);
+    m_pInterface->TxWrite(nOffset - IPV4_PSEUDO_HEADER_SIZE, pPseudo, IPV4_PSEUDO_HEADER_SIZE);
+    //Checksum over pseudo-header and segment including its checksum field is zero if valid, regardless of NIC byte order
+    return 0 == m_pInterface->GetChecksum(nOffset - IPV4_PSEUDO_HEADER_SIZE, IPV4_PSEUDO_HEADER_SIZE + nLen); //Copied frame is abandoned and its slot reused by next TxBegin
+}
+
+void IPV4::ProcessDhcp()
+{
+    DhcpMessage message;
+    if(!ParseDhcp(message) || message.lXid != m_lDhcpXid)
+        return; //Not a reply to our current exchange
+    if(DHCP_DISCOVERY == m_nDhcpStatus)
+    {
+        //Expecting DHCP OFFER - accept first
+        if(DHCP_TYPE_OFFER != message.nType)
             return;
-        if(FindDhcpOption(DHCP_OPTION_MASK, nLen))
-        {
-            m_pInterface->RxGetByte(); //Get length but assume it is correct
-            m_pInterface->RxGetData(m_addressMask.GetAddress(), 4); //Set subnet mask
-        }
-        if(FindDhcpOption(DHCP_OPTION_ROUTER, nLen))
-        {
-            m_pInterface->RxGetByte(); //Get length but assume it is correct
-            m_pInterface->RxGetData(m_addressGw.GetAddress(), 4); //Set gateway router address
-        }
-        if(FindDhcpOption(DHCP_OPTION_LEASE, nLen))
-        {
-            m_pInterface->RxGetByte(); //Get length but assume it is correct
-            uint32_t lLease = ((m_pInterface->RxGetWord()) & (uint32_t(m_pInterface->RxGetWord()) << 16)) / 2 + millis();
-            m_timerDhcp.start(lLease & 0xFFFF);
-        }
-        if(FindDhcpOption(DHCP_OPTION_DNS, nLen))
-        {
-            m_pInterface->RxGetByte(); //Get length but assume it is correct
-            m_pInterface->RxGetData(m_addressDns.GetAddress(), 4); //Set DNS to first offered DNS (this class only supports one DNS server
-        }
-        m_pInterface->RxGetData(m_addressLocal.GetAddress(), 4, MAC_HEADER_SIZE + m_nHeaderLength + UDP_HEADER_SIZE + DHCP_OFFSET_YIADDR); //Set local IP
-        m_nDhcpStatus = DHCP_BOUND; //Our work here is done - until lease renewal
+        //Store DHCP server IP/MAC in ARP cache
+        m_arpCache.Update(m_pRxPacket->GetNetworkHeader() + IPV4_OFFSET_SOURCE, m_pRxPacket->pData + MAC_OFFSET_SOURCE);
+        m_addressOffered = message.addressYour;
+        m_addressDhcp = message.addressServer;
+        TRACE_IP(TRACE_DHCP_OFFER, m_addressOffered.GetAddress());
+        SetDhcpState(DHCP_REQUESTED);
+        return;
     }
-    //!@todo Process UDP listening sockets
+    if(DHCP_TYPE_NAK == message.nType)
+    {
+        //Server refused request - abandon address and start again
+        m_addressLocal = Ipv4Address();
+        m_leaseStore.Clear();
+        SetDhcpState(DHCP_DISCOVERY);
+        return;
+    }
+    //Expecting DHCP ACK
+    if(DHCP_TYPE_ACK != message.nType)
+        return;
+    m_addressLocal = message.addressYour; //Set local IP
+    m_addressDhcp = message.addressServer; //May change when rebinding
+    if(!message.addressMask.IsNull())
+        m_addressMask = message.addressMask;
+    UpdateSubnet();
+    if(!message.addressRouter.IsNull())
+        m_arpCache.Pin(ARP_GATEWAY_INDEX, message.addressRouter.GetAddress());
+    if(message.nDnsCount)
+        m_arpCache.Pin(ARP_DNS_INDEX, message.aDns[0].GetAddress()); //This class only supports one DNS server
+    //Lease timers default to RFC 2131 4.4.5 values. Absent lease is treated as infinite
+    m_lDhcpLease = message.lLease ? message.lLease : 0xFFFFFFFF;
+    m_lDhcpT2 = (message.lT2 && message.lT2 < m_lDhcpLease) ? message.lT2 : m_lDhcpLease - m_lDhcpLease / 8;
+    m_lDhcpT1 = (message.lT1 && message.lT1 < m_lDhcpT2) ? message.lT1 : m_lDhcpLease / 2;
+    TRACE_IP(TRACE_DHCP_ACK, m_addressLocal.GetAddress());
+    SetDhcpState(DHCP_BOUND); //Our work here is done - until lease renewal
+    SaveLease();
 }
 
-void IPV4::SendDhcpPacket(byte nType)
+void IPV4::SetDhcpState(byte nState)
 {
-    byte pBuffer[] = {0,0,0,0,0,0};
-    byte pBroadcast[] = {255,255,255,255};
-    m_addressBroadcast.SetAddress(pBroadcast); //Set our broadcast address to the IPV4 global broadcast
-    if(DHCP_DISCOVERY == nType)
+    m_nDhcpStatus = nState;
+    ++m_pStats->aDhcp[nState];
+    m_nDhcpRetries = 0;
+    if(m_pOwner)
+        m_pOwner->UpdateRxFilter(); //Accept broadcast replies before sending request
+    switch(nState)
     {
-        m_addressLocal.SetAddress(pBuffer); //Reset our local IP address
-        //!@todo Clear other addresses?
+        case DHCP_DISCOVERY:
+        case DHCP_RENEWING:
+        case DHCP_REBINDING:
+        case DHCP_REBOOTING:
+            m_lDhcpXid = Random(); //New exchange
+            break;
+        case DHCP_BOUND:
+            m_lDhcpTick = millis(); //Start lease clock
+            m_lDhcpElapsed = 0;
+            return;
+        case DHCP_REQUESTED:
+            break;
+        default:
+            return; //Disabled or not started
     }
-    if(DHCP_RENEWING == nType)
-        TxBegin(&m_addressDhcp, IP_PROTOCOL_UDP);
+    SendDhcpPacket();
+}
+
+void IPV4::SendDhcpPacket()
+{
+    byte pBuffer[6];
+    bool bBound = (DHCP_RENEWING == m_nDhcpStatus || DHCP_REBINDING == m_nDhcpStatus); //Client has an address
+    if(DHCP_RENEWING == m_nDhcpStatus)
+        TxBegin(&m_addressDhcp, IP_PROTOCOL_UDP); //Renew directly with server
     else
-        TxBegin(&m_addressBroadcast, IP_PROTOCOL_UDP);
-    //Write UDP header
+    {
+        Ipv4Address addressBroadcast{255,255,255,255};
+        TxBegin(&addressBroadcast, IP_PROTOCOL_UDP); //Source is 0.0.0.0 until bound
+    }
+    //Write UDP header and start of BOOTP header
     //!@todo Implement TxUdpBegin and TxUdpEnd?
-    TxAppendWord(DHCP_CLIENT_PORT); //UDP source port
-    TxAppendWord(DHCP_SERVER_PORT); //UDP destination port
-    if(DHCP_DISCOVERY == nType)
-        TxAppendWord(UDP_HEADER_SIZE + DHCP_OFFSET_OPTIONS + 10); //Options exclude requested IP
+    TxAppend_P(DHCP_TEMPLATE_HEADER, sizeof(DHCP_TEMPLATE_HEADER));
+    TxAppendWord(m_lDhcpXid >> 16); //Transaction ID
+    TxAppendWord(m_lDhcpXid & 0xFFFF);
+    if(bBound)
+    {
+        TxAppendFill(0, DHCP_OFFSET_CIADDR - DHCP_OFFSET_SECS); //Seconds and flags
+        TxAppend(m_addressLocal.GetAddress(), 4); //Client IP address only when renewing or rebinding
+        TxAppendFill(0, DHCP_OFFSET_CHADDR - DHCP_OFFSET_YIADDR);
+    }
     else
-        TxAppendWord(UDP_HEADER_SIZE + DHCP_OFFSET_OPTIONS + 16); //Options include requested IP
-    TxAppendWord(0x0000); //Clear checksum
-    //Write DHCP Discover message
-    TxAppendByte(0x01); //Boot request
-    TxAppendByte(0x01); //Ethernet
-    TxAppendByte(0x06); //Hardware address length
-    TxAppendByte(0x00); //Hops
-    TxAppendByte(0x44); //Random transaction ID
-    TxAppendByte(0x48); //!@todo Do we need to store DHCP transaction ID or do we use same one every time?
-    TxAppendByte(0x43);
-    TxAppendByte(0x50);
-    for(uint16_t nPos = 0; nPos < 20; ++nPos)
-        TxAppendByte(0);
-    //!@todo Write own address for request
+        TxAppendFill(0, DHCP_OFFSET_CHADDR - DHCP_OFFSET_SECS);
     m_pInterface->GetMac(pBuffer);
     TxAppend(pBuffer, 6); //Write own MAC
-    for(uint16_t nPos = 0; nPos < 202; ++nPos)
-        TxAppendByte(0); //Pad with zeros
-    TxAppendByte(0x63); //Magic cookie
-    TxAppendByte(0x82); //Magic cookie
-    TxAppendByte(0x53); //Magic cookie
-    TxAppendByte(0x63); //Magic cookie
-    //DHCP Options
-    //Adjust DHCP_PACKET_SIZE to suit quantity of options. Currently DHCP_OFFSET_OPTIONS(240) + 9
-    TxAppendByte(53); //Option 53: Message type
-    TxAppendByte(1);
-    switch(nType)
+    TxAppendFill(0, DHCP_OFFSET_MAGIC - DHCP_OFFSET_CHADDR - 6); //Pad chaddr, sname and file with zeros
+    //Magic cookie and DHCP Options
+    TxAppend_P(DHCP_TEMPLATE_COOKIE, sizeof(DHCP_TEMPLATE_COOKIE));
+    TxAppendByte(DHCP_DISCOVERY == m_nDhcpStatus ? DHCP_TYPE_DISCOVER : DHCP_TYPE_REQUEST);
+    if(DHCP_REQUESTED == m_nDhcpStatus || DHCP_REBOOTING == m_nDhcpStatus)
     {
-        case DHCP_DISCOVERY:
-            TxAppendByte(DHCP_TYPE_DISCOVER);
-            break;
-        case DHCP_REQUESTED:
-        case DHCP_RENEWING: //!@todo Check renewal is same as request
-            TxAppendByte(DHCP_TYPE_REQUEST);
-            break;
+        //Selecting - identify offer being accepted. Rebooting - identify stored address without server (RFC 2131 4.3.2)
+        TxAppendWord(DHCP_OPTION_REQ_IP << 8 | 4);
+        TxAppend(m_addressOffered.GetAddress(), 4);
+    }
+    if(DHCP_REQUESTED == m_nDhcpStatus)
+    {
+        TxAppendWord(DHCP_OPTION_SERVER << 8 | 4);
+        TxAppend(m_addressDhcp.GetAddress(), 4);
     }
-    if(nType != DHCP_DISCOVERY)
+    TxAppend_P(DHCP_TEMPLATE_PARAM, sizeof(DHCP_TEMPLATE_PARAM));
+    TxWriteWord(UDP_OFFSET_LENGTH, m_nTxPayload);
+    TxEnd();
+
+    //Schedule retransmission
+    uint32_t lWait;
+    if(bBound)
     {
-        TxAppendByte(50); //Option 50: Requested IP
-        TxAppendByte(4); //Length of IP address = 4
-        TxAppend(m_addressLocal.GetAddress(), 4);
+        //Half of time remaining until T2 (renewing) or lease expiry (rebinding), at least 60s (RFC 2131 4.4.5)
+        uint32_t lRemaining = (DHCP_RENEWING == m_nDhcpStatus ? m_lDhcpT2 : m_lDhcpLease) - m_lDhcpElapsed;
+        lWait = min(max(lRemaining / 2, 60UL), 86400UL) * 1000; //Timers are checked each Poll so cap keeps millis comparison valid
     }
-    TxAppendByte(55); //Option 55: Parameter Request List
-    TxAppendByte(4); //Length 3
-    TxAppendByte(1); //Request Subnet Mask
-    TxAppendByte(3); //Request Router
-    TxAppendByte(6); //Request DNS
-    TxAppendByte(51); //Request lease time
-    TxAppendByte(255); //Option 255: END
-    TxEnd(); //Send DHCP discover
-    if(DHCP_REQUESTED == nType)
+    else
     {
-        //Blank local IP address until DHCP acknowledge recieved
-        byte pNull[] = {0,0,0,0};
-        m_addressLocal.SetAddress(pNull);
+        //Exponential backoff randomised by +/-1s (RFC 2131 4.1)
+        lWait = min(DHCP_RETRY_INTERVAL << min(m_nDhcpRetries, byte(6)), DHCP_RETRY_MAX) - 1000 + Random() % 2001;
     }
-    m_nDhcpStatus = nType;
+    ++m_nDhcpRetries;
+    m_lDhcpNext = millis() + lWait;
 }
 
-bool IPV4::FindDhcpOption(byte nOption, uint16_t nLen)
+void IPV4::PollDhcp()
 {
-    uint16_t nPos = MAC_HEADER_SIZE + IPV4_HEADER_SIZE + UDP_HEADER_SIZE + DHCP_OFFSET_OPTIONS;
-    byte nResult = m_pInterface->RxGetByte(nPos);
-    while((nPos < MAC_HEADER_SIZE + IPV4_HEADER_SIZE + UDP_HEADER_SIZE + nLen) && (nResult != 0xFF))
+    if(m_nDhcpStatus < DHCP_DISCOVERY)
+        return; //Disabled or not started
+    //Lease clock counts seconds so that leases longer than millis range are timed correctly
+    uint32_t lNow = millis();
+    uint32_t lSeconds = (lNow - m_lDhcpTick) / 1000;
+    m_lDhcpTick += lSeconds * 1000;
+    m_lDhcpElapsed += lSeconds;
+    switch(m_nDhcpStatus)
     {
-        if(nResult == nOption)
-            return true;
-        byte nLength = m_pInterface->RxGetByte();
-        byte pBuffer[nLength];
-        m_pInterface->RxGetData(pBuffer, nLen);
-        nPos = nPos + nLength + 2;
-        nResult = m_pInterface->RxGetByte(nPos);
+        case DHCP_BOUND:
+            if(m_lDhcpElapsed >= m_lDhcpT1)
+                SetDhcpState(DHCP_RENEWING);
+            return;
+        case DHCP_RENEWING:
+            if(m_lDhcpElapsed >= m_lDhcpT2)
+            {
+                SetDhcpState(DHCP_REBINDING); //Server not responding so ask any server
+                return;
+            }
+            break;
+        case DHCP_REBINDING:
+            if(m_lDhcpElapsed >= m_lDhcpLease)
+            {
+                m_addressLocal = Ipv4Address(); //Lease expired - stop using address (RFC 2131 4.4.5)
+                m_leaseStore.Clear();
+                SetDhcpState(DHCP_DISCOVERY);
+                return;
+            }
+            break;
+        case DHCP_REQUESTED:
+            if(m_nDhcpRetries >= DHCP_REQUEST_RETRIES && int32_t(lNow - m_lDhcpNext) >= 0)
+            {
+                SetDhcpState(DHCP_DISCOVERY); //Offer withdrawn or lost so start again
+                return;
+            }
+            break;
+        case DHCP_REBOOTING:
+            if(m_nDhcpRetries >= DHCP_REQUEST_RETRIES && int32_t(lNow - m_lDhcpNext) >= 0)
+            {
+                //No server answered - keep stored lease if it is known to be current, otherwise start again
+                if(!RestoreLease())
+                    SetDhcpState(DHCP_DISCOVERY);
+                return;
+            }
+            break;
     }
-    return false;
+    if(int32_t(lNow - m_lDhcpNext) >= 0)
+        SendDhcpPacket(); //Retransmit
+}
+
+uint32_t IPV4::Random()
+{
+    //xorshift32
+    m_lRandom ^= m_lRandom << 13;
+    m_lRandom ^= m_lRandom >> 17;
+    m_lRandom ^= m_lRandom << 5;
+    return m_lRandom;
+}
+
+bool IPV4::ParseDhcp(DhcpMessage& message)
+{
+    message.nType = 0;
+    message.addressMask = Ipv4Address();
+    message.addressRouter = Ipv4Address();
+    message.nDnsCount = 0;
+    message.lLease = message.lT1 = message.lT2 = 0;
+    if(m_pRxPacket->nPayloadLen < UDP_HEADER_SIZE + DHCP_OFFSET_OPTIONS)
+        return false; //Too short for BOOTP header and magic cookie
+    uint16_t nDhcp = m_pRxPacket->nPayloadOffset + UDP_HEADER_SIZE; //Offset of DHCP message within frame
+    uint16_t nEnd = m_pRxPacket->nPayloadOffset + m_pRxPacket->nPayloadLen; //IP length has been validated against frame length
+    byte pBuffer[DHCP_PARSE_CHUNK];
+
+    //Fixed fields up to and including siaddr
+    if(m_pInterface->RxGetData(pBuffer, DHCP_OFFSET_GIADDR, nDhcp) != DHCP_OFFSET_GIADDR || DHCP_OP_REPLY != pBuffer[DHCP_OFFSET_OP])
+        return false;
+    message.lXid = (uint32_t(pBuffer[DHCP_OFFSET_XID]) << 24) | (uint32_t(pBuffer[DHCP_OFFSET_XID + 1]) << 16) | (uint16_t(pBuffer[DHCP_OFFSET_XID + 2]) << 8) | pBuffer[DHCP_OFFSET_XID + 3];
+    message.addressYour = pBuffer + DHCP_OFFSET_YIADDR;
+    message.addressServer = pBuffer + DHCP_OFFSET_SIADDR;
+    m_pInterface->RxGetData(pBuffer, 4, nDhcp + DHCP_OFFSET_MAGIC);
+    if(pBuffer[0] != 99 || pBuffer[1] != 130 || pBuffer[2] != 83 || pBuffer[3] != 99)
+        return false;
+
+    //Options - buffer holds frame bytes from nBufferPos to nBufferEnd
+    uint16_t nPos = nDhcp + DHCP_OFFSET_OPTIONS;
+    uint16_t nBufferPos = nPos;
+    uint16_t nBufferEnd = nPos;
+    while(nPos < nEnd)
+    {
+        if(nPos + 2 > nBufferEnd || nPos + 2 + min(pBuffer[nPos - nBufferPos + 1], DHCP_OPTION_MAX_USED) > nBufferEnd)
+        {
+            //Option header or used part of its value not buffered so read next burst starting at option
+            uint16_t nRead = m_pInterface->RxGetData(pBuffer, min(uint16_t(DHCP_PARSE_CHUNK), uint16_t(nEnd - nPos)), nPos);
+            if(0 == nRead)
+                break;
+            nBufferPos = nPos;
+            nBufferEnd = nPos + nRead;
+        }
+        const byte* pOption = pBuffer + nPos - nBufferPos;
+        if(DHCP_OPTION_END == pOption[0])
+            break;
+        if(DHCP_OPTION_PAD == pOption[0])
+        {
+            ++nPos;
+            continue;
+        }
+        if(nPos + 2 > nBufferEnd || nPos + 2 + pOption[1] > nEnd)
+            break; //Truncated option
+        byte nLen = pOption[1];
+        const byte* pValue = pOption + 2;
+        switch(pOption[0])
+        {
+            case DHCP_OPTION_TYPE:
+                if(nLen >= 1)
+                    message.nType = pValue[0];
+                break;
+            case DHCP_OPTION_MASK:
+                if(nLen >= 4)
+                    message.addressMask = pValue;
+                break;
+            case DHCP_OPTION_ROUTER:
+                if(nLen >= 4)
+                    message.addressRouter = pValue; //Use first router
+                break;
+            case DHCP_OPTION_DNS:
+                for(message.nDnsCount = 0; message.nDnsCount < DHCP_DNS_SERVERS && message.nDnsCount < nLen / 4; ++message.nDnsCount)
+                    message.aDns[message.nDnsCount] = pValue + message.nDnsCount * 4;
+                break;
+            case DHCP_OPTION_SERVER:
+                if(nLen >= 4)
+                    message.addressServer = pValue;
+                break;
+            case DHCP_OPTION_LEASE:
+            case DHCP_OPTION_T1:
+            case DHCP_OPTION_T2:
+                if(nLen >= 4)
+                {
+                    uint32_t lValue = (uint32_t(pValue[0]) << 24) | (uint32_t(pValue[1]) << 16) | (uint16_t(pValue[2]) << 8) | pValue[3];
+                    if(DHCP_OPTION_LEASE == pOption[0])
+                        message.lLease = lValue;
+                    else if(DHCP_OPTION_T1 == pOption[0])
+                        message.lT1 = lValue;
+                    else
+                        message.lT2 = lValue;
+                }
+                break;
+        }
+        nPos += 2 + nLen;
+    }
+    return true;
 }
 
 //void IPV4::SendPacket(TxListEntry* pTxListEntry, byte nProtocol, byte* pDestination)
@@ -445,25 +732,27 @@ bool IPV4::FindDhcpOption(byte nOption, uint16_t nLen)
 //    }
 //}
 
-void IPV4::ConfigureStaticIp(Address *pIp,
-                             Address *pGw,
-                             Address *pDns,
-                             Address *pNetmask)
+void IPV4::ConfigureStaticIp(Ipv4Address* pIp,
+                             Ipv4Address* pGw,
+                             Ipv4Address* pDns,
+                             Ipv4Address* pNetmask)
 {
-    m_nDhcpStatus = DHCP_DISABLED;
-    m_timerDhcp.stop();
+    SetDhcpState(DHCP_DISABLED);
     if(pIp != 0)
         m_addressLocal.SetAddress(pIp->GetAddress());
     if(pGw != 0)
-    {
-        memcpy(m_aArpTable[ARP_GATEWAY_INDEX].ip, pGw->GetAddress(), 4);
+        m_arpCache.Pin(ARP_GATEWAY_INDEX, pGw->GetAddress());
         //!@todo lookup gw mac
-    }
     if(pDns != 0)
-        memcpy(m_aArpTable[ARP_DNS_INDEX].ip, pDns->GetAddress(), 4);
+        m_arpCache.Pin(ARP_DNS_INDEX, pDns->GetAddress());
         //!@todo lookup dns gw
     if(pNetmask != 0)
         m_addressMask.SetAddress(pNetmask->GetAddress());
+    UpdateSubnet();
+}
+
+void IPV4::UpdateSubnet()
+{
     //Update broadcast address
     for(byte i = 0; i < 4; ++i)
         m_addressBroadcast.GetAddress()[i] = m_addressLocal.GetAddress()[i] | ~m_addressMask.GetAddress()[i];
@@ -474,10 +763,81 @@ void IPV4::ConfigureStaticIp(Address *pIp,
 
 void IPV4::ConfigureDhcp()
 {
-    SendDhcpPacket(DHCP_DISCOVERY);
+    //Seed random numbers (DHCP transaction ID and backoff) from MAC and time so that hosts booting together differ
+    byte pMac[6];
+    m_pInterface->GetMac(pMac);
+    m_lRandom ^= micros();
+    for(byte nIndex = 0; nIndex < 6; ++nIndex)
+        m_lRandom = (m_lRandom << 5) + m_lRandom + pMac[nIndex];
+    if(0 == m_lRandom)
+        m_lRandom = 1; //xorshift must not be seeded with zero
+    m_addressLocal = Ipv4Address();
+    m_lDhcpTick = millis(); //Lease clock runs from first poll but is restarted when bound
+    m_lDhcpElapsed = 0;
+    //Ask server to confirm stored lease (INIT-REBOOT) rather than discover. Address is not used until acknowledged
+    DhcpLease lease;
+    if(m_leaseStore.Load(lease) && lease.IsValid() && !lease.addressLocal.IsNull())
+    {
+        uint32_t lNow = m_leaseStore.GetTime();
+        if(!lNow || !lease.lExpiry || int32_t(lease.lExpiry - lNow) > 0)
+        {
+            m_addressOffered = lease.addressLocal;
+            SetDhcpState(DHCP_REBOOTING);
+            return;
+        }
+    }
+    SetDhcpState(DHCP_DISCOVERY);
+}
+
+void IPV4::SaveLease()
+{
+    DhcpLease lease;
+    lease.lLease = m_lDhcpLease;
+    uint32_t lNow = m_leaseStore.GetTime();
+    if(lNow && 0xFFFFFFFF != m_lDhcpLease)
+        lease.lExpiry = lNow + m_lDhcpLease;
+    lease.addressLocal = m_addressLocal;
+    lease.addressServer = m_addressDhcp;
+    lease.addressMask = m_addressMask;
+    lease.addressRouter = *GetGw();
+    lease.addressDns = *GetDns();
+    lease.Seal();
+    m_leaseStore.Save(lease);
 }
 
-uint16_t IPV4::Ping(Address* pIp, void (*HandleEchoResponse)(uint16_t nSequence))
+bool IPV4::RestoreLease()
+{
+    DhcpLease lease;
+    if(!m_leaseStore.Load(lease) || !lease.IsValid())
+        return false;
+    uint32_t lNow = m_leaseStore.GetTime();
+    uint32_t lElapsed = 0;
+    if(0xFFFFFFFF != lease.lLease)
+    {
+        //Without a clock that survives restart the remaining lease is unknown so the address must not be used
+        if(!lNow || !lease.lExpiry || int32_t(lease.lExpiry - lNow) <= 0)
+            return false;
+        lElapsed = lease.lLease - (lease.lExpiry - lNow);
+    }
+    m_addressLocal = lease.addressLocal;
+    m_addressDhcp = lease.addressServer;
+    m_addressMask = lease.addressMask;
+    UpdateSubnet();
+    if(!lease.addressRouter.IsNull())
+        m_arpCache.Pin(ARP_GATEWAY_INDEX, lease.addressRouter.GetAddress());
+    if(!lease.addressDns.IsNull())
+        m_arpCache.Pin(ARP_DNS_INDEX, lease.addressDns.GetAddress());
+    //T1 and T2 are not stored so use RFC 2131 4.4.5 defaults
+    m_lDhcpLease = lease.lLease;
+    m_lDhcpT2 = m_lDhcpLease - m_lDhcpLease / 8;
+    m_lDhcpT1 = m_lDhcpLease / 2;
+    TRACE_IP(TRACE_DHCP_ACK, m_addressLocal.GetAddress());
+    SetDhcpState(DHCP_BOUND);
+    m_lDhcpElapsed = lElapsed; //Renew or rebind at once if T1 or T2 has already passed
+    return true;
+}
+
+uint16_t IPV4::Ping(Ipv4Address* pIp, void (*HandleEchoResponse)(uint16_t nSequence))
 {
     byte pPayload[32] = {8}; //Populate type=8 (echo request)
     memset(pPayload + 1, 0, 5); //Clear next 5 bytes (code, checksum, identifier)
@@ -500,20 +860,20 @@ void IPV4::EnableIcmp(bool bEnable)
     m_bIcmpEnabled = bEnable;
 }
 
-bool IPV4::IsLocalIp(byte* pIp)
+bool IPV4::IsLocalIp(const byte* pIp)
 {
     return(m_addressLocal == pIp);
 }
 
-bool IPV4::IsOnLocalSubnet(Address* pIp)
+bool IPV4::IsOnLocalSubnet(const byte* pIp)
 {
     for(byte i = 0; i < 4; ++i)
-        if((m_addressSubnet.GetAddress()[i] & pIp->GetAddress()[i]) != m_addressSubnet.GetAddress()[i])
+        if((m_addressMask.GetAddress()[i] & pIp[i]) != m_addressSubnet.GetAddress()[i])
             return false;
     return true;
 }
 
-bool IPV4::IsBroadcast(Address* pIp)
+bool IPV4::IsBroadcast(Ipv4Address* pIp)
 {
     bool bReturn = true;
     for(byte i = 0; i < 4; ++i)
@@ -526,18 +886,37 @@ bool IPV4::IsMulticast(byte* pIp)
     return((*pIp & 0xE0) == 0xE0);
 }
 
-byte* IPV4::ArpLookup(Address* pIp, uint16_t nTimeout)
+byte* IPV4::ArpLookup(Ipv4Address* pIp, uint16_t nTimeout)
 {
-    //Search ARP table
-    for(byte nIndex = 0; nIndex < ARP_TABLE_SIZE + 2; ++nIndex)
+    //Search ARP cache
+    byte* pMac = m_arpCache.Lookup(pIp->GetAddress());
+    if(pMac)
+        return pMac;
+    SendArpRequest(pIp->GetAddress());
+    //Wait for ARP response
+    uint32_t lStart = millis();
+    while(millis() - lStart < nTimeout)
     {
-        if((*pIp) == m_aArpTable[nIndex].ip, 4)
-            return m_aArpTable[nIndex].mac;
+        //Will only run if nTimeout set but will block and disguard all recieved packets until ARP response or timeout
+        uint16_t nLen = m_pInterface->RxBegin();
+        if(0 == nLen)
+            continue;
+        m_pRxPacket->Fetch(m_pInterface, nLen);
+        if(ETHTYPE_ARP == m_pRxPacket->nEthertype)
+            ProcessArp();
+        m_pInterface->RxEnd();
+        if((pMac = m_arpCache.Lookup(pIp->GetAddress())))
+            return pMac;
     }
-    //Do ARP lookup
+    return NULL;
+}
+
+void IPV4::SendArpRequest(const byte* pIp)
+{
+    TRACE_IP(TRACE_ARP_REQUEST_TX, pIp);
     m_pInterface->TxBegin(NULL, ETHTYPE_ARP);
     m_pInterface->TxAppendWord(0x0001); //HTYPE = Ethernet
-    m_pInterface->TxAppendWord(0x0008); //PTYPE = IP (note: TxAppendWord expects host byte order)
+    m_pInterface->TxAppendWord(ETHTYPE_IPV4); //PTYPE = IP (note: TxAppendWord expects host byte order)
     m_pInterface->TxAppendByte(0x06); //HSIZE = Ethernet address (MAC) length
     m_pInterface->TxAppendByte(0x04); //PSIZE = IP address length
     m_pInterface->TxAppendWord(0x0001); //OPCODE = Request
@@ -545,59 +924,217 @@ byte* IPV4::ArpLookup(Address* pIp, uint16_t nTimeout)
     m_pInterface->GetMac(pBuffer);
     m_pInterface->TxAppend(pBuffer, 6); //Sender MAC
     m_pInterface->TxAppend(m_addressLocal.GetAddress(), 4); //Sender IP
-    m_pInterface->TxAppendWord(0x0000); //Target MAC
-    m_pInterface->TxAppendWord(0x0000);
-    m_pInterface->TxAppend(pIp->GetAddress(), 4); //Target IP
+    m_pInterface->TxAppendFill(0, 6); //Target MAC
+    m_pInterface->TxAppend((byte*)pIp, 4); //Target IP
     m_pInterface->TxEnd(); //Send ARP request
-    //Add entry to ARP table with empty MAC
-    memcpy(m_aArpTable[m_nArpCursor].ip, pIp->GetAddress(), 4);
-    memset(m_aArpTable[m_nArpCursor].mac, 0, 6);
-    ++m_nArpCursor;
-    if(m_nArpCursor >= ARP_TABLE_SIZE + 2)
-        m_nArpCursor = 2;
-    //Wait for ARP response
-    uint16_t nExpire = millis() + nTimeout; //Store expiry time
-    while(nExpire > millis())
+    m_pStats->aTxEth[STATS_ETH_ARP].Add(MAC_HEADER_SIZE + ARP_IPV4_LEN);
+    //Add entry to ARP cache with empty MAC
+    m_arpCache.Add(pIp);
+}
+
+bool IPV4::ParkFrame()
+{
+    if(m_addressNextHop.IsNull())
     {
-        //Will only run if nTimeout set but will block and disguard all recieved packets until ARP response or timeout
-        if(m_pInterface->RxBegin() >= int16_t(MAC_HEADER_SIZE + ARP_IPV4_LEN))
+        ++m_pStats->aDrop[STATS_DROP_NO_ROUTE];
+        return false; //No route (e.g. gateway not configured) so drop frame
+    }
+    //Find a free descriptor and any outstanding request for same next hop
+    byte nFree = ARP_QUEUE_SIZE;
+    byte nPending = ARP_QUEUE_SIZE;
+    for(byte nIndex = 0; nIndex < ARP_QUEUE_SIZE; ++nIndex)
+    {
+        if(ENC28J60_NO_SLOT == m_aArpQueue[nIndex].nSlot)
+            nFree = nIndex;
+        else if(m_aArpQueue[nIndex].ip == m_addressNextHop)
+            nPending = nIndex;
+    }
+    //Hold frame in NIC before building any ARP request (which would overwrite it)
+    byte nSlot = (nFree < ARP_QUEUE_SIZE) ? m_pInterface->TxHold() : ENC28J60_NO_SLOT;
+    if(ENC28J60_NO_SLOT != nSlot)
+    {
+        ArpPending& pending = m_aArpQueue[nFree];
+        pending.ip = m_addressNextHop;
+        pending.nSlot = nSlot;
+        if(nPending < ARP_QUEUE_SIZE)
         {
-            byte nIndex;
-            if((nIndex = ProcessArp(ARP_IPV4_LEN)) != ARP_EOF)
-                   return m_aArpTable[nIndex].mac;
+            //Coalesce with outstanding request
+            pending.nRetries = m_aArpQueue[nPending].nRetries;
+            pending.lNext = m_aArpQueue[nPending].lNext;
+            return true;
         }
+        pending.nRetries = 0;
+        pending.lNext = millis() + ARP_RETRY_INTERVAL;
     }
-    return NULL;
+    else
+    {
+        ++m_pStats->aDrop[STATS_DROP_ARP_QUEUE];
+        if(nPending < ARP_QUEUE_SIZE)
+            return false; //Frame dropped but request already outstanding
+    }
+    //Frame dropped if it could not be held but still resolve next hop so that later frames may be sent
+    SendArpRequest(m_addressNextHop.GetAddress());
+    return ENC28J60_NO_SLOT != nSlot;
 }
 
-void IPV4::TxBegin(Address* pTarget, uint16_t nProtocol)
+void IPV4::ReleaseFrames()
 {
-    if(IsBroadcast(pTarget))
-        m_pInterface->TxBegin();
-    else if(IsOnLocalSubnet(pTarget))
-        m_pInterface->TxBegin(ArpLookup(pTarget)); //Begin Tx transaction with MAC address of target host or broadcast if ARP fails
-    else
-        m_pInterface->TxBegin(ArpLookup(&m_addressGw));
-    //Clear IPV4 header
-    byte nZero = 0;
-    for(byte nOffset = 0; nOffset < IPV4_HEADER_SIZE; ++nOffset)
-        m_pInterface->TxAppend(&nZero, 1);
-
-    m_pInterface->TxWriteByte(MAC_HEADER_SIZE + IPV4_OFFSET_VERSION, 0x45);
-    m_pInterface->TxWriteByte(MAC_HEADER_SIZE + IPV4_OFFSET_TTL, 64);
-    m_pInterface->TxWriteByte(MAC_HEADER_SIZE + IPV4_OFFSET_PROTOCOL, nProtocol);
-    m_pInterface->TxWrite(MAC_HEADER_SIZE + IPV4_OFFSET_SOURCE, m_addressLocal.GetAddress(), 4);
+    for(byte nIndex = 0; nIndex < ARP_QUEUE_SIZE; ++nIndex)
+    {
+        ArpPending& pending = m_aArpQueue[nIndex];
+        if(ENC28J60_NO_SLOT == pending.nSlot)
+            continue;
+        byte* pMac = m_arpCache.Lookup(pending.ip.GetAddress());
+        if(!pMac)
+            continue;
+        m_pInterface->TxRelease(pending.nSlot, pMac);
+        pending.nSlot = ENC28J60_NO_SLOT;
+    }
+}
+
+byte IPV4::GetRxFilter()
+{
+    byte nFilter = ENC28J60_FILTER_UNICAST | ENC28J60_FILTER_ARP;
+    if(DHCP_DISCOVERY == m_nDhcpStatus || DHCP_REQUESTED == m_nDhcpStatus || DHCP_REBINDING == m_nDhcpStatus || DHCP_REBOOTING == m_nDhcpStatus)
+        nFilter |= ENC28J60_FILTER_BROADCAST; //Server may broadcast offer and acknowledge
+    return nFilter;
+}
+
+void IPV4::Poll()
+{
+    PollDhcp();
+    ReleaseFrames(); //Next hop may have been learnt from other traffic
+    uint32_t lNow = millis();
+    for(byte nIndex = 0; nIndex < ARP_QUEUE_SIZE; ++nIndex)
+    {
+        ArpPending& pending = m_aArpQueue[nIndex];
+        if(ENC28J60_NO_SLOT == pending.nSlot || int32_t(lNow - pending.lNext) < 0)
+            continue;
+        bool bAbandon = (pending.nRetries >= ARP_RETRIES);
+        if(bAbandon)
+            TRACE_IP(TRACE_ARP_ABANDON, pending.ip.GetAddress());
+        else
+            SendArpRequest(pending.ip.GetAddress());
+        //Apply to all frames waiting for same next hop
+        byte nRetries = pending.nRetries + 1;
+        uint32_t lNext = lNow + (ARP_RETRY_INTERVAL << nRetries); //Exponential backoff
+        Ipv4Address ip = pending.ip;
+        for(byte nWaiting = nIndex; nWaiting < ARP_QUEUE_SIZE; ++nWaiting)
+        {
+            ArpPending& waiting = m_aArpQueue[nWaiting];
+            if(ENC28J60_NO_SLOT == waiting.nSlot || waiting.ip != ip)
+                continue;
+            if(bAbandon)
+            {
+                m_pInterface->TxDiscard(waiting.nSlot); //Host not responding so drop its frames
+                ++m_pStats->aDrop[STATS_DROP_ARP_TIMEOUT];
+                waiting.nSlot = ENC28J60_NO_SLOT;
+            }
+            else
+            {
+                waiting.nRetries = nRetries;
+                waiting.lNext = lNext;
+            }
+        }
+    }
+}
+
+void IPV4::TxBegin(Ipv4Address* pTarget, uint16_t nProtocol)
+{
+    Ipv4Address addressTarget;
     if(pTarget)
-        m_pInterface->TxWrite(MAC_HEADER_SIZE + IPV4_OFFSET_DESTINATION, pTarget->GetAddress(), 4);
+        addressTarget = *pTarget;
+    else
+        GetRemoteIp(addressTarget);
+    TxHeader* pHeader = GetTxHeader(addressTarget, nProtocol);
+    m_bTxResolved = true;
+    if(IsBroadcast(&addressTarget))
+        memset(pHeader->aHeader + MAC_OFFSET_DESTINATION, 0xFF, 6);
     else
-        m_pInterface->DMACopy(MAC_HEADER_SIZE + IPV4_OFFSET_DESTINATION, MAC_HEADER_SIZE + IPV4_OFFSET_SOURCE, 4);
+    {
+        //Send direct to host on local subnet, otherwise via gateway
+        m_addressNextHop = IsOnLocalSubnet(addressTarget.GetAddress()) ? addressTarget : *GetGw();
+        byte* pMac = m_arpCache.Lookup(m_addressNextHop.GetAddress());
+        m_bTxResolved = (NULL != pMac);
+        if(pMac)
+            memcpy(pHeader->aHeader + MAC_OFFSET_DESTINATION, pMac, 6); //Destination MAC of unresolved frame is written when it is released - it is never broadcast
+    }
+    m_pInterface->TxBeginFrame(pHeader->aHeader, sizeof(pHeader->aHeader));
+    m_nIpv4Protocol = nProtocol;
+    m_nTxSum = pHeader->nSum;
+    m_nTxAddressSum = pHeader->nAddressSum;
+    m_lTxPayloadSum = 0;
     m_nTxPayload = 0;
 }
 
+TxHeader* IPV4::GetTxHeader(const Ipv4Address& ip, byte nProtocol)
+{
+    TxHeader* pHeader = NULL;
+    for(byte nIndex = 0; nIndex < IPV4_HEADER_CACHE_SIZE; ++nIndex)
+    {
+        if(m_aTxHeader[nIndex].nProtocol == nProtocol && m_aTxHeader[nIndex].ip == ip)
+        {
+            pHeader = &m_aTxHeader[nIndex];
+            if(0 == memcmp(pHeader->aHeader + MAC_HEADER_SIZE + IPV4_OFFSET_SOURCE, m_addressLocal.GetAddress(), 4))
+                return pHeader;
+            break; //Local address has changed so rebuild
+        }
+    }
+    if(!pHeader)
+    {
+        pHeader = &m_aTxHeader[m_nTxHeaderNext];
+        m_nTxHeaderNext = (m_nTxHeaderNext + 1) % IPV4_HEADER_CACHE_SIZE;
+    }
+    pHeader->ip = ip;
+    pHeader->nProtocol = nProtocol;
+    byte* pData = pHeader->aHeader;
+    memset(pData, 0, sizeof(pHeader->aHeader));
+    m_pInterface->GetMac(pData + MAC_OFFSET_SOURCE);
+    pData[MAC_OFFSET_TYPE] = ETHTYPE_IPV4 >> 8;
+    pData[MAC_OFFSET_TYPE + 1] = ETHTYPE_IPV4 & 0xFF;
+    pData += MAC_HEADER_SIZE;
+    pData[IPV4_OFFSET_VERSION] = 0x45;
+    pData[IPV4_OFFSET_TTL] = IPV4_TTL;
+    pData[IPV4_OFFSET_PROTOCOL] = nProtocol;
+    memcpy(pData + IPV4_OFFSET_SOURCE, m_addressLocal.GetAddress(), 4);
+    memcpy(pData + IPV4_OFFSET_DESTINATION, ip.GetAddress(), 4);
+    pHeader->nSum = Checksum::Add(pData, IPV4_HEADER_SIZE, 0); //Constant part of header so that TxEnd only adds length and identification
+    pHeader->nAddressSum = Checksum::Add(pData + IPV4_OFFSET_SOURCE, 8, 0);
+    return pHeader;
+}
+
+void IPV4::AddTxSum(uint16_t nOffset, const byte* pData, uint16_t nLen)
+{
+    if((nOffset & 1) && nLen)
+    {
+        m_lTxPayloadSum += *pData++; //Low byte of word
+        --nLen;
+    }
+    m_lTxPayloadSum += Checksum::Add(pData, nLen); //Remainder starts on word boundary
+}
+
+void IPV4::ReplaceTxSum(uint16_t nOffset, uint16_t nLen)
+{
+    if(nOffset < m_nTxPayload)
+    {
+        //Subtract bytes about to be overwritten (adding one's complement of their sum) read by NIC DMA checksum
+        uint16_t nOld = min(uint16_t(nOffset + nLen), m_nTxPayload) - nOffset;
+        uint16_t nSum = m_pInterface->GetChecksum(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + nOffset, nOld); //Complement of sum
+        m_lTxPayloadSum += (nOffset & 1) ? uint16_t((nSum << 8) | (nSum >> 8)) : nSum;
+    }
+    else if(nOffset > m_nTxPayload)
+    {
+        //Add bytes skipped between end of payload and write which will be sent with whatever NIC memory holds
+        uint16_t nSum = ~m_pInterface->GetChecksum(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + m_nTxPayload, nOffset - m_nTxPayload);
+        m_lTxPayloadSum += (m_nTxPayload & 1) ? uint16_t((nSum << 8) | (nSum >> 8)) : nSum;
+    }
+}
+
 bool IPV4::TxAppendByte(byte nData)
 {
     if(m_pInterface->TxAppendByte(nData))
     {
+        AddTxSum(m_nTxPayload, &nData, 1);
         ++m_nTxPayload;
         return true;
     }
@@ -608,6 +1145,8 @@ bool IPV4::TxAppendWord(uint16_t nData)
 {
     if(m_pInterface->TxAppendWord(nData))
     {
+        byte pData[2] = {byte(nData >> 8), byte(nData & 0xFF)};
+        AddTxSum(m_nTxPayload, pData, 2);
         m_nTxPayload += 2;
         return true;
     }
@@ -618,6 +1157,37 @@ bool IPV4::TxAppend(byte* pData, uint16_t nLen)
 {
     if(m_pInterface->TxAppend(pData, nLen))
     {
+        AddTxSum(m_nTxPayload, pData, nLen);
+        m_nTxPayload += nLen;
+        return true;
+    }
+    return false;
+}
+
+bool IPV4::TxAppendFill(byte nData, uint16_t nLen)
+{
+    if(m_pInterface->TxAppendFill(nData, nLen))
+    {
+        if(nData)
+        {
+            uint16_t nHigh = (m_nTxPayload & 1) ? nLen / 2 : (nLen + 1) / 2; //Quantity of bytes at even offsets
+            m_lTxPayloadSum += uint32_t(nHigh) * uint16_t(nData << 8) + uint32_t(nLen - nHigh) * nData;
+        }
+        m_nTxPayload += nLen;
+        return true;
+    }
+    return false;
+}
+
+bool IPV4::TxAppend_P(const byte* pData, uint16_t nLen)
+{
+    if(m_pInterface->TxAppend_P(pData, nLen))
+    {
+        for(uint16_t nIndex = 0; nIndex < nLen; ++nIndex)
+        {
+            byte nData = pgm_read_byte(pData + nIndex);
+            AddTxSum(m_nTxPayload + nIndex, &nData, 1);
+        }
         m_nTxPayload += nLen;
         return true;
     }
@@ -626,28 +1196,58 @@ bool IPV4::TxAppend(byte* pData, uint16_t nLen)
 
 void IPV4::TxWriteByte(uint16_t nOffset, byte nData)
 {
+    ReplaceTxSum(nOffset, 1);
     m_pInterface->TxWriteByte(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + nOffset, nData);
-    m_nTxPayload = max(m_nTxPayload, nOffset);
+    AddTxSum(nOffset, &nData, 1);
+    m_nTxPayload = max(m_nTxPayload, uint16_t(nOffset + 1));
 }
 
 void IPV4::TxWriteWord(uint16_t nOffset, uint16_t nData)
 {
+    ReplaceTxSum(nOffset, 2);
     m_pInterface->TxWriteWord(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + nOffset, nData);
-    m_nTxPayload = max(m_nTxPayload, nOffset);
+    byte pData[2] = {byte(nData >> 8), byte(nData & 0xFF)};
+    AddTxSum(nOffset, pData, 2);
+    m_nTxPayload = max(m_nTxPayload, uint16_t(nOffset + 2));
 }
 
-
 void IPV4::TxWrite(uint16_t nOffset, byte* pData, uint16_t nLen)
 {
+    ReplaceTxSum(nOffset, nLen);
     m_pInterface->TxWrite(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + nOffset, pData, nLen);
-    m_nTxPayload = max(m_nTxPayload, nOffset + nLen);
+    AddTxSum(nOffset, pData, nLen);
+    m_nTxPayload = max(m_nTxPayload, uint16_t(nOffset + nLen));
 }
 
-void IPV4::TxEnd()
+bool IPV4::TxEnd()
 {
-    m_pInterface->TxWriteWord(MAC_HEADER_SIZE + IPV4_OFFSET_ID, m_nIdentification++);
-    m_pInterface->TxWriteWord(MAC_HEADER_SIZE + IPV4_OFFSET_LENGTH, IPV4_HEADER_SIZE + m_nTxPayload);
-    m_pInterface->TxWriteWord(MAC_HEADER_SIZE + IPV4_OFFSET_CHECKSUM, ENC28J60::SwapBytes(m_pInterface->GetChecksum(MAC_HEADER_SIZE, IPV4_HEADER_SIZE)));
+    //Patch length, identification and checksum (from cached header sum) in one write
+    uint16_t nLength = IPV4_HEADER_SIZE + m_nTxPayload;
+    uint16_t nId = m_nIdentification++;
+    uint32_t lSum = uint32_t(m_nTxSum) + nLength + nId;
+    uint16_t nChecksum = ~Checksum::Fold(lSum);
+    byte pPatch[IPV4_OFFSET_SOURCE - IPV4_OFFSET_LENGTH] = {byte(nLength >> 8), byte(nLength & 0xFF), byte(nId >> 8), byte(nId & 0xFF),
+        0, 0, IPV4_TTL, m_nIpv4Protocol, byte(nChecksum >> 8), byte(nChecksum & 0xFF)};
+    m_pInterface->TxWrite(MAC_HEADER_SIZE + IPV4_OFFSET_LENGTH, pPatch, sizeof(pPatch));
+    //Complete transport checksum from running sum of payload - no second pass over data
+    if(IP_PROTOCOL_UDP == m_nIpv4Protocol && m_nTxPayload >= UDP_HEADER_SIZE)
+    {
+        lSum = m_lTxPayloadSum + m_nTxAddressSum + IP_PROTOCOL_UDP + m_nTxPayload; //Include pseudo-header
+        nChecksum = ~Checksum::Fold(lSum);
+        m_pInterface->TxWriteWord(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + UDP_OFFSET_CHECKSUM, nChecksum ? nChecksum : 0xFFFF); //Zero means no checksum (RFC 768)
+    }
+    else if(IP_PROTOCOL_TCP == m_nIpv4Protocol && m_nTxPayload >= TCP_HEADER_SIZE)
+    {
+        lSum = m_lTxPayloadSum + m_nTxAddressSum + IP_PROTOCOL_TCP + m_nTxPayload; //Include pseudo-header
+        m_pInterface->TxWriteWord(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + TCP_OFFSET_CHECKSUM, ~Checksum::Fold(lSum));
+    }
+    else if(IP_PROTOCOL_ICMP == m_nIpv4Protocol && m_nTxPayload >= ICMP_HEADER_SIZE)
+        m_pInterface->TxWriteWord(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + ICMP_OFFSET_CHECKSUM, ~Checksum::Fold(m_lTxPayloadSum));
+    m_pStats->aTxEth[STATS_ETH_IPV4].Add(MAC_HEADER_SIZE + IPV4_HEADER_SIZE + m_nTxPayload);
+    m_pStats->aTxIp[NetStats::GetIpIndex(m_nIpv4Protocol)].Add(m_nTxPayload);
+    if(!m_bTxResolved)
+        return ParkFrame(); //Counted as sent. Counted as dropped if it cannot be held or resolved
     m_pInterface->TxEnd();
+    return true;
 }
 
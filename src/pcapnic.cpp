@@ -0,0 +1,245 @@
+#include "pcapnic.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t PCAP_MAGIC_US         = 0xA1B2C3D4; //!< pcap microsecond resolution
+static const uint32_t PCAP_MAGIC_NS         = 0xA1B23C4D; //!< pcap nanosecond resolution
+static const uint32_t PCAP_HEADER_SIZE      = 24;
+static const uint32_t PCAP_RECORD_SIZE      = 16;
+static const uint32_t PCAPNG_SHB            = 0x0A0D0D0A; //!< Section header block
+static const uint32_t PCAPNG_IDB            = 0x00000001; //!< Interface description block
+static const uint32_t PCAPNG_SPB            = 0x00000003; //!< Simple packet block
+static const uint32_t PCAPNG_EPB            = 0x00000006; //!< Enhanced packet block
+static const uint32_t PCAPNG_BYTE_ORDER     = 0x1A2B3C4D;
+static const uint16_t LINKTYPE_ETHERNET     = 1;
+
+static uint32_t Swap32(uint32_t nValue)
+{
+    return (nValue >> 24) | ((nValue >> 8) & 0xFF00) | ((nValue << 8) & 0xFF0000) | (nValue << 24);
+}
+
+PcapNic::PcapNic() :
+    m_pCapture(NULL),
+    m_nSize(0),
+    m_nPos(0),
+    m_nFirst(0),
+    m_bSwapped(false),
+    m_bPcapng(false),
+    m_bAutoFeed(true),
+    m_pFrame(NULL),
+    m_nFrameLen(0),
+    m_nEthertype(0),
+    m_nFed(0),
+    m_nDropped(0),
+    m_nInterfaces(0),
+    m_pOutput(NULL)
+{
+}
+
+PcapNic::~PcapNic()
+{
+    Close();
+}
+
+bool PcapNic::Open(const char* sFilename)
+{
+    if(m_pCapture)
+        munmap((void*)m_pCapture, m_nSize);
+    m_pCapture = NULL;
+    int nFile = open(sFilename, O_RDONLY);
+    if(nFile < 0)
+        return false;
+    struct stat fileStat;
+    if(fstat(nFile, &fileStat) || fileStat.st_size < PCAP_HEADER_SIZE)
+    {
+        close(nFile);
+        return false;
+    }
+    void* pMap = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, nFile, 0);
+    close(nFile);
+    if(MAP_FAILED == pMap)
+        return false;
+    m_pCapture = (const byte*)pMap;
+    m_nSize = fileStat.st_size;
+    uint32_t nMagic;
+    memcpy(&nMagic, m_pCapture, 4);
+    if(PCAPNG_SHB == nMagic)
+    {
+        m_bPcapng = true;
+        m_nFirst = 0; //Section header is parsed by NextFrame to get byte order
+    }
+    else
+    {
+        m_bPcapng = false;
+        m_bSwapped = (Swap32(nMagic) == PCAP_MAGIC_US || Swap32(nMagic) == PCAP_MAGIC_NS);
+        if((!m_bSwapped && nMagic != PCAP_MAGIC_US && nMagic != PCAP_MAGIC_NS) || Read32(20) != LINKTYPE_ETHERNET)
+        {
+            munmap(pMap, m_nSize);
+            m_pCapture = NULL;
+            return false; //Not an Ethernet capture file
+        }
+        m_nFirst = PCAP_HEADER_SIZE;
+    }
+    Rewind();
+    return true;
+}
+
+bool PcapNic::OpenOutput(const char* sFilename)
+{
+    if(m_pOutput)
+        fclose(m_pOutput);
+    m_pOutput = fopen(sFilename, "wb");
+    if(!m_pOutput)
+        return false;
+    uint32_t pHeader[6] = {PCAP_MAGIC_US, 0x00040002, 0, 0, 65535, LINKTYPE_ETHERNET};
+    fwrite(pHeader, sizeof(pHeader), 1, m_pOutput);
+    return true;
+}
+
+void PcapNic::Close()
+{
+    if(m_pCapture)
+        munmap((void*)m_pCapture, m_nSize);
+    m_pCapture = NULL;
+    m_nSize = 0;
+    if(m_pOutput)
+        fclose(m_pOutput);
+    m_pOutput = NULL;
+}
+
+void PcapNic::Rewind()
+{
+    m_nPos = m_nFirst;
+    m_nInterfaces = 0;
+}
+
+uint32_t PcapNic::Read32(size_t nOffset)
+{
+    uint32_t nValue;
+    memcpy(&nValue, m_pCapture + nOffset, 4);
+    return m_bSwapped ? Swap32(nValue) : nValue;
+}
+
+uint16_t PcapNic::Read16(size_t nOffset)
+{
+    uint16_t nValue;
+    memcpy(&nValue, m_pCapture + nOffset, 2);
+    return m_bSwapped ? SwapBytes(nValue) : nValue;
+}
+
+bool PcapNic::NextFrame(const byte** ppFrame, uint32_t* pnLen)
+{
+    while(m_pCapture)
+    {
+        if(!m_bPcapng)
+        {
+            if(m_nPos + PCAP_RECORD_SIZE > m_nSize)
+                return false;
+            uint32_t nCaptured = Read32(m_nPos + 8);
+            if(m_nPos + PCAP_RECORD_SIZE + nCaptured > m_nSize)
+                return false; //Truncated capture
+            *ppFrame = m_pCapture + m_nPos + PCAP_RECORD_SIZE;
+            *pnLen = nCaptured;
+            m_nPos += PCAP_RECORD_SIZE + nCaptured;
+            return true;
+        }
+        //pcapng blocks: type, total length, body, total length
+        if(m_nPos + 12 > m_nSize)
+            return false;
+        uint32_t nType;
+        memcpy(&nType, m_pCapture + m_nPos, 4);
+        if(PCAPNG_SHB == nType)
+        {
+            uint32_t nByteOrder;
+            memcpy(&nByteOrder, m_pCapture + m_nPos + 8, 4);
+            m_bSwapped = (nByteOrder != PCAPNG_BYTE_ORDER);
+            m_nInterfaces = 0; //Interface ids are per section
+        }
+        else
+            nType = Read32(m_nPos);
+        uint32_t nBlockLen = Read32(m_nPos + 4);
+        if(nBlockLen < 12 || m_nPos + nBlockLen > m_nSize)
+            return false;
+        size_t nBlock = m_nPos;
+        m_nPos += nBlockLen;
+        switch(nType)
+        {
+            case PCAPNG_IDB:
+                if(m_nInterfaces < PCAPNG_MAX_INTERFACES)
+                    m_pLinkType[m_nInterfaces++] = Read16(nBlock + 8);
+                break;
+            case PCAPNG_EPB:
+            {
+                uint32_t nInterface = Read32(nBlock + 8);
+                if(nInterface >= m_nInterfaces || m_pLinkType[nInterface] != LINKTYPE_ETHERNET)
+                    break;
+                uint32_t nCaptured = Read32(nBlock + 20);
+                if(28 + nCaptured + 4 > nBlockLen)
+                    break;
+                *ppFrame = m_pCapture + nBlock + 28;
+                *pnLen = nCaptured;
+                return true;
+            }
+            case PCAPNG_SPB:
+            {
+                if(0 == m_nInterfaces || m_pLinkType[0] != LINKTYPE_ETHERNET)
+                    break;
+                uint32_t nCaptured = min(Read32(nBlock + 8), nBlockLen - 16);
+                *ppFrame = m_pCapture + nBlock + 12;
+                *pnLen = nCaptured;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool PcapNic::Feed()
+{
+    const byte* pFrame;
+    uint32_t nLen;
+    if(!NextFrame(&pFrame, &nLen))
+        return false;
+    ++m_nFed;
+    m_pFrame = pFrame;
+    m_nFrameLen = min(nLen, uint32_t(0xFFFF));
+    m_nEthertype = (nLen >= 14) ? ((pFrame[12] << 8) | pFrame[13]) : 0;
+    if(nLen > ENC28J60_MAX_FRAME - 4 || !RxInject(pFrame, nLen))
+        ++m_nDropped;
+    return true;
+}
+
+uint16_t PcapNic::RxBegin()
+{
+    if(m_bAutoFeed && 0 == RxGetPacketCount())
+        Feed();
+    return ENC28J60Sim::RxBegin();
+}
+
+void PcapNic::TxEnd()
+{
+    bool bBuilding = (ENC28J60_SLOT_BUILDING == m_pTxSlotState[m_nTxSlot]);
+    ENC28J60Sim::TxEnd();
+    if(bBuilding)
+        WriteOutput();
+}
+
+void PcapNic::TxRelease(byte nSlot, byte* pMac)
+{
+    bool bHeld = (nSlot < ENC28J60_TX_SLOTS) && ENC28J60_SLOT_HELD == m_pTxSlotState[nSlot];
+    ENC28J60Sim::TxRelease(nSlot, pMac);
+    if(bHeld)
+        WriteOutput();
+}
+
+void PcapNic::WriteOutput()
+{
+    if(!m_pOutput)
+        return;
+    unsigned long lNow = micros();
+    uint32_t pRecord[4] = {uint32_t(lNow / 1000000), uint32_t(lNow % 1000000), m_nTxFrameLen, m_nTxFrameLen};
+    fwrite(pRecord, sizeof(pRecord), 1, m_pOutput);
+    fwrite(m_pTxFrame, m_nTxFrameLen, 1, m_pOutput);
+}
@@ -1,24 +1,137 @@
 #include "ribanENC28J60.h"
-#include "enc28j60.h"
 #include <Arduino.h>
 
-bool ribanENC28J60::Initialise(Address &addressMac, byte nChipSelectPin)
+volatile byte ribanENC28J60::s_nRxPending = 0;
+
+bool ribanENC28J60::Initialise(const MacAddress& addressMac, byte nChipSelectPin)
 {
     m_nChipSelectPin = nChipSelectPin;
     m_nNicVersion = 0;
+    m_bInterrupt = false;
+    m_nBroadcastListeners = 0;
+    m_nMulticastGroups = 0;
+    m_stats.Clear();
     #ifdef IP4
-    ipv4.Initialise(&m_nic),
+    ipv4.Initialise(&m_nic, &m_rxPacket, &m_stats, &m_sockets, this);
     #endif // IP4
     #ifdef IP6
-    ipv6.Initialise(&m_nic),
+    ipv6.Initialise(&m_nic);
     #endif // IP6
     m_pHandleTxError = NULL;
     m_addressLocalMac = addressMac;
-    m_nNicVersion = m_nic.Initialize(addressMac.GetAddress(), nChipSelectPin);
+    m_nNicVersion = m_nic.Initialize(m_addressLocalMac.GetAddress(), nChipSelectPin);
+    m_nRxFilter = 0;
+    m_bRxFilterChanged = true;
+    UpdateRxFilter();
     return (0 != m_nNicVersion);
 }
 
 
+void ribanENC28J60::EnableInterrupt(byte nPin)
+{
+    m_nInterruptPin = nPin;
+    s_nRxPending = 1; //Frames may already be waiting and would not raise another edge
+    m_bInterrupt = true;
+    m_nic.EnableInterrupt(nPin, HandleInterrupt);
+}
+
+void ribanENC28J60::DisableInterrupt()
+{
+    if(m_bInterrupt)
+        m_nic.EnableInterrupt(m_nInterruptPin, NULL);
+    m_bInterrupt = false;
+}
+
+void ribanENC28J60::GetStats(NetStats& stats, bool bReset)
+{
+    #ifdef IP4
+    ipv4.GetStats(stats, bReset);
+    #else
+    stats = m_stats;
+    if(bReset)
+        m_stats.Clear();
+    #endif // IP4
+    stats.lRxOverflows = m_nic.RxGetOverflowCount();
+    stats.lRxLost = m_nic.RxGetLostCount();
+    if(bReset)
+        m_nic.RxClearStats();
+}
+
+void ribanENC28J60::ListenBroadcast(bool bEnable)
+{
+    if(bEnable && m_nBroadcastListeners < 0xFF)
+        ++m_nBroadcastListeners;
+    else if(!bEnable && m_nBroadcastListeners)
+        --m_nBroadcastListeners;
+    UpdateRxFilter();
+}
+
+bool ribanENC28J60::JoinMulticast(const MacAddress& addressMac)
+{
+    for(byte nGroup = 0; nGroup < m_nMulticastGroups; ++nGroup)
+        if(m_aMulticast[nGroup] == addressMac)
+            return true;
+    if(m_nMulticastGroups >= RX_MULTICAST_GROUPS)
+        return false;
+    m_aMulticast[m_nMulticastGroups++] = addressMac;
+    m_bRxFilterChanged = true;
+    UpdateRxFilter();
+    return true;
+}
+
+void ribanENC28J60::LeaveMulticast(const MacAddress& addressMac)
+{
+    for(byte nGroup = 0; nGroup < m_nMulticastGroups; ++nGroup)
+    {
+        if(m_aMulticast[nGroup] != addressMac)
+            continue;
+        m_aMulticast[nGroup] = m_aMulticast[--m_nMulticastGroups]; //Keep list contiguous
+        m_bRxFilterChanged = true;
+        UpdateRxFilter();
+        return;
+    }
+}
+
+void ribanENC28J60::UpdateRxFilter()
+{
+    static_assert(sizeof(MacAddress) == 6, "MacAddress array must be contiguous bytes");
+    byte nFilter = ENC28J60_FILTER_UNICAST | ENC28J60_FILTER_CRC;
+    #ifdef IP4
+    nFilter |= ipv4.GetRxFilter();
+    #endif // IP4
+    #ifdef IP6
+    nFilter |= ENC28J60_FILTER_MULTICAST; //Neighbour discovery uses multicast
+    #endif // IP6
+    if(m_nBroadcastListeners)
+        nFilter |= ENC28J60_FILTER_BROADCAST;
+    if(m_nMulticastGroups)
+        nFilter |= ENC28J60_FILTER_HASH;
+    if(nFilter == m_nRxFilter && !m_bRxFilterChanged)
+        return;
+    m_nic.SetRxFilter(nFilter, m_aMulticast[0].GetAddress(), m_nMulticastGroups);
+    m_nRxFilter = nFilter;
+    m_bRxFilterChanged = false;
+}
+
+bool ribanENC28J60::IsRxWanted()
+{
+    const byte* pDestination = m_rxPacket.pData + MAC_OFFSET_DESTINATION;
+    if(!(pDestination[0] & 0x01) || (m_nRxFilter & ENC28J60_FILTER_MULTICAST))
+        return true; //Unicast or accepting all multicast
+    if(0xFF == (pDestination[0] & pDestination[1] & pDestination[2] & pDestination[3] & pDestination[4] & pDestination[5]))
+        return true; //Broadcast
+    for(byte nGroup = 0; nGroup < m_nMulticastGroups; ++nGroup)
+        if(m_aMulticast[nGroup] == pDestination)
+            return true;
+    return false;
+}
+
+void ribanENC28J60::HandleInterrupt()
+{
+    if(s_nRxPending < 0xFF)
+        ++s_nRxPending;
+}
+
 byte ribanENC28J60::GetNicVersion()
 {
     return m_nNicVersion;
@@ -26,58 +139,112 @@ byte ribanENC28J60::GetNicVersion()
 
 byte ribanENC28J60::Process()
 {
-    #define _DEBUG_
-    if(0 == m_nNicVersion)
-        return 0; //Not correctly initialised so do nothing
+    byte nRxCnt = 0;
+    Service(0, 0, nRxCnt);
+    return nRxCnt;
+}
 
+bool ribanENC28J60::Process(byte nMaxFrames, uint32_t lMaxTime)
+{
     byte nRxCnt = 0;
-    while(uint16_t nQuant = m_nic.RxBegin())
+    return Service(nMaxFrames, lMaxTime, nRxCnt);
+}
+
+void ribanENC28J60::ServiceTimers()
+{
+    //Collect completion of frames sent since last call
+    m_nic.TxPoll();
+    if(m_nic.TxGetStatus() == ENC28J60_TX_FAILED)
     {
-        if(nQuant >= MAC_HEADER_SIZE)
+        //Counted and cleared whether or not a handler is set so that each failure is counted once
+        TRACE(TRACE_TX_ERROR, 0, 0);
+        ++m_stats.nTxErrors;
+        if(m_pHandleTxError)
+            m_pHandleTxError();
+        m_nic.TxClearError();
+    }
+    #ifdef IP4
+    ipv4.Poll(); //Retransmit or release frames awaiting ARP resolution, renew DHCP lease
+    #endif // IP4
+    m_sockets.Poll(); //Disconnect idle sockets
+    UpdateRxFilter(); //Protocol state (e.g. DHCP) may change what is received
+}
+
+bool ribanENC28J60::Service(byte nMaxFrames, uint32_t lMaxTime, byte& nRxCnt)
+{
+    if(0 == m_nNicVersion)
+        return false; //Not correctly initialised so do nothing
+    uint32_t lStart = micros();
+    ServiceTimers(); //Timers run first so that a receive burst cannot starve them
+    if(m_bInterrupt)
+    {
+        if(0 == s_nRxPending)
+            return false; //Nothing received so avoid reading NIC
+        //Clear before draining so that an edge during draining is not lost
+        noInterrupts();
+        s_nRxPending = 0;
+        interrupts();
+    }
+
+    while(true)
+    {
+        if((nMaxFrames && nRxCnt >= nMaxFrames) || (lMaxTime && micros() - lStart >= lMaxTime))
+        {
+            //Budget exhausted - INT remains asserted whilst frames wait so no new edge will be raised
+            if(m_bInterrupt)
+                s_nRxPending = 1;
+            return true;
+        }
+        uint16_t nQuant = m_nic.RxBegin();
+        if(0 == nQuant)
+            return false;
+        m_rxPacket.Fetch(&m_nic, nQuant); //Get all headers in one burst
+        if(nQuant < MAC_HEADER_SIZE)
         {
-            //Get Ethertype from Ethernet header - ignore destination and source MAC for now
-            uint16_t nType = m_nic.RxGetWord(MAC_OFFSET_TYPE);
-            #ifdef _DEBUG_
-            Serial.print("Packet length: ");
-            Serial.println(nQuant);
-            Serial.print("Rx packet type: ");
-            Serial.println(nType, HEX);
-            #endif // _DEBUG_
-            switch(nType)
+            TRACE(TRACE_RX_REJECTED, nQuant, 0);
+            ++m_stats.aDrop[STATS_DROP_RUNT];
+        }
+        else if(!IsRxWanted())
+        {
+            TRACE(TRACE_RX_REJECTED, nQuant, m_rxPacket.nEthertype);
+            ++m_stats.aDrop[STATS_DROP_FILTERED];
+        }
+        else
+        {
+            TRACE(TRACE_RX_FRAME, nQuant, m_rxPacket.nEthertype);
+            m_stats.aRxEth[NetStats::GetEthIndex(m_rxPacket.nEthertype)].Add(nQuant);
+            switch(m_rxPacket.nEthertype)
             {
                 #ifdef IP4
                 case ETHTYPE_ARP:
-                    #ifdef _DEBUG_
-                    Serial.println("ARP packet recieved");
-                    #endif //_DEBUG_
-                    ipv4.ProcessArp(nQuant); //!@todo Consider ARP messages for other protocols
+                    ipv4.ProcessArp(); //!@todo Consider ARP messages for other protocols
                     break;
                 case ETHTYPE_IPV4:
-                    #ifdef _DEBUG_
-                    Serial.println("IPV4 packet recieved");
-                    #endif //_DEBUG_
-                    ipv4.Process(nQuant - MAC_HEADER_SIZE);
+                    ipv4.Process();
                     break;
                 #endif // IP4
                 #ifdef IP6
                 case ETHTYPE_IPV6:
-                    #ifdef _DEBUG_
-                    Serial.println("IPV6 packet recieved");
-                    #endif //_DEBUG_
-                    m_pIpv6->Process(nType, nQuant - MAC_HEADER_SIZE);
+                    m_pIpv6->Process(m_rxPacket.nEthertype, nQuant - MAC_HEADER_SIZE);
                     break;
                 #endif // IP6
+                default:
+                {
+                    Socket* pSocket = m_sockets.Find(PROTO_RAW, m_rxPacket.nEthertype);
+                    if(pSocket)
+                        pSocket->ProcessRaw(nQuant);
+                    else if(0 == DoProcess(m_rxPacket.nEthertype, nQuant - MAC_HEADER_SIZE))
+                    {
+                        TRACE(TRACE_RX_UNHANDLED, nQuant, m_rxPacket.nEthertype);
+                        ++m_stats.aDrop[STATS_DROP_ETHERTYPE];
+                    }
+                }
             }
         }
-        if(m_pHandleTxError && m_nic.TxGetStatus() == ENC28J60_TX_FAILED)
-        {
-            m_pHandleTxError();
-            m_nic.TxClearError();
-        }
         m_nic.RxEnd();
-        ++nRxCnt;
+        if(0 == ++nRxCnt % PROCESS_TIMER_FRAMES)
+            ServiceTimers(); //Interleave timers with long receive bursts
     }
-    return nRxCnt;
 }
 
 //void ribanENC28J60::TxPacket(TxListEntry* pSendList, byte* pDestination)
@@ -103,17 +270,23 @@ void ribanENC28J60::SetTxErrorHandler(void (*HandleTxError)())
     m_pHandleTxError = HandleTxError;
 }
 
-void ribanENC28J60::TxBegin(Address* pMac, uint16_t nEthertype)
+void ribanENC28J60::TxBegin(MacAddress* pMac, uint16_t nEthertype)
 {
     m_nic.TxBegin(pMac?pMac->GetAddress():NULL, nEthertype);
+    m_nTxEthertype = nEthertype;
+    m_nTxLen = MAC_HEADER_SIZE;
 }
 
 bool ribanENC28J60::TxAppend(byte* pData, uint16_t nLen)
 {
-    return m_nic.TxAppend(pData, nLen);
+    if(!m_nic.TxAppend(pData, nLen))
+        return false;
+    m_nTxLen += nLen;
+    return true;
 }
 
 void ribanENC28J60::TxEnd()
 {
     m_nic.TxEnd();
+    m_stats.aTxEth[NetStats::GetEthIndex(m_nTxEthertype)].Add(m_nTxLen);
 }
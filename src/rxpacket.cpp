@@ -0,0 +1,30 @@
+#include "rxpacket.h"
+
+void RxPacket::Fetch(NIC* pInterface, uint16_t nFrameLen)
+{
+    nLen = nFrameLen;
+    nEthertype = 0;
+    bIpv4 = false;
+    bL4 = false;
+    nCursor = ENC28J60_CURSOR;
+    uint16_t nFetched = pInterface->RxGetData(pData, min(nLen, RX_PREFETCH_SIZE), 0);
+    if(nFetched < MAC_HEADER_SIZE)
+        return;
+    nEthertype = GetWord(MAC_OFFSET_TYPE);
+    if(ETHTYPE_IPV4 != nEthertype || nFetched < MAC_HEADER_SIZE + IPV4_HEADER_SIZE)
+        return;
+    byte* pIp = GetNetworkHeader();
+    nIpHeaderLen = (pIp[IPV4_OFFSET_VERSION] & 0x0F) * 4;
+    uint16_t nTotal = GetWord(MAC_HEADER_SIZE + IPV4_OFFSET_LENGTH);
+    if((pIp[IPV4_OFFSET_VERSION] >> 4) != 4 || nIpHeaderLen < IPV4_HEADER_SIZE || nTotal < nIpHeaderLen || nTotal > nLen - MAC_HEADER_SIZE)
+        return; //Invalid header or truncated packet
+    nProtocol = pIp[IPV4_OFFSET_PROTOCOL];
+    nPayloadOffset = MAC_HEADER_SIZE + nIpHeaderLen;
+    nPayloadLen = nTotal - nIpHeaderLen;
+    bIpv4 = true;
+    uint16_t nL4Len = min(nPayloadLen, uint16_t(RX_PREFETCH_SIZE - RX_L4_OFFSET));
+    if(nIpHeaderLen == IPV4_HEADER_SIZE)
+        bL4 = (nFetched >= RX_L4_OFFSET + nL4Len);
+    else
+        bL4 = (pInterface->RxGetData(GetTransportHeader(), nL4Len, nPayloadOffset) == nL4Len); //Skip options
+}
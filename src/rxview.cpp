@@ -0,0 +1,92 @@
+#include "rxview.h"
+
+uint16_t RxView::Peek(byte* pBuffer, uint16_t nLen, uint16_t nPosition)
+{
+    if(nPosition >= m_nLen)
+        return 0;
+    nLen = min(nLen, uint16_t(m_nLen - nPosition));
+    if(0 == nLen)
+        return 0;
+    uint16_t nFrameOffset = m_nOffset + nPosition;
+    //Continue from NIC read pointer if it is already at the requested position - avoids rewriting it
+    uint16_t nRead = m_pInterface->RxGetData(pBuffer, nLen, (nFrameOffset == m_pRxPacket->nCursor) ? ENC28J60_CURSOR : nFrameOffset);
+    m_pRxPacket->nCursor = nFrameOffset + nRead;
+    return nRead;
+}
+
+uint16_t RxView::Read(byte* pBuffer, uint16_t nLen)
+{
+    uint16_t nRead = Peek(pBuffer, nLen, m_nPosition);
+    m_nPosition += nRead;
+    return nRead;
+}
+
+bool RxView::Seek(uint16_t nPosition)
+{
+    if(nPosition > m_nLen)
+    {
+        m_nPosition = m_nLen;
+        m_bOverrun = true;
+        return false;
+    }
+    m_nPosition = nPosition;
+    return true;
+}
+
+bool RxView::Skip(uint16_t nLen)
+{
+    return Seek(uint32_t(m_nPosition) + nLen > m_nLen ? m_nLen + 1 : m_nPosition + nLen);
+}
+
+bool RxView::Fetch(byte* pBuffer, uint16_t nLen, uint16_t nPosition)
+{
+    if(uint32_t(nPosition) + nLen > m_nLen || Peek(pBuffer, nLen, nPosition) != nLen)
+    {
+        memset(pBuffer, 0, nLen);
+        m_bOverrun = true;
+        return false;
+    }
+    return true;
+}
+
+byte RxView::GetByte(uint16_t nPosition)
+{
+    byte nValue;
+    Fetch(&nValue, 1, nPosition);
+    return nValue;
+}
+
+uint16_t RxView::GetWord(uint16_t nPosition)
+{
+    byte pValue[2];
+    Fetch(pValue, 2, nPosition);
+    return (pValue[0] << 8) | pValue[1];
+}
+
+uint32_t RxView::GetLong(uint16_t nPosition)
+{
+    byte pValue[4];
+    Fetch(pValue, 4, nPosition);
+    return (uint32_t(pValue[0]) << 24) | (uint32_t(pValue[1]) << 16) | (uint16_t(pValue[2] << 8)) | pValue[3]; //Casts avoid sign extension where int is 16-bit
+}
+
+byte RxView::ReadByte()
+{
+    byte nValue = GetByte(m_nPosition);
+    Skip(1);
+    return nValue;
+}
+
+uint16_t RxView::ReadWord()
+{
+    uint16_t nValue = GetWord(m_nPosition);
+    Skip(2);
+    return nValue;
+}
+
+uint32_t RxView::ReadLong()
+{
+    uint32_t lValue = GetLong(m_nPosition);
+    Skip(4);
+    return lValue;
+}
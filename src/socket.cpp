@@ -1,56 +1,415 @@
 #include "socket.h"
 #include "ribanENC28J60.h"
 
-Socket::Socket(byte nDomain, ribanEthernet* pInterface, byte nProtocol) :
-    m_nProtocol(nProtocol),
-    m_pInterface(pInterface)
+SocketIndex::SocketIndex() :
+    m_nNextPort(UDP_EPHEMERAL_PORT)
+{
+    for(byte nBucket = 0; nBucket < SOCKET_HASH_SIZE; ++nBucket)
+        m_pBucket[nBucket] = NULL;
+}
+
+Socket* SocketIndex::Find(byte nProtocol, uint16_t nPort)
 {
-    switch(nDomain)
+    for(Socket* pSocket = m_pBucket[Hash(nProtocol, nPort)]; pSocket; pSocket = pSocket->m_pNext)
     {
-        case AF_INET:
-            break;
-        case AF_INET6:
-            break;
-        case AF_PACKET:
-            break;
+        if(pSocket->m_nPortLocal == nPort && pSocket->m_nProtocol == nProtocol)
+            return pSocket;
+    }
+    return NULL;
+}
+
+bool SocketIndex::Add(Socket* pSocket)
+{
+    if(Find(pSocket->m_nProtocol, pSocket->m_nPortLocal))
+        return false;
+    byte nBucket = Hash(pSocket->m_nProtocol, pSocket->m_nPortLocal);
+    pSocket->m_pNext = m_pBucket[nBucket];
+    m_pBucket[nBucket] = pSocket;
+    return true;
+}
+
+void SocketIndex::Remove(Socket* pSocket)
+{
+    for(Socket** ppLink = &m_pBucket[Hash(pSocket->m_nProtocol, pSocket->m_nPortLocal)]; *ppLink; ppLink = &(*ppLink)->m_pNext)
+    {
+        if(*ppLink != pSocket)
+            continue;
+        *ppLink = pSocket->m_pNext;
+        pSocket->m_pNext = NULL;
+        return;
+    }
+}
+
+uint16_t SocketIndex::GetEphemeralPort(byte nProtocol)
+{
+    do
+    {
+        if(++m_nNextPort < UDP_EPHEMERAL_PORT)
+            m_nNextPort = UDP_EPHEMERAL_PORT; //Wrapped
+    } while(Find(nProtocol, m_nNextPort));
+    return m_nNextPort;
+}
+
+void SocketIndex::Poll()
+{
+    for(byte nBucket = 0; nBucket < SOCKET_HASH_SIZE; ++nBucket)
+    {
+        Socket* pSocket = m_pBucket[nBucket];
+        while(pSocket)
+        {
+            Socket* pNext = pSocket->m_pNext; //Socket may remove itself
+            pSocket->Poll();
+            pSocket = pNext;
+        }
     }
-//    m_pInterface->AddSocket(this);
+}
+
+Socket::Socket(byte nDomain, ribanENC28J60* pInterface, byte nProtocol) :
+    m_nDomain(nDomain),
+    m_nProtocol((AF_PACKET == nDomain) ? PROTO_RAW : nProtocol),
+    m_nStatus(SOCK_CLOSED),
+    m_bListening(false),
+    m_bIndexed(false),
+    m_nPortLocal(0),
+    m_nPortRemote(0),
+    m_addressRemote((AF_PACKET == nDomain) ? ADDR_TYPE_MAC : ADDR_TYPE_IPV4),
+    m_nTxLen(0),
+    m_nIdleTimeout(0),
+    m_pHandler(NULL),
+    m_pNext(NULL),
+    m_pInterface(pInterface)
+{
 }
 
 Socket::~Socket()
 {
-//    m_pInterface->RemoveSocket(this);
+    Unbind();
+}
+
+bool Socket::Listen(uint16_t nPort, void (*pHandler)(Socket* pSocket, RxView& view))
+{
+    if(AF_INET6 == m_nDomain || (AF_INET == m_nDomain && PROTO_RAW == m_nProtocol))
+        return false; //IPV6 and raw IP sockets are not implemented
+    Unbind();
+    m_nPortLocal = nPort;
+    if(!Bind())
+        return false;
+    m_bListening = true;
+    m_pHandler = pHandler;
+    m_nStatus = SOCK_LISTEN;
+    return true;
 }
 
-void Socket::TxBegin(Address* pAddress, uint16_t nPort)
+bool Socket::Connect(const Address& address, uint16_t nPort, void (*pHandler)(Socket* pSocket, RxView& view))
 {
-    switch(pAddress->GetType())
+    if(AF_INET != m_nDomain || PROTO_RAW == m_nProtocol || ADDR_TYPE_IPV4 != address.GetType())
+        return false;
+    if(PROTO_TCP == m_nProtocol || !m_bIndexed)
+    {
+        //Bind to a new local port so that replies reach this socket. Any existing TCP connection is abandoned
+        Unbind();
+        m_bListening = false;
+        m_nPortLocal = m_pInterface->m_sockets.GetEphemeralPort(m_nProtocol);
+        if(!Bind())
+            return false;
+    }
+    m_addressRemote = address;
+    m_nPortRemote = nPort;
+    m_pHandler = pHandler;
+    m_lActivity = millis();
+    if(PROTO_UDP == m_nProtocol)
     {
-        case AF_INET:
-            m_pInterface->TxBegin(pAddress);
+        m_nStatus = SOCK_CONNECTED; //Connectionless - just sets default target
+        return true;
+    }
+    m_lSequence = micros(); //Initial sequence number from clock (RFC 793 3.3)
+    m_lAcknowledge = 0;
+    m_nStatus = SOCK_SYN_SENT;
+    SendTcp(TCP_FLAG_SYN);
+    return true;
+}
+
+void Socket::Close()
+{
+    if(PROTO_TCP == m_nProtocol && (SOCK_CONNECTED == m_nStatus || SOCK_SYN_RECEIVED == m_nStatus))
+    {
+        SendTcp(TCP_FLAG_FIN | TCP_FLAG_ACK);
+        m_nStatus = SOCK_FIN_WAIT;
+        return;
+    }
+    m_bListening = false;
+    Disconnect();
+}
+
+void Socket::Disconnect()
+{
+    m_nPortRemote = 0;
+    if(m_bListening)
+    {
+        m_nStatus = SOCK_LISTEN;
+        return;
+    }
+    m_nStatus = SOCK_CLOSED;
+    Unbind();
+}
+
+bool Socket::Bind()
+{
+    if(PROTO_UDP == m_nProtocol && UDP_EOF != m_pInterface->ipv4.udp.Find(m_nPortLocal))
+        return false; //Port used by a UDP listener (ipv4.udp) which would receive its datagrams
+    m_bIndexed = m_pInterface->AddSocket(this);
+    return m_bIndexed;
+}
+
+void Socket::Unbind()
+{
+    if(m_bIndexed)
+        m_pInterface->RemoveSocket(this);
+    m_bIndexed = false;
+}
+
+void Socket::Poll()
+{
+    if(SOCK_CLOSED == m_nStatus || SOCK_LISTEN == m_nStatus)
+        return;
+    if(PROTO_TCP == m_nProtocol && (SOCK_SYN_SENT == m_nStatus || SOCK_SYN_RECEIVED == m_nStatus))
+    {
+        //No retransmission so abandon handshake (a listening socket may then accept another connection)
+        if(millis() - m_lActivity < TCP_HANDSHAKE_TIMEOUT)
+            return;
+        if(SOCK_SYN_RECEIVED == m_nStatus)
+            SendTcp(TCP_FLAG_RST | TCP_FLAG_ACK);
+        Disconnect();
+        return;
+    }
+    if(!m_nIdleTimeout || millis() - m_lActivity < uint32_t(m_nIdleTimeout) * 1000)
+        return;
+    if(PROTO_TCP == m_nProtocol)
+        SendTcp(TCP_FLAG_RST | TCP_FLAG_ACK);
+    Disconnect();
+}
+
+bool Socket::TxBegin(Address* pAddress, uint16_t nPort)
+{
+    m_nTxLen = 0;
+    switch(m_nProtocol)
+    {
+        case PROTO_UDP:
+        {
+            Ipv4Address addressTarget((pAddress ? pAddress : &m_addressRemote)->GetAddress());
+            if(!nPort)
+                nPort = m_nPortRemote;
+            if(!nPort)
+                return false; //No target
+            m_pInterface->ipv4.udp.BeginPacket(&addressTarget, nPort, m_nPortLocal ? m_nPortLocal : UDP_EPHEMERAL_PORT);
+            return true;
+        }
+        case PROTO_TCP:
+            if(SOCK_CONNECTED != m_nStatus)
+                return false;
+            return TcpBegin(TCP_FLAG_ACK | TCP_FLAG_PSH);
+        case PROTO_RAW:
+        {
+            MacAddress addressTarget((pAddress ? pAddress : &m_addressRemote)->GetAddress());
+            m_pInterface->TxBegin(&addressTarget, nPort ? nPort : m_nPortLocal);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Socket::TxAppend(byte* pData, uint16_t nSize)
+{
+    bool bSuccess = false;
+    switch(m_nProtocol)
+    {
+        case PROTO_UDP:
+            bSuccess = m_pInterface->ipv4.udp.Append(pData, nSize);
             break;
-        case AF_INET6:
-            m_pInterface->TxBegin(pAddress);
+        case PROTO_TCP:
+            bSuccess = m_pInterface->ipv4.TxAppend(pData, nSize);
             break;
-        case AF_PACKET:
-            m_pInterface->TxBegin(pAddress);
+        case PROTO_RAW:
+            bSuccess = m_pInterface->TxAppend(pData, nSize);
             break;
     }
+    if(bSuccess)
+        m_nTxLen += nSize;
+    return bSuccess;
+}
+
+bool Socket::TxEnd()
+{
+    switch(m_nProtocol)
+    {
+        case PROTO_UDP:
+            return m_pInterface->ipv4.udp.EndPacket();
+        case PROTO_TCP:
+            if(!m_pInterface->ipv4.TxEnd())
+                return false;
+            m_lSequence += m_nTxLen;
+            m_lActivity = millis();
+            return true;
+        case PROTO_RAW:
+            m_pInterface->TxEnd();
+            return true;
+    }
+    return false;
+}
+
+bool Socket::Send(byte* pData, uint16_t nSize, Address* pAddress, uint16_t nPort)
+{
+    if(!TxBegin(pAddress, nPort))
+        return false;
+    if(!TxAppend(pData, nSize))
+        return false; //Frame is abandoned and its slot reused by next TxBegin
+    return TxEnd();
+}
+
+void Socket::ProcessUdp(uint16_t nLen)
+{
+    RxPacket& rxPacket = m_pInterface->m_rxPacket;
+    if(SOCK_CONNECTED != m_nStatus)
+    {
+        //Reply to sender by default
+        m_addressRemote.SetAddress(rxPacket.GetNetworkHeader() + IPV4_OFFSET_SOURCE);
+        m_nPortRemote = rxPacket.GetWord(RX_L4_OFFSET + UDP_OFFSET_SOURCE_PORT);
+    }
+    m_lActivity = millis();
+    RxView view(&m_pInterface->m_nic, &rxPacket, rxPacket.nPayloadOffset + UDP_HEADER_SIZE, nLen - UDP_HEADER_SIZE);
+    if(m_pHandler)
+        m_pHandler(this, view);
+}
+
+void Socket::ProcessRaw(uint16_t nLen)
+{
+    RxPacket& rxPacket = m_pInterface->m_rxPacket;
+    m_addressRemote.SetAddress(rxPacket.pData + MAC_OFFSET_SOURCE);
+    RxView view(&m_pInterface->m_nic, &rxPacket, MAC_HEADER_SIZE, nLen - MAC_HEADER_SIZE);
+    if(m_pHandler)
+        m_pHandler(this, view);
 }
 
-void Socket::TxAppend(byte* pData, uint16_t nSize)
+bool Socket::TcpBegin(byte nFlags)
 {
-    m_pProtocol->TxAppend(pData, nSize);
+    Ipv4Address addressTarget(m_addressRemote.GetAddress());
+    byte pHeader[TCP_HEADER_SIZE] = {
+        byte(m_nPortLocal >> 8), byte(m_nPortLocal & 0xFF), byte(m_nPortRemote >> 8), byte(m_nPortRemote & 0xFF),
+        byte(m_lSequence >> 24), byte(m_lSequence >> 16), byte(m_lSequence >> 8), byte(m_lSequence),
+        byte(m_lAcknowledge >> 24), byte(m_lAcknowledge >> 16), byte(m_lAcknowledge >> 8), byte(m_lAcknowledge),
+        (TCP_HEADER_SIZE / 4) << 4, nFlags, byte(TCP_WINDOW >> 8), byte(TCP_WINDOW & 0xFF),
+        0, 0, //Checksum completed by IPV4::TxEnd
+        0, 0 //Urgent pointer
+    };
+    m_pInterface->ipv4.TxBegin(&addressTarget, IP_PROTOCOL_TCP);
+    return m_pInterface->ipv4.TxAppend(pHeader, sizeof(pHeader));
 }
 
-void Socket::TxEnd()
+void Socket::SendTcp(byte nFlags)
 {
-    m_pProtocol->TxEnd();
+    if(!TcpBegin(nFlags))
+        return;
+    m_pInterface->ipv4.TxEnd();
+    if(nFlags & (TCP_FLAG_SYN | TCP_FLAG_FIN))
+        ++m_lSequence;
 }
 
-void Socket::Send(byte* pData, uint16_t nSize, Address* pAddress, uint16_t nPort)
+bool Socket::ProcessTcp(uint16_t nLen)
 {
-    TxBegin(pAddress, nPort);
-    TxAppend(pData, nSize);
-    TxEnd();
+    RxPacket& rxPacket = m_pInterface->m_rxPacket;
+    const byte* pSource = rxPacket.GetNetworkHeader() + IPV4_OFFSET_SOURCE;
+    uint16_t nPortRemote = rxPacket.GetWord(RX_L4_OFFSET + TCP_OFFSET_SOURCE_PORT);
+    if(SOCK_LISTEN != m_nStatus && (m_addressRemote != pSource || m_nPortRemote != nPortRemote))
+        return false; //Socket is busy with another connection so IPV4 resets sender
+    //Prefetch buffer only holds start of TCP header so read whole header in one burst
+    byte pHeader[TCP_HEADER_SIZE];
+    RxView segment(&m_pInterface->m_nic, &rxPacket, rxPacket.nPayloadOffset, nLen);
+    if(segment.Read(pHeader, TCP_HEADER_SIZE) != TCP_HEADER_SIZE)
+        return false;
+    uint16_t nHeaderLen = (pHeader[TCP_OFFSET_DATA] >> 4) * 4;
+    if(nHeaderLen < TCP_HEADER_SIZE || nHeaderLen > nLen)
+        return false;
+    uint32_t lSequence = (uint32_t(pHeader[TCP_OFFSET_SEQUENCE]) << 24) | (uint32_t(pHeader[TCP_OFFSET_SEQUENCE + 1]) << 16) | (uint16_t(pHeader[TCP_OFFSET_SEQUENCE + 2] << 8)) | pHeader[TCP_OFFSET_SEQUENCE + 3];
+    uint32_t lAcknowledge = (uint32_t(pHeader[TCP_OFFSET_ACKNOWLEDGE]) << 24) | (uint32_t(pHeader[TCP_OFFSET_ACKNOWLEDGE + 1]) << 16) | (uint16_t(pHeader[TCP_OFFSET_ACKNOWLEDGE + 2] << 8)) | pHeader[TCP_OFFSET_ACKNOWLEDGE + 3];
+    byte nFlags = pHeader[TCP_OFFSET_FLAGS];
+    uint16_t nDataLen = nLen - nHeaderLen;
+
+    if(nFlags & TCP_FLAG_RST)
+    {
+        if(SOCK_LISTEN == m_nStatus)
+            return false;
+        Disconnect();
+        return true;
+    }
+    switch(m_nStatus)
+    {
+        case SOCK_LISTEN:
+            if((nFlags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) != TCP_FLAG_SYN)
+                return false;
+            m_addressRemote.SetAddress(pSource);
+            m_nPortRemote = nPortRemote;
+            m_lAcknowledge = lSequence + 1;
+            m_lSequence = micros(); //Initial sequence number from clock (RFC 793 3.3)
+            m_lActivity = millis();
+            SendTcp(TCP_FLAG_SYN | TCP_FLAG_ACK);
+            m_nStatus = SOCK_SYN_RECEIVED;
+            return true;
+        case SOCK_SYN_SENT:
+            if((nFlags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) != (TCP_FLAG_SYN | TCP_FLAG_ACK) || lAcknowledge != m_lSequence)
+                return false;
+            m_lAcknowledge = lSequence + 1;
+            m_lActivity = millis();
+            m_nStatus = SOCK_CONNECTED;
+            SendTcp(TCP_FLAG_ACK);
+            return true;
+    }
+    if(lSequence != m_lAcknowledge)
+    {
+        SendTcp(TCP_FLAG_ACK); //Out of order or retransmission - acknowledge what has been received so peer resends
+        return true;
+    }
+    m_lActivity = millis();
+    if((nFlags & TCP_FLAG_ACK) && lAcknowledge == m_lSequence)
+    {
+        //All sent data acknowledged
+        if(SOCK_SYN_RECEIVED == m_nStatus)
+            m_nStatus = SOCK_CONNECTED;
+        else if(SOCK_LAST_ACK == m_nStatus)
+        {
+            Disconnect();
+            return true;
+        }
+    }
+    bool bAcknowledge = false;
+    if(nDataLen && (SOCK_CONNECTED == m_nStatus || SOCK_FIN_WAIT == m_nStatus))
+    {
+        m_lAcknowledge += nDataLen; //Before handler so that any reply acknowledges the data
+        bAcknowledge = true;
+        if(m_pHandler)
+        {
+            uint32_t lSent = m_lSequence;
+            RxView view(&m_pInterface->m_nic, &rxPacket, rxPacket.nPayloadOffset + nHeaderLen, nDataLen);
+            m_pHandler(this, view);
+            if(lSent != m_lSequence)
+                bAcknowledge = false; //Handler sent data which carried acknowledgement
+        }
+    }
+    if(nFlags & TCP_FLAG_FIN)
+    {
+        ++m_lAcknowledge;
+        if(SOCK_FIN_WAIT == m_nStatus)
+        {
+            SendTcp(TCP_FLAG_ACK);
+            Disconnect(); //Skip TIME-WAIT - minimal implementation
+        }
+        else
+        {
+            SendTcp(TCP_FLAG_FIN | TCP_FLAG_ACK); //Close our side immediately (no half-close)
+            m_nStatus = SOCK_LAST_ACK;
+        }
+        return true;
+    }
+    if(bAcknowledge)
+        SendTcp(TCP_FLAG_ACK);
+    return true;
 }
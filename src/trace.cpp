@@ -0,0 +1,38 @@
+#include "trace.h"
+
+#if TRACE_SIZE
+TraceRecord Trace::s_aRecord[TRACE_SIZE];
+byte Trace::s_nHead = 0;
+bool Trace::s_bWrapped = false;
+
+/** @brief  Write value as fixed width hexadecimal
+*   @param  lValue Value to write
+*   @param  nDigits Quantity of hex digits
+*/
+static void PrintHex(uint32_t lValue, byte nDigits)
+{
+    while(nDigits--)
+        Serial.print(byte((lValue >> (nDigits * 4)) & 0x0F), HEX);
+}
+
+void Trace::Dump()
+{
+    byte nCount = GetCount();
+    Serial.print("TRACE ");
+    Serial.println(nCount);
+    for(byte nIndex = 0; nIndex < nCount; ++nIndex)
+    {
+        const TraceRecord& record = GetRecord(nIndex);
+        Serial.print("T:");
+        PrintHex(record.lTime, 8);
+        Serial.print(' ');
+        PrintHex(record.nEvent, 2);
+        Serial.print(' ');
+        PrintHex(record.nArg1, 4);
+        Serial.print(' ');
+        PrintHex(record.nArg2, 4);
+        Serial.println();
+    }
+    Clear();
+}
+#endif // TRACE_SIZE
@@ -1,3 +1,108 @@
 #include "udp.h"
+#include "ipv4.h"
 
+UDP::UDP() :
+    m_nRemotePort(0),
+    m_nTxLen(0)
+{
+    memset(m_pBucket, UDP_EOF, sizeof(m_pBucket));
+    for(byte nIndex = 0; nIndex < UDP_LISTENERS; ++nIndex)
+    {
+        m_aListener[nIndex].pHandler = NULL;
+        m_aListener[nIndex].nNext = UDP_EOF;
+    }
+}
 
+void UDP::Initialise(IPV4* pIpv4, NIC* pInterface, RxPacket* pRxPacket, SocketIndex* pSockets)
+{
+    m_pIpv4 = pIpv4;
+    m_pInterface = pInterface;
+    m_pRxPacket = pRxPacket;
+    m_pSockets = pSockets;
+}
+
+byte UDP::Find(uint16_t nPort)
+{
+    for(byte nIndex = m_pBucket[Hash(nPort)]; nIndex != UDP_EOF; nIndex = m_aListener[nIndex].nNext)
+    {
+        if(m_aListener[nIndex].nPort == nPort)
+            return nIndex;
+    }
+    return UDP_EOF;
+}
+
+bool UDP::Listen(uint16_t nPort, void (*pHandleUdpPacket)(uint16_t nPort, RxView& view))
+{
+    byte nIndex = Find(nPort);
+    if(UDP_EOF != nIndex)
+    {
+        if(pHandleUdpPacket)
+        {
+            m_aListener[nIndex].pHandler = pHandleUdpPacket;
+            return true;
+        }
+        //Remove from hash bucket
+        byte* pLink = &m_pBucket[Hash(nPort)];
+        while(*pLink != nIndex)
+            pLink = &m_aListener[*pLink].nNext;
+        *pLink = m_aListener[nIndex].nNext;
+        m_aListener[nIndex].pHandler = NULL;
+        m_aListener[nIndex].nNext = UDP_EOF;
+        return true;
+    }
+    if(!pHandleUdpPacket)
+        return true; //Not listening
+    if(m_pSockets && m_pSockets->Find(PROTO_UDP, nPort))
+        return false; //Port bound by a socket
+    for(nIndex = 0; nIndex < UDP_LISTENERS; ++nIndex)
+    {
+        UdpListener& listener = m_aListener[nIndex];
+        if(listener.pHandler)
+            continue;
+        listener.nPort = nPort;
+        listener.pHandler = pHandleUdpPacket;
+        byte nBucket = Hash(nPort);
+        listener.nNext = m_pBucket[nBucket];
+        m_pBucket[nBucket] = nIndex;
+        return true;
+    }
+    return false; //Table full
+}
+
+void UDP::Dispatch(byte nIndex, uint16_t nLen)
+{
+    m_addressRemote.SetAddress(m_pRxPacket->GetNetworkHeader() + IPV4_OFFSET_SOURCE);
+    m_nRemotePort = m_pRxPacket->GetWord(RX_L4_OFFSET + UDP_OFFSET_SOURCE_PORT);
+    RxView view(m_pInterface, m_pRxPacket, m_pRxPacket->nPayloadOffset + UDP_HEADER_SIZE, nLen - UDP_HEADER_SIZE);
+    m_aListener[nIndex].pHandler(m_aListener[nIndex].nPort, view);
+}
+
+void UDP::BeginPacket(Ipv4Address* pIp, uint16_t nPort, uint16_t nLocalPort)
+{
+    byte pHeader[UDP_HEADER_SIZE] = {byte(nLocalPort >> 8), byte(nLocalPort & 0xFF), byte(nPort >> 8), byte(nPort & 0xFF), 0, 0, 0, 0}; //Length and checksum completed when sent
+    m_pIpv4->TxBegin(pIp, IP_PROTOCOL_UDP);
+    m_pIpv4->TxAppend(pHeader, sizeof(pHeader));
+    m_nTxLen = UDP_HEADER_SIZE;
+}
+
+bool UDP::Append(byte* pData, uint16_t nLen)
+{
+    if(!m_pIpv4->TxAppend(pData, nLen))
+        return false;
+    m_nTxLen += nLen;
+    return true;
+}
+
+bool UDP::EndPacket()
+{
+    m_pIpv4->TxWriteWord(UDP_OFFSET_LENGTH, m_nTxLen);
+    return m_pIpv4->TxEnd(); //Completes checksum
+}
+
+bool UDP::Send(byte* pData, uint16_t nLen, Ipv4Address* pIp, uint16_t nPort, uint16_t nLocalPort)
+{
+    BeginPacket(pIp, nPort, nLocalPort);
+    if(!Append(pData, nLen))
+        return false; //Frame is abandoned and its slot reused by next TxBegin
+    return EndPacket();
+}